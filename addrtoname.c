@@ -96,8 +96,13 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#ifdef HAVE_PTHREADS
+#include <pthread.h>
+#include <time.h>
+#endif
 
 #include "netdissect.h"
+#include "netdissect-hash.h"
 #include "addrtoname.h"
 #include "addrtostr.h"
 #include "ethertype.h"
@@ -119,12 +124,8 @@ struct hnamemem {
 	struct hnamemem *nxt;
 };
 
-static struct hnamemem hnametable[HASHNAMESIZE];
-static struct hnamemem tporttable[HASHNAMESIZE];
-static struct hnamemem uporttable[HASHNAMESIZE];
-static struct hnamemem eprototable[HASHNAMESIZE];
-static struct hnamemem dnaddrtable[HASHNAMESIZE];
-static struct hnamemem ipxsaptable[HASHNAMESIZE];
+static ND_THREAD_LOCAL struct hnamemem dnaddrtable[HASHNAMESIZE];
+static ND_THREAD_LOCAL struct hnamemem ipxsaptable[HASHNAMESIZE];
 
 #ifdef _WIN32
 /*
@@ -169,14 +170,6 @@ win32_gethostbyaddr(const char *addr, int len, int type)
 #define gethostbyaddr win32_gethostbyaddr
 #endif /* _WIN32 */
 
-struct h6namemem {
-	nd_ipv6 addr;
-	char *name;
-	struct h6namemem *nxt;
-};
-
-static struct h6namemem h6nametable[HASHNAMESIZE];
-
 struct enamemem {
 	u_short e_addr0;
 	u_short e_addr1;
@@ -186,8 +179,7 @@ struct enamemem {
 	struct enamemem *e_nxt;
 };
 
-static struct enamemem enametable[HASHNAMESIZE];
-static struct enamemem nsaptable[HASHNAMESIZE];
+static ND_THREAD_LOCAL struct enamemem nsaptable[HASHNAMESIZE];
 
 struct bsnamemem {
 	u_short bs_addr0;
@@ -199,16 +191,347 @@ struct bsnamemem {
 	struct bsnamemem *bs_nxt;
 };
 
-static struct bsnamemem bytestringtable[HASHNAMESIZE];
+static ND_THREAD_LOCAL struct bsnamemem bytestringtable[HASHNAMESIZE];
+
+/*
+ * Open-addressing caches for the names looked up most often: IPv4 and
+ * IPv6 host names, TCP and UDP port names and MAC-48 names.
+ *
+ * Keys are up to 16 bytes, held as two 64-bit words and hashed in full,
+ * so that an IPv6 address doesn't hash on its last 16 bits only.  The
+ * table uses linear probing and doubles when more than half full.  Names
+ * are copied into an arena of large chunks rather than strdup()ed one by
+ * one.
+ *
+ * If --name-cache-size is given, the host and MAC-48 caches are trimmed
+ * back to that many entries between packets, evicting in approximate LRU
+ * order (the "clock" algorithm, using a bit set whenever an entry is
+ * looked up); pointers to names are only valid until the end of the
+ * packet in that case.
+ */
+#define NC_INITIAL_SIZE	256		/* slots; must be a power of 2 */
+#define NC_CHUNK_SIZE	16384		/* bytes per arena chunk */
+
+struct nc_entry {
+	uint64_t key[2];
+	const char *name;	/* NULL if the slot is empty */
+	u_int ref;		/* looked up since the clock hand last passed */
+};
+
+struct nc_chunk {
+	struct nc_chunk *next;
+	size_t used;
+	size_t size;
+	char data[];
+};
 
-struct protoidmem {
-	uint32_t p_oui;
-	u_short p_proto;
-	const char *p_name;
-	struct protoidmem *p_nxt;
+struct name_cache {
+	const char *what;
+	struct nc_entry *entries;
+	size_t size;		/* number of slots, a power of 2 */
+	size_t count;		/* number of slots in use */
+	size_t max;		/* evict down to this many entries; 0 = no limit */
+	size_t hand;		/* clock hand for eviction */
+	struct nc_chunk *chunks;
+	size_t name_bytes;	/* arena bytes used by live names */
+	size_t arena_bytes;	/* arena bytes used in total */
+	uint64_t hits;
+	uint64_t misses;
+	uint64_t probes;
+	u_int max_probes;
+	uint64_t evictions;
 };
 
-static struct protoidmem protoidtable[HASHNAMESIZE];
+static ND_THREAD_LOCAL struct name_cache host_cache = { .what = "IPv4 host" };
+static ND_THREAD_LOCAL struct name_cache host6_cache = { .what = "IPv6 host" };
+static ND_THREAD_LOCAL struct name_cache tport_cache = { .what = "TCP port" };
+static ND_THREAD_LOCAL struct name_cache uport_cache = { .what = "UDP port" };
+static ND_THREAD_LOCAL struct name_cache mac48_cache = { .what = "MAC-48" };
+
+/*
+ * The service, ethers and IPX SAP names are put in their tables on
+ * first use rather than by init_addrtoname(), so that a run that
+ * prints none of them doesn't read the services and ethers databases.
+ * load_name_tables() does it for all of them.
+ */
+static ND_THREAD_LOCAL int services_loaded;
+static ND_THREAD_LOCAL int ethers_loaded;
+static ND_THREAD_LOCAL int ipxsap_loaded;
+
+static void init_servarray(netdissect_options *);
+static void init_etherarray(netdissect_options *);
+static void init_ipxsaparray(netdissect_options *);
+
+static inline size_t
+nc_hash(uint64_t k0, uint64_t k1)
+{
+	const uint64_t w[2] = { k0, k1 };
+
+	return ((size_t)nd_hash64(0, w, 2));
+}
+
+/*
+ * Find the slot holding the key, or the empty slot where it would go.
+ * The table must have been allocated.
+ */
+static struct nc_entry *
+nc_probe(const struct name_cache *nc, uint64_t k0, uint64_t k1,
+	 u_int *probesp)
+{
+	size_t mask = nc->size - 1;
+	size_t i = nc_hash(k0, k1) & mask;
+	struct nc_entry *e;
+	u_int probes = 1;
+
+	for (;;) {
+		e = &nc->entries[i];
+		if (e->name == NULL || (e->key[0] == k0 && e->key[1] == k1))
+			break;
+		i = (i + 1) & mask;
+		probes++;
+	}
+	*probesp = probes;
+	return (e);
+}
+
+/* Look up a key without touching the statistics or the LRU state. */
+static struct nc_entry *
+nc_find(const struct name_cache *nc, uint64_t k0, uint64_t k1)
+{
+	struct nc_entry *e;
+	u_int probes;
+
+	if (nc->entries == NULL)
+		return (NULL);
+	e = nc_probe(nc, k0, k1, &probes);
+	return (e->name != NULL ? e : NULL);
+}
+
+static const char *
+nc_lookup(struct name_cache *nc, uint64_t k0, uint64_t k1)
+{
+	struct nc_entry *e;
+	u_int probes;
+
+	if (nc->entries == NULL) {
+		nc->misses++;
+		return (NULL);
+	}
+	e = nc_probe(nc, k0, k1, &probes);
+	nc->probes += probes;
+	if (probes > nc->max_probes)
+		nc->max_probes = probes;
+	if (e->name == NULL) {
+		nc->misses++;
+		return (NULL);
+	}
+	nc->hits++;
+	e->ref = 1;
+	return (e->name);
+}
+
+/* Copy the first len bytes of name, NUL-terminated, into the arena. */
+static const char *
+nc_intern(netdissect_options *ndo, struct name_cache *nc, const char *name,
+	  size_t len)
+{
+	struct nc_chunk *c = nc->chunks;
+	size_t size;
+	char *p;
+
+	if (c == NULL || c->size - c->used < len + 1) {
+		size = len + 1 > NC_CHUNK_SIZE ? len + 1 : NC_CHUNK_SIZE;
+		c = (struct nc_chunk *)malloc(sizeof(*c) + size);
+		if (c == NULL)
+			(*ndo->ndo_error)(ndo, S_ERR_ND_MEM_ALLOC,
+					  "%s: malloc", __func__);
+		c->used = 0;
+		c->size = size;
+		/*
+		 * Keep filling the partly-used chunk if this string was
+		 * too big for it.
+		 */
+		if (nc->chunks != NULL && size > NC_CHUNK_SIZE) {
+			c->next = nc->chunks->next;
+			nc->chunks->next = c;
+		} else {
+			c->next = nc->chunks;
+			nc->chunks = c;
+		}
+	}
+	p = c->data + c->used;
+	memcpy(p, name, len);
+	p[len] = '\0';
+	c->used += len + 1;
+	nc->name_bytes += len + 1;
+	nc->arena_bytes += len + 1;
+	return (p);
+}
+
+static void
+nc_grow(netdissect_options *ndo, struct name_cache *nc)
+{
+	struct nc_entry *old = nc->entries;
+	size_t oldsize = nc->size;
+	size_t i;
+	u_int probes;
+
+	nc->size = oldsize != 0 ? oldsize * 2 : NC_INITIAL_SIZE;
+	nc->entries = (struct nc_entry *)calloc(nc->size, sizeof(*nc->entries));
+	if (nc->entries == NULL)
+		(*ndo->ndo_error)(ndo, S_ERR_ND_MEM_ALLOC, "%s: calloc", __func__);
+	for (i = 0; i < oldsize; i++) {
+		if (old[i].name != NULL)
+			*nc_probe(nc, old[i].key[0], old[i].key[1], &probes) =
+			    old[i];
+	}
+	nc->hand = 0;
+	free(old);
+}
+
+/*
+ * Add a key that isn't in the cache, with the first len bytes of name
+ * as its name, and return the copy of the name.
+ */
+static const char *
+nc_insert(netdissect_options *ndo, struct name_cache *nc, uint64_t k0,
+	  uint64_t k1, const char *name, size_t len)
+{
+	struct nc_entry *e;
+	u_int probes;
+
+	if ((nc->count + 1) * 2 > nc->size)
+		nc_grow(ndo, nc);
+	e = nc_probe(nc, k0, k1, &probes);
+	e->key[0] = k0;
+	e->key[1] = k1;
+	e->name = nc_intern(ndo, nc, name, len);
+	e->ref = 1;
+	nc->count++;
+	return (e->name);
+}
+
+/* Give an entry a new name; the old one stays in the arena. */
+static void
+nc_rename(netdissect_options *ndo, struct name_cache *nc, struct nc_entry *e,
+	  const char *name, size_t len)
+{
+	nc->name_bytes -= strlen(e->name) + 1;
+	e->name = nc_intern(ndo, nc, name, len);
+}
+
+/*
+ * Remove the entry in slot i, moving later entries of the same probe
+ * sequence back so that no lookup stops short at the hole.
+ */
+static void
+nc_delete(struct name_cache *nc, size_t i)
+{
+	size_t mask = nc->size - 1;
+	size_t j = i;
+	size_t home;
+
+	nc->name_bytes -= strlen(nc->entries[i].name) + 1;
+	for (;;) {
+		j = (j + 1) & mask;
+		if (nc->entries[j].name == NULL)
+			break;
+		home = nc_hash(nc->entries[j].key[0],
+		    nc->entries[j].key[1]) & mask;
+		/* Can the entry in slot j move to slot i? */
+		if (i <= j ? (home <= i || home > j) : (home <= i && home > j)) {
+			nc->entries[i] = nc->entries[j];
+			i = j;
+		}
+	}
+	memset(&nc->entries[i], 0, sizeof(nc->entries[i]));
+	nc->count--;
+}
+
+/* Copy the live names into a new arena and free the old one. */
+static void
+nc_compact(netdissect_options *ndo, struct name_cache *nc)
+{
+	struct nc_chunk *c = nc->chunks, *next;
+	size_t i;
+
+	nc->chunks = NULL;
+	nc->name_bytes = 0;
+	nc->arena_bytes = 0;
+	for (i = 0; i < nc->size; i++) {
+		if (nc->entries[i].name != NULL)
+			nc->entries[i].name = nc_intern(ndo, nc,
+			    nc->entries[i].name, strlen(nc->entries[i].name));
+	}
+	for (; c != NULL; c = next) {
+		next = c->next;
+		free(c);
+	}
+}
+
+static void
+nc_trim(netdissect_options *ndo, struct name_cache *nc)
+{
+	struct nc_entry *e;
+
+	if (nc->max == 0 || nc->count <= nc->max)
+		return;
+	while (nc->count > nc->max) {
+		e = &nc->entries[nc->hand];
+		if (e->name != NULL && !e->ref) {
+			/* The next entry to look at may now be in this slot. */
+			nc_delete(nc, nc->hand);
+			nc->evictions++;
+			continue;
+		}
+		e->ref = 0;
+		nc->hand = (nc->hand + 1) & (nc->size - 1);
+	}
+	if (nc->arena_bytes > 2 * nc->name_bytes + NC_CHUNK_SIZE)
+		nc_compact(ndo, nc);
+}
+
+static void
+nc_print_stats(const struct name_cache *nc, FILE *f)
+{
+	uint64_t lookups = nc->hits + nc->misses;
+
+	if (lookups == 0)
+		return;
+	fprintf(f, "%s name cache: %zu entr%s, %" PRIu64 " hit%s, %" PRIu64
+	    " miss%s, %.2f probes per lookup (max %u), %" PRIu64
+	    " eviction%s\n",
+	    nc->what, nc->count, nc->count == 1 ? "y" : "ies",
+	    nc->hits, PLURAL_SUFFIX(nc->hits),
+	    nc->misses, nc->misses == 1 ? "" : "es",
+	    (double)nc->probes / (double)lookups, nc->max_probes,
+	    nc->evictions, PLURAL_SUFFIX(nc->evictions));
+}
+
+/*
+ * Report the name cache statistics, for the caches that have been used.
+ */
+void
+print_name_cache_stats(FILE *f)
+{
+	nc_print_stats(&host_cache, f);
+	nc_print_stats(&host6_cache, f);
+	nc_print_stats(&tport_cache, f);
+	nc_print_stats(&uport_cache, f);
+	nc_print_stats(&mac48_cache, f);
+}
+
+/*
+ * Length of a host name as it should be printed: with -N, without
+ * the domain qualifications.
+ */
+static size_t
+host_name_len(netdissect_options *ndo, const char *name)
+{
+	if (ndo->ndo_Nflag)
+		return (strcspn(name, "."));
+	return (strlen(name));
+}
 
 /*
  * A faster replacement for inet_ntoa().
@@ -219,7 +542,7 @@ intoa(uint32_t addr)
 	char *cp;
 	u_int byte;
 	int n;
-	static char buf[sizeof(".xxx.xxx.xxx.xxx")];
+	static ND_THREAD_LOCAL char buf[sizeof(".xxx.xxx.xxx.xxx")];
 
 	addr = ntohl(addr);
 	cp = buf + sizeof(buf);
@@ -243,12 +566,275 @@ intoa(uint32_t addr)
 	return cp + 1;
 }
 
-static uint32_t f_netmask;
-static uint32_t f_localnet;
+static ND_THREAD_LOCAL uint32_t f_netmask;
+static ND_THREAD_LOCAL uint32_t f_localnet;
 #ifdef HAVE_CASPER
 cap_channel_t *capdns;
 #endif
 
+#ifdef HAVE_PTHREADS
+/*
+ * Background resolution of addresses to names, for --resolve-async.
+ *
+ * The first time an address is seen, a lookup is queued for one of a
+ * few resolver threads, and the address is printed numerically unless
+ * the lookup finishes within --resolve-wait milliseconds.  Lookups that
+ * finish later are picked up between packets by update_resolved_names(),
+ * which puts the name into the host_cache/host6_cache entry, so
+ * that the following packets print it.
+ *
+ * Only the main thread touches the name tables; the resolver threads
+ * only see the request slots, which are all protected by one mutex.
+ * If the queue is full, the address just stays numeric.
+ */
+#define RESOLVER_THREADS	4
+#define RESOLVER_QUEUE_SIZE	1024	/* lookups outstanding at a time */
+
+enum resolver_slot_state {
+	RS_FREE,		/* on the free list */
+	RS_QUEUED,		/* waiting for a resolver thread */
+	RS_BUSY,		/* being looked up */
+	RS_DONE,		/* looked up, result not yet used */
+	RS_CLAIMED		/* looked up, result already used */
+};
+
+struct resolver_slot {
+	enum resolver_slot_state state;
+	int family;		/* AF_INET or AF_INET6 */
+	nd_ipv6 addr;		/* only the first 4 bytes for AF_INET */
+	int found;		/* non-zero if name is valid */
+	char name[NI_MAXHOST];
+};
+
+static struct {
+	int started;		/* 1 if running, -1 if it couldn't start */
+	pthread_mutex_t lock;
+	pthread_cond_t work;	/* something was queued */
+	pthread_cond_t done;	/* something was looked up */
+	struct resolver_slot slots[RESOLVER_QUEUE_SIZE];
+	u_int free_list[RESOLVER_QUEUE_SIZE];
+	u_int free_count;
+	u_int queue[RESOLVER_QUEUE_SIZE];	/* FIFO of queued slots */
+	u_int queue_head, queue_count;
+	u_int done_queue[RESOLVER_QUEUE_SIZE];	/* FIFO of looked-up slots */
+	u_int done_head, done_count;
+} resolver = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.work = PTHREAD_COND_INITIALIZER,
+	.done = PTHREAD_COND_INITIALIZER,
+};
+
+static void *
+resolver_thread(void *arg _U_)
+{
+	struct resolver_slot *slot;
+	struct sockaddr_storage ss;
+	socklen_t sslen;
+	char name[NI_MAXHOST];
+	u_int idx;
+	int found;
+
+	pthread_mutex_lock(&resolver.lock);
+	for (;;) {
+		while (resolver.queue_count == 0)
+			pthread_cond_wait(&resolver.work, &resolver.lock);
+		idx = resolver.queue[resolver.queue_head];
+		resolver.queue_head = (resolver.queue_head + 1) % RESOLVER_QUEUE_SIZE;
+		resolver.queue_count--;
+		slot = &resolver.slots[idx];
+		slot->state = RS_BUSY;
+
+		memset(&ss, 0, sizeof(ss));
+		if (slot->family == AF_INET) {
+			struct sockaddr_in *sin = (struct sockaddr_in *)&ss;
+
+			sin->sin_family = AF_INET;
+			memcpy(&sin->sin_addr, slot->addr, 4);
+			sslen = sizeof(*sin);
+		} else {
+			struct sockaddr_in6 *sin6 = (struct sockaddr_in6 *)&ss;
+
+			sin6->sin6_family = AF_INET6;
+			memcpy(&sin6->sin6_addr, slot->addr, sizeof(nd_ipv6));
+			sslen = sizeof(*sin6);
+		}
+		pthread_mutex_unlock(&resolver.lock);
+
+		found = getnameinfo((struct sockaddr *)&ss, sslen,
+		    name, sizeof(name), NULL, 0, NI_NAMEREQD) == 0;
+
+		pthread_mutex_lock(&resolver.lock);
+		slot->found = found;
+		if (found)
+			strlcpy(slot->name, name, sizeof(slot->name));
+		slot->state = RS_DONE;
+		resolver.done_queue[(resolver.done_head + resolver.done_count) %
+		    RESOLVER_QUEUE_SIZE] = idx;
+		resolver.done_count++;
+		pthread_cond_broadcast(&resolver.done);
+	}
+	/* NOTREACHED */
+	return NULL;
+}
+
+static int
+resolver_start(netdissect_options *ndo)
+{
+	pthread_t tid;
+	u_int i;
+	int err;
+
+	for (i = 0; i < RESOLVER_QUEUE_SIZE; i++)
+		resolver.free_list[i] = i;
+	resolver.free_count = RESOLVER_QUEUE_SIZE;
+	for (i = 0; i < RESOLVER_THREADS; i++) {
+		err = pthread_create(&tid, NULL, resolver_thread, NULL);
+		if (err != 0) {
+			if (i == 0) {
+				(*ndo->ndo_warning)(ndo,
+				    "can't start resolver thread: %s; resolving names synchronously",
+				    strerror(err));
+				return (-1);
+			}
+			break;
+		}
+		pthread_detach(tid);
+	}
+	return (1);
+}
+
+/*
+ * A replacement for gethostbyaddr() that queues the lookup for the
+ * resolver threads and waits at most ndo_resolve_wait milliseconds for
+ * it.  Returns NULL if the name isn't known (yet).
+ */
+static struct hostent *
+async_gethostbyaddr(netdissect_options *ndo, const char *addr, int len,
+    int type)
+{
+	static struct hostent host;
+	static char hostbuf[NI_MAXHOST];
+	struct resolver_slot *slot;
+	struct timespec deadline;
+	u_int idx;
+	int found = 0;
+
+	if (resolver.started == 0)
+		resolver.started = resolver_start(ndo);
+	if (resolver.started < 0)
+		return gethostbyaddr(addr, len, type);
+
+	pthread_mutex_lock(&resolver.lock);
+	if (resolver.free_count == 0) {
+		pthread_mutex_unlock(&resolver.lock);
+		return NULL;
+	}
+	idx = resolver.free_list[--resolver.free_count];
+	slot = &resolver.slots[idx];
+	slot->state = RS_QUEUED;
+	slot->family = type;
+	memcpy(slot->addr, addr, len);
+	resolver.queue[(resolver.queue_head + resolver.queue_count) %
+	    RESOLVER_QUEUE_SIZE] = idx;
+	resolver.queue_count++;
+	pthread_cond_signal(&resolver.work);
+
+	if (ndo->ndo_resolve_wait > 0) {
+		clock_gettime(CLOCK_REALTIME, &deadline);
+		deadline.tv_sec += ndo->ndo_resolve_wait / 1000;
+		deadline.tv_nsec += (ndo->ndo_resolve_wait % 1000) * 1000000L;
+		if (deadline.tv_nsec >= 1000000000L) {
+			deadline.tv_sec++;
+			deadline.tv_nsec -= 1000000000L;
+		}
+		while (slot->state != RS_DONE) {
+			if (pthread_cond_timedwait(&resolver.done,
+			    &resolver.lock, &deadline) != 0)
+				break;
+		}
+		if (slot->state == RS_DONE) {
+			/* Got it in time; the entry needn't be updated later. */
+			slot->state = RS_CLAIMED;
+			found = slot->found;
+			if (found)
+				strlcpy(hostbuf, slot->name, sizeof(hostbuf));
+		}
+	}
+	pthread_mutex_unlock(&resolver.lock);
+
+	if (!found)
+		return NULL;
+	host.h_name = hostbuf;
+	return &host;
+}
+
+/*
+ * Give the name cache entries for the addresses looked up in the
+ * background since the last call their names.
+ */
+static void
+update_resolved_names(netdissect_options *ndo)
+{
+	struct resolver_slot *slot;
+	struct nc_entry *e;
+	u_int idx;
+	uint64_t key[2];
+
+	if (resolver.started <= 0)
+		return;
+	pthread_mutex_lock(&resolver.lock);
+	while (resolver.done_count != 0) {
+		idx = resolver.done_queue[resolver.done_head];
+		resolver.done_head = (resolver.done_head + 1) % RESOLVER_QUEUE_SIZE;
+		resolver.done_count--;
+		slot = &resolver.slots[idx];
+		if (slot->state == RS_DONE && slot->found) {
+			/*
+			 * The entry may have been evicted while the
+			 * lookup was in progress.
+			 */
+			if (slot->family == AF_INET) {
+				uint32_t addr;
+
+				memcpy(&addr, slot->addr, sizeof(addr));
+				e = nc_find(&host_cache, addr, 0);
+				if (e != NULL)
+					nc_rename(ndo, &host_cache, e,
+					    slot->name,
+					    host_name_len(ndo, slot->name));
+			} else {
+				memcpy(key, slot->addr, sizeof(key));
+				e = nc_find(&host6_cache, key[0], key[1]);
+				if (e != NULL)
+					nc_rename(ndo, &host6_cache, e,
+					    slot->name,
+					    host_name_len(ndo, slot->name));
+			}
+		}
+		slot->state = RS_FREE;
+		resolver.free_list[resolver.free_count++] = idx;
+	}
+	pthread_mutex_unlock(&resolver.lock);
+}
+#endif /* HAVE_PTHREADS */
+
+/*
+ * Bring the name caches up to date: fill in the names looked up in the
+ * background, and evict entries if the caches have grown past
+ * --name-cache-size.  Called between packets, so that no pointer to a
+ * name being replaced or evicted is still in use.
+ */
+void
+update_name_tables(netdissect_options *ndo)
+{
+#ifdef HAVE_PTHREADS
+	update_resolved_names(ndo);
+#endif
+	nc_trim(ndo, &host_cache);
+	nc_trim(ndo, &host6_cache);
+	nc_trim(ndo, &mac48_cache);
+}
+
 /*
  * Return a name for the IP address pointed to by ap.  This address
  * is assumed to be in network byte order.
@@ -272,16 +858,12 @@ ipaddr_string(netdissect_options *ndo, const u_char *ap)
 {
 	struct hostent *hp;
 	uint32_t addr;
-	struct hnamemem *p;
+	const char *name;
 
 	memcpy(&addr, ap, sizeof(addr));
-	p = &hnametable[addr & (HASHNAMESIZE-1)];
-	for (; p->nxt; p = p->nxt) {
-		if (p->addr == addr)
-			return (p->name);
-	}
-	p->addr = addr;
-	p->nxt = newhnamemem(ndo);
+	name = nc_lookup(&host_cache, addr, 0);
+	if (name != NULL)
+		return (name);
 
 	/*
 	 * Print names unless:
@@ -298,29 +880,20 @@ ipaddr_string(netdissect_options *ndo, const u_char *ap)
 			hp = cap_gethostbyaddr(capdns, (char *)&addr, 4,
 			    AF_INET);
 		} else
+#endif
+#ifdef HAVE_PTHREADS
+		if (ndo->ndo_resolve_async)
+			hp = async_gethostbyaddr(ndo, (char *)&addr, 4,
+			    AF_INET);
+		else
 #endif
 			hp = gethostbyaddr((char *)&addr, 4, AF_INET);
-		if (hp) {
-			char *dotp;
-
-			p->name = strdup(hp->h_name);
-			if (p->name == NULL)
-				(*ndo->ndo_error)(ndo, S_ERR_ND_MEM_ALLOC,
-					"%s: strdup(hp->h_name)", __func__);
-			if (ndo->ndo_Nflag) {
-				/* Remove domain qualifications */
-				dotp = strchr(p->name, '.');
-				if (dotp)
-					*dotp = '\0';
-			}
-			return (p->name);
-		}
+		if (hp)
+			return (nc_insert(ndo, &host_cache, addr, 0,
+			    hp->h_name, host_name_len(ndo, hp->h_name)));
 	}
-	p->name = strdup(intoa(addr));
-	if (p->name == NULL)
-		(*ndo->ndo_error)(ndo, S_ERR_ND_MEM_ALLOC,
-				  "%s: strdup(intoa(addr))", __func__);
-	return (p->name);
+	name = intoa(addr);
+	return (nc_insert(ndo, &host_cache, addr, 0, name, strlen(name)));
 }
 
 /*
@@ -333,23 +906,15 @@ ip6addr_string(netdissect_options *ndo, const u_char *ap)
 	struct hostent *hp;
 	union {
 		nd_ipv6 addr;
-		struct for_hash_addr {
-			char fill[14];
-			uint16_t d;
-		} addra;
+		uint64_t key[2];
 	} addr;
-	struct h6namemem *p;
 	const char *cp;
 	char ntop_buf[INET6_ADDRSTRLEN];
 
 	memcpy(&addr, ap, sizeof(addr));
-	p = &h6nametable[addr.addra.d & (HASHNAMESIZE-1)];
-	for (; p->nxt; p = p->nxt) {
-		if (memcmp(&p->addr, &addr, sizeof(addr)) == 0)
-			return (p->name);
-	}
-	memcpy(p->addr, addr.addr, sizeof(nd_ipv6));
-	p->nxt = newh6namemem(ndo);
+	cp = nc_lookup(&host6_cache, addr.key[0], addr.key[1]);
+	if (cp != NULL)
+		return (cp);
 
 	/*
 	 * Do not print names if -n was given.
@@ -361,32 +926,24 @@ ip6addr_string(netdissect_options *ndo, const u_char *ap)
 			hp = cap_gethostbyaddr(capdns, (char *)&addr,
 			    sizeof(addr), AF_INET6);
 		} else
+#endif
+#ifdef HAVE_PTHREADS
+		if (ndo->ndo_resolve_async)
+			hp = async_gethostbyaddr(ndo, (char *)&addr,
+			    sizeof(addr), AF_INET6);
+		else
 #endif
 			hp = gethostbyaddr((char *)&addr, sizeof(addr),
 			    AF_INET6);
-		if (hp) {
-			char *dotp;
-
-			p->name = strdup(hp->h_name);
-			if (p->name == NULL)
-				(*ndo->ndo_error)(ndo, S_ERR_ND_MEM_ALLOC,
-					"%s: strdup(hp->h_name)", __func__);
-			if (ndo->ndo_Nflag) {
-				/* Remove domain qualifications */
-				dotp = strchr(p->name, '.');
-				if (dotp)
-					*dotp = '\0';
-			}
-			return (p->name);
-		}
+		if (hp)
+			return (nc_insert(ndo, &host6_cache, addr.key[0],
+			    addr.key[1], hp->h_name,
+			    host_name_len(ndo, hp->h_name)));
 	}
 #endif /* AF_INET6 */
 	cp = addrtostr6(ap, ntop_buf, sizeof(ntop_buf));
-	p->name = strdup(cp);
-	if (p->name == NULL)
-		(*ndo->ndo_error)(ndo, S_ERR_ND_MEM_ALLOC,
-				  "%s: strdup(cp)", __func__);
-	return (p->name);
+	return (nc_insert(ndo, &host6_cache, addr.key[0], addr.key[1], cp,
+	    strlen(cp)));
 }
 
 static const char hex[16] = {
@@ -426,34 +983,15 @@ octet_to_hex(char *cp, uint8_t octet)
 	return (cp);
 }
 
-/* Find the hash node that corresponds the ether address 'ep' */
+/* The name cache key for the MAC-48 address 'ep' */
 
-static struct enamemem *
-lookup_emem(netdissect_options *ndo, const u_char *ep)
+static inline uint64_t
+mac48_key(const u_char *ep)
 {
-	u_int i, j, k;
-	struct enamemem *tp;
+	uint64_t k = 0;
 
-	k = (ep[0] << 8) | ep[1];
-	j = (ep[2] << 8) | ep[3];
-	i = (ep[4] << 8) | ep[5];
-
-	tp = &enametable[(i ^ j) & (HASHNAMESIZE-1)];
-	while (tp->e_nxt)
-		if (tp->e_addr0 == i &&
-		    tp->e_addr1 == j &&
-		    tp->e_addr2 == k)
-			return tp;
-		else
-			tp = tp->e_nxt;
-	tp->e_addr0 = (u_short)i;
-	tp->e_addr1 = (u_short)j;
-	tp->e_addr2 = (u_short)k;
-	tp->e_nxt = (struct enamemem *)calloc(1, sizeof(*tp));
-	if (tp->e_nxt == NULL)
-		(*ndo->ndo_error)(ndo, S_ERR_ND_MEM_ALLOC, "%s: calloc", __func__);
-
-	return tp;
+	memcpy(&k, ep, MAC48_LEN);
+	return (k);
 }
 
 /*
@@ -553,46 +1091,21 @@ lookup_nsap(netdissect_options *ndo, const u_char *nsap,
 	return tp;
 }
 
-/* Find the hash node that corresponds the protoid 'pi'. */
-
-static struct protoidmem *
-lookup_protoid(netdissect_options *ndo, const u_char *pi)
-{
-	u_int i, j;
-	struct protoidmem *tp;
-
-	/* 5 octets won't be aligned */
-	i = (((pi[0] << 8) + pi[1]) << 8) + pi[2];
-	j =   (pi[3] << 8) + pi[4];
-	/* XXX should be endian-insensitive, but do big-endian testing  XXX */
-
-	tp = &protoidtable[(i ^ j) & (HASHNAMESIZE-1)];
-	while (tp->p_nxt)
-		if (tp->p_oui == i && tp->p_proto == j)
-			return tp;
-		else
-			tp = tp->p_nxt;
-	tp->p_oui = i;
-	tp->p_proto = (u_short)j;
-	tp->p_nxt = (struct protoidmem *)calloc(1, sizeof(*tp));
-	if (tp->p_nxt == NULL)
-		(*ndo->ndo_error)(ndo, S_ERR_ND_MEM_ALLOC, "%s: calloc", __func__);
-
-	return tp;
-}
-
 const char *
 mac48_string(netdissect_options *ndo, const uint8_t *ep)
 {
 	int i;
 	char *cp;
-	struct enamemem *tp;
+	const char *name;
+	uint64_t k = mac48_key(ep);
 	int oui;
 	char buf[BUFSIZE];
 
-	tp = lookup_emem(ndo, ep);
-	if (tp->e_name)
-		return (tp->e_name);
+	if (!ethers_loaded)
+		init_etherarray(ndo);
+	name = nc_lookup(&mac48_cache, k, 0);
+	if (name != NULL)
+		return (name);
 #ifdef USE_ETHER_NTOHOST
 	if (!ndo->ndo_nflag) {
 		char buf2[BUFSIZE];
@@ -604,13 +1117,9 @@ mac48_string(netdissect_options *ndo, const uint8_t *ep)
 		struct ether_addr ea;
 
 		memcpy (&ea, ep, MAC48_LEN);
-		if (ether_ntohost(buf2, &ea) == 0) {
-			tp->e_name = strdup(buf2);
-			if (tp->e_name == NULL)
-				(*ndo->ndo_error)(ndo, S_ERR_ND_MEM_ALLOC,
-					"%s: strdup(buf2)", __func__);
-			return (tp->e_name);
-		}
+		if (ether_ntohost(buf2, &ea) == 0)
+			return (nc_insert(ndo, &mac48_cache, k, 0, buf2,
+			    strlen(buf2)));
 	}
 #endif
 	cp = buf;
@@ -626,11 +1135,7 @@ mac48_string(netdissect_options *ndo, const uint8_t *ep)
 		    tok2str(oui_values, "Unknown", oui));
 	} else
 		*cp = '\0';
-	tp->e_name = strdup(buf);
-	if (tp->e_name == NULL)
-		(*ndo->ndo_error)(ndo, S_ERR_ND_MEM_ALLOC,
-				  "%s: strdup(buf)", __func__);
-	return (tp->e_name);
+	return (nc_insert(ndo, &mac48_cache, k, 0, buf, strlen(buf)));
 }
 
 const char *
@@ -741,45 +1246,35 @@ isonsap_string(netdissect_options *ndo, const uint8_t *nsap,
 const char *
 tcpport_string(netdissect_options *ndo, u_short port)
 {
-	struct hnamemem *tp;
-	uint32_t i = port;
+	const char *name;
 	char buf[sizeof("00000")];
+	int len;
 
-	for (tp = &tporttable[i & (HASHNAMESIZE-1)]; tp->nxt; tp = tp->nxt)
-		if (tp->addr == i)
-			return (tp->name);
-
-	tp->addr = i;
-	tp->nxt = newhnamemem(ndo);
+	if (!services_loaded)
+		init_servarray(ndo);
+	name = nc_lookup(&tport_cache, port, 0);
+	if (name != NULL)
+		return (name);
 
-	(void)snprintf(buf, sizeof(buf), "%u", i);
-	tp->name = strdup(buf);
-	if (tp->name == NULL)
-		(*ndo->ndo_error)(ndo, S_ERR_ND_MEM_ALLOC,
-				  "%s: strdup(buf)", __func__);
-	return (tp->name);
+	len = snprintf(buf, sizeof(buf), "%u", port);
+	return (nc_insert(ndo, &tport_cache, port, 0, buf, len));
 }
 
 const char *
 udpport_string(netdissect_options *ndo, u_short port)
 {
-	struct hnamemem *tp;
-	uint32_t i = port;
+	const char *name;
 	char buf[sizeof("00000")];
+	int len;
 
-	for (tp = &uporttable[i & (HASHNAMESIZE-1)]; tp->nxt; tp = tp->nxt)
-		if (tp->addr == i)
-			return (tp->name);
-
-	tp->addr = i;
-	tp->nxt = newhnamemem(ndo);
+	if (!services_loaded)
+		init_servarray(ndo);
+	name = nc_lookup(&uport_cache, port, 0);
+	if (name != NULL)
+		return (name);
 
-	(void)snprintf(buf, sizeof(buf), "%u", i);
-	tp->name = strdup(buf);
-	if (tp->name == NULL)
-		(*ndo->ndo_error)(ndo, S_ERR_ND_MEM_ALLOC,
-				  "%s: strdup(buf)", __func__);
-	return (tp->name);
+	len = snprintf(buf, sizeof(buf), "%u", port);
+	return (nc_insert(ndo, &uport_cache, port, 0, buf, len));
 }
 
 const char *
@@ -790,6 +1285,8 @@ ipxsap_string(netdissect_options *ndo, u_short port)
 	uint32_t i = port;
 	char buf[sizeof("0000")];
 
+	if (!ipxsap_loaded)
+		init_ipxsaparray(ndo);
 	for (tp = &ipxsaptable[i & (HASHNAMESIZE-1)]; tp->nxt; tp = tp->nxt)
 		if (tp->addr == i)
 			return (tp->name);
@@ -815,119 +1312,26 @@ static void
 init_servarray(netdissect_options *ndo)
 {
 	struct servent *sv;
-	struct hnamemem *table;
-	int i;
-	char buf[sizeof("0000000000")];
+	struct name_cache *nc;
 
+	services_loaded = 1;
+	if (ndo->ndo_nflag)
+		return;
 	while ((sv = getservent()) != NULL) {
 		int port = ntohs(sv->s_port);
-		i = port & (HASHNAMESIZE-1);
 		if (strcmp(sv->s_proto, "tcp") == 0)
-			table = &tporttable[i];
+			nc = &tport_cache;
 		else if (strcmp(sv->s_proto, "udp") == 0)
-			table = &uporttable[i];
+			nc = &uport_cache;
 		else
 			continue;
 
-		while (table->name)
-			table = table->nxt;
-		if (ndo->ndo_nflag) {
-			(void)snprintf(buf, sizeof(buf), "%d", port);
-			table->name = strdup(buf);
-		} else
-			table->name = strdup(sv->s_name);
-		if (table->name == NULL)
-			(*ndo->ndo_error)(ndo, S_ERR_ND_MEM_ALLOC,
-					  "%s: strdup", __func__);
-
-		table->addr = port;
-		table->nxt = newhnamemem(ndo);
-	}
-	endservent();
-}
-
-static const struct eproto {
-	const char *s;
-	u_short p;
-} eproto_db[] = {
-	{ "aarp", ETHERTYPE_AARP },
-	{ "arp", ETHERTYPE_ARP },
-	{ "atalk", ETHERTYPE_ATALK },
-	{ "decnet", ETHERTYPE_DN },
-	{ "ip", ETHERTYPE_IP },
-	{ "ip6", ETHERTYPE_IPV6 },
-	{ "lat", ETHERTYPE_LAT },
-	{ "loopback", ETHERTYPE_LOOPBACK },
-	{ "mopdl", ETHERTYPE_MOPDL },
-	{ "moprc", ETHERTYPE_MOPRC },
-	{ "rarp", ETHERTYPE_REVARP },
-	{ "sca", ETHERTYPE_SCA },
-	{ (char *)0, 0 }
-};
-
-static void
-init_eprotoarray(netdissect_options *ndo)
-{
-	int i;
-	struct hnamemem *table;
-
-	for (i = 0; eproto_db[i].s; i++) {
-		int j = htons(eproto_db[i].p) & (HASHNAMESIZE-1);
-		table = &eprototable[j];
-		while (table->name)
-			table = table->nxt;
-		table->name = eproto_db[i].s;
-		table->addr = htons(eproto_db[i].p);
-		table->nxt = newhnamemem(ndo);
-	}
-}
-
-static const struct protoidlist {
-	const u_char protoid[5];
-	const char *name;
-} protoidlist[] = {
-	{{ 0x00, 0x00, 0x0c, 0x01, 0x07 }, "CiscoMLS" },
-	{{ 0x00, 0x00, 0x0c, 0x20, 0x00 }, "CiscoCDP" },
-	{{ 0x00, 0x00, 0x0c, 0x20, 0x01 }, "CiscoCGMP" },
-	{{ 0x00, 0x00, 0x0c, 0x20, 0x03 }, "CiscoVTP" },
-	{{ 0x00, 0xe0, 0x2b, 0x00, 0xbb }, "ExtremeEDP" },
-	{{ 0x00, 0x00, 0x00, 0x00, 0x00 }, NULL }
-};
-
-/*
- * SNAP proto IDs with org code 0:0:0 are actually encapsulated Ethernet
- * types.
- */
-static void
-init_protoidarray(netdissect_options *ndo)
-{
-	int i;
-	struct protoidmem *tp;
-	const struct protoidlist *pl;
-	u_char protoid[5];
-
-	protoid[0] = 0;
-	protoid[1] = 0;
-	protoid[2] = 0;
-	for (i = 0; eproto_db[i].s; i++) {
-		u_short etype = htons(eproto_db[i].p);
-
-		memcpy((char *)&protoid[3], (char *)&etype, 2);
-		tp = lookup_protoid(ndo, protoid);
-		tp->p_name = strdup(eproto_db[i].s);
-		if (tp->p_name == NULL)
-			(*ndo->ndo_error)(ndo, S_ERR_ND_MEM_ALLOC,
-				"%s: strdup(eproto_db[i].s)", __func__);
-	}
-	/* Hardwire some SNAP proto ID names */
-	for (pl = protoidlist; pl->name != NULL; ++pl) {
-		tp = lookup_protoid(ndo, pl->protoid);
-		/* Don't override existing name */
-		if (tp->p_name != NULL)
+		/* The first entry for a port wins */
+		if (nc_find(nc, port, 0) != NULL)
 			continue;
-
-		tp->p_name = pl->name;
+		nc_insert(ndo, nc, port, 0, sv->s_name, strlen(sv->s_name));
 	}
+	endservent();
 }
 
 static const struct etherlist {
@@ -956,22 +1360,32 @@ static void
 init_etherarray(netdissect_options *ndo)
 {
 	const struct etherlist *el;
-	struct enamemem *tp;
+	uint64_t k;
 #ifdef USE_ETHER_NTOHOST
 	char name[256];
 #else
 	struct pcap_etherent *ep;
+	struct nc_entry *e;
 	FILE *fp;
+#endif
 
+	ethers_loaded = 1;
+	if (ndo->ndo_nflag)
+		return;
+#ifndef USE_ETHER_NTOHOST
 	/* Suck in entire ethers file */
 	fp = fopen(PCAP_ETHERS_FILE, "r");
 	if (fp != NULL) {
 		while ((ep = pcap_next_etherent(fp)) != NULL) {
-			tp = lookup_emem(ndo, ep->addr);
-			tp->e_name = strdup(ep->name);
-			if (tp->e_name == NULL)
-				(*ndo->ndo_error)(ndo, S_ERR_ND_MEM_ALLOC,
-					"%s: strdup(ep->addr)", __func__);
+			/* A later entry for an address overrides */
+			k = mac48_key(ep->addr);
+			e = nc_find(&mac48_cache, k, 0);
+			if (e != NULL)
+				nc_rename(ndo, &mac48_cache, e, ep->name,
+				    strlen(ep->name));
+			else
+				nc_insert(ndo, &mac48_cache, k, 0, ep->name,
+				    strlen(ep->name));
 		}
 		(void)fclose(fp);
 	}
@@ -979,9 +1393,9 @@ init_etherarray(netdissect_options *ndo)
 
 	/* Hardwire some ethernet names */
 	for (el = etherlist; el->name != NULL; ++el) {
-		tp = lookup_emem(ndo, el->addr);
+		k = mac48_key(el->addr);
 		/* Don't override existing name */
-		if (tp->e_name != NULL)
+		if (nc_find(&mac48_cache, k, 0) != NULL)
 			continue;
 
 #ifdef USE_ETHER_NTOHOST
@@ -992,14 +1406,11 @@ init_etherarray(netdissect_options *ndo)
 		struct ether_addr ea;
 		memcpy (&ea, el->addr, MAC48_LEN);
 		if (ether_ntohost(name, &ea) == 0) {
-			tp->e_name = strdup(name);
-			if (tp->e_name == NULL)
-				(*ndo->ndo_error)(ndo, S_ERR_ND_MEM_ALLOC,
-					"%s: strdup(name)", __func__);
+			nc_insert(ndo, &mac48_cache, k, 0, name, strlen(name));
 			continue;
 		}
 #endif
-		tp->e_name = el->name;
+		nc_insert(ndo, &mac48_cache, k, 0, el->name, strlen(el->name));
 	}
 }
 
@@ -1229,6 +1640,9 @@ init_ipxsaparray(netdissect_options *ndo)
 	int i;
 	struct hnamemem *table;
 
+	ipxsap_loaded = 1;
+	if (ndo->ndo_nflag)
+		return;
 	for (i = 0; ipxsap_db[i].s != NULL; i++) {
 		u_int j = htons(ipxsap_db[i].v) & (HASHNAMESIZE-1);
 		table = &ipxsaptable[j];
@@ -1253,17 +1667,24 @@ init_addrtoname(netdissect_options *ndo, uint32_t localnet, uint32_t mask)
 		f_localnet = localnet;
 		f_netmask = mask;
 	}
-	if (ndo->ndo_nflag)
-		/*
-		 * Simplest way to suppress names.
-		 */
-		return;
+	host_cache.max = ndo->ndo_name_cache_size;
+	host6_cache.max = ndo->ndo_name_cache_size;
+	mac48_cache.max = ndo->ndo_name_cache_size;
+}
 
-	init_etherarray(ndo);
-	init_servarray(ndo);
-	init_eprotoarray(ndo);
-	init_protoidarray(ndo);
-	init_ipxsaparray(ndo);
+/*
+ * Load the name tables that haven't been loaded yet; call this before
+ * giving up access to the files they're read from.
+ */
+void
+load_name_tables(netdissect_options *ndo)
+{
+	if (!ethers_loaded)
+		init_etherarray(ndo);
+	if (!services_loaded)
+		init_servarray(ndo);
+	if (!ipxsap_loaded)
+		init_ipxsaparray(ndo);
 }
 
 const char *
@@ -1288,8 +1709,8 @@ struct hnamemem *
 newhnamemem(netdissect_options *ndo)
 {
 	struct hnamemem *p;
-	static struct hnamemem *ptr = NULL;
-	static u_int num = 0;
+	static ND_THREAD_LOCAL struct hnamemem *ptr = NULL;
+	static ND_THREAD_LOCAL u_int num = 0;
 
 	if (num  == 0) {
 		num = 64;
@@ -1303,31 +1724,11 @@ newhnamemem(netdissect_options *ndo)
 	return (p);
 }
 
-/* Return a zero'ed h6namemem struct and cuts down on calloc() overhead */
-struct h6namemem *
-newh6namemem(netdissect_options *ndo)
-{
-	struct h6namemem *p;
-	static struct h6namemem *ptr = NULL;
-	static u_int num = 0;
-
-	if (num  == 0) {
-		num = 64;
-		ptr = (struct h6namemem *)calloc(num, sizeof (*ptr));
-		if (ptr == NULL)
-			(*ndo->ndo_error)(ndo, S_ERR_ND_MEM_ALLOC,
-					  "%s: calloc", __func__);
-	}
-	--num;
-	p = ptr++;
-	return (p);
-}
-
 /* Represent TCI part of the 802.1Q 4-octet tag as text. */
 const char *
 ieee8021q_tci_string(const uint16_t tci)
 {
-	static char buf[128];
+	static ND_THREAD_LOCAL char buf[128];
 	snprintf(buf, sizeof(buf), "vlan %u, p %u%s",
 	         tci & 0xfff,
 	         tci >> 13,
@@ -60,8 +60,10 @@ extern const char *ip6addr_string(netdissect_options *, const u_char *);
 extern const char *intoa(uint32_t);
 
 extern void init_addrtoname(netdissect_options *, uint32_t, uint32_t);
+extern void load_name_tables(netdissect_options *);
+extern void update_name_tables(netdissect_options *);
+extern void print_name_cache_stats(FILE *);
 extern struct hnamemem *newhnamemem(netdissect_options *);
-extern struct h6namemem *newh6namemem(netdissect_options *);
 extern const char * ieee8021q_tci_string(const uint16_t);
 
 /* macro(s) and inline function(s) with setjmp/longjmp logic to call
@@ -134,3 +136,11 @@ get_ip6addr_string(netdissect_options *ndo, const u_char *p)
 #define GET_ISONSAP_STRING(nsap, nsap_length) get_isonsap_string(ndo, (const u_char *)(nsap), nsap_length)
 #define GET_IPADDR_STRING(p) get_ipaddr_string(ndo, (const u_char *)(p))
 #define GET_IP6ADDR_STRING(p) get_ip6addr_string(ndo, (const u_char *)(p))
+
+/* See "Validated views" in extract.h. */
+#define VIEW_MAC48_STRING(ok, p) \
+	((ok) ? mac48_string(ndo, (const u_char *)(p)) : GET_MAC48_STRING(p))
+#define VIEW_IPADDR_STRING(ok, p) \
+	((ok) ? ipaddr_string(ndo, (const u_char *)(p)) : GET_IPADDR_STRING(p))
+#define VIEW_IP6ADDR_STRING(ok, p) \
+	((ok) ? ip6addr_string(ndo, (const u_char *)(p)) : GET_IP6ADDR_STRING(p))
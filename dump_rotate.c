@@ -0,0 +1,332 @@
+/*
+ * Copyright (c) 2026 The TCPDUMP project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that: (1) source code
+ * distributions retain the above copyright notice and this paragraph
+ * in its entirety, and (2) distributions including binary code include
+ * the above copyright notice and this paragraph in its entirety in
+ * the documentation or other materials provided with the distribution.
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND
+ * WITHOUT ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, WITHOUT
+ * LIMITATION, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE.
+ */
+
+/*
+ * Savefile rotation helper.
+ *
+ * Rotating to a new savefile used to mean creating (and, with -W,
+ * truncating) the file and closing the old one on the capture thread,
+ * which can take long enough for packets to be dropped.  Instead, a
+ * helper thread creates the next savefile in advance, under a
+ * temporary name in the same directory; at the rotation, the capture
+ * thread just renames it to the name it should have, which replaces
+ * any old file of that name in one step.  So that the space used by
+ * the replaced file isn't freed on the capture thread either, it's
+ * opened before the rename and closed by the helper thread, as are
+ * the savefiles that have been rotated away from.
+ *
+ * The helper thread also keeps the -G timer, so that files are
+ * rotated on the time boundaries rather than on the first packet
+ * that arrives after a boundary.
+ *
+ * If no file has been prepared in time, or the new file is in
+ * another directory, the caller falls back to opening it itself.
+ */
+
+#include <config.h>
+
+#include "netdissect-stdinc.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <pcap.h>
+
+#include "dump_rotate.h"
+
+#ifdef USE_DUMP_ROTATE
+
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <unistd.h>
+
+#ifndef PATH_MAX
+#define PATH_MAX 1024
+#endif
+
+#define DR_NCLOSE	16	/* size of the queue of files to close */
+
+struct dr_close {
+	pcap_dumper_t *pdd;	/* a savefile, or */
+	int fd;			/* a replaced file */
+};
+
+static struct {
+	int started;
+	int dirfd;
+	int mode;
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t wake;
+	int stop;
+
+	/* The next savefile */
+	int want;			/* one has been asked for ... */
+	char want_dir[PATH_MAX + 1];	/* ... in this directory */
+	int fd;				/* -1 if none is ready */
+	char dir[PATH_MAX + 1];		/* directory it's in */
+	char tmpname[PATH_MAX + 1];
+
+	/* Files waiting to be closed */
+	struct dr_close closeq[DR_NCLOSE];
+	u_int nclose;
+
+	/* The -G timer */
+	time_t first;
+	int interval;
+	atomic_int_fast64_t due;	/* boundary reached, or 0 */
+} dr = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.wake = PTHREAD_COND_INITIALIZER,
+	.fd = -1,
+};
+
+/* Length of the directory part of a path name, including the last '/' */
+static size_t
+dr_dirlen(const char *name)
+{
+	const char *p = strrchr(name, '/');
+
+	return (p == NULL ? 0 : (size_t)(p - name) + 1);
+}
+
+/* Create an empty file in directory "dir"; called without the lock. */
+static int
+dr_create(const char *dir, char *tmpname)
+{
+	int fd;
+
+	if (snprintf(tmpname, PATH_MAX + 1, "%s.tcpdump-%ld.next", dir,
+	    (long)getpid()) > PATH_MAX)
+		return (-1);
+	fd = openat(dr.dirfd, tmpname, O_CREAT | O_EXCL | O_WRONLY, dr.mode);
+	if (fd == -1 && errno == EEXIST) {
+		/* Left behind by a process that had the same ID. */
+		(void)unlinkat(dr.dirfd, tmpname, 0);
+		fd = openat(dr.dirfd, tmpname, O_CREAT | O_EXCL | O_WRONLY,
+		    dr.mode);
+	}
+	return (fd);
+}
+
+/* Queue a file to be closed; called with the lock held. */
+static int
+dr_queue_close(pcap_dumper_t *pdd, int fd)
+{
+	if (dr.nclose == DR_NCLOSE)
+		return (-1);
+	dr.closeq[dr.nclose].pdd = pdd;
+	dr.closeq[dr.nclose].fd = fd;
+	dr.nclose++;
+	pthread_cond_signal(&dr.wake);
+	return (0);
+}
+
+static void *
+dr_thread(void *arg _U_)
+{
+	char dir[PATH_MAX + 1], tmpname[PATH_MAX + 1];
+	struct dr_close c;
+	struct timespec ts;
+	time_t now, next = dr.first + dr.interval;
+	int fd;
+
+	pthread_mutex_lock(&dr.lock);
+	for (;;) {
+		if (dr.nclose != 0) {
+			c = dr.closeq[--dr.nclose];
+			pthread_mutex_unlock(&dr.lock);
+			if (c.pdd != NULL)
+				pcap_dump_close(c.pdd);
+			else
+				close(c.fd);
+			pthread_mutex_lock(&dr.lock);
+			continue;
+		}
+		if (dr.want && !dr.stop) {
+			dr.want = 0;
+			if (dr.fd != -1 && strcmp(dr.dir, dr.want_dir) == 0)
+				continue;
+			strcpy(dir, dr.want_dir);
+			fd = dr.fd;
+			dr.fd = -1;
+			strcpy(tmpname, dr.tmpname);
+			pthread_mutex_unlock(&dr.lock);
+			if (fd != -1) {
+				/* Prepared in the wrong directory. */
+				close(fd);
+				(void)unlinkat(dr.dirfd, tmpname, 0);
+			}
+			fd = dr_create(dir, tmpname);
+			pthread_mutex_lock(&dr.lock);
+			if (fd != -1) {
+				dr.fd = fd;
+				strcpy(dr.dir, dir);
+				strcpy(dr.tmpname, tmpname);
+			}
+			continue;
+		}
+		if (dr.stop)
+			break;
+		if (dr.interval != 0) {
+			now = time(NULL);
+			if (now >= next) {
+				/* Rotate to the last boundary passed. */
+				next = now - (now - dr.first) % dr.interval;
+				atomic_store(&dr.due, (int_fast64_t)next);
+				next += dr.interval;
+				continue;
+			}
+			ts.tv_sec = next;
+			ts.tv_nsec = 0;
+			pthread_cond_timedwait(&dr.wake, &dr.lock, &ts);
+		} else
+			pthread_cond_wait(&dr.wake, &dr.lock);
+	}
+	pthread_mutex_unlock(&dr.lock);
+	return (NULL);
+}
+
+/*
+ * Start the helper thread.  Files are created relative to dirfd, with
+ * the given mode; with a non-zero interval, dump_rotate_due() reports
+ * every interval seconds from "first".  Returns -1, with a message
+ * in errbuf, on failure.
+ */
+int
+dump_rotate_start(int dirfd, int mode, time_t first, int interval,
+    char *errbuf, size_t errbuf_size)
+{
+	sigset_t all, old;
+	int err;
+
+	dr.dirfd = dirfd;
+	dr.mode = mode;
+	dr.first = first;
+	dr.interval = interval;
+
+	/* Leave the signals to the capture thread. */
+	sigfillset(&all);
+	pthread_sigmask(SIG_SETMASK, &all, &old);
+	err = pthread_create(&dr.thread, NULL, dr_thread, NULL);
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+	if (err != 0) {
+		snprintf(errbuf, errbuf_size,
+		    "can't create rotation thread: %s", strerror(err));
+		return (-1);
+	}
+	dr.started = 1;
+	return (0);
+}
+
+/* Have a file prepared in the directory of the savefile "name". */
+void
+dump_rotate_prepare(const char *name)
+{
+	size_t len = dr_dirlen(name);
+
+	pthread_mutex_lock(&dr.lock);
+	memcpy(dr.want_dir, name, len);
+	dr.want_dir[len] = '\0';
+	dr.want = 1;
+	pthread_cond_signal(&dr.wake);
+	pthread_mutex_unlock(&dr.lock);
+}
+
+/*
+ * Give the prepared file the name "name" and return a descriptor for
+ * it, or return -1 if there's no file ready in the right directory.
+ */
+int
+dump_rotate_take(const char *name)
+{
+	size_t len = dr_dirlen(name);
+	int fd, old;
+
+	pthread_mutex_lock(&dr.lock);
+	if (dr.fd == -1 || strlen(dr.dir) != len ||
+	    memcmp(dr.dir, name, len) != 0) {
+		pthread_mutex_unlock(&dr.lock);
+		return (-1);
+	}
+	/* Keep the file being replaced, if any, for the helper to close. */
+	old = openat(dr.dirfd, name, O_RDONLY | O_NONBLOCK);
+	if (renameat(dr.dirfd, dr.tmpname, dr.dirfd, name) == -1) {
+		pthread_mutex_unlock(&dr.lock);
+		if (old != -1)
+			close(old);
+		return (-1);
+	}
+	fd = dr.fd;
+	dr.fd = -1;
+	if (old != -1 && dr_queue_close(NULL, old) == -1)
+		close(old);
+	pthread_mutex_unlock(&dr.lock);
+	return (fd);
+}
+
+/*
+ * Have a savefile closed by the helper thread; returns -1 if it can't
+ * be queued, in which case the caller must close it.
+ */
+int
+dump_rotate_close(pcap_dumper_t *pdd)
+{
+	int ret;
+
+	pthread_mutex_lock(&dr.lock);
+	ret = dr_queue_close(pdd, -1);
+	pthread_mutex_unlock(&dr.lock);
+	return (ret);
+}
+
+/*
+ * If a -G boundary has been passed since the last call, return the
+ * time of the last boundary passed; otherwise return 0.
+ */
+time_t
+dump_rotate_due(void)
+{
+	if (atomic_load_explicit(&dr.due, memory_order_relaxed) == 0)
+		return (0);
+	return ((time_t)atomic_exchange(&dr.due, 0));
+}
+
+/* Close everything queued, remove any unused file and stop the thread. */
+void
+dump_rotate_stop(void)
+{
+	if (!dr.started)
+		return;
+	dr.started = 0;
+	pthread_mutex_lock(&dr.lock);
+	dr.stop = 1;
+	pthread_cond_signal(&dr.wake);
+	pthread_mutex_unlock(&dr.lock);
+	pthread_join(dr.thread, NULL);
+	if (dr.fd != -1) {
+		close(dr.fd);
+		(void)unlinkat(dr.dirfd, dr.tmpname, 0);
+		dr.fd = -1;
+	}
+}
+#endif /* USE_DUMP_ROTATE */
@@ -0,0 +1,36 @@
+/*
+ * Copyright (c) 2026 The TCPDUMP project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that: (1) source code
+ * distributions retain the above copyright notice and this paragraph
+ * in its entirety, and (2) distributions including binary code include
+ * the above copyright notice and this paragraph in its entirety in
+ * the documentation or other materials provided with the distribution.
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND
+ * WITHOUT ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, WITHOUT
+ * LIMITATION, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE.
+ */
+
+#ifndef dump_rotate_h
+#define dump_rotate_h
+
+/*
+ * Savefile rotation (-C and -G) helped by a separate thread, which
+ * creates the next savefile ahead of time, closes old ones and keeps
+ * the -G timer.
+ */
+#if defined(HAVE_PTHREADS) && defined(HAVE_STDATOMIC_H)
+#define USE_DUMP_ROTATE
+
+extern int dump_rotate_start(int, int, time_t, int, char *, size_t);
+extern void dump_rotate_prepare(const char *);
+extern int dump_rotate_take(const char *);
+extern int dump_rotate_close(pcap_dumper_t *);
+extern time_t dump_rotate_due(void);
+extern void dump_rotate_stop(void);
+#endif /* HAVE_PTHREADS && HAVE_STDATOMIC_H */
+
+#endif /* dump_rotate_h */
@@ -0,0 +1,935 @@
+/*
+ * Copyright (c) 2026 The TCPDUMP project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that: (1) source code
+ * distributions retain the above copyright notice and this paragraph
+ * in its entirety, and (2) distributions including binary code include
+ * the above copyright notice and this paragraph in its entirety in
+ * the documentation or other materials provided with the distribution.
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND
+ * WITHOUT ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, WITHOUT
+ * LIMITATION, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE.
+ */
+
+/*
+ * Background savefile writer.
+ *
+ * The capture thread appends pcap records to a single-producer,
+ * single-consumer ring buffer; a writer thread takes them out and
+ * writes them to the savefile in large writes, so that the capture
+ * thread only blocks if the disk falls behind by more than the size
+ * of the ring.  The ring indices are only ever advanced by one thread
+ * each, so no lock is needed to pass data; the mutex and condition
+ * variables are only used to put an idle thread to sleep and wake it up.
+ *
+ * Opening, flushing and closing a savefile are passed to the writer
+ * thread through a second, small ring of requests, each of which
+ * records the position in the data ring at which it takes effect.
+ *
+ * The savefile header is written by pcap_dump_open() on the capture
+ * thread; the writer thread flushes it and then writes the records
+ * straight to the file descriptor, so the pcap_dumper_t must not be
+ * used by the capture thread after it's been handed to the writer.
+ *
+ * With --direct-io, on systems with O_DIRECT, the records are copied
+ * into an aligned buffer and written with O_DIRECT in multiples of
+ * DW_ALIGN bytes, bypassing the page cache; the part of a file that
+ * doesn't fill a whole block is written with O_DIRECT turned off.
+ *
+ * With --compress, the writer thread runs the data through zlib or
+ * libzstd on its way to the file, so that the capture thread doesn't
+ * spend any time compressing.  pcap_dump_open() has already buffered
+ * an uncompressed header, so the writer thread writes it out, truncates
+ * the file, and starts it again with a compressed copy of the header
+ * made once by dump_writer_set_compression().
+ *
+ * The compressed size of what's still queued isn't known, so for -C
+ * the capture thread works with a bound on the file size: what it was
+ * the last time it was known exactly, plus the most the data queued
+ * since could compress to.  Only when that bound goes past the limit
+ * does it have the writer flush the compressor, and wait for it, to
+ * get the exact size again.  The first flush comes when about a file's
+ * worth of data has been queued, and each one after that when enough
+ * has been queued to fill the rest of the file if it didn't compress at
+ * all.  Data that compresses well can take a few hundred flushes a
+ * file, each of which makes the file a few dozen bytes bigger.
+ */
+
+#ifdef __linux__
+#define _GNU_SOURCE	/* for O_DIRECT */
+#endif
+
+#include <config.h>
+
+#include "netdissect-stdinc.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <pcap.h>
+
+#include "dump_writer.h"
+
+#ifdef USE_DUMP_WRITER
+
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifdef USE_DUMP_WRITER_GZIP
+#define ZLIB_CONST
+#include <zlib.h>
+#endif
+#ifdef USE_DUMP_WRITER_ZSTD
+#include <zstd.h>
+#endif
+
+#define DW_CHUNK	(256*1024)	/* don't bother writing less, unless idle */
+#define DW_IDLE_MSEC	200		/* ... for this long */
+#define DW_ALIGN	4096		/* alignment for O_DIRECT */
+#define DW_DIRECT_BUF	(1024*1024)	/* size of the O_DIRECT buffer */
+#define DW_NREQ		64		/* size of the request ring */
+#define DW_ZBUF		(256*1024)	/* size of the compressed data buffer */
+#define DW_HDR_MAX	64		/* room for a savefile header */
+
+enum dw_op {
+	DW_OPEN,	/* start writing to a new savefile */
+	DW_FLUSH,	/* write out everything queued so far (-U) */
+	DW_CLOSE	/* finish and close the current savefile */
+};
+
+struct dw_req {
+	enum dw_op op;
+	uint64_t pos;		/* position in the data ring */
+	pcap_dumper_t *pdd;
+};
+
+/* How far to push data through the compressor */
+enum dw_zmode {
+	DW_Z_CONTINUE,	/* only as far as the compressor wants */
+	DW_Z_FLUSH,	/* so that everything so far can be decompressed */
+	DW_Z_END	/* to the end of the compressed stream */
+};
+
+/* A pcap record header, as written by pcap_dump() */
+struct dw_pkthdr {
+	uint32_t tv_sec;
+	uint32_t tv_usec;
+	uint32_t caplen;
+	uint32_t len;
+};
+
+static struct {
+	int started;
+	int direct;
+	u_char *ring;
+	size_t size;			/* a power of 2 */
+	atomic_uint_fast64_t head;	/* bytes queued, ever */
+	atomic_uint_fast64_t tail;	/* bytes taken by the writer, ever */
+	struct dw_req reqs[DW_NREQ];
+	atomic_uint req_head;
+	atomic_uint req_tail;
+	atomic_uint closes_done;
+
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t wake;		/* signaled to wake the writer */
+	pthread_cond_t room;		/* signaled to wake the capture thread */
+	atomic_int writer_idle;
+	atomic_int producer_waiting;
+	atomic_int stop;
+	atomic_int failed;
+	char errbuf[128];
+
+	/* Compression, set up before the thread is started */
+	enum dump_compression compress;
+	u_char hdr[DW_HDR_MAX];		/* the savefile header */
+	size_t hdrlen;
+	u_char *zbuf;
+#ifdef USE_DUMP_WRITER_GZIP
+	z_stream zs;
+#endif
+#ifdef USE_DUMP_WRITER_ZSTD
+	ZSTD_CCtx *zcx;
+#endif
+	atomic_uint_fast64_t zout;	/* compressed size of the current file */
+
+	/* Used only by the capture thread */
+	uint64_t file_start;		/* head when the file was opened */
+	int64_t file_base;		/* size of the file at that point */
+	u_int closes_issued;
+	uint64_t zsync_pos;		/* where the file size was last known */
+	int64_t zsync_size;		/* ... and what it was */
+	struct dump_writer_stats stats;
+
+	/* Used only by the writer thread */
+	int fd;
+	pcap_dumper_t *pdd;
+	int64_t offset;			/* in the current file */
+	int direct_on;			/* O_DIRECT currently set on fd */
+	u_char *dbuf;			/* O_DIRECT buffer */
+	size_t dlen;
+	uint64_t zout_count;		/* value for zout */
+} dw = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.wake = PTHREAD_COND_INITIALIZER,
+	.room = PTHREAD_COND_INITIALIZER,
+	.fd = -1,
+};
+
+static void
+dw_deadline(struct timespec *ts, u_int msec)
+{
+	clock_gettime(CLOCK_REALTIME, ts);
+	ts->tv_sec += msec / 1000;
+	ts->tv_nsec += (long)(msec % 1000) * 1000000;
+	if (ts->tv_nsec >= 1000000000) {
+		ts->tv_sec++;
+		ts->tv_nsec -= 1000000000;
+	}
+}
+
+static uint64_t
+dw_usec(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((uint64_t)ts.tv_sec * 1000000 + (uint64_t)ts.tv_nsec / 1000);
+}
+
+/* Wake the writer thread, if it's waiting. */
+static void
+dw_wake_writer(void)
+{
+	if (atomic_load(&dw.writer_idle)) {
+		pthread_mutex_lock(&dw.lock);
+		pthread_cond_signal(&dw.wake);
+		pthread_mutex_unlock(&dw.lock);
+	}
+}
+
+/* Wake the capture thread, if it's waiting. */
+static void
+dw_wake_producer(void)
+{
+	if (atomic_load(&dw.producer_waiting)) {
+		pthread_mutex_lock(&dw.lock);
+		pthread_cond_signal(&dw.room);
+		pthread_mutex_unlock(&dw.lock);
+	}
+}
+
+/*
+ * Wait, on the capture thread, for the writer to make progress; the
+ * timeout only guards against a wakeup that's never sent.
+ */
+static void
+dw_wait_for_writer(void)
+{
+	struct timespec ts;
+
+	pthread_mutex_lock(&dw.lock);
+	atomic_store(&dw.producer_waiting, 1);
+	pthread_cond_signal(&dw.wake);
+	dw_deadline(&ts, 10);
+	pthread_cond_timedwait(&dw.room, &dw.lock, &ts);
+	atomic_store(&dw.producer_waiting, 0);
+	pthread_mutex_unlock(&dw.lock);
+}
+
+static void
+dw_fail_msg(const char *what, const char *msg)
+{
+	if (!atomic_load(&dw.failed)) {
+		snprintf(dw.errbuf, sizeof(dw.errbuf), "%s: %s", what, msg);
+		atomic_store(&dw.failed, 1);
+	}
+}
+
+static void
+dw_fail(const char *what, int err)
+{
+	dw_fail_msg(what, strerror(err));
+}
+
+static void
+dw_write_fd(const u_char *p, size_t n)
+{
+	ssize_t r;
+
+	while (n != 0 && !atomic_load(&dw.failed)) {
+		r = write(dw.fd, p, n);
+		if (r < 0) {
+			if (errno == EINTR)
+				continue;
+			dw_fail("write error on savefile", errno);
+			return;
+		}
+		p += r;
+		n -= (size_t)r;
+		dw.offset += r;
+	}
+}
+
+#ifdef O_DIRECT
+static void
+dw_set_direct(int on)
+{
+	int flags;
+
+	if (dw.direct_on == on)
+		return;
+	flags = fcntl(dw.fd, F_GETFL);
+	if (flags == -1 ||
+	    fcntl(dw.fd, F_SETFL, on ? flags | O_DIRECT : flags & ~O_DIRECT) == -1) {
+		dw_fail("can't change O_DIRECT on savefile", errno);
+		return;
+	}
+	dw.direct_on = on;
+}
+
+/*
+ * Write out the O_DIRECT buffer, as far as it can be written in whole
+ * aligned blocks; with "all", write the rest too.
+ */
+static void
+dw_drain_direct(int all)
+{
+	size_t n, done = 0;
+
+	if (dw.offset % DW_ALIGN != 0) {
+		/* Bring the file offset to a block boundary first. */
+		n = DW_ALIGN - (size_t)(dw.offset % DW_ALIGN);
+		if (n > dw.dlen)
+			n = dw.dlen;
+		dw_set_direct(0);
+		dw_write_fd(dw.dbuf, n);
+		/* O_DIRECT needs an aligned buffer, too. */
+		memmove(dw.dbuf, dw.dbuf + n, dw.dlen - n);
+		dw.dlen -= n;
+	}
+	n = dw.dlen & ~(size_t)(DW_ALIGN - 1);
+	if (n != 0) {
+		dw_set_direct(1);
+		dw_write_fd(dw.dbuf, n);
+		done = n;
+	}
+	if (all && done != dw.dlen) {
+		dw_set_direct(0);
+		dw_write_fd(dw.dbuf + done, dw.dlen - done);
+		done = dw.dlen;
+	}
+	memmove(dw.dbuf, dw.dbuf + done, dw.dlen - done);
+	dw.dlen -= done;
+}
+#endif /* O_DIRECT */
+
+/* Write data to the current file. */
+static void
+dw_write(const u_char *p, size_t n)
+{
+	if (dw.fd == -1 || atomic_load(&dw.failed))
+		return;
+#ifdef O_DIRECT
+	if (dw.direct) {
+		size_t c;
+
+		while (n != 0) {
+			c = DW_DIRECT_BUF - dw.dlen;
+			if (c > n)
+				c = n;
+			memcpy(dw.dbuf + dw.dlen, p, c);
+			dw.dlen += c;
+			p += c;
+			n -= c;
+			if (dw.dlen == DW_DIRECT_BUF)
+				dw_drain_direct(0);
+		}
+		return;
+	}
+#endif
+	dw_write_fd(p, n);
+}
+
+/* Run data for the current file through the compressor. */
+static void
+dw_compress(const u_char *p, size_t n, enum dw_zmode mode)
+{
+	uint64_t out = 0;
+
+	switch (dw.compress) {
+
+#ifdef USE_DUMP_WRITER_GZIP
+	case DUMP_COMPRESS_GZIP: {
+		int flush = mode == DW_Z_END ? Z_FINISH :
+		    mode == DW_Z_FLUSH ? Z_SYNC_FLUSH : Z_NO_FLUSH;
+
+		dw.zs.next_in = p;
+		dw.zs.avail_in = (uInt)n;
+		do {
+			dw.zs.next_out = dw.zbuf;
+			dw.zs.avail_out = DW_ZBUF;
+			if (deflate(&dw.zs, flush) == Z_STREAM_ERROR) {
+				dw_fail_msg("can't compress savefile",
+				    dw.zs.msg != NULL ? dw.zs.msg : "zlib error");
+				return;
+			}
+			dw_write(dw.zbuf, DW_ZBUF - dw.zs.avail_out);
+			out += DW_ZBUF - dw.zs.avail_out;
+		} while (dw.zs.avail_out == 0);
+		if (mode == DW_Z_END)
+			deflateReset(&dw.zs);
+		break;
+	}
+#endif
+
+#ifdef USE_DUMP_WRITER_ZSTD
+	case DUMP_COMPRESS_ZSTD: {
+		ZSTD_EndDirective end = mode == DW_Z_END ? ZSTD_e_end :
+		    mode == DW_Z_FLUSH ? ZSTD_e_flush : ZSTD_e_continue;
+		ZSTD_inBuffer in = { p, n, 0 };
+		ZSTD_outBuffer zout;
+		size_t r;
+
+		for (;;) {
+			zout.dst = dw.zbuf;
+			zout.size = DW_ZBUF;
+			zout.pos = 0;
+			r = ZSTD_compressStream2(dw.zcx, &zout, &in, end);
+			if (ZSTD_isError(r)) {
+				dw_fail_msg("can't compress savefile",
+				    ZSTD_getErrorName(r));
+				return;
+			}
+			dw_write(dw.zbuf, zout.pos);
+			out += zout.pos;
+			if (end == ZSTD_e_continue ? in.pos == in.size : r == 0)
+				break;
+		}
+		break;
+	}
+#endif
+
+	default:
+		break;
+	}
+	dw.zout_count += out;
+	atomic_store_explicit(&dw.zout, dw.zout_count, memory_order_relaxed);
+}
+
+/* Write, and perhaps compress, data for the current file. */
+static void
+dw_output(const u_char *p, size_t n)
+{
+	size_t c;
+
+	if (dw.fd == -1 || atomic_load(&dw.failed))
+		return;
+	if (dw.compress == DUMP_COMPRESS_NONE) {
+		dw_write(p, n);
+		return;
+	}
+	/* zlib counts in uInts. */
+	while (n != 0) {
+		c = n < DW_CHUNK ? n : DW_CHUNK;
+		dw_compress(p, c, DW_Z_CONTINUE);
+		p += c;
+		n -= c;
+	}
+}
+
+/*
+ * Write everything that's been handed to dw_output() so far; mode says
+ * how far to take the compressed stream.
+ */
+static void
+dw_finish_output(enum dw_zmode mode)
+{
+	if (dw.fd == -1 || atomic_load(&dw.failed))
+		return;
+	if (dw.compress != DUMP_COMPRESS_NONE)
+		dw_compress(NULL, 0, mode);
+#ifdef O_DIRECT
+	if (dw.direct)
+		dw_drain_direct(1);
+#endif
+}
+
+/*
+ * Replace the uncompressed header pcap_dump_open() wrote with the
+ * start of a compressed stream.
+ */
+static void
+dw_start_compressed(void)
+{
+	if (ftruncate(dw.fd, 0) == -1 || lseek(dw.fd, 0, SEEK_SET) == -1) {
+		dw_fail("can't truncate savefile", errno);
+		return;
+	}
+	dw.offset = 0;
+	dw.zout_count = 0;
+	dw_compress(dw.hdr, dw.hdrlen, DW_Z_CONTINUE);
+}
+
+static void
+dw_do_request(const struct dw_req *req)
+{
+	switch (req->op) {
+
+	case DW_OPEN:
+		dw_finish_output(DW_Z_END);
+		dw.pdd = req->pdd;
+		/* Write the header that pcap_dump_open() buffered. */
+		if (pcap_dump_flush(dw.pdd) == -1)
+			dw_fail("write error on savefile", errno);
+		dw.fd = fileno(pcap_dump_file(dw.pdd));
+		dw.offset = pcap_dump_ftell(dw.pdd);
+		dw.direct_on = 0;
+		if (dw.compress != DUMP_COMPRESS_NONE)
+			dw_start_compressed();
+		break;
+
+	case DW_FLUSH:
+		dw_finish_output(DW_Z_FLUSH);
+		break;
+
+	case DW_CLOSE:
+		if (req->pdd == dw.pdd) {
+			dw_finish_output(DW_Z_END);
+#ifdef O_DIRECT
+			if (dw.direct_on)
+				dw_set_direct(0);
+#endif
+			dw.pdd = NULL;
+			dw.fd = -1;
+		}
+		pcap_dump_close(req->pdd);
+		atomic_fetch_add(&dw.closes_done, 1);
+		break;
+	}
+}
+
+static void *
+dw_thread(void *arg _U_)
+{
+	uint64_t head, tail, limit, n, off;
+	unsigned int rhead, rtail;
+	const struct dw_req *req;
+	int idle = 0;
+	struct timespec ts;
+
+	for (;;) {
+		head = atomic_load_explicit(&dw.head, memory_order_acquire);
+		tail = atomic_load_explicit(&dw.tail, memory_order_relaxed);
+		rhead = atomic_load_explicit(&dw.req_head, memory_order_acquire);
+		rtail = atomic_load_explicit(&dw.req_tail, memory_order_relaxed);
+		req = rhead != rtail ? &dw.reqs[rtail % DW_NREQ] : NULL;
+		limit = req != NULL ? req->pos : head;
+
+		/*
+		 * Write what's queued if there's a lot of it, if a request
+		 * is waiting for it to be written, if the capture thread is
+		 * waiting for room, or if nothing more has come for a while.
+		 */
+		n = limit - tail;
+		if (n != 0 && (n >= DW_CHUNK || req != NULL || idle ||
+		    atomic_load(&dw.producer_waiting) ||
+		    atomic_load(&dw.stop))) {
+			off = tail & (dw.size - 1);
+			if (n > dw.size - off)
+				n = dw.size - off;
+			dw_output(dw.ring + off, (size_t)n);
+			atomic_store_explicit(&dw.tail, tail + n,
+			    memory_order_release);
+			dw_wake_producer();
+			continue;
+		}
+		if (req != NULL) {
+			dw_do_request(req);
+			atomic_store_explicit(&dw.req_tail, rtail + 1,
+			    memory_order_release);
+			dw_wake_producer();
+			continue;
+		}
+		if (atomic_load(&dw.stop))
+			break;
+
+		pthread_mutex_lock(&dw.lock);
+		atomic_store(&dw.writer_idle, 1);
+		idle = 0;
+		if (atomic_load(&dw.head) - tail < DW_CHUNK &&
+		    atomic_load(&dw.req_head) == rtail &&
+		    !atomic_load(&dw.stop)) {
+			dw_deadline(&ts, DW_IDLE_MSEC);
+			if (pthread_cond_timedwait(&dw.wake, &dw.lock, &ts) ==
+			    ETIMEDOUT)
+				idle = 1;
+		}
+		atomic_store(&dw.writer_idle, 0);
+		pthread_mutex_unlock(&dw.lock);
+	}
+	dw_finish_output(DW_Z_END);
+	return (NULL);
+}
+
+/*
+ * Have savefiles compressed, at the given level and, with zstd, using
+ * the given number of extra threads; the savefile header is taken
+ * from a dumper for pd.  Must be called before dump_writer_start().
+ * Returns -1, with a message in errbuf, on failure.
+ */
+int
+dump_writer_set_compression(enum dump_compression method, int level,
+    int threads, pcap_t *pd, char *errbuf, size_t errbuf_size)
+{
+	pcap_dumper_t *pdd;
+	FILE *fp;
+	long len;
+
+	/* Make the header the way pcap_dump_open() does. */
+	fp = tmpfile();
+	if (fp == NULL) {
+		snprintf(errbuf, errbuf_size,
+		    "can't create temporary file: %s", strerror(errno));
+		return (-1);
+	}
+	pdd = pcap_dump_fopen(pd, fp);
+	if (pdd == NULL) {
+		snprintf(errbuf, errbuf_size, "%s", pcap_geterr(pd));
+		fclose(fp);
+		return (-1);
+	}
+	len = pcap_dump_ftell(pdd);
+	if (pcap_dump_flush(pdd) == -1 || len <= 0 || len > DW_HDR_MAX ||
+	    fseek(fp, 0, SEEK_SET) == -1 ||
+	    fread(dw.hdr, 1, (size_t)len, fp) != (size_t)len) {
+		snprintf(errbuf, errbuf_size, "can't make savefile header");
+		pcap_dump_close(pdd);
+		return (-1);
+	}
+	pcap_dump_close(pdd);
+	dw.hdrlen = (size_t)len;
+
+	dw.zbuf = (u_char *)malloc(DW_ZBUF);
+	if (dw.zbuf == NULL) {
+		snprintf(errbuf, errbuf_size, "can't allocate compression buffer");
+		return (-1);
+	}
+	switch (method) {
+
+#ifdef USE_DUMP_WRITER_GZIP
+	case DUMP_COMPRESS_GZIP:
+		/* 16 more window bits means a gzip header and trailer. */
+		if (deflateInit2(&dw.zs, level, Z_DEFLATED, 15 + 16, 8,
+		    Z_DEFAULT_STRATEGY) != Z_OK) {
+			snprintf(errbuf, errbuf_size, "can't initialize zlib: %s",
+			    dw.zs.msg != NULL ? dw.zs.msg : "unknown error");
+			return (-1);
+		}
+		(void)threads;
+		break;
+#endif
+
+#ifdef USE_DUMP_WRITER_ZSTD
+	case DUMP_COMPRESS_ZSTD: {
+		size_t r;
+
+		dw.zcx = ZSTD_createCCtx();
+		if (dw.zcx == NULL) {
+			snprintf(errbuf, errbuf_size,
+			    "can't allocate zstd context");
+			return (-1);
+		}
+		r = ZSTD_CCtx_setParameter(dw.zcx, ZSTD_c_compressionLevel,
+		    level);
+		if (!ZSTD_isError(r) && threads != 0)
+			r = ZSTD_CCtx_setParameter(dw.zcx, ZSTD_c_nbWorkers,
+			    threads);
+		if (ZSTD_isError(r)) {
+			snprintf(errbuf, errbuf_size, "can't set up zstd: %s",
+			    ZSTD_getErrorName(r));
+			return (-1);
+		}
+		break;
+	}
+#endif
+
+	default:
+		snprintf(errbuf, errbuf_size,
+		    "compression method not supported");
+		return (-1);
+	}
+	dw.compress = method;
+	return (0);
+}
+
+/*
+ * Start the writer thread, with a ring of at least bufsize bytes.
+ * Returns -1, with a message in errbuf, on failure.
+ */
+int
+dump_writer_start(size_t bufsize, int direct, char *errbuf, size_t errbuf_size)
+{
+	size_t size;
+	sigset_t all, old;
+	int err;
+
+#ifndef O_DIRECT
+	if (direct) {
+		snprintf(errbuf, errbuf_size,
+		    "direct I/O isn't supported on this platform");
+		return (-1);
+	}
+#endif
+	for (size = 2*DW_CHUNK; size < bufsize; size *= 2)
+		;
+	dw.ring = (u_char *)malloc(size);
+	if (dw.ring == NULL) {
+		snprintf(errbuf, errbuf_size, "can't allocate %zu-byte write buffer",
+		    size);
+		return (-1);
+	}
+	dw.size = size;
+	if (direct) {
+		err = posix_memalign((void **)&dw.dbuf, DW_ALIGN, DW_DIRECT_BUF);
+		if (err != 0) {
+			snprintf(errbuf, errbuf_size,
+			    "can't allocate direct I/O buffer: %s", strerror(err));
+			return (-1);
+		}
+		dw.direct = 1;
+	}
+	/* Leave the signals to the capture thread. */
+	sigfillset(&all);
+	pthread_sigmask(SIG_SETMASK, &all, &old);
+	err = pthread_create(&dw.thread, NULL, dw_thread, NULL);
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+	if (err != 0) {
+		snprintf(errbuf, errbuf_size, "can't create writer thread: %s",
+		    strerror(err));
+		return (-1);
+	}
+	dw.started = 1;
+	return (0);
+}
+
+/* Queue a request, waiting for room in the request ring if need be. */
+static void
+dw_request(enum dw_op op, pcap_dumper_t *pdd)
+{
+	unsigned int rhead = atomic_load_explicit(&dw.req_head,
+	    memory_order_relaxed);
+	struct dw_req *req;
+
+	while (rhead - atomic_load_explicit(&dw.req_tail,
+	    memory_order_acquire) == DW_NREQ)
+		dw_wait_for_writer();
+	req = &dw.reqs[rhead % DW_NREQ];
+	req->op = op;
+	req->pos = atomic_load_explicit(&dw.head, memory_order_relaxed);
+	req->pdd = pdd;
+	atomic_store_explicit(&dw.req_head, rhead + 1, memory_order_release);
+	dw_wake_writer();
+}
+
+/*
+ * Hand a savefile just opened with pcap_dump_open() or pcap_dump_fopen()
+ * to the writer thread.
+ */
+int
+dump_writer_open(pcap_dumper_t *pdd, char *errbuf, size_t errbuf_size)
+{
+#ifdef O_DIRECT
+	int fd, flags;
+
+	if (dw.direct) {
+		/* Make sure O_DIRECT can be used on the file. */
+		fd = fileno(pcap_dump_file(pdd));
+		flags = fcntl(fd, F_GETFL);
+		if (flags == -1 || fcntl(fd, F_SETFL, flags | O_DIRECT) == -1 ||
+		    fcntl(fd, F_SETFL, flags) == -1) {
+			snprintf(errbuf, errbuf_size,
+			    "can't use direct I/O on the savefile: %s",
+			    strerror(errno));
+			return (-1);
+		}
+	}
+#else
+	(void)errbuf;
+	(void)errbuf_size;
+#endif
+	dw.file_base = pcap_dump_ftell(pdd);
+	dw.file_start = atomic_load_explicit(&dw.head, memory_order_relaxed);
+	/* The header pcap_dump_open() wrote counts as queued data. */
+	dw.zsync_pos = dw.file_start - (uint64_t)dw.file_base;
+	dw.zsync_size = 0;
+	dw_request(DW_OPEN, pdd);
+	return (0);
+}
+
+/* Copy len bytes into the ring at position pos. */
+static void
+dw_put(uint64_t pos, const void *p, size_t len)
+{
+	size_t off = pos & (dw.size - 1);
+	size_t n = dw.size - off;
+
+	if (n > len)
+		n = len;
+	memcpy(dw.ring + off, p, n);
+	if (n < len)
+		memcpy(dw.ring, (const u_char *)p + n, len - n);
+}
+
+/*
+ * Queue a packet for the current savefile.  Returns -1 if the writer
+ * thread has failed; dump_writer_geterr() says why.
+ */
+int
+dump_writer_dump(const struct pcap_pkthdr *h, const u_char *sp)
+{
+	struct dw_pkthdr hdr;
+	uint64_t head = atomic_load_explicit(&dw.head, memory_order_relaxed);
+	uint64_t tail, queued, start = 0;
+	size_t len = sizeof(hdr) + h->caplen;
+
+	if (atomic_load_explicit(&dw.failed, memory_order_relaxed))
+		return (-1);
+	for (;;) {
+		tail = atomic_load_explicit(&dw.tail, memory_order_acquire);
+		if (dw.size - (head - tail) >= len)
+			break;
+		if (start == 0) {
+			start = dw_usec();
+			dw.stats.stalls++;
+		}
+		dw_wait_for_writer();
+		if (atomic_load(&dw.failed))
+			return (-1);
+	}
+	if (start != 0)
+		dw.stats.stall_usec += dw_usec() - start;
+
+	hdr.tv_sec = (uint32_t)h->ts.tv_sec;
+	hdr.tv_usec = (uint32_t)h->ts.tv_usec;
+	hdr.caplen = h->caplen;
+	hdr.len = h->len;
+	dw_put(head, &hdr, sizeof(hdr));
+	dw_put(head + sizeof(hdr), sp, h->caplen);
+	atomic_store_explicit(&dw.head, head + len, memory_order_release);
+
+	queued = head + len - tail;
+	if (queued > dw.stats.max_queued)
+		dw.stats.max_queued = queued;
+	if (queued >= DW_CHUNK)
+		dw_wake_writer();
+	return (0);
+}
+
+/*
+ * The most that n bytes of data can compress to, allowing for a
+ * flush, and the header and trailer of the compressed stream.
+ */
+static uint64_t
+dw_zbound(uint64_t n)
+{
+	return (n + (n >> 8) + 64);
+}
+
+/*
+ * The size the current savefile will have once everything queued so
+ * far is written.  If it's compressed, that's only known once the
+ * writer has compressed everything; until then, this is a bound on the
+ * size, and only when that bound is more than limit does it wait for
+ * the writer to catch up and flush the compressor, to get the exact
+ * size.  So the result is more than limit only if the size is.
+ */
+int64_t
+dump_writer_ftell(int64_t limit)
+{
+	uint64_t head = atomic_load_explicit(&dw.head, memory_order_relaxed);
+	unsigned int rhead;
+	int64_t size;
+
+	if (dw.compress == DUMP_COMPRESS_NONE)
+		return ((int64_t)(dw.file_base + (head - dw.file_start)));
+	if (head == dw.zsync_pos)
+		return (dw.zsync_size);
+	size = dw.zsync_size + (int64_t)dw_zbound(head - dw.zsync_pos);
+	if (size <= limit)
+		return (size);
+
+	/* Wait until the flush has been done. */
+	rhead = atomic_load_explicit(&dw.req_head, memory_order_relaxed) + 1;
+	dw_request(DW_FLUSH, NULL);
+	while (atomic_load_explicit(&dw.req_tail, memory_order_acquire) !=
+	    rhead && !atomic_load(&dw.failed))
+		dw_wait_for_writer();
+	dw.zsync_pos = head;
+	dw.zsync_size = (int64_t)atomic_load_explicit(&dw.zout,
+	    memory_order_relaxed);
+	return (dw.zsync_size);
+}
+
+void
+dump_writer_flush(void)
+{
+	dw_request(DW_FLUSH, NULL);
+}
+
+/*
+ * Have the writer thread close a savefile once everything queued for
+ * it has been written.
+ */
+void
+dump_writer_close(pcap_dumper_t *pdd)
+{
+	dw.closes_issued++;
+	dw_request(DW_CLOSE, pdd);
+}
+
+/* Wait until at most "pending" savefiles are still waiting to be closed. */
+void
+dump_writer_wait(u_int pending)
+{
+	while (dw.closes_issued - atomic_load(&dw.closes_done) > pending &&
+	    !atomic_load(&dw.failed))
+		dw_wait_for_writer();
+}
+
+/* Write out everything queued and stop the writer thread. */
+void
+dump_writer_stop(void)
+{
+	if (!dw.started)
+		return;
+	dw.started = 0;
+	atomic_store(&dw.stop, 1);
+	pthread_mutex_lock(&dw.lock);
+	pthread_cond_signal(&dw.wake);
+	pthread_mutex_unlock(&dw.lock);
+	pthread_join(dw.thread, NULL);
+}
+
+const char *
+dump_writer_geterr(void)
+{
+	return (dw.errbuf);
+}
+
+void
+dump_writer_get_stats(struct dump_writer_stats *stats)
+{
+	*stats = dw.stats;
+	stats->queued = atomic_load(&dw.head) - atomic_load(&dw.tail);
+}
+#endif /* USE_DUMP_WRITER */
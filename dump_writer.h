@@ -0,0 +1,68 @@
+/*
+ * Copyright (c) 2026 The TCPDUMP project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that: (1) source code
+ * distributions retain the above copyright notice and this paragraph
+ * in its entirety, and (2) distributions including binary code include
+ * the above copyright notice and this paragraph in its entirety in
+ * the documentation or other materials provided with the distribution.
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND
+ * WITHOUT ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, WITHOUT
+ * LIMITATION, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE.
+ */
+
+#ifndef dump_writer_h
+#define dump_writer_h
+
+/*
+ * Writing savefiles from a separate thread (--write-buffer), so that a
+ * slow disk doesn't stall the capture loop.
+ */
+#if defined(HAVE_PTHREADS) && defined(HAVE_STDATOMIC_H)
+#define USE_DUMP_WRITER
+
+struct dump_writer_stats {
+	uint64_t queued;	/* bytes waiting to be written */
+	uint64_t max_queued;	/* largest value of "queued" seen */
+	uint64_t stalls;	/* times the buffer was full */
+	uint64_t stall_usec;	/* time spent waiting for room in the buffer */
+};
+
+/*
+ * The writer thread can also compress savefiles as it writes them,
+ * with zlib (gzip) and/or libzstd.
+ */
+#if defined(HAVE_LIBZ) && defined(HAVE_ZLIB_H)
+#define USE_DUMP_WRITER_GZIP
+#endif
+#if defined(HAVE_LIBZSTD) && defined(HAVE_ZSTD_H)
+#define USE_DUMP_WRITER_ZSTD
+#endif
+#if defined(USE_DUMP_WRITER_GZIP) || defined(USE_DUMP_WRITER_ZSTD)
+#define USE_DUMP_WRITER_COMPRESSION
+#endif
+
+enum dump_compression {
+	DUMP_COMPRESS_NONE,
+	DUMP_COMPRESS_GZIP,
+	DUMP_COMPRESS_ZSTD
+};
+
+extern int dump_writer_set_compression(enum dump_compression, int, int,
+    pcap_t *, char *, size_t);
+extern int dump_writer_start(size_t, int, char *, size_t);
+extern int dump_writer_open(pcap_dumper_t *, char *, size_t);
+extern int dump_writer_dump(const struct pcap_pkthdr *, const u_char *);
+extern int64_t dump_writer_ftell(int64_t);
+extern void dump_writer_flush(void);
+extern void dump_writer_close(pcap_dumper_t *);
+extern void dump_writer_wait(u_int);
+extern void dump_writer_stop(void);
+extern const char *dump_writer_geterr(void);
+extern void dump_writer_get_stats(struct dump_writer_stats *);
+#endif /* HAVE_PTHREADS && HAVE_STDATOMIC_H */
+
+#endif /* dump_writer_h */
@@ -939,4 +939,27 @@ get_cpy_bytes(netdissect_options *ndo, u_char *dst, const u_char *p, size_t len)
 
 #define GET_CPY_BYTES(dst, p, len) get_cpy_bytes(ndo, (u_char *)(dst), (const u_char *)(p), len)
 
+/*
+ * Validated views.
+ *
+ * A printer that fetches several fields of a fixed-size header can
+ * check once that the whole header was captured and keep the result:
+ *
+ *	const int hdr_ok = ND_TTEST_SIZE(hdr);
+ *
+ * and fetch the fields with the VIEW_ macros, passing that result.  If
+ * it's true, the field is fetched without another bounds check; if it
+ * isn't, the VIEW_ macro is the same as the GET_ macro, so a truncated
+ * header is printed, and reported, exactly as it would otherwise be.
+ *
+ * The result stays good only while the end of the captured data isn't
+ * moved back before the end of the header, e.g. by nd_push_snaplen().
+ */
+#define VIEW_U_1(ok, p) \
+	((ok) ? EXTRACT_U_1((const u_char *)(p)) : GET_U_1(p))
+#define VIEW_BE_U_2(ok, p) \
+	((ok) ? EXTRACT_BE_U_2((const u_char *)(p)) : GET_BE_U_2(p))
+#define VIEW_BE_U_4(ok, p) \
+	((ok) ? EXTRACT_BE_U_4((const u_char *)(p)) : GET_BE_U_4(p))
+
 #endif /* EXTRACT_H */
@@ -0,0 +1,493 @@
+/*
+ * Copyright (c) 2026 The TCPDUMP project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that: (1) source code
+ * distributions retain the above copyright notice and this paragraph
+ * in its entirety, and (2) distributions including binary code include
+ * the above copyright notice and this paragraph in its entirety in
+ * the documentation or other materials provided with the distribution.
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND
+ * WITHOUT ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, WITHOUT
+ * LIMITATION, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE.
+ */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "netdissect-stdinc.h"
+
+#include "netdissect.h"
+#include "netdissect-hash.h"
+#include "flowstate.h"
+
+/*
+ * The flows of all types are in one open-addressing hash table, with
+ * linear probing; it's at most half full.  A slot keeps the hash as
+ * well as the pointer, so that probing past other flows doesn't touch
+ * them.
+ *
+ * Each type has a timer wheel, with one bucket per second, and each
+ * flow is in a bucket no later than the second in which it expires.
+ * The wheels are turned by the packet time stamps, and a flow whose
+ * time is up is dropped when its bucket comes round.  Time stamps that
+ * go backwards don't turn the wheels back, and timeouts are counted
+ * from the time the wheels have got to.
+ *
+ * Most packets push a flow's time back; rather than moving the flow to
+ * another bucket for each of them, that's done when its bucket comes
+ * round.  So the wheel order isn't the order in which flows were last
+ * used, and each type also keeps its flows on a list, most recently
+ * used first; when a flow has to be dropped to make room, it's the one
+ * at the end of that list.
+ */
+#define ND_FLOW_INITIAL_SIZE	1024	/* slots; a power of 2 */
+#define ND_FLOW_WHEEL_SIZE	1024	/* seconds; a power of 2 */
+#define ND_FLOW_WHEEL_MASK	(ND_FLOW_WHEEL_SIZE - 1)
+
+struct nd_flow {
+	struct nd_flow_key key;
+	struct nd_flow	*timer_prev;
+	struct nd_flow	*timer_next;
+	struct nd_flow	*lru_prev;	/* more recently used */
+	struct nd_flow	*lru_next;	/* less recently used */
+	uint64_t	used;		/* when last used, in lookups */
+	time_t		expires;
+	time_t		bucket;		/* time of the bucket it's in */
+	size_t		hash;
+	size_t		size;		/* allocated, including this header */
+	uint8_t		type;
+	/* followed by the type's data, at ND_FLOW_HDR */
+};
+
+#define ND_FLOW_HDR	((sizeof(struct nd_flow) + 15) & ~(size_t)15)
+
+struct nd_flow_slot {
+	size_t		hash;
+	struct nd_flow	*flow;		/* NULL = empty */
+};
+
+struct nd_flow_type_state {
+	struct nd_flow	*wheel[ND_FLOW_WHEEL_SIZE];
+	struct nd_flow	*lru_head;	/* most recently used */
+	struct nd_flow	*lru_tail;	/* least recently used */
+	size_t		count;
+	size_t		max_count;
+	uint64_t	created;
+	uint64_t	expired;
+	uint64_t	evicted_full;
+	uint64_t	evicted_memory;
+};
+
+struct nd_flow_state {
+	struct nd_flow_slot *slots;
+	size_t		size;		/* number of slots, a power of 2 */
+	size_t		count;
+	size_t		bytes;		/* flows and slots */
+	size_t		max_bytes;
+	uint64_t	lookups;
+	uint64_t	probes;
+	time_t		wheel_time;	/* last second the wheels turned to */
+	struct nd_flow_type_state types[ND_FLOW_TYPES];
+};
+
+static const char *nd_flow_type_names[ND_FLOW_TYPES] = {
+	"TCP conversations",
+	"RPC calls"
+};
+
+static struct nd_flow_state *
+nd_flow_get_state(netdissect_options *ndo)
+{
+	if (ndo->ndo_flow_state == NULL) {
+		ndo->ndo_flow_state = (struct nd_flow_state *)
+			calloc(1, sizeof(*ndo->ndo_flow_state));
+		if (ndo->ndo_flow_state == NULL)
+			(*ndo->ndo_error)(ndo, S_ERR_ND_MEM_ALLOC,
+					  "%s: calloc", __func__);
+		ndo->ndo_flow_state->wheel_time = ndo->ndo_packet_ts.tv_sec;
+	}
+	return ndo->ndo_flow_state;
+}
+
+static size_t
+nd_flow_hash(enum nd_flow_type type, const struct nd_flow_key *key)
+{
+	uint64_t w[sizeof(*key) / 8];
+
+	memcpy(w, key, sizeof(w));
+	return ((size_t)nd_hash64(type, w, sizeof(w) / sizeof(w[0])));
+}
+
+static struct nd_flow *
+nd_flow_from_data(void *data)
+{
+	return (struct nd_flow *)((u_char *)data - ND_FLOW_HDR);
+}
+
+static void *
+nd_flow_data(struct nd_flow *f)
+{
+	return (u_char *)f + ND_FLOW_HDR;
+}
+
+/*
+ * Find the slot holding the flow, or the empty slot where it would go.
+ * The table must have been allocated.
+ */
+static struct nd_flow_slot *
+nd_flow_probe(struct nd_flow_state *fs, enum nd_flow_type type,
+	      const struct nd_flow_key *key, size_t hash)
+{
+	size_t mask = fs->size - 1;
+	size_t i = hash & mask;
+	struct nd_flow_slot *s;
+
+	fs->lookups++;
+	for (;;) {
+		fs->probes++;
+		s = &fs->slots[i];
+		if (s->flow == NULL ||
+		    (s->hash == hash && s->flow->type == type &&
+		     memcmp(&s->flow->key, key, sizeof(*key)) == 0))
+			return (s);
+		i = (i + 1) & mask;
+	}
+}
+
+static void
+nd_flow_grow(netdissect_options *ndo, struct nd_flow_state *fs)
+{
+	struct nd_flow_slot *old = fs->slots;
+	size_t oldsize = fs->size;
+	size_t i, j, mask;
+
+	fs->size = oldsize != 0 ? oldsize * 2 : ND_FLOW_INITIAL_SIZE;
+	fs->slots = (struct nd_flow_slot *)
+		calloc(fs->size, sizeof(*fs->slots));
+	if (fs->slots == NULL)
+		(*ndo->ndo_error)(ndo, S_ERR_ND_MEM_ALLOC,
+				  "%s: calloc", __func__);
+	mask = fs->size - 1;
+	for (i = 0; i < oldsize; i++) {
+		if (old[i].flow == NULL)
+			continue;
+		j = old[i].hash & mask;
+		while (fs->slots[j].flow != NULL)
+			j = (j + 1) & mask;
+		fs->slots[j] = old[i];
+	}
+	free(old);
+	fs->bytes += (fs->size - oldsize) * sizeof(*fs->slots);
+	if (fs->bytes > fs->max_bytes)
+		fs->max_bytes = fs->bytes;
+}
+
+static void
+nd_flow_lru_unlink(struct nd_flow_state *fs, struct nd_flow *f)
+{
+	struct nd_flow_type_state *ts = &fs->types[f->type];
+
+	if (f->lru_prev != NULL)
+		f->lru_prev->lru_next = f->lru_next;
+	else
+		ts->lru_head = f->lru_next;
+	if (f->lru_next != NULL)
+		f->lru_next->lru_prev = f->lru_prev;
+	else
+		ts->lru_tail = f->lru_prev;
+}
+
+/* Put the flow at the front of its type's list, as the last one used. */
+static void
+nd_flow_lru_link(struct nd_flow_state *fs, struct nd_flow *f)
+{
+	struct nd_flow_type_state *ts = &fs->types[f->type];
+
+	f->used = fs->lookups;
+	f->lru_prev = NULL;
+	f->lru_next = ts->lru_head;
+	if (ts->lru_head != NULL)
+		ts->lru_head->lru_prev = f;
+	else
+		ts->lru_tail = f;
+	ts->lru_head = f;
+}
+
+static void
+nd_flow_touch(struct nd_flow_state *fs, struct nd_flow *f)
+{
+	if (fs->types[f->type].lru_head != f) {
+		nd_flow_lru_unlink(fs, f);
+		nd_flow_lru_link(fs, f);
+	} else
+		f->used = fs->lookups;
+}
+
+static void
+nd_flow_timer_unlink(struct nd_flow_state *fs, struct nd_flow *f)
+{
+	if (f->timer_prev != NULL)
+		f->timer_prev->timer_next = f->timer_next;
+	else
+		fs->types[f->type].wheel[f->bucket & ND_FLOW_WHEEL_MASK] =
+		    f->timer_next;
+	if (f->timer_next != NULL)
+		f->timer_next->timer_prev = f->timer_prev;
+}
+
+/* Put the flow in the bucket for the second in which it expires. */
+static void
+nd_flow_timer_link(struct nd_flow_state *fs, struct nd_flow *f)
+{
+	struct nd_flow **bucket =
+	    &fs->types[f->type].wheel[f->expires & ND_FLOW_WHEEL_MASK];
+
+	f->bucket = f->expires;
+	f->timer_prev = NULL;
+	f->timer_next = *bucket;
+	if (*bucket != NULL)
+		(*bucket)->timer_prev = f;
+	*bucket = f;
+}
+
+/*
+ * Take the flow out of the table, moving later entries of the same
+ * probe sequence back so that no lookup stops short at the hole, and
+ * off its timer wheel, and free it.
+ */
+static void
+nd_flow_delete(struct nd_flow_state *fs, struct nd_flow *f)
+{
+	size_t mask = fs->size - 1;
+	size_t i = f->hash & mask;
+	size_t j, home;
+
+	while (fs->slots[i].flow != f)
+		i = (i + 1) & mask;
+	j = i;
+	for (;;) {
+		j = (j + 1) & mask;
+		if (fs->slots[j].flow == NULL)
+			break;
+		home = fs->slots[j].hash & mask;
+		/* Can the entry in slot j move to slot i? */
+		if (i <= j ? (home <= i || home > j) : (home <= i && home > j)) {
+			fs->slots[i] = fs->slots[j];
+			i = j;
+		}
+	}
+	fs->slots[i].flow = NULL;
+
+	nd_flow_timer_unlink(fs, f);
+	nd_flow_lru_unlink(fs, f);
+	fs->types[f->type].count--;
+	fs->count--;
+	fs->bytes -= f->size;
+	free(f);
+}
+
+/*
+ * Turn the wheels to the time of the packet being printed, dropping
+ * the flows whose time is up and moving those whose time was pushed
+ * back to the bucket they now expire in.
+ */
+static void
+nd_flow_expire(netdissect_options *ndo, struct nd_flow_state *fs)
+{
+	time_t now = ndo->ndo_packet_ts.tv_sec;
+	struct nd_flow_type_state *ts;
+	struct nd_flow *f, *next;
+	time_t t, steps;
+	u_int type;
+
+	if (now <= fs->wheel_time)
+		return;
+	steps = now - fs->wheel_time;
+	if (steps > ND_FLOW_WHEEL_SIZE)
+		steps = ND_FLOW_WHEEL_SIZE;
+	for (type = 0; type < ND_FLOW_TYPES; type++) {
+		ts = &fs->types[type];
+		for (t = now - steps + 1; t <= now && ts->count != 0; t++) {
+			for (f = ts->wheel[t & ND_FLOW_WHEEL_MASK]; f != NULL;
+			     f = next) {
+				next = f->timer_next;
+				if (f->expires <= now) {
+					ts->expired++;
+					nd_flow_delete(fs, f);
+				} else if (f->bucket <= now) {
+					nd_flow_timer_unlink(fs, f);
+					nd_flow_timer_link(fs, f);
+				}
+				/* else it's in for a later turn of the wheel */
+			}
+		}
+	}
+	fs->wheel_time = now;
+}
+
+/*
+ * Return the data for the flow, or NULL if there isn't one.
+ */
+void *
+nd_flow_find(netdissect_options *ndo, enum nd_flow_type type,
+	     const struct nd_flow_key *key)
+{
+	struct nd_flow_state *fs = nd_flow_get_state(ndo);
+	struct nd_flow *f;
+
+	if (fs->size == 0)
+		return (NULL);
+	nd_flow_expire(ndo, fs);
+	f = nd_flow_probe(fs, type, key, nd_flow_hash(type, key))->flow;
+	if (f == NULL)
+		return (NULL);
+	nd_flow_touch(fs, f);
+	return (nd_flow_data(f));
+}
+
+/*
+ * The per-type limit on the number of flows, if any.
+ */
+static u_int
+nd_flow_type_limit(const netdissect_options *ndo, enum nd_flow_type type)
+{
+	switch (type) {
+	case ND_FLOW_TCP_SEQ:
+		return (ndo->ndo_tcp_flow_table_size);
+	case ND_FLOW_RPC_CALL:
+		return (ndo->ndo_rpc_xid_table_size);
+	default:
+		return (0);
+	}
+}
+
+/*
+ * Drop the flow, of any type, that was used least recently.
+ */
+static void
+nd_flow_evict_any(struct nd_flow_state *fs)
+{
+	struct nd_flow *f, *victim = NULL;
+	u_int type;
+
+	for (type = 0; type < ND_FLOW_TYPES; type++) {
+		f = fs->types[type].lru_tail;
+		if (f != NULL && (victim == NULL || f->used < victim->used))
+			victim = f;
+	}
+	fs->types[victim->type].evicted_memory++;
+	nd_flow_delete(fs, victim);
+}
+
+/*
+ * Add a flow, which mustn't already be there, with size bytes of
+ * zeroed data, that expires after timeout seconds unless
+ * nd_flow_set_timeout() is called; return its data.
+ */
+void *
+nd_flow_create(netdissect_options *ndo, enum nd_flow_type type,
+	       const struct nd_flow_key *key, size_t size, u_int timeout)
+{
+	struct nd_flow_state *fs = nd_flow_get_state(ndo);
+	struct nd_flow_type_state *ts = &fs->types[type];
+	struct nd_flow_slot *slot;
+	struct nd_flow *f;
+	size_t limit = (size_t)ndo->ndo_flow_state_memory * 1024;
+	u_int max_count = nd_flow_type_limit(ndo, type);
+
+	nd_flow_expire(ndo, fs);
+	size += ND_FLOW_HDR;
+	if (max_count != 0 && ts->count >= max_count) {
+		ts->evicted_full++;
+		nd_flow_delete(fs, ts->lru_tail);
+	}
+	while (limit != 0 && fs->count != 0 && fs->bytes + size > limit)
+		nd_flow_evict_any(fs);
+	if ((fs->count + 1) * 2 > fs->size)
+		nd_flow_grow(ndo, fs);
+
+	f = (struct nd_flow *)calloc(1, size);
+	if (f == NULL)
+		(*ndo->ndo_error)(ndo, S_ERR_ND_MEM_ALLOC,
+				  "%s: calloc", __func__);
+	f->key = *key;
+	f->hash = nd_flow_hash(type, key);
+	f->type = (uint8_t)type;
+	f->size = size;
+	f->expires = fs->wheel_time + timeout;
+	slot = nd_flow_probe(fs, type, key, f->hash);
+	slot->hash = f->hash;
+	slot->flow = f;
+	nd_flow_timer_link(fs, f);
+	nd_flow_lru_link(fs, f);
+
+	fs->count++;
+	fs->bytes += size;
+	if (fs->bytes > fs->max_bytes)
+		fs->max_bytes = fs->bytes;
+	ts->count++;
+	if (ts->count > ts->max_count)
+		ts->max_count = ts->count;
+	ts->created++;
+	return (nd_flow_data(f));
+}
+
+/*
+ * Make the flow expire timeout seconds from now, and count it as just
+ * used.  A later time is picked up when the flow's bucket comes round;
+ * an earlier one needs the flow moved now.
+ */
+void
+nd_flow_set_timeout(netdissect_options *ndo, void *data, u_int timeout)
+{
+	struct nd_flow_state *fs = ndo->ndo_flow_state;
+	struct nd_flow *f = nd_flow_from_data(data);
+
+	nd_flow_touch(fs, f);
+	f->expires = fs->wheel_time + timeout;
+	if (f->expires < f->bucket) {
+		nd_flow_timer_unlink(fs, f);
+		nd_flow_timer_link(fs, f);
+	}
+}
+
+void
+nd_flow_remove(netdissect_options *ndo, void *data)
+{
+	nd_flow_delete(ndo->ndo_flow_state, nd_flow_from_data(data));
+}
+
+/*
+ * Report the flow state statistics, if it has been used.
+ */
+void
+nd_flow_print_stats(netdissect_options *ndo, FILE *f)
+{
+	const struct nd_flow_state *fs = ndo->ndo_flow_state;
+	const struct nd_flow_type_state *ts;
+	u_int i;
+
+	if (fs == NULL || fs->lookups == 0)
+		return;
+	fprintf(f, "Flow state: %zu flows in %zu slots, %zu bytes (at most %zu),"
+		" %.2f probes per lookup\n",
+		fs->count, fs->size, fs->bytes, fs->max_bytes,
+		(double)fs->probes / (double)fs->lookups);
+	for (i = 0; i < ND_FLOW_TYPES; i++) {
+		ts = &fs->types[i];
+		if (ts->created == 0)
+			continue;
+		fprintf(f, "  %s: %zu (at most %zu), %" PRIu64 " new, %"
+			PRIu64 " expired, %" PRIu64 " dropped when full, %"
+			PRIu64 " dropped for memory\n",
+			nd_flow_type_names[i], ts->count, ts->max_count,
+			ts->created, ts->expired, ts->evicted_full,
+			ts->evicted_memory);
+	}
+}
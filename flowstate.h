@@ -0,0 +1,63 @@
+/*
+ * Copyright (c) 2026 The TCPDUMP project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that: (1) source code
+ * distributions retain the above copyright notice and this paragraph
+ * in its entirety, and (2) distributions including binary code include
+ * the above copyright notice and this paragraph in its entirety in
+ * the documentation or other materials provided with the distribution.
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND
+ * WITHOUT ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, WITHOUT
+ * LIMITATION, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE.
+ */
+
+#ifndef netdissect_flowstate_h
+#define netdissect_flowstate_h
+
+/*
+ * State that printers keep from one packet to the next, about a
+ * conversation or a transaction in one, hung off the netdissect_options
+ * structure.
+ *
+ * Each kind of state has its own type, with a fixed-size block of data
+ * per flow, a time after which a flow not seen again is dropped, and
+ * optionally a limit on the number of flows.  A limit on the memory
+ * used by all of them (--flow-state-memory) drops the flows of any type
+ * that were used least recently.  Time is that of the packet time stamps.
+ */
+
+#include "netdissect.h"
+
+enum nd_flow_type {
+	ND_FLOW_TCP_SEQ,	/* print-tcp.c: initial sequence numbers */
+	ND_FLOW_RPC_CALL,	/* xidmap.c: outstanding RPC calls */
+	ND_FLOW_TYPES
+};
+
+/*
+ * Addresses, ports and protocol, in whichever order the printer
+ * chooses, and an ID for anything else that identifies the flow, such
+ * as a transaction ID.  Zero it before filling it in.
+ */
+struct nd_flow_key {
+	nd_ipv6		src;		/* an IPv4 address uses 4 bytes */
+	nd_ipv6		dst;
+	uint16_t	sport;		/* host order */
+	uint16_t	dport;		/* host order */
+	uint8_t		ipver;		/* 4 or 6 */
+	uint8_t		proto;		/* IPPROTO_ value */
+	uint8_t		pad[2];
+	uint32_t	id[4];		/* type-specific */
+};
+
+extern void *nd_flow_find(netdissect_options *, enum nd_flow_type,
+			  const struct nd_flow_key *);
+extern void *nd_flow_create(netdissect_options *, enum nd_flow_type,
+			    const struct nd_flow_key *, size_t, u_int);
+extern void nd_flow_set_timeout(netdissect_options *, void *, u_int);
+extern void nd_flow_remove(netdissect_options *, void *);
+
+#endif /* netdissect_flowstate_h */
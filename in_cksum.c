@@ -39,109 +39,223 @@
 
 #include "netdissect-stdinc.h"
 
+#include <string.h>
+
 #include "netdissect.h"
+#include "compiler-tests.h"
 
 /*
- * Checksum routine for Internet Protocol family headers (Portable Version).
+ * Checksum routine for Internet Protocol family headers.
+ *
+ * This routine is very heavily used when printing with -v, so the
+ * summing of each piece is done by a "kernel" that adds up the data
+ * in large native-byte-order words into a 64-bit accumulator, with
+ * the carries folded back in only at the end.  As RFC 1071 notes, the
+ * ones-complement sum is independent of the size of the words being
+ * summed, as long as the end-around carries are done, and of the byte
+ * order, as long as the result is used in that same byte order.
+ *
+ * A piece that starts at an odd offset in the data being checksummed
+ * has its bytes paired up the other way around from how they would
+ * be paired if it were summed on its own, so its sum is byte-swapped
+ * before being added in; this is also described in RFC 1071.
  *
- * This routine is very heavily used in the network
- * code and should be modified for each CPU to be as fast as possible.
+ * On x86 processors that support AVX2, in_cksum_init() selects a
+ * kernel that sums 32 bytes at a time.
+ */
+
+/*
+ * Sum of the bytes in [p, p+len), as native-byte-order 16-bit words,
+ * with an odd trailing byte padded with a zero byte; the result is
+ * not folded to 16 bits.  len must be less than 2^32.
+ */
+typedef uint64_t (*cksum_kernel_t)(const uint8_t *, u_int);
+
+static uint64_t
+cksum_tail(const uint8_t *p, u_int len, uint64_t sum)
+{
+	uint32_t w32;
+	uint16_t w16;
+	uint8_t last[2];
+
+	if (len >= 4) {
+		memcpy(&w32, p, 4);
+		sum += w32;
+		p += 4;
+		len -= 4;
+	}
+	if (len >= 2) {
+		memcpy(&w16, p, 2);
+		sum += w16;
+		p += 2;
+		len -= 2;
+	}
+	if (len != 0) {
+		last[0] = *p;
+		last[1] = 0;
+		memcpy(&w16, last, 2);
+		sum += w16;
+	}
+	return sum;
+}
+
+static uint64_t
+cksum_generic(const uint8_t *p, u_int len)
+{
+	uint64_t sum0 = 0, sum1 = 0, carry0 = 0, carry1 = 0;
+	uint64_t w0, w1;
+
+	/*
+	 * Add 64-bit words, counting the carries out of the top of each
+	 * accumulator separately; two independent accumulators keep the
+	 * additions from waiting on each other.
+	 */
+	while (len >= 16) {
+		memcpy(&w0, p, 8);
+		memcpy(&w1, p + 8, 8);
+		sum0 += w0;
+		carry0 += sum0 < w0;
+		sum1 += w1;
+		carry1 += sum1 < w1;
+		p += 16;
+		len -= 16;
+	}
+	/*
+	 * A carry out of bit 63 is worth 2^64, which is 1 modulo 65535;
+	 * fold everything down to 32 bits so the sum can't overflow.
+	 */
+	sum0 = (sum0 & 0xffffffff) + (sum0 >> 32) +
+	    (sum1 & 0xffffffff) + (sum1 >> 32) + carry0 + carry1;
+	if (len >= 8) {
+		memcpy(&w0, p, 8);
+		sum0 += (w0 & 0xffffffff) + (w0 >> 32);
+		p += 8;
+		len -= 8;
+	}
+	return cksum_tail(p, len, sum0);
+}
+
+#if (defined(__x86_64__) || defined(__i386__)) && \
+    (ND_IS_AT_LEAST_GNUC_VERSION(4,9) || ND_IS_AT_LEAST_CLANG_VERSION(3,8))
+#define HAVE_CKSUM_AVX2
+#include <immintrin.h>
+
+__attribute__((target("avx2")))
+static uint64_t
+cksum_avx2(const uint8_t *p, u_int len)
+{
+	const __m256i lo32 = _mm256_set1_epi64x(0xffffffff);
+	__m256i sum_lo = _mm256_setzero_si256();
+	__m256i sum_hi = _mm256_setzero_si256();
+	__m256i v;
+	uint64_t lanes[4];
+	uint64_t sum;
+
+	/*
+	 * For short pieces, such as IP headers, setting up the vectors
+	 * and adding up the lanes costs more than it saves.
+	 */
+	if (len < 128)
+		return (cksum_generic(p, len));
+
+	/*
+	 * As in cksum_generic(), but with the 32-bit halves of each of
+	 * the four 64-bit lanes in separate accumulators.
+	 */
+	while (len >= 64) {
+		v = _mm256_loadu_si256((const __m256i *)(const void *)p);
+		sum_lo = _mm256_add_epi64(sum_lo, _mm256_and_si256(v, lo32));
+		sum_hi = _mm256_add_epi64(sum_hi, _mm256_srli_epi64(v, 32));
+		v = _mm256_loadu_si256((const __m256i *)(const void *)(p + 32));
+		sum_lo = _mm256_add_epi64(sum_lo, _mm256_and_si256(v, lo32));
+		sum_hi = _mm256_add_epi64(sum_hi, _mm256_srli_epi64(v, 32));
+		p += 64;
+		len -= 64;
+	}
+	if (len >= 32) {
+		v = _mm256_loadu_si256((const __m256i *)(const void *)p);
+		sum_lo = _mm256_add_epi64(sum_lo, _mm256_and_si256(v, lo32));
+		sum_hi = _mm256_add_epi64(sum_hi, _mm256_srli_epi64(v, 32));
+		p += 32;
+		len -= 32;
+	}
+	_mm256_storeu_si256((__m256i *)(void *)lanes,
+	    _mm256_add_epi64(sum_lo, sum_hi));
+	sum = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+	return sum + cksum_generic(p, len);
+}
+#endif
+
+static const struct {
+	const char *name;
+	cksum_kernel_t kernel;
+} cksum_kernels[] = {
+	{ "generic", cksum_generic },
+#ifdef HAVE_CKSUM_AVX2
+	{ "avx2", cksum_avx2 },
+#endif
+};
+
+static cksum_kernel_t cksum_kernel = cksum_generic;
+
+/*
+ * Pick the fastest kernel this CPU supports; called from nd_init().
+ * Until this is called, the portable kernel is used.
  */
+void
+in_cksum_init(void)
+{
+#ifdef HAVE_CKSUM_AVX2
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+		cksum_kernel = cksum_avx2;
+#endif
+}
 
-#define ADDCARRY(x)  {if ((x) > 65535) (x) -= 65535;}
-#define REDUCE {l_util.l = sum; sum = l_util.s[0] + l_util.s[1]; ADDCARRY(sum);}
+/*
+ * Use the n'th kernel, so that each can be tested and timed, and set
+ * *namep to its name; return 1 if it's now in use, 0 if this CPU can't
+ * run it, and -1 if there's no such kernel.
+ */
+int
+in_cksum_set_kernel(u_int n, const char **namep)
+{
+	if (n >= sizeof(cksum_kernels) / sizeof(cksum_kernels[0]))
+		return (-1);
+	*namep = cksum_kernels[n].name;
+#ifdef HAVE_CKSUM_AVX2
+	__builtin_cpu_init();
+	if (cksum_kernels[n].kernel == cksum_avx2 &&
+	    !__builtin_cpu_supports("avx2"))
+		return (0);
+#endif
+	cksum_kernel = cksum_kernels[n].kernel;
+	return (1);
+}
 
 uint16_t
 in_cksum(const struct cksum_vec *vec, int veclen)
 {
-	const uint16_t *w;
-	int sum = 0;
-	int mlen = 0;
-	int byte_swapped = 0;
-
-	union {
-		uint8_t		c[2];
-		uint16_t	s;
-	} s_util;
-	union {
-		uint16_t	s[2];
-		uint32_t	l;
-	} l_util;
+	uint64_t sum = 0;
+	uint64_t part;
+	u_int odd = 0;
 
 	for (; veclen != 0; vec++, veclen--) {
 		if (vec->len == 0)
 			continue;
-		w = (const uint16_t *)(const void *)vec->ptr;
-		if (mlen == -1) {
-			/*
-			 * The first byte of this chunk is the continuation
-			 * of a word spanning between this chunk and the
-			 * last chunk.
-			 *
-			 * s_util.c[0] is already saved when scanning previous
-			 * chunk.
-			 */
-			s_util.c[1] = *(const uint8_t *)w;
-			sum += s_util.s;
-			w = (const uint16_t *)(const void *)((const uint8_t *)w + 1);
-			mlen = vec->len - 1;
-		} else
-			mlen = vec->len;
-		/*
-		 * Force to even boundary.
-		 */
-		if ((1 & (uintptr_t) w) && (mlen > 0)) {
-			REDUCE;
-			sum <<= 8;
-			s_util.c[0] = *(const uint8_t *)w;
-			w = (const uint16_t *)(const void *)((const uint8_t *)w + 1);
-			mlen--;
-			byte_swapped = 1;
-		}
-		/*
-		 * Unroll the loop to make overhead from
-		 * branches &c small.
-		 */
-		while ((mlen -= 32) >= 0) {
-			sum += w[0]; sum += w[1]; sum += w[2]; sum += w[3];
-			sum += w[4]; sum += w[5]; sum += w[6]; sum += w[7];
-			sum += w[8]; sum += w[9]; sum += w[10]; sum += w[11];
-			sum += w[12]; sum += w[13]; sum += w[14]; sum += w[15];
-			w += 16;
-		}
-		mlen += 32;
-		while ((mlen -= 8) >= 0) {
-			sum += w[0]; sum += w[1]; sum += w[2]; sum += w[3];
-			w += 4;
-		}
-		mlen += 8;
-		if (mlen == 0 && byte_swapped == 0)
-			continue;
-		REDUCE;
-		while ((mlen -= 2) >= 0) {
-			sum += *w++;
-		}
-		if (byte_swapped) {
-			REDUCE;
-			sum <<= 8;
-			byte_swapped = 0;
-			if (mlen == -1) {
-				s_util.c[1] = *(const uint8_t *)w;
-				sum += s_util.s;
-				mlen = 0;
-			} else
-				mlen = -1;
-		} else if (mlen == -1)
-			s_util.c[0] = *(const uint8_t *)w;
-	}
-	if (mlen == -1) {
-		/* The last mbuf has odd # of bytes. Follow the
-		   standard (the odd byte may be shifted left by 8 bits
-		   or not as determined by endian-ness of the machine) */
-		s_util.c[1] = 0;
-		sum += s_util.s;
+		part = cksum_kernel(vec->ptr, vec->len);
+		part = (part & 0xffffffff) + (part >> 32);
+		part = (part & 0xffff) + (part >> 16);
+		part = (part & 0xffff) + (part >> 16);
+		part = (part & 0xffff) + (part >> 16);
+		if (odd)
+			part = ((part & 0xff) << 8) | (part >> 8);
+		sum += part;
+		odd ^= vec->len & 1;
 	}
-	REDUCE;
+	sum = (sum & 0xffff) + (sum >> 16);
+	sum = (sum & 0xffff) + (sum >> 16);
+	sum = (sum & 0xffff) + (sum >> 16);
 	return (~sum & 0xffff);
 }
 
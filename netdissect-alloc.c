@@ -16,9 +16,57 @@
 
 #include <config.h>
 
+#include <stdio.h>
 #include <stdlib.h>
 #include "netdissect-alloc.h"
 
+/*
+ * Memory handed out by nd_malloc() lasts until the end of the packet,
+ * when nd_free_all() releases all of it at once.
+ *
+ * Most of it comes from an arena of fixed-size blocks: an allocation
+ * takes the next bytes of the current block, and nd_free_all() just
+ * goes back to the start of the first one.  The blocks are kept for
+ * the whole run, so after the first few packets nothing is malloc()ed
+ * or free()d.  Allocations too big for that are malloc()ed, kept in a
+ * linked list, and freed by nd_free_all().
+ */
+#define ND_ARENA_BLOCK_SIZE	(64 * 1024)
+#define ND_ARENA_MAX_ALLOC	(ND_ARENA_BLOCK_SIZE / 4)
+#define ND_ARENA_ALIGN		16
+#define ND_ARENA_ROUNDUP(x) \
+	(((x) + (ND_ARENA_ALIGN - 1)) & ~(size_t)(ND_ARENA_ALIGN - 1))
+
+struct nd_arena_block {
+	struct nd_arena_block *next;
+	/* ND_ARENA_BLOCK_SIZE bytes, starting at ND_ARENA_BLOCK_HDR */
+};
+
+#define ND_ARENA_BLOCK_HDR	ND_ARENA_ROUNDUP(sizeof(struct nd_arena_block))
+
+struct nd_arena {
+	struct nd_arena_block *first;
+	struct nd_arena_block *current;	/* NULL = no blocks yet */
+	size_t offset;			/* first free byte in current */
+	size_t used;			/* bytes allocated for this packet */
+	size_t high_water;		/* most bytes allocated for a packet */
+	u_int nblocks;
+	uint64_t allocs;
+	uint64_t big_allocs;		/* allocations malloc()ed on their own */
+};
+
+static struct nd_arena *
+nd_get_arena(netdissect_options *ndo)
+{
+	struct nd_arena *a = ndo->ndo_arena;
+
+	if (a == NULL) {
+		a = (struct nd_arena *)calloc(1, sizeof(*a));
+		ndo->ndo_arena = a;
+	}
+	return a;
+}
+
 static void nd_add_alloc_list(netdissect_options *, nd_mem_chunk_t *);
 
 /*
@@ -36,22 +84,70 @@ nd_add_alloc_list(netdissect_options *ndo, nd_mem_chunk_t *chunkp)
 	ndo->ndo_last_mem_p = chunkp;
 }
 
-/* malloc replacement, with tracking in a linked list */
+/* malloc replacement; the memory is freed by nd_free_all() */
 void *
 nd_malloc(netdissect_options *ndo, size_t size)
 {
-	nd_mem_chunk_t *chunkp = malloc(sizeof(nd_mem_chunk_t) + size);
-	if (chunkp == NULL)
+	struct nd_arena *a = nd_get_arena(ndo);
+	struct nd_arena_block *block;
+	nd_mem_chunk_t *chunkp;
+	void *p;
+
+	if (a == NULL)
 		return NULL;
-	nd_add_alloc_list(ndo, chunkp);
-	return chunkp + 1;
+	if (size > ND_ARENA_MAX_ALLOC) {
+		chunkp = malloc(sizeof(nd_mem_chunk_t) + size);
+		if (chunkp == NULL)
+			return NULL;
+		nd_add_alloc_list(ndo, chunkp);
+		a->big_allocs++;
+		p = chunkp + 1;
+	} else {
+		size = ND_ARENA_ROUNDUP(size);
+		if (a->current == NULL ||
+		    a->offset + size > ND_ARENA_BLOCK_SIZE) {
+			/* On to the next block, if need be a new one. */
+			block = a->current != NULL ? a->current->next : NULL;
+			if (block == NULL) {
+				block = malloc(ND_ARENA_BLOCK_HDR +
+					       ND_ARENA_BLOCK_SIZE);
+				if (block == NULL)
+					return NULL;
+				block->next = NULL;
+				if (a->current != NULL)
+					a->current->next = block;
+				else
+					a->first = block;
+				a->nblocks++;
+			}
+			a->current = block;
+			a->offset = 0;
+		}
+		p = (char *)a->current + ND_ARENA_BLOCK_HDR + a->offset;
+		a->offset += size;
+	}
+	a->allocs++;
+	a->used += size;
+	if (a->used > a->high_water)
+		a->high_water = a->used;
+	return p;
 }
 
-/* Free chunks in allocation linked list from last to first */
+/*
+ * Free everything allocated with nd_malloc(): start again at the
+ * beginning of the arena, and free the big chunks from last to first.
+ */
 void
 nd_free_all(netdissect_options *ndo)
 {
+	struct nd_arena *a = ndo->ndo_arena;
 	nd_mem_chunk_t *current, *previous;
+
+	if (a != NULL) {
+		a->current = a->first;
+		a->offset = 0;
+		a->used = 0;
+	}
 	current = ndo->ndo_last_mem_p;
 	while (current != NULL) {
 		previous = current->prev_mem_p;
@@ -60,3 +156,17 @@ nd_free_all(netdissect_options *ndo)
 	}
 	ndo->ndo_last_mem_p = NULL;
 }
+
+void
+nd_alloc_print_stats(netdissect_options *ndo, FILE *f)
+{
+	const struct nd_arena *a = ndo->ndo_arena;
+
+	if (a == NULL || a->allocs == 0)
+		return;
+	fprintf(f, "Per-packet memory: %" PRIu64 " allocations, %zu bytes"
+		" at most for a packet, %u blocks of %u bytes, %" PRIu64
+		" allocations too big for a block\n",
+		a->allocs, a->high_water, a->nblocks,
+		(u_int)ND_ARENA_BLOCK_SIZE, a->big_allocs);
+}
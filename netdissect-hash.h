@@ -0,0 +1,42 @@
+/*
+ * Copyright (c) 2026 The TCPDUMP project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that: (1) source code
+ * distributions retain the above copyright notice and this paragraph
+ * in its entirety, and (2) distributions including binary code include
+ * the above copyright notice and this paragraph in its entirety in
+ * the documentation or other materials provided with the distribution.
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND
+ * WITHOUT ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, WITHOUT
+ * LIMITATION, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE.
+ */
+
+#ifndef netdissect_hash_h
+#define netdissect_hash_h
+
+/*
+ * Hash for the open-addressing tables that the printers and the name
+ * caches keep: multiply each 64-bit word of the key in, after the seed,
+ * by the golden ratio, then use the MurmurHash3 finalizer so that the
+ * low bits, which pick the slot, depend on all of the key.
+ */
+static inline uint64_t
+nd_hash64(uint64_t seed, const uint64_t *w, size_t nwords)
+{
+	uint64_t h = seed;
+	size_t i;
+
+	for (i = 0; i < nwords; i++)
+		h = (h ^ w[i]) * UINT64_C(0x9e3779b97f4a7c15);
+	h ^= h >> 33;
+	h *= UINT64_C(0xff51afd7ed558ccd);
+	h ^= h >> 33;
+	h *= UINT64_C(0xc4ceb9fe1a85ec53);
+	h ^= h >> 33;
+	return (h);
+}
+
+#endif /* netdissect_hash_h */
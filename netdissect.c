@@ -26,6 +26,7 @@
 
 #include "netdissect-stdinc.h"
 #include "netdissect.h"
+#include "netdissect-alloc.h"
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -74,6 +75,8 @@ nd_init(char *errbuf, size_t errbuf_size)
 	smiInit("tcpdump");
 #endif
 
+	in_cksum_init();
+
 	/*
 	 * Clears the error buffer, and uses it so we don't get
 	 * "unused argument" warnings at compile time.
@@ -116,7 +119,7 @@ nd_push_buffer(netdissect_options *ndo, u_char *new_buffer,
 {
 	struct netdissect_saved_packet_info *ndspi;
 
-	ndspi = (struct netdissect_saved_packet_info *)malloc(sizeof(struct netdissect_saved_packet_info));
+	ndspi = (struct netdissect_saved_packet_info *)nd_malloc(ndo, sizeof(struct netdissect_saved_packet_info));
 	if (ndspi == NULL)
 		return (0);	/* fail */
 	ndspi->ndspi_buffer = new_buffer;
@@ -150,7 +153,7 @@ nd_push_snaplen(netdissect_options *ndo, const u_char *bp, const u_int newlen)
 	struct netdissect_saved_packet_info *ndspi;
 	u_int snaplen_remaining;
 
-	ndspi = (struct netdissect_saved_packet_info *)malloc(sizeof(struct netdissect_saved_packet_info));
+	ndspi = (struct netdissect_saved_packet_info *)nd_malloc(ndo, sizeof(struct netdissect_saved_packet_info));
 	if (ndspi == NULL)
 		return (0);	/* fail */
 	ndspi->ndspi_buffer = NULL;	/* no new buffer */
@@ -252,8 +255,8 @@ nd_pop_packet_info(netdissect_options *ndo)
 	ndo->ndo_snapend = ndspi->ndspi_snapend;
 	ndo->ndo_packet_info_stack = ndspi->ndspi_prev;
 
+	/* ndspi itself came from nd_malloc(), freed at the end of the packet */
 	free(ndspi->ndspi_buffer);
-	free(ndspi);
 }
 
 void
@@ -178,6 +178,22 @@ typedef struct netdissect_options netdissect_options;
 
 typedef void (*if_printer) IF_PRINTER_ARGS;
 
+typedef void (*ts_printer)(netdissect_options *, const struct timeval *);
+
+/*
+ * What pretty_print_packet() does for each packet, worked out once by
+ * nd_set_dispatch() when the link-layer header type is known rather
+ * than for every packet.
+ */
+struct nd_dispatch {
+  if_printer printer;		/* the link-layer printer */
+  ts_printer ts_print;		/* the time stamp printer for the -t flags */
+  int dlt;			/* the link-layer header type */
+  u_int flags;
+#define ND_DISPATCH_PREFIX	0x01	/* print the number or the lengths */
+#define ND_DISPATCH_RAW		0x02	/* print the raw data (-x, -X or -A) */
+};
+
 /*
  * In case the data in a buffer needs to be processed by being decrypted,
  * decompressed, etc. before it's dissected, we can't process it in place,
@@ -229,11 +245,19 @@ struct netdissect_options {
   const char *ndo_protocol;	/* protocol */
   jmp_buf ndo_early_end;	/* jmp_buf for setjmp()/longjmp() */
   void *ndo_last_mem_p;		/* pointer to the last allocated memory chunk */
+  struct nd_arena *ndo_arena;	/* per-packet memory, see netdissect-alloc.c */
   int ndo_packet_number;	/* print a packet number in the beginning of line */
   int ndo_lengths;		/* print packet header caplen and len */
   int ndo_print_sampling;	/* print every Nth packet */
   int ndo_suppress_default_print; /* don't use default_print() for unknown packet types */
   int ndo_tstamp_precision;	/* requested time stamp precision */
+  int ndo_resolve_async;	/* resolve addresses to names in the background */
+  int ndo_resolve_wait;		/* msec to wait for a background lookup */
+  u_int ndo_name_cache_size;	/* max entries per name cache, 0 = no limit */
+  u_int ndo_tcp_flow_table_size; /* max TCP conversations, 0 = no limit */
+  u_int ndo_rpc_xid_table_size;	/* max outstanding RPC calls, 0 = no limit */
+  u_int ndo_quic_cid_table_size; /* max QUIC connection IDs, 0 = no limit */
+  u_int ndo_flow_state_memory;	/* KiB of flow state, 0 = no limit */
   const char *program_name;	/* Name of the program using the library */
 
   char *ndo_espsecret;
@@ -242,6 +266,20 @@ struct netdissect_options {
 
   char *ndo_sigsecret;		/* Signature verification secret key */
 
+  struct port_map_user *ndo_port_map_user; /* from the --port-map file */
+  u_int ndo_port_map_nuser;
+
+  /*
+   * State kept across packets by individual printers; allocated on
+   * first use.
+   */
+  struct nd_flow_state *ndo_flow_state;		/* used by flowstate.c */
+  struct xid_map *ndo_xid_map;			/* used by xidmap.c */
+  struct esp_state *ndo_esp_state;		/* used by print-esp.c */
+  struct quic_cid_table *ndo_quic_cid_table;	/* used by print-quic.c */
+  struct port_map *ndo_udp_port_map;		/* used by print-udp.c */
+  struct port_map *ndo_tcp_port_map;		/* used by print-tcp.c */
+
   int   ndo_packettype;	/* as specified by -T */
 
   int   ndo_snaplen;
@@ -250,12 +288,26 @@ struct netdissect_options {
   /*global pointers to beginning and end of current packet (during printing) */
   const u_char *ndo_packetp;
   const u_char *ndo_snapend;
+  struct timeval ndo_packet_ts;	/* time stamp of the current packet */
+  struct timeval ndo_ts_ref;	/* what -ttt and -ttttt times are relative to */
 
   /* stack of saved packet boundary and buffer information */
   struct netdissect_saved_packet_info *ndo_packet_info_stack;
 
+  /*
+   * Output of the default ndo_printf() is accumulated here and
+   * written out with nd_flush_output() once per packet, unless
+   * ndo_keep_output is set, in which case it's left for the
+   * application to take.
+   */
+  char *ndo_outbuf;
+  size_t ndo_outbuf_len;
+  size_t ndo_outbuf_size;
+  int ndo_keep_output;
+
   /* pointer to the if_printer function */
   if_printer ndo_if_printer;
+  struct nd_dispatch ndo_dispatch;
 
   /* pointer to void function to output stuff */
   void (*ndo_default_print)(netdissect_options *,
@@ -281,6 +333,8 @@ extern WARN_UNUSED_RESULT int nd_push_snaplen(netdissect_options *, const u_char
 extern void nd_change_snaplen(netdissect_options *, const u_char *, const u_int);
 extern void nd_pop_packet_info(netdissect_options *);
 extern void nd_pop_all_packet_info(netdissect_options *);
+extern void nd_alloc_print_stats(netdissect_options *, FILE *);
+extern void nd_flow_print_stats(netdissect_options *, FILE *);
 
 /*
  * Report a packet truncation with a longjmp().
@@ -455,15 +509,25 @@ ND_ICHECKMSG_ZU((#expression_1), (expression_1), operator, (expression_2))
 #define ND_PRINT(...) (ndo->ndo_printf)(ndo, __VA_ARGS__)
 #define ND_DEFAULTPRINT(ap, length) (*ndo->ndo_default_print)(ndo, ap, length)
 
+extern void nd_print_str(netdissect_options *, const char *);
+extern void nd_print_strn(netdissect_options *, const char *, size_t);
+extern void nd_print_uint(netdissect_options *, u_int);
+extern void nd_print_hex(netdissect_options *, u_int, u_int);
+extern void nd_flush_output(netdissect_options *);
+
 extern void ts_print(netdissect_options *, const struct timeval *);
+extern ts_printer get_ts_printer(const netdissect_options *);
 extern void signed_relts_print(netdissect_options *, int32_t);
 extern void unsigned_relts_print(netdissect_options *, uint32_t);
 
 extern const char *nd_format_time(char *buf, size_t bufsize,
     const char *format, const struct tm *timeptr);
+extern struct tm *nd_localtime(const time_t *, struct tm *);
+extern struct tm *nd_gmtime(const time_t *, struct tm *);
 
 extern void fn_print_char(netdissect_options *, u_char);
 extern void fn_print_str(netdissect_options *, const u_char *);
+extern void fn_print_strn(netdissect_options *, const u_char *, size_t);
 extern u_int nd_printztn(netdissect_options *, const u_char *, u_int, const u_char *);
 extern int nd_printn(netdissect_options *, const u_char *, u_int, const u_char *);
 extern void nd_printjn(netdissect_options *, const u_char *, u_int);
@@ -770,6 +834,9 @@ extern void stp_print(netdissect_options *, const u_char *, u_int);
 extern void sunrpc_print(netdissect_options *, const u_char *, u_int, const u_char *);
 extern void syslog_print(netdissect_options *, const u_char *, u_int);
 extern void tcp_print(netdissect_options *, const u_char *, u_int, const u_char *, int);
+extern void xid_map_print_stats(netdissect_options *, FILE *);
+extern void xid_map_print_latency(netdissect_options *, FILE *);
+extern void quic_print_cid_stats(netdissect_options *, FILE *);
 extern void telnet_print(netdissect_options *, const u_char *, u_int);
 extern void tftp_print(netdissect_options *, const u_char *, u_int);
 extern void timed_print(netdissect_options *, const u_char *);
@@ -798,6 +865,8 @@ struct cksum_vec {
 	const uint8_t	*ptr;
 	int		len;
 };
+extern void in_cksum_init(void);
+extern int in_cksum_set_kernel(u_int, const char **);
 extern uint16_t in_cksum(const struct cksum_vec *, int);
 extern uint16_t in_cksum_shouldbe(uint16_t, uint16_t);
 
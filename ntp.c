@@ -58,6 +58,7 @@ p_ntp_time_fmt(netdissect_options *ndo, const char *fmt,
 	    time_t seconds;
 	    char time_buf[128];
 	    const char *time_string;
+	    struct tm tm;
 
 	    if ((i & 0x80000000) != 0)
 		seconds_64bit = (int64_t)i - DIFF_1970_1900;
@@ -72,7 +73,7 @@ p_ntp_time_fmt(netdissect_options *ndo, const char *fmt,
 		time_string = "[timestamp overflow]";
 	    } else {
 		time_string = nd_format_time(time_buf, sizeof (time_buf),
-					     fmt, gmtime(&seconds));
+					     fmt, nd_gmtime(&seconds, &tm));
 	    }
 	    ND_PRINT(" (%s)", time_string);
 	}
@@ -0,0 +1,313 @@
+/*
+ * Copyright (c) 2026 The TCPDUMP project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that: (1) source code
+ * distributions retain the above copyright notice and this paragraph
+ * in its entirety, and (2) distributions including binary code include
+ * the above copyright notice and this paragraph in its entirety in
+ * the documentation or other materials provided with the distribution.
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND
+ * WITHOUT ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, WITHOUT
+ * LIMITATION, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE.
+ */
+
+#include <config.h>
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "netdissect-stdinc.h"
+
+#include "netdissect.h"
+#include "ipproto.h"
+#include "portmap.h"
+
+/*
+ * Entries read from the port map file, for all protocols, kept for the
+ * whole run in ndo_port_map_user.
+ */
+#define PORT_MAP_MAX_USER	1024
+
+struct port_map_user {
+	uint8_t proto;			/* IPPROTO_UDP or IPPROTO_TCP */
+	struct port_map_entry entry;
+};
+
+static int
+port_map_parse_port(const char *s, uint16_t *port)
+{
+	unsigned long v;
+	char *end;
+
+	if (*s < '0' || *s > '9')
+		return -1;
+	errno = 0;
+	v = strtoul(s, &end, 10);
+	if (errno != 0 || *end != '\0' || v > 65535)
+		return -1;
+	*port = (uint16_t)v;
+	return 0;
+}
+
+static int
+port_map_parse_dissector(const struct tok *names, const char *s)
+{
+	for (; names->s != NULL; names++) {
+		if (strcmp(names->s, s) == 0)
+			return names->v;
+	}
+	return -1;
+}
+
+/*
+ * Read the port map file.  Each line is
+ *
+ *	protocol port[-port] dissector [src|dst]
+ *
+ * with "udp" or "tcp" as the protocol, for instance "udp 8053 domain";
+ * blank lines and those starting with "#" are ignored.
+ * Returns -1, with an error message in ebuf, on failure.
+ */
+int
+port_map_read(netdissect_options *ndo, const char *file, char *ebuf,
+	      size_t ebufsize)
+{
+	FILE *fp;
+	char line[1024];
+	char *field[5], *p, *dash;
+	const struct tok *names;
+	struct port_map_user *user, *u;
+	u_int lineno = 0, n;
+	int dissector;
+
+	fp = fopen(file, "r");
+	if (fp == NULL) {
+		snprintf(ebuf, ebufsize, "%s: %s", file, strerror(errno));
+		return -1;
+	}
+	while (fgets(line, sizeof(line), fp) != NULL) {
+		lineno++;
+		if (strchr(line, '\n') == NULL && !feof(fp)) {
+			snprintf(ebuf, ebufsize, "%s, line %u: line too long",
+				 file, lineno);
+			goto fail;
+		}
+		n = 0;
+		for (p = strtok(line, " \t\r\n"); p != NULL && n < 5;
+		     p = strtok(NULL, " \t\r\n"))
+			field[n++] = p;
+		if (n == 0 || field[0][0] == '#')
+			continue;
+		if (n < 3 || n > 4) {
+			snprintf(ebuf, ebufsize,
+				 "%s, line %u: expected \"protocol port[-port] dissector [src|dst]\"",
+				 file, lineno);
+			goto fail;
+		}
+		if (ndo->ndo_port_map_nuser >= PORT_MAP_MAX_USER) {
+			snprintf(ebuf, ebufsize,
+				 "%s, line %u: more than %u entries",
+				 file, lineno, PORT_MAP_MAX_USER);
+			goto fail;
+		}
+		user = (struct port_map_user *)realloc(ndo->ndo_port_map_user,
+		    (ndo->ndo_port_map_nuser + 1) * sizeof(*user));
+		if (user == NULL) {
+			snprintf(ebuf, ebufsize, "%s: realloc", __func__);
+			goto fail;
+		}
+		ndo->ndo_port_map_user = user;
+		u = &user[ndo->ndo_port_map_nuser];
+
+		if (strcmp(field[0], "udp") == 0) {
+			u->proto = IPPROTO_UDP;
+			names = udp_port_dissectors;
+		} else if (strcmp(field[0], "tcp") == 0) {
+			u->proto = IPPROTO_TCP;
+			names = tcp_port_dissectors;
+		} else {
+			snprintf(ebuf, ebufsize,
+				 "%s, line %u: unknown protocol \"%s\"",
+				 file, lineno, field[0]);
+			goto fail;
+		}
+
+		dash = strchr(field[1], '-');
+		if (dash != NULL)
+			*dash++ = '\0';
+		if (port_map_parse_port(field[1], &u->entry.low) == -1 ||
+		    port_map_parse_port(dash != NULL ? dash : field[1],
+					&u->entry.high) == -1 ||
+		    u->entry.high < u->entry.low) {
+			snprintf(ebuf, ebufsize,
+				 "%s, line %u: invalid port or port range",
+				 file, lineno);
+			goto fail;
+		}
+
+		dissector = port_map_parse_dissector(names, field[2]);
+		if (dissector == -1) {
+			snprintf(ebuf, ebufsize,
+				 "%s, line %u: unknown %s dissector \"%s\"",
+				 file, lineno, field[0], field[2]);
+			goto fail;
+		}
+		u->entry.dissector = (uint8_t)dissector;
+
+		if (n == 3)
+			u->entry.match = PORT_MATCH_EITHER;
+		else if (strcmp(field[3], "dst") == 0)
+			u->entry.match = PORT_MATCH_DST;
+		else if (strcmp(field[3], "src") == 0)
+			u->entry.match = PORT_MATCH_SRC;
+		else {
+			snprintf(ebuf, ebufsize,
+				 "%s, line %u: expected \"src\" or \"dst\", not \"%s\"",
+				 file, lineno, field[3]);
+			goto fail;
+		}
+		ndo->ndo_port_map_nuser++;
+	}
+	if (ferror(fp)) {
+		snprintf(ebuf, ebufsize, "%s: %s", file, strerror(errno));
+		goto fail;
+	}
+	fclose(fp);
+	return 0;
+
+fail:
+	fclose(fp);
+	return -1;
+}
+
+static int
+port_map_bound_cmp(const void *a, const void *b)
+{
+	uint32_t x = *(const uint32_t *)a;
+	uint32_t y = *(const uint32_t *)b;
+
+	return (x > y) - (x < y);
+}
+
+/*
+ * Append the list of the entries that match the port, on the side
+ * given, and return its offset, or 0 (the empty list) if none do.
+ */
+static uint32_t
+port_map_add_list(netdissect_options *ndo, struct port_map *map,
+		  size_t *nlists, size_t *maxlists, uint32_t port,
+		  enum port_match side)
+{
+	const struct port_map_entry *e;
+	uint16_t *lists;
+	size_t start = *nlists;
+	u_int i;
+
+	for (i = 0; i < map->nentries; i++) {
+		e = &map->entries[i];
+		if (port < e->low || port > e->high ||
+		    (e->match != PORT_MATCH_EITHER && e->match != side))
+			continue;
+		/* Leave room for this one and PORT_MAP_END. */
+		if (*nlists + 2 > *maxlists) {
+			*maxlists *= 2;
+			lists = (uint16_t *)realloc(map->lists,
+			    *maxlists * sizeof(*lists));
+			if (lists == NULL)
+				(*ndo->ndo_error)(ndo, S_ERR_ND_MEM_ALLOC,
+						  "%s: realloc", __func__);
+			map->lists = lists;
+		}
+		map->lists[(*nlists)++] = (uint16_t)i;
+	}
+	if (*nlists == start)
+		return 0;
+	map->lists[(*nlists)++] = PORT_MAP_END;
+	return (uint32_t)start;
+}
+
+/*
+ * Build the port map for the protocol from the entries read from the
+ * port map file for it, followed by the printer's own entries.
+ */
+struct port_map *
+port_map_build(netdissect_options *ndo, uint8_t proto,
+	       const struct port_map_entry *builtin, u_int nbuiltin)
+{
+	struct port_map *map;
+	uint32_t *bounds;
+	u_int nbounds, nsegments, i, s;
+	size_t nlists, maxlists;
+	uint32_t port, end;
+
+	/*
+	 * calloc() return used by 'ndo_udp_port_map' or 'ndo_tcp_port_map':
+	 * do not free()
+	 */
+	map = (struct port_map *)calloc(1, sizeof(*map));
+	if (map == NULL)
+		(*ndo->ndo_error)(ndo, S_ERR_ND_MEM_ALLOC,
+				  "%s: calloc", __func__);
+	map->entries = (struct port_map_entry *)malloc(
+	    (ndo->ndo_port_map_nuser + nbuiltin) * sizeof(*map->entries));
+	if (map->entries == NULL)
+		(*ndo->ndo_error)(ndo, S_ERR_ND_MEM_ALLOC,
+				  "%s: malloc", __func__);
+	for (i = 0; i < ndo->ndo_port_map_nuser; i++) {
+		if (ndo->ndo_port_map_user[i].proto == proto)
+			map->entries[map->nentries++] =
+			    ndo->ndo_port_map_user[i].entry;
+	}
+	memcpy(&map->entries[map->nentries], builtin,
+	       nbuiltin * sizeof(*builtin));
+	map->nentries += nbuiltin;
+
+	/*
+	 * The segments start at port 0 and wherever an entry's range
+	 * starts or ends.
+	 */
+	bounds = (uint32_t *)malloc((2 * map->nentries + 1) * sizeof(*bounds));
+	if (bounds == NULL)
+		(*ndo->ndo_error)(ndo, S_ERR_ND_MEM_ALLOC,
+				  "%s: malloc", __func__);
+	nbounds = 0;
+	bounds[nbounds++] = 0;
+	for (i = 0; i < map->nentries; i++) {
+		bounds[nbounds++] = map->entries[i].low;
+		if (map->entries[i].high < 65535)
+			bounds[nbounds++] = map->entries[i].high + 1U;
+	}
+	qsort(bounds, nbounds, sizeof(*bounds), port_map_bound_cmp);
+	nsegments = 0;
+	for (i = 0; i < nbounds; i++) {
+		if (nsegments == 0 || bounds[i] != bounds[nsegments - 1])
+			bounds[nsegments++] = bounds[i];
+	}
+
+	map->dst = (uint32_t *)malloc(nsegments * sizeof(*map->dst));
+	map->src = (uint32_t *)malloc(nsegments * sizeof(*map->src));
+	maxlists = 64;
+	map->lists = (uint16_t *)malloc(maxlists * sizeof(*map->lists));
+	if (map->dst == NULL || map->src == NULL || map->lists == NULL)
+		(*ndo->ndo_error)(ndo, S_ERR_ND_MEM_ALLOC,
+				  "%s: malloc", __func__);
+	map->lists[0] = PORT_MAP_END;
+	nlists = 1;
+	for (s = 0; s < nsegments; s++) {
+		port = bounds[s];
+		end = s + 1 < nsegments ? bounds[s + 1] : 65536;
+		map->dst[s] = port_map_add_list(ndo, map, &nlists, &maxlists,
+						port, PORT_MATCH_DST);
+		map->src[s] = port_map_add_list(ndo, map, &nlists, &maxlists,
+						port, PORT_MATCH_SRC);
+		for (; port < end; port++)
+			map->segment[port] = (uint16_t)s;
+	}
+	free(bounds);
+	return map;
+}
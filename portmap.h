@@ -0,0 +1,116 @@
+/*
+ * Copyright (c) 2026 The TCPDUMP project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that: (1) source code
+ * distributions retain the above copyright notice and this paragraph
+ * in its entirety, and (2) distributions including binary code include
+ * the above copyright notice and this paragraph in its entirety in
+ * the documentation or other materials provided with the distribution.
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND
+ * WITHOUT ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, WITHOUT
+ * LIMITATION, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE.
+ */
+
+#ifndef netdissect_portmap_h
+#define netdissect_portmap_h
+
+/*
+ * Tables mapping UDP and TCP ports to the dissectors for the payload.
+ *
+ * A printer gives a list of entries, each saying which dissector to
+ * use for a range of source and/or destination ports; the entries read
+ * from the --port-map file go in front of it.  When several entries
+ * match a packet, the first one in the list is tried first, and if its
+ * dissector declines the packet, the next one, and so on, just as with
+ * a chain of "if (port == ...) ... else if ..." tests.
+ */
+
+#include "netdissect.h"
+
+enum port_match {
+	PORT_MATCH_EITHER,	/* source or destination port */
+	PORT_MATCH_DST,		/* destination port only */
+	PORT_MATCH_SRC		/* source port only */
+};
+
+struct port_map_entry {
+	uint16_t	low;		/* first port in the range */
+	uint16_t	high;		/* last port in the range */
+	uint8_t		match;		/* enum port_match */
+	uint8_t		dissector;	/* printer-specific number */
+};
+
+#define PORT_MAP_END	UINT16_MAX
+
+/*
+ * The first port of each range in which the matching entries are the
+ * same is the start of a segment; for each port, "segment" gives the
+ * number of the segment it's in, and for each segment, "dst" and "src"
+ * give the offset in "lists" of the indices, in "entries", of the
+ * entries that match the port as a destination or source port, in
+ * order, ending with PORT_MAP_END.
+ */
+struct port_map {
+	struct port_map_entry *entries;
+	u_int nentries;
+	uint32_t *dst;
+	uint32_t *src;
+	uint16_t *lists;
+	uint16_t segment[65536];
+};
+
+struct port_map_iter {
+	const struct port_map *map;
+	const uint16_t *dst;
+	const uint16_t *src;
+	uint16_t sport;
+	uint16_t dport;
+};
+
+/* Names of the dissectors that the port map file can refer to. */
+extern const struct tok udp_port_dissectors[];
+extern const struct tok tcp_port_dissectors[];
+
+extern int port_map_read(netdissect_options *, const char *, char *, size_t);
+extern struct port_map *port_map_build(netdissect_options *, uint8_t,
+    const struct port_map_entry *, u_int);
+
+static inline void
+port_map_iter_init(struct port_map_iter *it, const struct port_map *map,
+		   uint16_t sport, uint16_t dport)
+{
+	it->map = map;
+	it->dst = &map->lists[map->dst[map->segment[dport]]];
+	it->src = &map->lists[map->src[map->segment[sport]]];
+	it->sport = sport;
+	it->dport = dport;
+}
+
+/*
+ * Get the next dissector to try, and the port that matched (the
+ * destination port if both did), or return -1 if there are no more.
+ */
+static inline int
+port_map_next(struct port_map_iter *it, uint16_t *port)
+{
+	uint16_t idx;
+
+	if (*it->dst <= *it->src) {
+		idx = *it->dst;
+		if (idx == PORT_MAP_END)
+			return -1;
+		it->dst++;
+		if (*it->src == idx)
+			it->src++;
+		*port = it->dport;
+	} else {
+		idx = *it->src++;
+		*port = it->sport;
+	}
+	return it->map->entries[idx].dissector;
+}
+
+#endif /* netdissect_portmap_h */
@@ -100,6 +100,7 @@ ahcp_time_print(netdissect_options *ndo,
                 const u_char *cp, uint8_t len)
 {
 	time_t t;
+	struct tm tm;
 	char buf[sizeof("-yyyyyyyyyy-mm-dd hh:mm:ss UTC")];
 
 	if (len != 4)
@@ -107,7 +108,7 @@ ahcp_time_print(netdissect_options *ndo,
 	t = GET_BE_U_4(cp);
 	ND_PRINT(": %s",
 	    nd_format_time(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S UTC",
-	      gmtime(&t)));
+	      nd_gmtime(&t, &tm)));
 	return;
 
 invalid:
@@ -91,11 +91,12 @@ arista_print_date_hms_time(netdissect_options *ndo, const uint32_t seconds,
 		const uint32_t nanoseconds)
 {
 	const time_t ts = seconds;
+	struct tm tm;
 	char buf[sizeof("-yyyyyyyyyy-mm-dd hh:mm:ss")];
 
 	ND_PRINT("%s.%09u",
 	    nd_format_time(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S",
-	       gmtime(&ts)), nanoseconds);
+	       nd_gmtime(&ts, &tm)), nanoseconds);
 	if (nanoseconds > ND_NANO_PER_SEC - 1)
 		ND_PRINT(" " ND_INVALID_NANO_SEC_STR);
 }
@@ -99,61 +99,92 @@ ascii_print(netdissect_options *ndo,
 		nd_trunc_longjmp(ndo);
 }
 
+/*
+ * The hex dumpers build each line of output in a buffer, with a table
+ * lookup per hex digit, and print it with one call, rather than
+ * formatting every pair of bytes with snprintf().  They only look at
+ * bytes that ND_BYTES_AVAILABLE_AFTER() says are in the buffer, so
+ * they don't need the GET_ macros.
+ */
+static const char hexdigits[] = "0123456789abcdef";
+
+#define HEXDUMP_OFFSET_MAX	(sizeof("0x12345678: ") - 1)
+#define HEXDUMP_LINE_MAX \
+		(HEXDUMP_OFFSET_MAX + HEXDUMP_HEXSTUFF_PER_LINE + 2 + \
+		 HEXDUMP_BYTES_PER_LINE)
+
+/*
+ * Render the offset as "0x%04x: " would, and return a pointer past it.
+ */
+static char *
+hexdump_format_offset(char *p, u_int offset)
+{
+	u_int ndigits = 4;
+
+	while (ndigits < 2 * sizeof(offset) && (offset >> (4 * ndigits)) != 0)
+		ndigits++;
+	*p++ = '0';
+	*p++ = 'x';
+	while (ndigits != 0) {
+		ndigits--;
+		*p++ = hexdigits[(offset >> (4 * ndigits)) & 0xf];
+	}
+	*p++ = ':';
+	*p++ = ' ';
+	return p;
+}
+
+/*
+ * Render bytes as " %02x%02x" for each pair and " %02x" for an odd
+ * last byte, and return a pointer past them.
+ */
+static char *
+hexdump_format_bytes(char *p, const u_char *cp, u_int length)
+{
+	u_int i, c;
+
+	for (i = 0; i < length; i++) {
+		if ((i & 1) == 0)
+			*p++ = ' ';
+		c = EXTRACT_U_1(cp + i);
+		*p++ = hexdigits[c >> 4];
+		*p++ = hexdigits[c & 0xf];
+	}
+	return p;
+}
+
 static void
 hex_and_ascii_print_with_offset(netdissect_options *ndo, const char *indent,
 				const u_char *cp, u_int length, u_int offset)
 {
 	u_int caplength;
-	u_int i;
-	u_int s1, s2;
-	u_int nshorts;
+	u_int i, n, c;
 	int truncated = FALSE;
-	char hexstuff[HEXDUMP_SHORTS_PER_LINE*HEXDUMP_HEXSTUFF_PER_SHORT+1], *hsp;
-	char asciistuff[ASCII_LINELENGTH+1], *asp;
+	char line[HEXDUMP_LINE_MAX], *p, *hexstuff;
 
 	caplength = ND_BYTES_AVAILABLE_AFTER(cp);
 	if (length > caplength) {
 		length = caplength;
 		truncated = TRUE;
 	}
-	nshorts = length / sizeof(u_short);
-	i = 0;
-	hsp = hexstuff; asp = asciistuff;
-	while (nshorts != 0) {
-		s1 = GET_U_1(cp);
-		cp++;
-		s2 = GET_U_1(cp);
-		cp++;
-		(void)snprintf(hsp, sizeof(hexstuff) - (hsp - hexstuff),
-		    " %02x%02x", s1, s2);
-		hsp += HEXDUMP_HEXSTUFF_PER_SHORT;
-		*(asp++) = (char)(ND_ASCII_ISGRAPH(s1) ? s1 : '.');
-		*(asp++) = (char)(ND_ASCII_ISGRAPH(s2) ? s2 : '.');
-		i++;
-		if (i >= HEXDUMP_SHORTS_PER_LINE) {
-			*hsp = *asp = '\0';
-			ND_PRINT("%s0x%04x: %-*s  %s",
-			    indent, offset, HEXDUMP_HEXSTUFF_PER_LINE,
-			    hexstuff, asciistuff);
-			i = 0; hsp = hexstuff; asp = asciistuff;
-			offset += HEXDUMP_BYTES_PER_LINE;
+	while (length != 0) {
+		n = ND_MIN(length, HEXDUMP_BYTES_PER_LINE);
+		p = hexdump_format_offset(line, offset);
+		hexstuff = p;
+		p = hexdump_format_bytes(p, cp, n);
+		while (p < hexstuff + HEXDUMP_HEXSTUFF_PER_LINE)
+			*p++ = ' ';
+		*p++ = ' ';
+		*p++ = ' ';
+		for (i = 0; i < n; i++) {
+			c = EXTRACT_U_1(cp + i);
+			*p++ = (char)(ND_ASCII_ISGRAPH(c) ? c : '.');
 		}
-		nshorts--;
-	}
-	if (length & 1) {
-		s1 = GET_U_1(cp);
-		cp++;
-		(void)snprintf(hsp, sizeof(hexstuff) - (hsp - hexstuff),
-		    " %02x", s1);
-		hsp += 3;
-		*(asp++) = (char)(ND_ASCII_ISGRAPH(s1) ? s1 : '.');
-		++i;
-	}
-	if (i > 0) {
-		*hsp = *asp = '\0';
-		ND_PRINT("%s0x%04x: %-*s  %s",
-		     indent, offset, HEXDUMP_HEXSTUFF_PER_LINE,
-		     hexstuff, asciistuff);
+		nd_print_str(ndo, indent);
+		nd_print_strn(ndo, line, (size_t)(p - line));
+		cp += n;
+		length -= n;
+		offset += HEXDUMP_BYTES_PER_LINE;
 	}
 	if (truncated)
 		nd_trunc_longjmp(ndo);
@@ -175,32 +206,24 @@ hex_print_with_offset(netdissect_options *ndo,
 		      u_int offset)
 {
 	u_int caplength;
-	u_int i, s;
-	u_int nshorts;
+	u_int n;
 	int truncated = FALSE;
+	char line[HEXDUMP_OFFSET_MAX + HEXDUMP_HEXSTUFF_PER_LINE], *p;
 
 	caplength = ND_BYTES_AVAILABLE_AFTER(cp);
 	if (length > caplength) {
 		length = caplength;
 		truncated = TRUE;
 	}
-	nshorts = length / sizeof(u_short);
-	i = 0;
-	while (nshorts != 0) {
-		if ((i++ % 8) == 0) {
-			ND_PRINT("%s0x%04x: ", indent, offset);
-			offset += HEXDUMP_BYTES_PER_LINE;
-		}
-		s = GET_U_1(cp);
-		cp++;
-		ND_PRINT(" %02x%02x", s, GET_U_1(cp));
-		cp++;
-		nshorts--;
-	}
-	if (length & 1) {
-		if ((i % 8) == 0)
-			ND_PRINT("%s0x%04x: ", indent, offset);
-		ND_PRINT(" %02x", GET_U_1(cp));
+	while (length != 0) {
+		n = ND_MIN(length, HEXDUMP_BYTES_PER_LINE);
+		p = hexdump_format_offset(line, offset);
+		p = hexdump_format_bytes(p, cp, n);
+		nd_print_str(ndo, indent);
+		nd_print_strn(ndo, line, (size_t)(p - line));
+		cp += n;
+		length -= n;
+		offset += HEXDUMP_BYTES_PER_LINE;
 	}
 	if (truncated)
 		nd_trunc_longjmp(ndo);
@@ -125,7 +125,7 @@ static const struct tok diversity_str[] = {
 static const char *
 format_id(netdissect_options *ndo, const u_char *id)
 {
-    static char buf[25];
+    static ND_THREAD_LOCAL char buf[25];
     snprintf(buf, 25, "%02x:%02x:%02x:%02x:%02x:%02x:%02x:%02x",
              GET_U_1(id), GET_U_1(id + 1), GET_U_1(id + 2),
              GET_U_1(id + 3), GET_U_1(id + 4), GET_U_1(id + 5),
@@ -140,7 +140,7 @@ static const unsigned char v4prefix[16] =
 static const char *
 format_prefix(netdissect_options *ndo, const u_char *prefix, unsigned char plen)
 {
-    static char buf[50];
+    static ND_THREAD_LOCAL char buf[50];
 
     /*
      * prefix points to a buffer on the stack into which the prefix has
@@ -761,7 +761,7 @@ bgp_vpn_ip_print(netdissect_options *ndo,
 {
 
     /* worst case string is s fully formatted v6 address */
-    static char addr[sizeof("1234:5678:89ab:cdef:1234:5678:89ab:cdef")];
+    static ND_THREAD_LOCAL char addr[sizeof("1234:5678:89ab:cdef:1234:5678:89ab:cdef")];
     char *pos = addr;
 
     switch(addr_length) {
@@ -842,7 +842,7 @@ const char *
 bgp_vpn_rd_print(netdissect_options *ndo, const u_char *pptr)
 {
     /* allocate space for the largest possible string */
-    static char rd[sizeof("xxxxx.xxxxx:xxxxx (xxx.xxx.xxx.xxx:xxxxx)")];
+    static ND_THREAD_LOCAL char rd[sizeof("xxxxx.xxxxx:xxxxx (xxx.xxx.xxx.xxx:xxxxx)")];
     char *pos = rd;
     /* allocate space for the largest possible string */
     char astostr[AS_STR_SIZE];
@@ -1013,7 +1013,7 @@ bgp_rt_prefix_print(netdissect_options *ndo,
     /* allocate space for the largest possible string */
     char rtc_prefix_in_hex[sizeof("0000 0000 0000 0000")] = "";
     u_int rtc_prefix_in_hex_len = 0;
-    static char output[61]; /* max response string */
+    static ND_THREAD_LOCAL char output[61]; /* max response string */
     /* allocate space for the largest possible string */
     char astostr[AS_STR_SIZE];
     uint16_t ec_type = 0;
@@ -35,6 +35,8 @@
 #endif
 
 #include "netdissect.h"
+#include "netdissect-alloc.h"
+#include "netdissect-hash.h"
 #include "extract.h"
 
 #include "diag-control.h"
@@ -111,6 +113,36 @@ struct sa_list {
 	int             authsecret_len;
 	u_char		secret[256];  /* is that big enough for all secrets? */
 	int		secretlen;
+	EVP_CIPHER_CTX	*ctx;	      /* key set up on first use */
+};
+
+/*
+ * State hung off the netdissect_options structure: indexes of the SA
+ * list, rebuilt when SAs are added to it, and buffers for decrypted
+ * data that are reused from packet to packet.
+ *
+ * The indexes are open-addressing hash tables, at most half full, of
+ * the ESP SAs by SPI and destination address and of the IKEv2 SAs by
+ * initiator flag and SPIs.  When an SA appears more than once in the
+ * list, the index has the first one, as a scan of the list would find.
+ *
+ * A buffer is free if nothing on the packet information stack refers
+ * to it; with ESP in ESP, more than one can be in use.
+ */
+#define ESP_BUFFER_POOL_SIZE	4
+#define ESP_BUFFER_MIN_SIZE	2048
+
+struct esp_buffer {
+	u_char		*data;
+	u_int		size;
+};
+
+struct esp_state {
+	const struct sa_list *indexed_head;	/* list the indexes are of */
+	struct sa_list	**by_spi;
+	struct sa_list	**by_ike;
+	size_t		nslots;		/* in each index; a power of 2 */
+	struct esp_buffer buffers[ESP_BUFFER_POOL_SIZE];
 };
 
 #ifndef HAVE_EVP_CIPHER_CTX_NEW
@@ -169,39 +201,242 @@ set_cipher_parameters(EVP_CIPHER_CTX *ctx, const EVP_CIPHER *cipher,
 }
 #endif
 
+static struct esp_state *
+esp_get_state(netdissect_options *ndo)
+{
+	if (ndo->ndo_esp_state == NULL) {
+		ndo->ndo_esp_state = (struct esp_state *)
+			calloc(1, sizeof(*ndo->ndo_esp_state));
+		if (ndo->ndo_esp_state == NULL)
+			(*ndo->ndo_error)(ndo, S_ERR_ND_MEM_ALLOC,
+					  "%s: calloc", __func__);
+	}
+	return ndo->ndo_esp_state;
+}
+
+static size_t
+esp_hash(uint64_t h0, uint64_t h1, uint64_t h2)
+{
+	const uint64_t w[3] = { h0, h1, h2 };
+
+	return ((size_t)nd_hash64(0, w, 3));
+}
+
+static size_t
+esp_spi_hash(uint32_t spi, u_int version, const void *daddr)
+{
+	uint64_t a[2] = { 0, 0 };
+
+	memcpy(a, daddr, version == 6 ? sizeof(nd_ipv6) : sizeof(nd_ipv4));
+	return esp_hash((uint64_t)version << 32 | spi, a[0], a[1]);
+}
+
+static size_t
+esp_ike_hash(int initiator, const u_char spii[8], const u_char spir[8])
+{
+	uint64_t i, r;
+
+	memcpy(&i, spii, sizeof(i));
+	memcpy(&r, spir, sizeof(r));
+	return esp_hash((uint64_t)initiator, i, r);
+}
+
+static int
+esp_spi_match(const struct sa_list *sa, uint32_t spi, u_int version,
+	      const void *daddr)
+{
+	return sa->spi == spi && sa->daddr_version == version &&
+	    UNALIGNED_MEMCMP(&sa->daddr, daddr,
+		version == 6 ? sizeof(nd_ipv6) : sizeof(nd_ipv4)) == 0;
+}
+
+static int
+esp_ike_match(const struct sa_list *sa, int initiator, const u_char spii[8],
+	      const u_char spir[8])
+{
+	return sa->spi == 0 && sa->initiator == initiator &&
+	    memcmp(sa->spii, spii, 8) == 0 && memcmp(sa->spir, spir, 8) == 0;
+}
+
+/*
+ * (Re)build the indexes if SAs have been added since they were built.
+ */
+static void
+esp_index_sas(netdissect_options *ndo, struct esp_state *st)
+{
+	struct sa_list *sa;
+	size_t count = 0, nslots, i, mask;
+
+	if (st->by_spi != NULL && st->indexed_head == ndo->ndo_sa_list_head)
+		return;
+	for (sa = ndo->ndo_sa_list_head; sa != NULL; sa = sa->next)
+		count++;
+	nslots = 16;
+	while (nslots < 2 * count)
+		nslots *= 2;
+	free(st->by_spi);
+	free(st->by_ike);
+	st->by_spi = (struct sa_list **)calloc(nslots, sizeof(*st->by_spi));
+	st->by_ike = (struct sa_list **)calloc(nslots, sizeof(*st->by_ike));
+	if (st->by_spi == NULL || st->by_ike == NULL)
+		(*ndo->ndo_error)(ndo, S_ERR_ND_MEM_ALLOC,
+				  "%s: calloc", __func__);
+	st->nslots = nslots;
+	mask = nslots - 1;
+	for (sa = ndo->ndo_sa_list_head; sa != NULL; sa = sa->next) {
+		if (sa->daddr_version == 4 || sa->daddr_version == 6) {
+			for (i = esp_spi_hash(sa->spi, sa->daddr_version,
+			    &sa->daddr) & mask; st->by_spi[i] != NULL;
+			    i = (i + 1) & mask) {
+				if (esp_spi_match(st->by_spi[i], sa->spi,
+				    sa->daddr_version, &sa->daddr))
+					break;
+			}
+			if (st->by_spi[i] == NULL)
+				st->by_spi[i] = sa;
+		}
+		if (sa->spi == 0) {
+			for (i = esp_ike_hash(sa->initiator, sa->spii,
+			    sa->spir) & mask; st->by_ike[i] != NULL;
+			    i = (i + 1) & mask) {
+				if (esp_ike_match(st->by_ike[i], sa->initiator,
+				    sa->spii, sa->spir))
+					break;
+			}
+			if (st->by_ike[i] == NULL)
+				st->by_ike[i] = sa;
+		}
+	}
+	st->indexed_head = ndo->ndo_sa_list_head;
+}
+
+/* Find the ESP SA for an SPI and destination address, if there is one. */
+static struct sa_list *
+esp_find_sa(netdissect_options *ndo, uint32_t spi, u_int version,
+	    const void *daddr)
+{
+	struct esp_state *st = esp_get_state(ndo);
+	struct sa_list *sa;
+	size_t i, mask;
+
+	esp_index_sas(ndo, st);
+	mask = st->nslots - 1;
+	for (i = esp_spi_hash(spi, version, daddr) & mask;
+	    (sa = st->by_spi[i]) != NULL; i = (i + 1) & mask) {
+		if (esp_spi_match(sa, spi, version, daddr))
+			return sa;
+	}
+	return NULL;
+}
+
+/* Find the IKEv2 SA for an initiator flag and SPIs, if there is one. */
+static struct sa_list *
+esp_find_ike_sa(netdissect_options *ndo, int initiator, const u_char spii[8],
+		const u_char spir[8])
+{
+	struct esp_state *st = esp_get_state(ndo);
+	struct sa_list *sa;
+	size_t i, mask;
+
+	esp_index_sas(ndo, st);
+	mask = st->nslots - 1;
+	for (i = esp_ike_hash(initiator, spii, spir) & mask;
+	    (sa = st->by_ike[i]) != NULL; i = (i + 1) & mask) {
+		if (esp_ike_match(sa, initiator, spii, spir))
+			return sa;
+	}
+	return NULL;
+}
+
+static int
+esp_buffer_in_use(const netdissect_options *ndo, const u_char *data)
+{
+	const struct netdissect_saved_packet_info *ndspi;
+
+	if (ndo->ndo_packetp == data)
+		return 1;
+	for (ndspi = ndo->ndo_packet_info_stack; ndspi != NULL;
+	    ndspi = ndspi->ndspi_prev) {
+		if (ndspi->ndspi_packetp == data)
+			return 1;
+	}
+	return 0;
+}
+
+/*
+ * Get a buffer for len bytes of decrypted data: a free one from the
+ * pool if there is one, otherwise one from nd_malloc(), freed at the
+ * end of the packet.
+ */
 static u_char *
+esp_get_buffer(netdissect_options *ndo, const char *caller, u_int len)
+{
+	struct esp_state *st = esp_get_state(ndo);
+	struct esp_buffer *b;
+	u_char *data;
+	u_int i, size;
+
+	for (i = 0; i < ESP_BUFFER_POOL_SIZE; i++) {
+		b = &st->buffers[i];
+		if (b->data != NULL && esp_buffer_in_use(ndo, b->data))
+			continue;
+		if (b->size < len || b->data == NULL) {
+			size = ND_MAX(len, ESP_BUFFER_MIN_SIZE);
+			data = (u_char *)realloc(b->data, size);
+			if (data == NULL)
+				break;
+			b->data = data;
+			b->size = size;
+		}
+		return b->data;
+	}
+	data = (u_char *)nd_malloc(ndo, ND_MAX(len, 1));
+	if (data == NULL)
+		(*ndo->ndo_error)(ndo, S_ERR_ND_MEM_ALLOC,
+		    "%s: can't allocate memory for decryption buffer", caller);
+	return data;
+}
+
+/*
+ * Decrypt into pt, which has room for ctlen bytes.  The SA's cipher
+ * context is set up with the key once; each packet only sets the IV.
+ */
+static int
 do_decrypt(netdissect_options *ndo, const char *caller, struct sa_list *sa,
-    const u_char *iv, const u_char *ct, unsigned int ctlen)
+    const u_char *iv, const u_char *ct, unsigned int ctlen, u_char *pt)
 {
 	EVP_CIPHER_CTX *ctx;
 	unsigned int block_size;
-	unsigned int ptlen;
-	u_char *pt;
 	int len;
 
-	ctx = EVP_CIPHER_CTX_new();
-	if (ctx == NULL) {
-		/*
-		 * Failed to initialize the cipher context.
-		 * From a look at the OpenSSL code, this appears to
-		 * mean "couldn't allocate memory for the cipher context";
-		 * note that we're not passing any parameters, so there's
-		 * not much else it can mean.
-		 */
-		(*ndo->ndo_error)(ndo, S_ERR_ND_MEM_ALLOC,
-		    "%s: can't allocate memory for cipher context", caller);
-		return NULL;
+	if (sa->ctx == NULL) {
+		ctx = EVP_CIPHER_CTX_new();
+		if (ctx == NULL) {
+			/*
+			 * Failed to initialize the cipher context.
+			 * From a look at the OpenSSL code, this appears to
+			 * mean "couldn't allocate memory for the cipher
+			 * context"; note that we're not passing any
+			 * parameters, so there's not much else it can mean.
+			 */
+			(*ndo->ndo_error)(ndo, S_ERR_ND_MEM_ALLOC,
+			    "%s: can't allocate memory for cipher context",
+			    caller);
+			return 0;
+		}
+		if (set_cipher_parameters(ctx, sa->evp, sa->secret, NULL) < 0) {
+			EVP_CIPHER_CTX_free(ctx);
+			(*ndo->ndo_warning)(ndo, "%s: espkey init failed",
+			    caller);
+			return 0;
+		}
+		sa->ctx = ctx;
 	}
+	ctx = sa->ctx;
 
-	if (set_cipher_parameters(ctx, sa->evp, sa->secret, NULL) < 0) {
-		EVP_CIPHER_CTX_free(ctx);
-		(*ndo->ndo_warning)(ndo, "%s: espkey init failed", caller);
-		return NULL;
-	}
 	if (set_cipher_parameters(ctx, NULL, NULL, iv) < 0) {
-		EVP_CIPHER_CTX_free(ctx);
 		(*ndo->ndo_warning)(ndo, "%s: IV init failed", caller);
-		return NULL;
+		return 0;
 	}
 
 	/*
@@ -213,24 +448,10 @@ do_decrypt(netdissect_options *ndo, const char *caller, struct sa_list *sa,
 	 */
 	block_size = (unsigned int)EVP_CIPHER_CTX_block_size(ctx);
 	if ((ctlen % block_size) != 0) {
-		EVP_CIPHER_CTX_free(ctx);
 		(*ndo->ndo_warning)(ndo,
 		    "%s: ciphertext size %u is not a multiple of the cipher block size %u",
 		    caller, ctlen, block_size);
-		return NULL;
-	}
-
-	/*
-	 * Attempt to allocate a buffer for the decrypted data, because
-	 * we can't decrypt on top of the input buffer.
-	 */
-	ptlen = ctlen;
-	pt = (u_char *)calloc(1, ptlen);
-	if (pt == NULL) {
-		EVP_CIPHER_CTX_free(ctx);
-		(*ndo->ndo_error)(ndo, S_ERR_ND_MEM_ALLOC,
-		    "%s: can't allocate memory for decryption buffer", caller);
-		return NULL;
+		return 0;
 	}
 
 	/*
@@ -238,20 +459,45 @@ do_decrypt(netdissect_options *ndo, const char *caller, struct sa_list *sa,
 	 * cipher block size, so we don't need to worry about padding.
 	 */
 	if (!EVP_CIPHER_CTX_set_padding(ctx, 0)) {
-		free(pt);
-		EVP_CIPHER_CTX_free(ctx);
 		(*ndo->ndo_warning)(ndo,
 		    "%s: EVP_CIPHER_CTX_set_padding failed", caller);
-		return NULL;
+		return 0;
 	}
 	if (!EVP_DecryptUpdate(ctx, pt, &len, ct, ctlen)) {
-		free(pt);
-		EVP_CIPHER_CTX_free(ctx);
 		(*ndo->ndo_warning)(ndo, "%s: EVP_DecryptUpdate failed",
 		    caller);
+		return 0;
+	}
+	return 1;
+}
+
+/*
+ * Decrypt the ciphertext into a buffer, and push that buffer and the
+ * values of ndo->ndo_packetp and ndo->ndo_snapend onto the buffer
+ * stack, changing ndo->ndo_packetp and ndo->ndo_snapend to refer to
+ * the buffer.  Return a pointer to the buffer, or NULL on failure.
+ */
+static u_char *
+esp_decrypt_and_push(netdissect_options *ndo, const char *caller,
+    struct sa_list *sa, const u_char *iv, const u_char *ct,
+    unsigned int ctlen)
+{
+	u_char *pt;
+
+	/* We can't decrypt on top of the input buffer. */
+	pt = esp_get_buffer(ndo, caller, ctlen);
+	if (!do_decrypt(ndo, caller, sa, iv, ct, ctlen, pt))
 		return NULL;
+
+	/*
+	 * Switch to the output buffer for dissection, and save the
+	 * packet information on the buffer stack.  Neither a pooled
+	 * buffer nor one from nd_malloc() is freed by popping it.
+	 */
+	if (!nd_push_buffer(ndo, NULL, pt, ctlen)) {
+		(*ndo->ndo_error)(ndo, S_ERR_ND_MEM_ALLOC,
+			"%s: can't push buffer on buffer stack", caller);
 	}
-	EVP_CIPHER_CTX_free(ctx);
 	return pt;
 }
 
@@ -278,19 +524,12 @@ int esp_decrypt_buffer_by_ikev2_print(netdissect_options *ndo,
 	const u_char *iv;
 	const u_char *ct;
 	unsigned int ctlen;
-	u_char *pt;
 
 	/* initiator arg is any non-zero value */
 	if(initiator) initiator=1;
 
 	/* see if we can find the SA, and if so, decode it */
-	for (sa = ndo->ndo_sa_list_head; sa != NULL; sa = sa->next) {
-		if (sa->spi == 0
-		    && initiator == sa->initiator
-		    && memcmp(spii, sa->spii, 8) == 0
-		    && memcmp(spir, sa->spir, 8) == 0)
-			break;
-	}
+	sa = esp_find_ike_sa(ndo, initiator, spii, spir);
 
 	if(sa == NULL) return 0;
 	if(sa->evp == NULL) return 0;
@@ -306,22 +545,9 @@ int esp_decrypt_buffer_by_ikev2_print(netdissect_options *ndo,
 
 	if(end <= ct) return 0;
 
-	pt = do_decrypt(ndo, __func__, sa, iv,
-	    ct, ctlen);
-	if (pt == NULL)
+	if (esp_decrypt_and_push(ndo, __func__, sa, iv, ct, ctlen) == NULL)
 		return 0;
 
-	/*
-	 * Switch to the output buffer for dissection, and save it
-	 * on the buffer stack so it can be freed; our caller must
-	 * pop it when done.
-	 */
-	if (!nd_push_buffer(ndo, pt, pt, ctlen)) {
-		free(pt);
-		(*ndo->ndo_error)(ndo, S_ERR_ND_MEM_ALLOC,
-			"%s: can't push buffer on buffer stack", __func__);
-	}
-
 	return 1;
 }
 DIAG_ON_DEPRECATION
@@ -340,6 +566,7 @@ static void esp_print_addsa(netdissect_options *ndo,
 				  "%s: malloc", __func__);
 
 	*nsa = *sa;
+	nsa->ctx = NULL;
 
 	if (sa_def)
 		ndo->ndo_sa_default = nsa;
@@ -564,6 +791,7 @@ static void esp_print_decode_ikeline(netdissect_options *ndo, char *line,
 		return;
 	}
 
+	memset(&sa1, 0, sizeof(sa1));
 	sa1.spi = 0;
 	sa1.initiator = (init[0] == 'I');
 	if(espprint_decode_hex(ndo, sa1.spii, sizeof(sa1.spii), icookie+2)!=8)
@@ -796,14 +1024,8 @@ esp_print(netdissect_options *ndo,
 		/* if we can't get nexthdr, we do not need to decrypt it */
 
 		/* see if we can find the SA, and if so, decode it */
-		for (sa = ndo->ndo_sa_list_head; sa != NULL; sa = sa->next) {
-			if (sa->spi == GET_BE_U_4(esp->esp_spi) &&
-			    sa->daddr_version == 6 &&
-			    UNALIGNED_MEMCMP(&sa->daddr.in6, &ip6->ip6_dst,
-				   sizeof(nd_ipv6)) == 0) {
-				break;
-			}
-		}
+		sa = esp_find_sa(ndo, GET_BE_U_4(esp->esp_spi), 6,
+		    ip6->ip6_dst);
 		break;
 	case 4:
 		/* nexthdr & padding are in the last fragment */
@@ -811,14 +1033,8 @@ esp_print(netdissect_options *ndo,
 			return;
 
 		/* see if we can find the SA, and if so, decode it */
-		for (sa = ndo->ndo_sa_list_head; sa != NULL; sa = sa->next) {
-			if (sa->spi == GET_BE_U_4(esp->esp_spi) &&
-			    sa->daddr_version == 4 &&
-			    UNALIGNED_MEMCMP(&sa->daddr.in4, &ip->ip_dst,
-				   sizeof(nd_ipv4)) == 0) {
-				break;
-			}
-		}
+		sa = esp_find_sa(ndo, GET_BE_U_4(esp->esp_spi), 4,
+		    ip->ip_dst);
 		break;
 	default:
 		return;
@@ -882,20 +1098,10 @@ esp_print(netdissect_options *ndo,
 		return;
 	}
 
-	pt = do_decrypt(ndo, __func__, sa, iv, ct, payloadlen);
+	pt = esp_decrypt_and_push(ndo, __func__, sa, iv, ct, payloadlen);
 	if (pt == NULL)
 		return;
 
-	/*
-	 * Switch to the output buffer for dissection, and
-	 * save it on the buffer stack so it can be freed.
-	 */
-	if (!nd_push_buffer(ndo, pt, pt, payloadlen)) {
-		free(pt);
-		(*ndo->ndo_error)(ndo, S_ERR_ND_MEM_ALLOC,
-			"%s: can't push buffer on buffer stack", __func__);
-	}
-
 	/*
 	 * Sanity check for pad length; if it, plus 2 for the pad
 	 * length and next header fields, is bigger than the ciphertext
@@ -929,7 +1135,7 @@ esp_print(netdissect_options *ndo,
 	ip_demux_print(ndo, pt, payloadlen - (padlen + 2), ver, fragmented,
 		       ttl_hl, nh, bp2);
 
-	/* Pop the buffer, freeing it. */
+	/* Pop the buffer. */
 	nd_pop_packet_info(ndo);
 	/* Pop the nd_push_snaplen */
 	nd_pop_packet_info(ndo);
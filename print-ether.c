@@ -105,12 +105,16 @@ const struct tok ethertype_values[] = {
     { 0, NULL}
 };
 
+/*
+ * If ok is true, the caller has checked that both addresses were
+ * captured.
+ */
 static void
-ether_addresses_print(netdissect_options *ndo, const u_char *src,
+ether_addresses_print(netdissect_options *ndo, int ok, const u_char *src,
 		      const u_char *dst)
 {
 	ND_PRINT("%s > %s, ",
-		 GET_MAC48_STRING(src), GET_MAC48_STRING(dst));
+		 VIEW_MAC48_STRING(ok, src), VIEW_MAC48_STRING(ok, dst));
 }
 
 static void
@@ -147,6 +151,7 @@ ether_common_print(netdissect_options *ndo, const u_char *p, u_int length,
 	int printed_length;
 	int llc_hdrlen;
 	struct lladdr_info src, dst;
+	int ehp_ok;
 
 	if (length < caplen) {
 		ND_PRINT("[length %u < caplen %u]", length, caplen);
@@ -168,6 +173,7 @@ ether_common_print(netdissect_options *ndo, const u_char *p, u_int length,
 	 * and print them if we're printing the link-layer header.
 	 */
 	ehp = (const struct ether_header *)p;
+	ehp_ok = ND_TTEST_LEN(p, ETHER_HDRLEN + switch_tag_len);
 	src.addr = ehp->ether_shost;
 	src.addr_string = mac48_string;
 	dst.addr = ehp->ether_dhost;
@@ -179,7 +185,7 @@ ether_common_print(netdissect_options *ndo, const u_char *p, u_int length,
 	hdrlen = 2*MAC48_LEN;
 
 	if (ndo->ndo_eflag)
-		ether_addresses_print(ndo, src.addr, dst.addr);
+		ether_addresses_print(ndo, ehp_ok, src.addr, dst.addr);
 
 	/*
 	 * Print the switch tag, if we have one, and skip past it.
@@ -196,8 +202,8 @@ ether_common_print(netdissect_options *ndo, const u_char *p, u_int length,
 	 * Get the length/type field, skip past it, and print it
 	 * if we're printing the link-layer header.
 	 */
+	length_type = VIEW_BE_U_2(ehp_ok, p);
 recurse:
-	length_type = GET_BE_U_2(p);
 
 	length -= 2;
 	caplen -= 2;
@@ -364,11 +370,12 @@ recurse:
 			length -= bytesConsumed;
 			caplen -= bytesConsumed;
 			hdrlen += bytesConsumed;
+			length_type = GET_BE_U_2(p);
 			goto recurse;
 		} else {
 			/* subtype/version not known, print raw packet */
 			if (!ndo->ndo_eflag && length_type > MAX_ETHERNET_LENGTH_VAL) {
-				ether_addresses_print(ndo, src.addr, dst.addr);
+				ether_addresses_print(ndo, 0, src.addr, dst.addr);
 				ether_type_print(ndo, length_type);
 				ND_PRINT(", length %u: ", orig_length);
 			}
@@ -396,7 +403,7 @@ recurse:
 				 * MAC addresses and the final Ethernet
 				 * type.
 				 */
-				ether_addresses_print(ndo, src.addr, dst.addr);
+				ether_addresses_print(ndo, 0, src.addr, dst.addr);
 				ether_type_print(ndo, length_type);
 				ND_PRINT(", length %u: ", orig_length);
 			}
@@ -289,7 +289,7 @@ get_forces_optlv_h(uint16_t opt)
 #define IND_CHR ' '
 #define IND_PREF '\n'
 #define IND_SUF 0x0
-static char ind_buf[IND_SIZE];
+static ND_THREAD_LOCAL char ind_buf[IND_SIZE];
 
 static char *
 indent_pr(int indent, int nlpref)
@@ -400,7 +400,7 @@ icmp_tstamp_print(u_int tstamp)
 {
     u_int msec,sec,min,hrs;
 
-    static char buf[64];
+    static ND_THREAD_LOCAL char buf[64];
 
     msec = tstamp % 1000;
     sec = tstamp / 1000;
@@ -774,7 +774,7 @@ get_rtpref(u_int v)
 static const char *
 get_lifetime(uint32_t v)
 {
-	static char buf[20];
+	static ND_THREAD_LOCAL char buf[20];
 
 	if (v == (uint32_t)~0UL)
 		return "infinity";
@@ -328,9 +328,12 @@ ip_print(netdissect_options *ndo,
 	const char *p_name;
 	int truncated = 0;
 	int presumed_offload = 0;
+	int ip_ok;
+	uint8_t vhl;
 
 	ndo->ndo_protocol = "ip";
 	ip = (const struct ip *)bp;
+	ip_ok = ND_TTEST_SIZE(ip);
 
 	if (!ndo->ndo_eflag) {
 		nd_print_protocol_caps(ndo);
@@ -338,19 +341,20 @@ ip_print(netdissect_options *ndo,
 	}
 
 	ND_ICHECK_ZU(length, <, sizeof (struct ip));
-	ND_ICHECKMSG_U("version", IP_V(ip), !=, 4);
+	vhl = VIEW_U_1(ip_ok, ip->ip_vhl);
+	ND_ICHECKMSG_U("version", (vhl & 0xf0) >> 4, !=, 4);
 
-	hlen = IP_HL(ip) * 4;
+	hlen = (vhl & 0x0f) * 4;
 	ND_ICHECKMSG_ZU("header length", hlen, <, sizeof (struct ip));
 
-	len = GET_BE_U_2(ip->ip_len);
+	len = VIEW_BE_U_2(ip_ok, ip->ip_len);
 	if (len > length) {
 		ND_PRINT("[total length %u > length %u]", len, length);
 		nd_print_invalid(ndo);
 		ND_PRINT(" ");
 	}
 	if (len == 0) {
-		uint8_t nh = GET_U_1(ip->ip_p);
+		uint8_t nh = VIEW_U_1(ip_ok, ip->ip_p);
 
 		if (nh == IPPROTO_TCP || nh == IPPROTO_UDP) {
 			// we guess that it is an offload because next header
@@ -377,12 +381,12 @@ ip_print(netdissect_options *ndo,
 
 	len -= hlen;
 
-	off = GET_BE_U_2(ip->ip_off);
+	off = VIEW_BE_U_2(ip_ok, ip->ip_off);
 
-	ip_proto = GET_U_1(ip->ip_p);
+	ip_proto = VIEW_U_1(ip_ok, ip->ip_p);
 
 	if (ndo->ndo_vflag) {
-		ip_tos = GET_U_1(ip->ip_tos);
+		ip_tos = VIEW_U_1(ip_ok, ip->ip_tos);
 		ND_PRINT("(tos 0x%x", ip_tos);
 		/* ECN bits */
 		switch (ip_tos & 0x03) {
@@ -403,7 +407,7 @@ ip_print(netdissect_options *ndo,
 			break;
 		}
 
-		ip_ttl = GET_U_1(ip->ip_ttl);
+		ip_ttl = VIEW_U_1(ip_ok, ip->ip_ttl);
 		if (ip_ttl >= 1)
 			ND_PRINT(", ttl %u", ip_ttl);
 
@@ -413,7 +417,7 @@ ip_print(netdissect_options *ndo,
 		 * For unfragmented datagrams, note the don't fragment flag.
 		 */
 		ND_PRINT(", id %u, offset %u, flags [%s], proto %s (%u)",
-		    GET_BE_U_2(ip->ip_id),
+		    VIEW_BE_U_2(ip_ok, ip->ip_id),
 		    (off & IP_OFFMASK) * 8,
 		    bittok2str(ip_frag_values, "none", off & (IP_RES|IP_DF|IP_MF)),
 		    tok2str(ipproto_values, "unknown", ip_proto),
@@ -425,7 +429,7 @@ ip_print(netdissect_options *ndo,
 			else
 				ND_PRINT(", length %u [was 0, presumed TSO]", length);
 		else
-			ND_PRINT(", length %u", GET_BE_U_2(ip->ip_len));
+			ND_PRINT(", length %u", VIEW_BE_U_2(ip_ok, ip->ip_len));
 
 		if ((hlen > sizeof(struct ip))) {
 			ND_PRINT(", options (");
@@ -442,7 +446,7 @@ ip_print(netdissect_options *ndo,
 			vec[0].len = hlen;
 			sum = in_cksum(vec, 1);
 			if (sum != 0) {
-				ip_sum = GET_BE_U_2(ip->ip_sum);
+				ip_sum = VIEW_BE_U_2(ip_ok, ip->ip_sum);
 				ND_PRINT(", bad cksum %x (->%x)!", ip_sum,
 				    in_cksum_shouldbe(ip_sum, sum));
 			}
@@ -454,8 +458,8 @@ ip_print(netdissect_options *ndo,
 			ND_PRINT(")\n    ");
 		if (truncated) {
 			ND_PRINT("%s > %s: ",
-			    GET_IPADDR_STRING(ip->ip_src),
-			    GET_IPADDR_STRING(ip->ip_dst));
+			    VIEW_IPADDR_STRING(ip_ok, ip->ip_src),
+			    VIEW_IPADDR_STRING(ip_ok, ip->ip_dst));
 			nd_print_trunc(ndo);
 			nd_pop_packet_info(ndo);
 			return;
@@ -468,13 +472,13 @@ ip_print(netdissect_options *ndo,
 	 * fragments.
 	 */
 	if ((off & IP_OFFMASK) == 0) {
-		uint8_t nh = GET_U_1(ip->ip_p);
+		uint8_t nh = VIEW_U_1(ip_ok, ip->ip_p);
 
 		if (nh != IPPROTO_TCP && nh != IPPROTO_UDP &&
 		    nh != IPPROTO_SCTP && nh != IPPROTO_DCCP) {
 			ND_PRINT("%s > %s: ",
-			    GET_IPADDR_STRING(ip->ip_src),
-			    GET_IPADDR_STRING(ip->ip_dst));
+			    VIEW_IPADDR_STRING(ip_ok, ip->ip_src),
+			    VIEW_IPADDR_STRING(ip_ok, ip->ip_dst));
 		}
 		/*
 		 * Do a bounds check before calling ip_demux_print().
@@ -492,7 +496,7 @@ ip_print(netdissect_options *ndo,
 		 */
 		ip_demux_print(ndo, (const u_char *)ip + hlen,
 			       ND_MIN(length - hlen, len), 4, off & IP_MF,
-			       GET_U_1(ip->ip_ttl), nh, bp);
+			       VIEW_U_1(ip_ok, ip->ip_ttl), nh, bp);
 	} else {
 		/*
 		 * Ultra quiet now means that all this stuff should be
@@ -508,8 +512,8 @@ ip_print(netdissect_options *ndo,
 		 * next level protocol header.  print the ip addr
 		 * and the protocol.
 		 */
-		ND_PRINT("%s > %s:", GET_IPADDR_STRING(ip->ip_src),
-		    GET_IPADDR_STRING(ip->ip_dst));
+		ND_PRINT("%s > %s:", VIEW_IPADDR_STRING(ip_ok, ip->ip_src),
+		    VIEW_IPADDR_STRING(ip_ok, ip->ip_dst));
 		if (!ndo->ndo_nflag && (p_name = netdb_protoname(ip_proto)) != NULL)
 			ND_PRINT(" %s", p_name);
 		else
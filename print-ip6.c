@@ -235,9 +235,11 @@ ip6_print(netdissect_options *ndo, const u_char *bp, u_int length)
 	int found_extension_header;
 	int found_jumbo;
 	int found_hbh;
+	int ip6_ok;
 
 	ndo->ndo_protocol = "ip6";
 	ip6 = (const struct ip6_hdr *)bp;
+	ip6_ok = ND_TTEST_SIZE(ip6);
 
 	if (!ndo->ndo_eflag) {
 		nd_print_protocol_caps(ndo);
@@ -245,9 +247,9 @@ ip6_print(netdissect_options *ndo, const u_char *bp, u_int length)
 	}
 
 	ND_ICHECK_ZU(length, <, sizeof (struct ip6_hdr));
-	ND_ICHECKMSG_U("version", IP6_VERSION(ip6), !=, 6);
+	ND_ICHECKMSG_U("version", (VIEW_U_1(ip6_ok, ip6->ip6_vfc) & 0xf0) >> 4, !=, 6);
 
-	payload_len = GET_BE_U_2(ip6->ip6_plen);
+	payload_len = VIEW_BE_U_2(ip6_ok, ip6->ip6_plen);
 	/*
 	 * RFC 1883 says:
 	 *
@@ -282,9 +284,9 @@ ip6_print(netdissect_options *ndo, const u_char *bp, u_int length)
 		len = length + sizeof(struct ip6_hdr);
 
 	ph = 255;
-	nh = GET_U_1(ip6->ip6_nxt);
+	nh = VIEW_U_1(ip6_ok, ip6->ip6_nxt);
 	if (ndo->ndo_vflag) {
-	    flow = GET_BE_U_4(ip6->ip6_flow);
+	    flow = VIEW_BE_U_4(ip6_ok, ip6->ip6_flow);
 	    ND_PRINT("(");
 	    /* RFC 2460 */
 	    if (flow & 0x0ff00000)
@@ -293,7 +295,7 @@ ip6_print(netdissect_options *ndo, const u_char *bp, u_int length)
 	        ND_PRINT("flowlabel 0x%05x, ", flow & 0x000fffff);
 
 	    ND_PRINT("hlim %u, next-header %s (%u), payload length %u) ",
-	                 GET_U_1(ip6->ip6_hlim),
+	                 VIEW_U_1(ip6_ok, ip6->ip6_hlim),
 	                 tok2str(ipproto_values,"unknown",nh),
 	                 nh,
 	                 payload_len);
@@ -327,8 +329,8 @@ ip6_print(netdissect_options *ndo, const u_char *bp, u_int length)
 		if (cp == (const u_char *)(ip6 + 1) &&
 		    nh != IPPROTO_TCP && nh != IPPROTO_UDP &&
 		    nh != IPPROTO_DCCP && nh != IPPROTO_SCTP) {
-			ND_PRINT("%s > %s: ", GET_IP6ADDR_STRING(ip6->ip6_src),
-				 GET_IP6ADDR_STRING(ip6->ip6_dst));
+			ND_PRINT("%s > %s: ", VIEW_IP6ADDR_STRING(ip6_ok, ip6->ip6_src),
+				 VIEW_IP6ADDR_STRING(ip6_ok, ip6->ip6_dst));
 		}
 
 		switch (nh) {
@@ -500,7 +502,7 @@ ip6_print(netdissect_options *ndo, const u_char *bp, u_int length)
 				}
 			}
 			ip_demux_print(ndo, cp, len, 6, fragmented,
-				       GET_U_1(ip6->ip6_hlim), nh, bp);
+				       VIEW_U_1(ip6_ok, ip6->ip6_hlim), nh, bp);
 			nd_pop_packet_info(ndo);
 			return;
 		}
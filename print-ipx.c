@@ -98,7 +98,7 @@ ipx_print(netdissect_options *ndo, const u_char *p, u_int length)
 static const char *
 ipxaddr_string(netdissect_options *ndo, uint32_t net, const u_char *node)
 {
-    static char line[256];
+    static ND_THREAD_LOCAL char line[256];
 
     snprintf(line, sizeof(line), "%08x.%02x:%02x:%02x:%02x:%02x:%02x",
 	    net, GET_U_1(node), GET_U_1(node + 1),
@@ -682,12 +682,12 @@ ikev1_print(netdissect_options *ndo,
 	    const u_char *bp2, const struct isakmp *base);
 
 #define MAXINITIATORS	20
-static int ninitiator = 0;
+static ND_THREAD_LOCAL int ninitiator = 0;
 union inaddr_u {
 	nd_ipv4 in4;
 	nd_ipv6 in6;
 };
-static struct {
+static ND_THREAD_LOCAL struct {
 	cookie_t initiator;
 	u_int version;
 	union inaddr_u iaddr;
@@ -2947,7 +2947,8 @@ ikev2_e_print(netdissect_options *ndo,
 		/*
 		 * esp_decrypt_buffer_by_ikev2_print pushed information
 		 * on the buffer stack; we're done with the buffer, so
-		 * pop it (which frees the buffer)
+		 * pop it (which frees the buffer if it isn't
+		 * one of the ones print-esp.c reuses)
 		 */
 		nd_pop_packet_info(ndo);
 	}
@@ -3065,7 +3066,7 @@ trunc:
 static char *
 numstr(u_int x)
 {
-	static char buf[20];
+	static ND_THREAD_LOCAL char buf[20];
 	snprintf(buf, sizeof(buf), "#%u", x);
 	return buf;
 }
@@ -1339,7 +1339,7 @@ static char *
 lldp_network_addr_print(netdissect_options *ndo, const u_char *tptr, u_int len)
 {
     uint8_t af;
-    static char buf[BUFSIZE];
+    static ND_THREAD_LOCAL char buf[BUFSIZE];
     const char * (*pfunc)(netdissect_options *, const u_char *);
 
     if (len < 1)
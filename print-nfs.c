@@ -26,6 +26,7 @@
 #include "netdissect-stdinc.h"
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <limits.h>
 
@@ -40,11 +41,12 @@
 #include "ip6.h"
 #include "rpc_auth.h"
 #include "rpc_msg.h"
+#include "xidmap.h"
 
 
 static void nfs_printfh(netdissect_options *, const uint32_t *, const u_int);
-static int xid_map_enter(netdissect_options *, const struct sunrpc_msg *, const u_char *);
-static int xid_map_find(netdissect_options *, const struct sunrpc_msg *, const u_char *, uint32_t *, uint32_t *);
+static int nfs_xid_map_enter(netdissect_options *, const struct sunrpc_msg *, const u_char *);
+static int nfs_xid_map_find(netdissect_options *, const struct sunrpc_msg *, const u_char *, uint32_t *, uint32_t *);
 static void interp_reply(netdissect_options *, const struct sunrpc_msg *, uint32_t, uint32_t, int);
 static const uint32_t *parse_post_op_attr(netdissect_options *, const uint32_t *, int);
 
@@ -358,6 +360,7 @@ nfsreply_noaddr_print(netdissect_options *ndo,
                       const u_char *bp2)
 {
 	const struct sunrpc_msg *rp;
+	struct xid_map_key key;
 	uint32_t proc, vers, reply_stat;
 	enum sunrpc_reject_stat rstat;
 	uint32_t rlow;
@@ -373,8 +376,13 @@ nfsreply_noaddr_print(netdissect_options *ndo,
 
 	case SUNRPC_MSG_ACCEPTED:
 		ND_PRINT("reply ok %u", length);
-		if (xid_map_find(ndo, rp, bp2, &proc, &vers) >= 0)
+		if (nfs_xid_map_find(ndo, rp, bp2, &proc, &vers) >= 0)
 			interp_reply(ndo, rp, proc, vers, length);
+		else if (xid_map_key_init(ndo, &key, XID_MAP_SUNRPC,
+					  GET_BE_U_4(rp->rm_xid), bp2, 1)) {
+			/* Not an NFS call (see sunrpc_print()); just time it. */
+			(void)xid_map_find(ndo, &key, &vers, &proc);
+		}
 		break;
 
 	case SUNRPC_MSG_DENIED:
@@ -573,7 +581,7 @@ nfsreq_noaddr_print(netdissect_options *ndo,
 	ND_PRINT("%u", length);
 	rp = (const struct sunrpc_msg *)bp;
 
-	if (!xid_map_enter(ndo, rp, bp2))	/* record proc number for later on */
+	if (!nfs_xid_map_enter(ndo, rp, bp2))	/* record proc number for later on */
 		goto trunc;
 
 	v3 = (GET_BE_U_4(&rp->rm_call.cb_vers) == NFS_VER3);
@@ -920,75 +928,28 @@ nfs_printfh(netdissect_options *ndo,
 }
 
 /*
- * Maintain a small cache of recent client.XID.server/proc pairs, to allow
- * us to match up replies with requests and thus to know how to parse
- * the reply.
- */
-
-struct xid_map_entry {
-	uint32_t	xid;		/* transaction ID (net order) */
-	int ipver;			/* IP version (4 or 6) */
-	nd_ipv6	client;			/* client IP address (net order) */
-	nd_ipv6	server;			/* server IP address (net order) */
-	uint32_t	proc;		/* call proc number (host order) */
-	uint32_t	vers;		/* program version (host order) */
-};
-
-/*
- * Map entries are kept in an array that we manage as a ring;
- * new entries are always added at the tail of the ring.  Initially,
- * all the entries are zero and hence don't match anything.
+ * Remember client.XID.server/proc tuples (see xidmap.c), to allow us
+ * to match up replies with requests and thus to know how to parse the
+ * reply.
  */
 
-#define	XIDMAPSIZE	64
-
-static struct xid_map_entry xid_map[XIDMAPSIZE];
-
-static int xid_map_next = 0;
-static int xid_map_hint = 0;
-
 static int
-xid_map_enter(netdissect_options *ndo,
-              const struct sunrpc_msg *rp, const u_char *bp)
+nfs_xid_map_enter(netdissect_options *ndo,
+                  const struct sunrpc_msg *rp, const u_char *bp)
 {
-	const struct ip *ip = NULL;
-	const struct ip6_hdr *ip6 = NULL;
-	struct xid_map_entry *xmep;
+	struct xid_map_key key;
+	uint32_t prog, vers;
 
 	if (!ND_TTEST_4(rp->rm_call.cb_proc))
 		return (0);
-	switch (IP_V((const struct ip *)bp)) {
-	case 4:
-		ip = (const struct ip *)bp;
-		break;
-	case 6:
-		ip6 = (const struct ip6_hdr *)bp;
-		break;
-	default:
+	if (!xid_map_key_init(ndo, &key, XID_MAP_NFS,
+			      GET_BE_U_4(rp->rm_xid), bp, 0))
 		return (1);
-	}
-
-	xmep = &xid_map[xid_map_next];
-
-	if (++xid_map_next >= XIDMAPSIZE)
-		xid_map_next = 0;
-
-	UNALIGNED_MEMCPY(&xmep->xid, &rp->rm_xid, sizeof(xmep->xid));
-	if (ip) {
-		xmep->ipver = 4;
-		UNALIGNED_MEMCPY(&xmep->client, ip->ip_src,
-				 sizeof(ip->ip_src));
-		UNALIGNED_MEMCPY(&xmep->server, ip->ip_dst,
-				 sizeof(ip->ip_dst));
-	} else if (ip6) {
-		xmep->ipver = 6;
-		UNALIGNED_MEMCPY(&xmep->client, ip6->ip6_src,
-				 sizeof(ip6->ip6_src));
-		UNALIGNED_MEMCPY(&xmep->server, ip6->ip6_dst,
-				 sizeof(ip6->ip6_dst));
-	}
-	xmep->proc = GET_BE_U_4(&rp->rm_call.cb_proc);
-	xmep->vers = GET_BE_U_4(&rp->rm_call.cb_vers);
+	prog = GET_BE_U_4(rp->rm_call.cb_prog);
+	vers = GET_BE_U_4(rp->rm_call.cb_vers);
+	xid_map_enter(ndo, &key, prog, vers,
+		      GET_BE_U_4(rp->rm_call.cb_proc),
+		      prog == NFS_PROG && vers == NFS_VER3 ? nfsproc_str : NULL);
 	return (1);
 }
 
@@ -997,59 +958,17 @@ xid_map_enter(netdissect_options *ndo,
  * version in vers return, or returns -1 on failure
  */
 static int
-xid_map_find(netdissect_options *ndo, const struct sunrpc_msg *rp,
-	     const u_char *bp, uint32_t *proc, uint32_t *vers)
+nfs_xid_map_find(netdissect_options *ndo, const struct sunrpc_msg *rp,
+		 const u_char *bp, uint32_t *proc, uint32_t *vers)
 {
-	int i;
-	struct xid_map_entry *xmep;
-	uint32_t xid;
-	const struct ip *ip = (const struct ip *)bp;
-	const struct ip6_hdr *ip6 = (const struct ip6_hdr *)bp;
-	int cmp;
-
-	UNALIGNED_MEMCPY(&xid, &rp->rm_xid, sizeof(xmep->xid));
-	/* Start searching from where we last left off */
-	i = xid_map_hint;
-	do {
-		xmep = &xid_map[i];
-		cmp = 1;
-		if (xmep->ipver != IP_V(ip) || xmep->xid != xid)
-			goto nextitem;
-		switch (xmep->ipver) {
-		case 4:
-			if (UNALIGNED_MEMCMP(ip->ip_src, &xmep->server,
-					     sizeof(ip->ip_src)) != 0 ||
-			    UNALIGNED_MEMCMP(ip->ip_dst, &xmep->client,
-					     sizeof(ip->ip_dst)) != 0) {
-				cmp = 0;
-			}
-			break;
-		case 6:
-			if (UNALIGNED_MEMCMP(ip6->ip6_src, &xmep->server,
-					     sizeof(ip6->ip6_src)) != 0 ||
-			    UNALIGNED_MEMCMP(ip6->ip6_dst, &xmep->client,
-					     sizeof(ip6->ip6_dst)) != 0) {
-				cmp = 0;
-			}
-			break;
-		default:
-			cmp = 0;
-			break;
-		}
-		if (cmp) {
-			/* match */
-			xid_map_hint = i;
-			*proc = xmep->proc;
-			*vers = xmep->vers;
-			return 0;
-		}
-	nextitem:
-		if (++i >= XIDMAPSIZE)
-			i = 0;
-	} while (i != xid_map_hint);
+	struct xid_map_key key;
 
-	/* search failed */
-	return (-1);
+	if (!xid_map_key_init(ndo, &key, XID_MAP_NFS,
+			      GET_BE_U_4(rp->rm_xid), bp, 1))
+		return (-1);
+	if (!xid_map_find(ndo, &key, vers, proc))
+		return (-1);
+	return (0);
 }
 
 /*
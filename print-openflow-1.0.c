@@ -673,7 +673,7 @@ static const struct tok bsn_onoff_str[] = {
 static const char *
 vlan_str(const uint16_t vid)
 {
-	static char buf[sizeof("65535 (bogus)")];
+	static ND_THREAD_LOCAL char buf[sizeof("65535 (bogus)")];
 
 	if (vid == OFP_VLAN_NONE)
 		return "NONE";
@@ -685,7 +685,7 @@ vlan_str(const uint16_t vid)
 static const char *
 pcp_str(const uint8_t pcp)
 {
-	static char buf[sizeof("255 (bogus)")];
+	static ND_THREAD_LOCAL char buf[sizeof("255 (bogus)")];
 	snprintf(buf, sizeof(buf), "%u%s", pcp,
 	         pcp <= 7 ? "" : " (bogus)");
 	return buf;
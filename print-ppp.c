@@ -1349,10 +1349,10 @@ ppp_hdlc(netdissect_options *ndo,
         if (length == 0)
                 return;
 
-	b = (u_char *)malloc(caplen);
+	b = (u_char *)nd_malloc(ndo, caplen);
 	if (b == NULL) {
 		(*ndo->ndo_error)(ndo, S_ERR_ND_MEM_ALLOC,
-			"%s: malloc", __func__);
+			"%s: nd_malloc", __func__);
 	}
 
 	/*
@@ -1374,12 +1374,11 @@ ppp_hdlc(netdissect_options *ndo,
 	}
 
 	/*
-	 * Switch to the output buffer for dissection, and save it
-	 * on the buffer stack so it can be freed; our caller must
-	 * pop it when done.
+	 * Switch to the output buffer for dissection, and save the
+	 * packet information on the buffer stack; our caller must pop
+	 * it when done.  The buffer is freed at the end of the packet.
 	 */
-	if (!nd_push_buffer(ndo, b, b, (u_int)(t - b))) {
-		free(b);
+	if (!nd_push_buffer(ndo, NULL, b, (u_int)(t - b))) {
 		(*ndo->ndo_error)(ndo, S_ERR_ND_MEM_ALLOC,
 			"%s: can't push buffer on buffer stack", __func__);
 	}
@@ -25,8 +25,12 @@
 
 #include <config.h>
 
+#include <stdlib.h>
+#include <string.h>
+
 #include "netdissect-stdinc.h"
 #include "netdissect-alloc.h"
+#include "netdissect-hash.h"
 #include "netdissect.h"
 #include "extract.h"
 
@@ -34,11 +38,6 @@
 
 typedef uint8_t quic_cid[QUIC_MAX_CID_LENGTH];
 
-struct quic_cid_array {
-	uint8_t cid[QUIC_MAX_CID_LENGTH];
-	uint8_t length;
-};
-
 enum quic_lh_packet_type {
 	QUIC_LH_TYPE_INITIAL = 0,
 	QUIC_LH_TYPE_0RTT = 1,
@@ -55,51 +54,362 @@ hexprint(netdissect_options *ndo, const uint8_t *cp, size_t len)
 		ND_PRINT("%02x", cp[i]);
 }
 
-#define QUIC_CID_LIST_MAX	512
+/*
+ * Connection IDs seen in long header packets are remembered, so that
+ * the destination connection ID of a short header packet, which has no
+ * length field, can be found and printed.
+ *
+ * The connection IDs are kept in an array of entries, on a least
+ * recently used list, indexed by an open-addressing hash table with
+ * linear probing that is at most half full; the table is hung off the
+ * netdissect_options structure.  The least recently used connection
+ * IDs are dropped when they haven't been seen for QUIC_CID_IDLE_TIMEOUT
+ * (of packet time stamps), or to stay within the size limit given with
+ * --quic-cid-table-size.
+ */
+#define QUIC_CID_INITIAL_SIZE	64
+#define QUIC_CID_IDLE_TIMEOUT	(10 * 60)	/* seconds */
+#define QUIC_CID_NONE		UINT32_MAX
+
+struct quic_cid_entry {
+	uint8_t cid[QUIC_MAX_CID_LENGTH];
+	uint8_t length;			/* 0 if the entry is free */
+	uint32_t hash;
+	uint32_t prev;			/* toward the most recently used */
+	uint32_t next;			/* toward the least recently used */
+	uint64_t last_use;		/* value of "clock" when last used */
+	time_t last_seen;		/* seconds part of the last time stamp */
+	uint64_t packets;		/* packets sent to this connection ID */
+	uint64_t bytes;			/* ... and their total length */
+};
 
-static struct quic_cid_array quic_cid_array[QUIC_CID_LIST_MAX];
+struct quic_cid_table {
+	struct quic_cid_entry *entries;
+	uint32_t nentries;		/* number allocated */
+	uint32_t count;			/* number in use */
+	uint32_t max_count;		/* largest value of "count" seen */
+	uint32_t free;			/* free list, linked through "next" */
+	uint32_t head;			/* most recently used */
+	uint32_t tail;			/* least recently used */
+	uint32_t *slots;		/* entry index + 1, or 0 if empty */
+	size_t nslots;			/* a power of 2 */
+	u_int length_count[QUIC_MAX_CID_LENGTH + 1];	/* in use, by length */
+	uint64_t clock;
+	uint64_t lookups;
+	uint64_t probes;
+	uint64_t evicted_idle;
+	uint64_t evicted_full;
+};
 
-static struct quic_cid_array *
-lookup_quic_cid(const u_char *cid, size_t length)
+static struct quic_cid_table *
+quic_cid_get_table(netdissect_options *ndo)
 {
-	for (unsigned int i = 0; i < QUIC_CID_LIST_MAX; i++) {
-		if (quic_cid_array[i].length > length) {
-			continue;
-		}
-		if (quic_cid_array[i].length == 0) {
+	struct quic_cid_table *t;
+
+	if (ndo->ndo_quic_cid_table == NULL) {
+		/* calloc() return used by 'ndo_quic_cid_table': do not free() */
+		t = (struct quic_cid_table *)calloc(1, sizeof(*t));
+		if (t == NULL)
+			(*ndo->ndo_error)(ndo, S_ERR_ND_MEM_ALLOC,
+					  "%s: calloc", __func__);
+		t->free = QUIC_CID_NONE;
+		t->head = QUIC_CID_NONE;
+		t->tail = QUIC_CID_NONE;
+		ndo->ndo_quic_cid_table = t;
+	}
+	return ndo->ndo_quic_cid_table;
+}
+
+static uint32_t
+quic_cid_hash(const uint8_t *cid, u_int length)
+{
+	uint64_t w[3] = { 0, 0, 0 };
+
+	memcpy(w, cid, length);
+	return ((uint32_t)nd_hash64(length, w, 3));
+}
+
+/*
+ * Find the slot for the connection ID, or the empty slot where it
+ * would go.
+ */
+static uint32_t *
+quic_cid_probe(struct quic_cid_table *t, const uint8_t *cid, u_int length,
+	       uint32_t hash)
+{
+	size_t mask = t->nslots - 1;
+	size_t i = hash & mask;
+	const struct quic_cid_entry *e;
+
+	for (;;) {
+		t->probes++;
+		if (t->slots[i] == 0)
 			break;
-		}
-		if (memcmp(quic_cid_array[i].cid, cid,
-			   quic_cid_array[i].length) == 0) {
-			/*
-			 * Swap the entries so that it behaves like an
-			 * LRU cache.
-			 */
-			if (i != 0) {
-				struct quic_cid_array tmp = quic_cid_array[i];
-				quic_cid_array[i] = quic_cid_array[0];
-				quic_cid_array[0] = tmp;
-			}
+		e = &t->entries[t->slots[i] - 1];
+		if (e->hash == hash && e->length == length &&
+		    memcmp(e->cid, cid, length) == 0)
+			break;
+		i = (i + 1) & mask;
+	}
+	return (&t->slots[i]);
+}
+
+static void
+quic_cid_unlink(struct quic_cid_table *t, uint32_t idx)
+{
+	struct quic_cid_entry *e = &t->entries[idx];
+
+	if (e->prev != QUIC_CID_NONE)
+		t->entries[e->prev].next = e->next;
+	else
+		t->head = e->next;
+	if (e->next != QUIC_CID_NONE)
+		t->entries[e->next].prev = e->prev;
+	else
+		t->tail = e->prev;
+}
+
+static void
+quic_cid_push(struct quic_cid_table *t, uint32_t idx)
+{
+	struct quic_cid_entry *e = &t->entries[idx];
+
+	e->prev = QUIC_CID_NONE;
+	e->next = t->head;
+	if (t->head != QUIC_CID_NONE)
+		t->entries[t->head].prev = idx;
+	else
+		t->tail = idx;
+	t->head = idx;
+}
+
+/* Make the entry the most recently used one. */
+static void
+quic_cid_touch(netdissect_options *ndo, struct quic_cid_table *t,
+	       uint32_t idx)
+{
+	struct quic_cid_entry *e = &t->entries[idx];
+
+	if (t->head != idx) {
+		quic_cid_unlink(t, idx);
+		quic_cid_push(t, idx);
+	}
+	e->last_use = ++t->clock;
+	e->last_seen = ndo->ndo_packet_ts.tv_sec;
+}
+
+/*
+ * Remove the entry, moving later entries of the same probe sequence
+ * back so that no lookup stops short at the hole it leaves in the
+ * hash table.
+ */
+static void
+quic_cid_remove(struct quic_cid_table *t, uint32_t idx)
+{
+	struct quic_cid_entry *e = &t->entries[idx];
+	size_t mask = t->nslots - 1;
+	size_t i, j, home;
 
-			return &quic_cid_array[0];
+	for (i = e->hash & mask; t->slots[i] != idx + 1; i = (i + 1) & mask)
+		continue;
+	j = i;
+	for (;;) {
+		j = (j + 1) & mask;
+		if (t->slots[j] == 0)
+			break;
+		home = t->entries[t->slots[j] - 1].hash & mask;
+		/* Can the entry in slot j move to slot i? */
+		if (i <= j ? (home <= i || home > j) : (home <= i && home > j)) {
+			t->slots[i] = t->slots[j];
+			i = j;
 		}
 	}
+	t->slots[i] = 0;
+
+	quic_cid_unlink(t, idx);
+	t->length_count[e->length]--;
+	e->length = 0;
+	e->next = t->free;
+	t->free = idx;
+	t->count--;
+}
+
+static void
+quic_cid_grow_slots(netdissect_options *ndo, struct quic_cid_table *t)
+{
+	size_t mask, i;
+	uint32_t idx;
+
+	free(t->slots);
+	t->nslots = t->nslots != 0 ? t->nslots * 2 : QUIC_CID_INITIAL_SIZE;
+	t->slots = (uint32_t *)calloc(t->nslots, sizeof(*t->slots));
+	if (t->slots == NULL)
+		(*ndo->ndo_error)(ndo, S_ERR_ND_MEM_ALLOC,
+				  "%s: calloc", __func__);
+	mask = t->nslots - 1;
+	for (idx = t->head; idx != QUIC_CID_NONE; idx = t->entries[idx].next) {
+		for (i = t->entries[idx].hash & mask; t->slots[i] != 0;
+		     i = (i + 1) & mask)
+			continue;
+		t->slots[i] = idx + 1;
+	}
+}
 
-	return NULL;
+static int
+quic_cid_expired(netdissect_options *ndo, const struct quic_cid_entry *e)
+{
+	return (ndo->ndo_packet_ts.tv_sec >= e->last_seen &&
+		ndo->ndo_packet_ts.tv_sec - e->last_seen >=
+		QUIC_CID_IDLE_TIMEOUT);
+}
+
+/* Get a free entry, making room for it if need be. */
+static uint32_t
+quic_cid_alloc(netdissect_options *ndo, struct quic_cid_table *t)
+{
+	struct quic_cid_entry *entries;
+	uint32_t idx, n;
+
+	/* Drop the connection IDs that have been idle for too long... */
+	while (t->tail != QUIC_CID_NONE &&
+	       quic_cid_expired(ndo, &t->entries[t->tail])) {
+		quic_cid_remove(t, t->tail);
+		t->evicted_idle++;
+	}
+	/* ...and the least recently used one if the table is full. */
+	if (ndo->ndo_quic_cid_table_size != 0 &&
+	    t->count >= ndo->ndo_quic_cid_table_size) {
+		quic_cid_remove(t, t->tail);
+		t->evicted_full++;
+	}
+
+	if (t->free == QUIC_CID_NONE) {
+		n = t->nentries != 0 ? t->nentries * 2 : QUIC_CID_INITIAL_SIZE / 2;
+		entries = (struct quic_cid_entry *)
+			realloc(t->entries, n * sizeof(*entries));
+		if (entries == NULL)
+			(*ndo->ndo_error)(ndo, S_ERR_ND_MEM_ALLOC,
+					  "%s: realloc", __func__);
+		t->entries = entries;
+		for (idx = n; idx > t->nentries; idx--) {
+			entries[idx - 1].length = 0;
+			entries[idx - 1].next = t->free;
+			t->free = idx - 1;
+		}
+		t->nentries = n;
+	}
+	if ((t->count + 1) * 2 > t->nslots)
+		quic_cid_grow_slots(ndo, t);
+	idx = t->free;
+	t->free = t->entries[idx].next;
+	return (idx);
 }
 
 static void
-register_quic_cid(const quic_cid cid, uint8_t length)
+register_quic_cid(netdissect_options *ndo, const quic_cid cid, uint8_t length)
 {
-	static uint16_t next_cid = 0;
+	struct quic_cid_table *t = quic_cid_get_table(ndo);
+	struct quic_cid_entry *e;
+	uint32_t hash, idx;
+	uint32_t *slot;
 
-	if (length == 0 ||
-	    lookup_quic_cid(cid, length) != NULL) {
+	if (length == 0)
 		return;
+	hash = quic_cid_hash(cid, length);
+	if (t->nslots != 0) {
+		t->lookups++;
+		slot = quic_cid_probe(t, cid, length, hash);
+		if (*slot != 0) {
+			quic_cid_touch(ndo, t, *slot - 1);
+			return;
+		}
 	}
-	memcpy(&quic_cid_array[next_cid].cid, cid, QUIC_MAX_CID_LENGTH);
-	quic_cid_array[next_cid].length = length;
-	next_cid = (next_cid + 1) % QUIC_CID_LIST_MAX;
+	idx = quic_cid_alloc(ndo, t);
+	e = &t->entries[idx];
+	memcpy(e->cid, cid, QUIC_MAX_CID_LENGTH);
+	e->length = length;
+	e->hash = hash;
+	e->packets = 0;
+	e->bytes = 0;
+	*quic_cid_probe(t, cid, length, hash) = idx + 1;
+	quic_cid_push(t, idx);
+	t->length_count[length]++;
+	t->count++;
+	if (t->count > t->max_count)
+		t->max_count = t->count;
+	e->last_use = ++t->clock;
+	e->last_seen = ndo->ndo_packet_ts.tv_sec;
+}
+
+/*
+ * Find the connection ID that the data at cid, of which there are
+ * length bytes, starts with; if more than one does, the most recently
+ * used one.
+ */
+static struct quic_cid_entry *
+lookup_quic_cid(netdissect_options *ndo, const u_char *cid, size_t length)
+{
+	struct quic_cid_table *t = ndo->ndo_quic_cid_table;
+	uint32_t *slot;
+	uint32_t best = QUIC_CID_NONE;
+	u_int l;
+
+	if (t == NULL || t->count == 0)
+		return NULL;
+	for (l = 1; l <= QUIC_MAX_CID_LENGTH && l <= length; l++) {
+		if (t->length_count[l] == 0)
+			continue;
+		t->lookups++;
+		slot = quic_cid_probe(t, cid, l, quic_cid_hash(cid, l));
+		if (*slot != 0 && quic_cid_expired(ndo, &t->entries[*slot - 1])) {
+			quic_cid_remove(t, *slot - 1);
+			t->evicted_idle++;
+			continue;
+		}
+		if (*slot != 0 && (best == QUIC_CID_NONE ||
+		    t->entries[*slot - 1].last_use > t->entries[best].last_use))
+			best = *slot - 1;
+	}
+	if (best == QUIC_CID_NONE)
+		return NULL;
+	quic_cid_touch(ndo, t, best);
+	return &t->entries[best];
+}
+
+/*
+ * Count a long header packet sent to the connection ID.
+ */
+static void
+count_quic_cid(netdissect_options *ndo, const quic_cid cid, uint8_t length,
+	       size_t bytes)
+{
+	struct quic_cid_table *t = ndo->ndo_quic_cid_table;
+	uint32_t *slot;
+
+	t->lookups++;
+	slot = quic_cid_probe(t, cid, length, quic_cid_hash(cid, length));
+	if (*slot != 0) {
+		t->entries[*slot - 1].packets++;
+		t->entries[*slot - 1].bytes += bytes;
+	}
+}
+
+/*
+ * Report the connection ID table statistics, if it has been used.
+ */
+void
+quic_print_cid_stats(netdissect_options *ndo, FILE *f)
+{
+	const struct quic_cid_table *t = ndo->ndo_quic_cid_table;
+
+	if (t == NULL || t->lookups == 0)
+		return;
+	fprintf(f, "QUIC connection IDs: %u in %zu slots (at most %u), "
+		"%.2f probes per lookup, %" PRIu64 " dropped when idle, %"
+		PRIu64 " dropped when full\n",
+		t->count, t->nslots, t->max_count,
+		(double)t->probes / (double)t->lookups,
+		t->evicted_idle, t->evicted_full);
 }
 
 /* Returns 1 if the first octet looks like a QUIC packet. */
@@ -157,6 +467,7 @@ quic_print_packet(netdissect_options *ndo, const u_char *bp, const u_char *end)
 	uint8_t vli_length = 0;
 	uint8_t *token = NULL;
 	uint64_t token_length = 0;
+	const u_char *start = bp;
 
 	first_octet = GET_U_1(bp);
 	bp += 1;
@@ -186,7 +497,7 @@ quic_print_packet(netdissect_options *ndo, const u_char *bp, const u_char *end)
 			bp += dcil;
 			ND_PRINT(", dcid ");
 			hexprint(ndo, dcid, dcil);
-			register_quic_cid(dcid, dcil);
+			register_quic_cid(ndo, dcid, dcil);
 		}
 		scil = GET_U_1(bp);
 		bp += 1;
@@ -196,7 +507,7 @@ quic_print_packet(netdissect_options *ndo, const u_char *bp, const u_char *end)
 			bp += scil;
 			ND_PRINT(", scid ");
 			hexprint(ndo, scid, scil);
-			register_quic_cid(scid, scil);
+			register_quic_cid(ndo, scid, scil);
 		}
 		if (version == 0) {
 			/* Version Negotiation packet */
@@ -248,17 +559,24 @@ quic_print_packet(netdissect_options *ndo, const u_char *bp, const u_char *end)
 					bp += payload_length;
 			}
 		}
+		if (dcil > 0 && dcil <= QUIC_MAX_CID_LENGTH)
+			count_quic_cid(ndo, dcid, dcil, bp - start);
 	} else {
 		/* Short Header */
 		ND_PRINT(", protected");
 		if (end > bp && end - bp > 16 &&
 		    ND_TTEST_LEN(bp, end - bp)) {
-			struct quic_cid_array *cid_array =
-				lookup_quic_cid(bp, end - bp);
-			if (cid_array != NULL) {
+			struct quic_cid_entry *e =
+				lookup_quic_cid(ndo, bp, end - bp);
+			if (e != NULL) {
+				e->packets++;
+				e->bytes += end - start;
 				ND_PRINT(", dcid ");
-				hexprint(ndo, cid_array->cid,
-					 cid_array->length);
+				hexprint(ndo, e->cid, e->length);
+				if (ndo->ndo_vflag)
+					ND_PRINT(" (%" PRIu64 " packets, %"
+						 PRIu64 " bytes)",
+						 e->packets, e->bytes);
 			}
 		} else {
 			nd_print_trunc(ndo);
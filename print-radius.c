@@ -876,7 +876,7 @@ print_attr_num(netdissect_options *ndo,
 
                           /* This attribute has standard values */
    if (attr_type[attr_code].siz_subtypes) {
-      static const char **table;
+      static ND_THREAD_LOCAL const char **table;
       uint32_t data_value;
       table = attr_type[attr_code].subtypes;
 
@@ -1195,15 +1195,15 @@ print_attr_time(netdissect_options *ndo,
                 const u_char *data, u_int length, u_short attr_code _U_)
 {
    time_t attr_time;
-   char string[26];
+   struct tm tm;
+   char string[sizeof("Www Mmm dd hh:mm:ss yyyy")];
 
    ND_ICHECK_U(length, !=, 4);
 
    attr_time = GET_BE_U_4(data);
-   strlcpy(string, ctime(&attr_time), sizeof(string));
-   /* Get rid of the newline */
-   string[24] = '\0';
-   ND_PRINT("%.24s", string);
+   /* What ctime() gives, without the newline */
+   ND_PRINT("%s", nd_format_time(string, sizeof(string),
+            "%a %b %e %H:%M:%S %Y", nd_localtime(&attr_time, &tm)));
    return;
 
 invalid:
@@ -38,6 +38,7 @@
 #include <config.h>
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include "netdissect-stdinc.h"
 
@@ -46,6 +47,7 @@
 #include "extract.h"
 
 #include "ip.h"
+#include "xidmap.h"
 
 #define FS_RX_PORT	7000
 #define CB_RX_PORT	7001
@@ -472,28 +474,14 @@ static const struct tok rx_ack_reasons[] = {
 };
 
 /*
- * Cache entries we keep around so we can figure out the RX opcode
+ * Calls are remembered (see xidmap.c) so we can figure out the RX opcode
  * numbers for replies.  This allows us to make sense of RX reply packets.
  */
 
-struct rx_cache_entry {
-	uint32_t	callnum;	/* Call number (net order) */
-	uint32_t	client;		/* client IP address (net order) */
-	uint32_t	server;		/* server IP address (net order) */
-	uint16_t	dport;		/* server UDP port (host order) */
-	uint16_t	serviceId;	/* Service identifier (net order) */
-	uint32_t	opcode;		/* RX opcode (host order) */
-};
-
-#define RX_CACHE_SIZE	64
-
-static struct rx_cache_entry	rx_cache[RX_CACHE_SIZE];
-
-static uint32_t	rx_cache_next = 0;
-static uint32_t	rx_cache_hint = 0;
 static void	rx_cache_insert(netdissect_options *, const u_char *, const struct ip *, uint16_t);
 static int	rx_cache_find(netdissect_options *, const struct rx_header *,
 			      const struct ip *, uint16_t, uint32_t *);
+static const struct tok *rx_opcode_names(uint16_t, uint32_t);
 
 static void fs_print(netdissect_options *, const u_char *, u_int);
 static void fs_reply_print(netdissect_options *, const u_char *, u_int, uint32_t);
@@ -677,34 +665,34 @@ rx_print(netdissect_options *ndo,
 }
 
 /*
- * Insert an entry into the cache.  Taken from print-nfs.c
+ * Insert an entry into the cache.
  */
 
 static void
 rx_cache_insert(netdissect_options *ndo,
                 const u_char *bp, const struct ip *ip, uint16_t dport)
 {
-	struct rx_cache_entry *rxent;
+	struct xid_map_key key;
 	const struct rx_header *rxh = (const struct rx_header *) bp;
+	uint32_t opcode;
 
 	if (!ND_TTEST_4(bp + sizeof(struct rx_header)))
 		return;
 
-	rxent = &rx_cache[rx_cache_next];
-
-	if (++rx_cache_next >= RX_CACHE_SIZE)
-		rx_cache_next = 0;
-
-	rxent->callnum = GET_BE_U_4(rxh->callNumber);
-	rxent->client = GET_IPV4_TO_NETWORK_ORDER(ip->ip_src);
-	rxent->server = GET_IPV4_TO_NETWORK_ORDER(ip->ip_dst);
-	rxent->dport = dport;
-	rxent->serviceId = GET_BE_U_2(rxh->serviceId);
-	rxent->opcode = GET_BE_U_4(bp + sizeof(struct rx_header));
+	if (!xid_map_key_init(ndo, &key, XID_MAP_RX,
+			      GET_BE_U_4(rxh->callNumber),
+			      (const u_char *)ip, 0))
+		return;
+	key.conn = GET_BE_U_4(rxh->cid);
+	key.port = dport;
+	key.service = GET_BE_U_2(rxh->serviceId);
+	opcode = GET_BE_U_4(bp + sizeof(struct rx_header));
+	xid_map_enter(ndo, &key, dport, 0, opcode,
+		      rx_opcode_names(dport, opcode));
 }
 
 /*
- * Lookup an entry in the cache.  Also taken from print-nfs.c
+ * Lookup an entry in the cache.
  *
  * Note that because this is a reply, we're looking at the _source_
  * port.
@@ -714,37 +702,50 @@ static int
 rx_cache_find(netdissect_options *ndo, const struct rx_header *rxh,
 	      const struct ip *ip, uint16_t sport, uint32_t *opcode)
 {
-	uint32_t i;
-	struct rx_cache_entry *rxent;
-	uint32_t clip;
-	uint32_t sip;
-
-	clip = GET_IPV4_TO_NETWORK_ORDER(ip->ip_dst);
-	sip = GET_IPV4_TO_NETWORK_ORDER(ip->ip_src);
-
-	/* Start the search where we last left off */
+	struct xid_map_key key;
+	uint32_t vers;
 
-	i = rx_cache_hint;
-	do {
-		rxent = &rx_cache[i];
-		if (rxent->callnum == GET_BE_U_4(rxh->callNumber) &&
-		    rxent->client == clip &&
-		    rxent->server == sip &&
-		    rxent->serviceId == GET_BE_U_2(rxh->serviceId) &&
-		    rxent->dport == sport) {
-
-			/* We got a match! */
+	if (!xid_map_key_init(ndo, &key, XID_MAP_RX,
+			      GET_BE_U_4(rxh->callNumber),
+			      (const u_char *)ip, 1))
+		return(0);
+	key.conn = GET_BE_U_4(rxh->cid);
+	key.port = sport;
+	key.service = GET_BE_U_2(rxh->serviceId);
+	return(xid_map_find(ndo, &key, &vers, opcode));
+}
 
-			rx_cache_hint = i;
-			*opcode = rxent->opcode;
-			return(1);
-		}
-		if (++i >= RX_CACHE_SIZE)
-			i = 0;
-	} while (i != rx_cache_hint);
+/*
+ * The names of the opcodes of the service on a port, for the latency
+ * report.
+ */
 
-	/* Our search failed */
-	return(0);
+static const struct tok *
+rx_opcode_names(uint16_t dport, uint32_t opcode)
+{
+	switch (dport) {
+		case FS_RX_PORT:
+			return(fs_req);
+		case CB_RX_PORT:
+			return(cb_req);
+	}
+	/* The replicated database services also handle Ubik calls. */
+	if (is_ubik(opcode))
+		return(ubik_req);
+	switch (dport) {
+		case PROT_RX_PORT:
+			return(pt_req);
+		case VLDB_RX_PORT:
+			return(vldb_req);
+		case KAUTH_RX_PORT:
+			return(kauth_req);
+		case VOL_RX_PORT:
+			return(vol_req);
+		case BOS_RX_PORT:
+			return(bos_req);
+		default:
+			return(NULL);
+	}
 }
 
 /*
@@ -792,12 +793,12 @@ rx_cache_find(netdissect_options *ndo, const struct rx_header *rxh,
 			ND_PRINT(" %" PRIu64, _i); \
 		}
 
-#define DATEOUT() { time_t _t; char str[256]; \
+#define DATEOUT() { time_t _t; struct tm _tm; char str[256]; \
 			_t = (time_t) GET_BE_S_4(bp); \
 			bp += sizeof(int32_t); \
 			ND_PRINT(" %s", \
 			    nd_format_time(str, sizeof(str), \
-			      "%Y-%m-%d %H:%M:%S", localtime(&_t))); \
+			      "%Y-%m-%d %H:%M:%S", nd_localtime(&_t, &_tm))); \
 		}
 
 #define STOREATTROUT() { uint32_t mask, _i; \
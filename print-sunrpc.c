@@ -45,6 +45,9 @@
 #ifdef HAVE_RPC_RPCENT_H
 #include <rpc/rpcent.h>
 #endif /* HAVE_RPC_RPCENT_H */
+#ifdef HAVE_PTHREADS
+#include <pthread.h>
+#endif
 #endif /* defined(HAVE_GETRPCBYNUMBER) && defined(HAVE_RPC_RPC_H) */
 
 #include <stdio.h>
@@ -59,6 +62,7 @@
 
 #include "rpc_auth.h"
 #include "rpc_msg.h"
+#include "xidmap.h"
 
 /*
  * Copyright (c) 2009, Sun Microsystems, Inc.
@@ -130,6 +134,7 @@
  */
 
 #define SUNRPC_PMAPPORT		((uint16_t)111)
+#define SUNRPC_PMAPPROG		((uint32_t)100000)
 #define SUNRPC_PMAPPROC_NULL	((uint32_t)0)
 #define SUNRPC_PMAPPROC_SET	((uint32_t)1)
 #define SUNRPC_PMAPPROC_UNSET	((uint32_t)2)
@@ -157,6 +162,7 @@ sunrpc_print(netdissect_options *ndo, const u_char *bp,
 	const struct sunrpc_msg *rp;
 	const struct ip *ip;
 	const struct ip6_hdr *ip6;
+	struct xid_map_key key;
 	uint32_t x;
 	char srcid[20], dstid[20];	/*fits 32bit*/
 
@@ -164,6 +170,15 @@ sunrpc_print(netdissect_options *ndo, const u_char *bp,
 	rp = (const struct sunrpc_msg *)bp;
 	ND_TCHECK_SIZE(rp);
 
+	/* Remember the call, to time the reply (see nfsreply_print()). */
+	if (xid_map_key_init(ndo, &key, XID_MAP_SUNRPC,
+			     GET_BE_U_4(rp->rm_xid), bp2, 0)) {
+		x = GET_BE_U_4(rp->rm_call.cb_prog);
+		xid_map_enter(ndo, &key, x, GET_BE_U_4(rp->rm_call.cb_vers),
+			      GET_BE_U_4(rp->rm_call.cb_proc),
+			      x == SUNRPC_PMAPPROG ? proc2str : NULL);
+	}
+
 	if (!ndo->ndo_nflag) {
 		snprintf(srcid, sizeof(srcid), "0x%x",
 		    GET_BE_U_4(rp->rm_xid));
@@ -214,22 +229,34 @@ sunrpc_print(netdissect_options *ndo, const u_char *bp,
 	}
 }
 
+#if defined(HAVE_GETRPCBYNUMBER) && defined(HAVE_RPC_RPC_H) && \
+    defined(HAVE_PTHREADS)
+/* getrpcbynumber() returns a pointer to a static structure */
+static pthread_mutex_t rpcent_lock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
 static char *
 progstr(uint32_t prog)
 {
 #if defined(HAVE_GETRPCBYNUMBER) && defined(HAVE_RPC_RPC_H)
 	struct rpcent *rp;
 #endif
-	static char buf[32];
-	static uint32_t lastprog = 0;
+	static ND_THREAD_LOCAL char buf[32];
+	static ND_THREAD_LOCAL uint32_t lastprog = 0;
 
 	if (lastprog != 0 && prog == lastprog)
 		return (buf);
 #if defined(HAVE_GETRPCBYNUMBER) && defined(HAVE_RPC_RPC_H)
+#ifdef HAVE_PTHREADS
+	pthread_mutex_lock(&rpcent_lock);
+#endif
 	rp = getrpcbynumber(prog);
 	if (rp != NULL)
 		strlcpy(buf, rp->r_name, sizeof(buf));
-	else
+#ifdef HAVE_PTHREADS
+	pthread_mutex_unlock(&rpcent_lock);
+#endif
+	if (rp == NULL)
 #endif
 		(void) snprintf(buf, sizeof(buf), "#%u", prog);
 	lastprog = prog;
@@ -48,7 +48,9 @@ __RCSID("$NetBSD: print-tcp.c,v 1.8 2007/07/24 11:53:48 drochner Exp $");
 
 #include "ip.h"
 #include "ip6.h"
+#include "flowstate.h"
 #include "ipproto.h"
+#include "portmap.h"
 #include "rpc_auth.h"
 #include "rpc_msg.h"
 
@@ -68,40 +70,38 @@ static void print_tcp_fastopen_option(netdissect_options *ndo, const u_char *cp,
 #define MAX_RST_DATA_LEN	30
 
 
-struct tha {
-        nd_ipv4 src;
-        nd_ipv4 dst;
-        u_int port;
-};
-
-struct tcp_seq_hash {
-        struct tcp_seq_hash *nxt;
-        struct tha addr;
-        uint32_t seq;
-        uint32_t ack;
-};
+/*
+ * Initial sequence numbers of the conversations seen so far, so that
+ * sequence numbers can be printed relative to them.  The conversations
+ * are kept in the flow state (see flowstate.h), keyed on the addresses
+ * and ports, in an arbitrary collating order so there's only one entry
+ * for both directions.
+ *
+ * A conversation that has been closed with an RST, or with a FIN in
+ * each direction, is dropped once no packets have been seen for it for
+ * TCP_FLOW_CLOSED_LINGER seconds (of packet time), so that the last
+ * ACKs and any retransmissions are still printed relative to it; any
+ * other conversation is dropped after TCP_FLOW_IDLE_TIMEOUT seconds,
+ * long enough to keep one that is only kept alive by keepalives.
+ * With --tcp-flow-table-size, at most that many conversations are
+ * kept, discarding the least recently used.
+ */
+#define TCP_FLOW_CLOSED_LINGER	60
+#define TCP_FLOW_IDLE_TIMEOUT	(2*3600 + 15*60)
 
-struct tha6 {
-        nd_ipv6 src;
-        nd_ipv6 dst;
-        u_int port;
-};
+#define TCP_FLOW_FIN	0x01	/* FIN seen from the source */
+#define TCP_FLOW_FIN_REV	0x02	/* FIN seen from the destination */
+#define TCP_FLOW_RST	0x04	/* RST seen */
 
-struct tcp_seq_hash6 {
-        struct tcp_seq_hash6 *nxt;
-        struct tha6 addr;
+struct tcp_flow {
         uint32_t seq;
         uint32_t ack;
+        u_int flags;
 };
 
-#define TSEQ_HASHSIZE 919
-
 /* These tcp options do not have the size octet */
 #define ZEROLENOPT(o) ((o) == TCPOPT_EOL || (o) == TCPOPT_NOP)
 
-static struct tcp_seq_hash tcp_seq_hash4[TSEQ_HASHSIZE];
-static struct tcp_seq_hash6 tcp_seq_hash6[TSEQ_HASHSIZE];
-
 const struct tok tcp_flag_values[] = {
         { TH_FIN, "F" },
         { TH_SYN, "S" },
@@ -180,6 +180,228 @@ tcp6_cksum(netdissect_options *ndo,
                                 IPPROTO_TCP);
 }
 
+/*
+ * The dissectors that tcp_print() can hand the payload to, by port.
+ */
+enum tcp_dissector {
+        TCP_FTP,
+        TCP_SSH,
+        TCP_TELNET,
+        TCP_SMTP,
+        TCP_WHOIS,
+        TCP_DOMAIN,
+        TCP_HTTP,
+        TCP_NBT_SSN,
+        TCP_BGP,
+        TCP_RPKI_RTR,
+        TCP_SMB,
+        TCP_RTSP,
+        TCP_MSDP,
+        TCP_LDP,
+        TCP_PPTP,
+        TCP_RESP,
+        TCP_BEEP,
+        TCP_OPENFLOW,
+        TCP_NFS,
+        TCP_ZMTP1
+};
+
+const struct tok tcp_port_dissectors[] = {
+        { TCP_FTP,              "ftp" },
+        { TCP_SSH,              "ssh" },
+        { TCP_TELNET,           "telnet" },
+        { TCP_SMTP,             "smtp" },
+        { TCP_WHOIS,            "whois" },
+        { TCP_DOMAIN,           "domain" },
+        { TCP_HTTP,             "http" },
+#ifdef ENABLE_SMB
+        { TCP_NBT_SSN,          "nbt-ssn" },
+#endif
+        { TCP_BGP,              "bgp" },
+        { TCP_RPKI_RTR,         "rpki-rtr" },
+#ifdef ENABLE_SMB
+        { TCP_SMB,              "smb" },
+#endif
+        { TCP_RTSP,             "rtsp" },
+        { TCP_MSDP,             "msdp" },
+        { TCP_LDP,              "ldp" },
+        { TCP_PPTP,             "pptp" },
+        { TCP_RESP,             "resp" },
+        { TCP_BEEP,             "beep" },
+        { TCP_OPENFLOW,         "openflow" },
+        { TCP_NFS,              "nfs" },
+        { TCP_ZMTP1,            "zmtp1" },
+        { 0, NULL }
+};
+
+#define EITHER(port, d) { (port), (port), PORT_MATCH_EITHER, (d) }
+
+/*
+ * When more than one entry matches, the first one is tried first.
+ */
+static const struct port_map_entry tcp_port_map[] = {
+        EITHER(FTP_PORT, TCP_FTP),
+        EITHER(SSH_PORT, TCP_SSH),
+        EITHER(TELNET_PORT, TCP_TELNET),
+        EITHER(SMTP_PORT, TCP_SMTP),
+        EITHER(WHOIS_PORT, TCP_WHOIS),
+        EITHER(NAMESERVER_PORT, TCP_DOMAIN),
+        EITHER(HTTP_PORT, TCP_HTTP),
+#ifdef ENABLE_SMB
+        EITHER(NETBIOS_SSN_PORT, TCP_NBT_SSN),
+#endif
+        EITHER(BGP_PORT, TCP_BGP),
+        EITHER(RPKI_RTR_PORT, TCP_RPKI_RTR),
+#ifdef ENABLE_SMB
+        EITHER(SMB_PORT, TCP_SMB),
+#endif
+        EITHER(RTSP_PORT, TCP_RTSP),
+        EITHER(MSDP_PORT, TCP_MSDP),
+        EITHER(LDP_PORT, TCP_LDP),
+        EITHER(PPTP_PORT, TCP_PPTP),
+        EITHER(REDIS_PORT, TCP_RESP),
+        EITHER(BEEP_PORT, TCP_BEEP),
+        EITHER(OPENFLOW_PORT_OLD, TCP_OPENFLOW),
+        EITHER(OPENFLOW_PORT_IANA, TCP_OPENFLOW),
+        EITHER(HTTP_PORT_ALT, TCP_HTTP),
+        EITHER(RTSP_PORT_ALT, TCP_RTSP),
+        EITHER(NFS_PORT, TCP_NFS)
+};
+
+#undef EITHER
+
+static const struct port_map *
+tcp_get_port_map(netdissect_options *ndo)
+{
+        if (ndo->ndo_tcp_port_map == NULL)
+                ndo->ndo_tcp_port_map = port_map_build(ndo, IPPROTO_TCP,
+                    tcp_port_map,
+                    sizeof(tcp_port_map) / sizeof(tcp_port_map[0]));
+        return ndo->ndo_tcp_port_map;
+}
+
+/*
+ * If data present, header length valid, and NFS port used, assume NFS.
+ * Pass offset of data plus 4 bytes for RPC TCP msg length to NFS print
+ * routines.
+ */
+static int
+tcp_nfs_print(netdissect_options *ndo, uint16_t port, uint16_t sport,
+              uint16_t dport, const u_char *bp, u_int length,
+              const u_char *ip)
+{
+        uint32_t fraglen;
+        const struct sunrpc_msg *rp;
+        enum sunrpc_msg_type direction;
+
+        if (length < 4)
+                return 0;
+        fraglen = GET_BE_U_4(bp) & 0x7FFFFFFF;
+        if (fraglen > length - 4)
+                fraglen = length - 4;
+        rp = (const struct sunrpc_msg *)(bp + 4);
+        if (ND_TTEST_4(rp->rm_direction)) {
+                direction = (enum sunrpc_msg_type) GET_BE_U_4(rp->rm_direction);
+                if (dport == port && direction == SUNRPC_CALL) {
+                        ND_PRINT(": NFS request xid %u ",
+                                 GET_BE_U_4(rp->rm_xid));
+                        nfsreq_noaddr_print(ndo, (const u_char *)rp, fraglen, ip);
+                } else if (sport == port && direction == SUNRPC_REPLY) {
+                        ND_PRINT(": NFS reply xid %u ",
+                                 GET_BE_U_4(rp->rm_xid));
+                        nfsreply_noaddr_print(ndo, (const u_char *)rp, fraglen, ip);
+                }
+        }
+        return 1;
+}
+
+/*
+ * Hand the payload to the dissector, which was chosen because the
+ * port matched; return 0 if the payload doesn't look like something
+ * the dissector handles, so that the next one is tried.
+ */
+static int
+tcp_dissect(netdissect_options *ndo, int dissector, uint16_t sport,
+            uint16_t dport, uint16_t port, const u_char *bp, u_int length,
+            const u_char *ip)
+{
+        switch (dissector) {
+
+        case TCP_FTP:
+                ND_PRINT(": ");
+                ftp_print(ndo, bp, length);
+                break;
+        case TCP_SSH:
+                ssh_print(ndo, bp, length);
+                break;
+        case TCP_TELNET:
+                telnet_print(ndo, bp, length);
+                break;
+        case TCP_SMTP:
+                ND_PRINT(": ");
+                smtp_print(ndo, bp, length);
+                break;
+        case TCP_WHOIS:
+                ND_PRINT(": ");
+                whois_print(ndo, bp, length);
+                break;
+        case TCP_DOMAIN:
+                /* over_tcp: TRUE, is_mdns: FALSE */
+                domain_print(ndo, bp, length, TRUE, FALSE);
+                break;
+        case TCP_HTTP:
+                ND_PRINT(": ");
+                http_print(ndo, bp, length);
+                break;
+#ifdef ENABLE_SMB
+        case TCP_NBT_SSN:
+                nbt_tcp_print(ndo, bp, length);
+                break;
+#endif
+        case TCP_BGP:
+                bgp_print(ndo, bp, length);
+                break;
+        case TCP_RPKI_RTR:
+                rpki_rtr_print(ndo, bp, length);
+                break;
+#ifdef ENABLE_SMB
+        case TCP_SMB:
+                smb_tcp_print(ndo, bp, length);
+                break;
+#endif
+        case TCP_RTSP:
+                ND_PRINT(": ");
+                rtsp_print(ndo, bp, length);
+                break;
+        case TCP_MSDP:
+                msdp_print(ndo, bp, length);
+                break;
+        case TCP_LDP:
+                ldp_print(ndo, bp, length);
+                break;
+        case TCP_PPTP:
+                pptp_print(ndo, bp);
+                break;
+        case TCP_RESP:
+                resp_print(ndo, bp, length);
+                break;
+        case TCP_BEEP:
+                beep_print(ndo, bp, length);
+                break;
+        case TCP_OPENFLOW:
+                openflow_print(ndo, bp, length);
+                break;
+        case TCP_NFS:
+                return tcp_nfs_print(ndo, port, sport, dport, bp, length, ip);
+        case TCP_ZMTP1:
+                zmtp1_print(ndo, bp, length);
+                break;
+        default:
+                return 0;
+        }
+        return 1;
+}
+
 void
 tcp_print(netdissect_options *ndo,
           const u_char *bp, u_int length,
@@ -197,14 +419,23 @@ tcp_print(netdissect_options *ndo,
         int rev;
         const struct ip6_hdr *ip6;
         u_int header_len;	/* Header length in bytes */
+        struct port_map_iter it;
+        uint16_t port;
+        int dissector;
+        int tp_ok, ip_ok;
+        uint8_t offx2;
 
         ndo->ndo_protocol = "tcp";
         tp = (const struct tcphdr *)bp;
         ip = (const struct ip *)bp2;
-        if (IP_V(ip) == 6)
+        if (IP_V(ip) == 6) {
                 ip6 = (const struct ip6_hdr *)bp2;
-        else
+                ip_ok = ND_TTEST_SIZE(ip6);
+        } else {
                 ip6 = NULL;
+                ip_ok = ND_TTEST_SIZE(ip);
+        }
+        tp_ok = ND_TTEST_SIZE(tp);
         ch = '\0';
         if (!ND_TTEST_2(tp->th_dport)) {
                 if (ip6) {
@@ -219,26 +450,26 @@ tcp_print(netdissect_options *ndo,
                 nd_trunc_longjmp(ndo);
         }
 
-        sport = GET_BE_U_2(tp->th_sport);
-        dport = GET_BE_U_2(tp->th_dport);
+        sport = VIEW_BE_U_2(tp_ok, tp->th_sport);
+        dport = VIEW_BE_U_2(tp_ok, tp->th_dport);
 
         if (ip6) {
-                if (GET_U_1(ip6->ip6_nxt) == IPPROTO_TCP) {
+                if (VIEW_U_1(ip_ok, ip6->ip6_nxt) == IPPROTO_TCP) {
                         ND_PRINT("%s.%s > %s.%s: ",
-                                 GET_IP6ADDR_STRING(ip6->ip6_src),
+                                 VIEW_IP6ADDR_STRING(ip_ok, ip6->ip6_src),
                                  tcpport_string(ndo, sport),
-                                 GET_IP6ADDR_STRING(ip6->ip6_dst),
+                                 VIEW_IP6ADDR_STRING(ip_ok, ip6->ip6_dst),
                                  tcpport_string(ndo, dport));
                 } else {
                         ND_PRINT("%s > %s: ",
                                  tcpport_string(ndo, sport), tcpport_string(ndo, dport));
                 }
         } else {
-                if (GET_U_1(ip->ip_p) == IPPROTO_TCP) {
+                if (VIEW_U_1(ip_ok, ip->ip_p) == IPPROTO_TCP) {
                         ND_PRINT("%s.%s > %s.%s: ",
-                                 GET_IPADDR_STRING(ip->ip_src),
+                                 VIEW_IPADDR_STRING(ip_ok, ip->ip_src),
                                  tcpport_string(ndo, sport),
-                                 GET_IPADDR_STRING(ip->ip_dst),
+                                 VIEW_IPADDR_STRING(ip_ok, ip->ip_dst),
                                  tcpport_string(ndo, dport));
                 } else {
                         ND_PRINT("%s > %s: ",
@@ -246,7 +477,8 @@ tcp_print(netdissect_options *ndo,
                 }
         }
 
-        hlen = TH_OFF(tp) * 4;
+        offx2 = VIEW_U_1(tp_ok, tp->th_offx2);
+        hlen = ((offx2 & 0xf0) >> 4) * 4;
 
         if (hlen < sizeof(*tp)) {
                 ND_PRINT(" tcp %u [bad hdr length %u - too short, < %zu]",
@@ -254,10 +486,10 @@ tcp_print(netdissect_options *ndo,
                 goto invalid;
         }
 
-        seq = GET_BE_U_4(tp->th_seq);
-        ack = GET_BE_U_4(tp->th_ack);
-        win = GET_BE_U_2(tp->th_win);
-        urp = GET_BE_U_2(tp->th_urp);
+        seq = VIEW_BE_U_4(tp_ok, tp->th_seq);
+        ack = VIEW_BE_U_4(tp_ok, tp->th_ack);
+        win = VIEW_BE_U_2(tp_ok, tp->th_win);
+        urp = VIEW_BE_U_2(tp_ok, tp->th_urp);
 
         if (ndo->ndo_qflag) {
                 ND_PRINT("tcp %u", length - hlen);
@@ -269,7 +501,7 @@ tcp_print(netdissect_options *ndo,
                 return;
         }
 
-        flags = tcp_get_flags(tp);
+        flags = VIEW_U_1(tp_ok, tp->th_flags) | ((offx2 & 0x0f) << 8);
         ND_PRINT("Flags [%s]", bittok2str_nosep(tcp_flag_values, "none", flags));
 
         if (!ndo->ndo_Sflag && (flags & TH_ACK)) {
@@ -279,135 +511,79 @@ tcp_print(netdissect_options *ndo,
                  * collating order so there's only one entry for
                  * both directions).
                  */
-                rev = 0;
-                if (ip6) {
-                        struct tcp_seq_hash6 *th;
-                        struct tcp_seq_hash6 *tcp_seq_hash;
-                        const void *src, *dst;
-                        struct tha6 tha;
+                struct nd_flow_key key;
+                struct tcp_flow *th;
+                const void *src, *dst;
+                u_int addrlen;
 
-                        tcp_seq_hash = tcp_seq_hash6;
+                if (ip6) {
                         src = (const void *)ip6->ip6_src;
                         dst = (const void *)ip6->ip6_dst;
-                        if (sport > dport)
+                        addrlen = sizeof(ip6->ip6_src);
+                } else {
+                        src = (const void *)ip->ip_src;
+                        dst = (const void *)ip->ip_dst;
+                        addrlen = sizeof(ip->ip_src);
+                }
+                rev = 0;
+                if (sport > dport)
+                        rev = 1;
+                else if (sport == dport) {
+                        if (UNALIGNED_MEMCMP(src, dst, addrlen) > 0)
                                 rev = 1;
-                        else if (sport == dport) {
-                                if (UNALIGNED_MEMCMP(src, dst, sizeof(ip6->ip6_dst)) > 0)
-                                        rev = 1;
-                        }
+                }
+                memset(&key, 0, sizeof(key));
+                if (rev) {
+                        UNALIGNED_MEMCPY(&key.src, dst, addrlen);
+                        UNALIGNED_MEMCPY(&key.dst, src, addrlen);
+                        key.sport = dport;
+                        key.dport = sport;
+                } else {
+                        UNALIGNED_MEMCPY(&key.src, src, addrlen);
+                        UNALIGNED_MEMCPY(&key.dst, dst, addrlen);
+                        key.sport = sport;
+                        key.dport = dport;
+                }
+                key.ipver = ip6 ? 6 : 4;
+                key.proto = IPPROTO_TCP;
+
+                th = nd_flow_find(ndo, ND_FLOW_TCP_SEQ, &key);
+                if (th == NULL || (flags & TH_SYN)) {
+                        /* didn't find it or new conversation */
+                        if (th == NULL)
+                                th = nd_flow_create(ndo, ND_FLOW_TCP_SEQ,
+                                                    &key, sizeof(*th),
+                                                    TCP_FLOW_IDLE_TIMEOUT);
+                        th->flags = 0;
                         if (rev) {
-                                UNALIGNED_MEMCPY(&tha.src, dst, sizeof(ip6->ip6_dst));
-                                UNALIGNED_MEMCPY(&tha.dst, src, sizeof(ip6->ip6_src));
-                                tha.port = ((u_int)dport) << 16 | sport;
-                        } else {
-                                UNALIGNED_MEMCPY(&tha.dst, dst, sizeof(ip6->ip6_dst));
-                                UNALIGNED_MEMCPY(&tha.src, src, sizeof(ip6->ip6_src));
-                                tha.port = ((u_int)sport) << 16 | dport;
-                        }
-
-                        for (th = &tcp_seq_hash[tha.port % TSEQ_HASHSIZE];
-                             th->nxt; th = th->nxt)
-                                if (memcmp((char *)&tha, (char *)&th->addr,
-                                           sizeof(th->addr)) == 0)
-                                        break;
-
-                        if (!th->nxt || (flags & TH_SYN)) {
-                                /* didn't find it or new conversation */
-                                /* calloc() return used by the 'tcp_seq_hash6'
-                                   hash table: do not free() */
-                                if (th->nxt == NULL) {
-                                        th->nxt = (struct tcp_seq_hash6 *)
-                                                calloc(1, sizeof(*th));
-                                        if (th->nxt == NULL)
-                                                (*ndo->ndo_error)(ndo,
-                                                        S_ERR_ND_MEM_ALLOC,
-                                                        "%s: calloc", __func__);
-                                }
-                                th->addr = tha;
-                                if (rev) {
-                                        th->ack = seq;
-                                        th->seq = ack - 1;
-                                } else {
-                                        th->seq = seq;
-                                        th->ack = ack - 1;
-                                }
+                                th->ack = seq;
+                                th->seq = ack - 1;
                         } else {
-                                if (rev) {
-                                        seq -= th->ack;
-                                        ack -= th->seq;
-                                } else {
-                                        seq -= th->seq;
-                                        ack -= th->ack;
-                                }
+                                th->seq = seq;
+                                th->ack = ack - 1;
                         }
-
-                        thseq = th->seq;
-                        thack = th->ack;
                 } else {
-                        struct tcp_seq_hash *th;
-                        struct tcp_seq_hash *tcp_seq_hash;
-                        struct tha tha;
-
-                        tcp_seq_hash = tcp_seq_hash4;
-                        if (sport > dport)
-                                rev = 1;
-                        else if (sport == dport) {
-                                if (UNALIGNED_MEMCMP(ip->ip_src, ip->ip_dst, sizeof(ip->ip_dst)) > 0)
-                                        rev = 1;
-                        }
                         if (rev) {
-                                UNALIGNED_MEMCPY(&tha.src, ip->ip_dst,
-                                                 sizeof(ip->ip_dst));
-                                UNALIGNED_MEMCPY(&tha.dst, ip->ip_src,
-                                                 sizeof(ip->ip_src));
-                                tha.port = ((u_int)dport) << 16 | sport;
-                        } else {
-                                UNALIGNED_MEMCPY(&tha.dst, ip->ip_dst,
-                                                 sizeof(ip->ip_dst));
-                                UNALIGNED_MEMCPY(&tha.src, ip->ip_src,
-                                                 sizeof(ip->ip_src));
-                                tha.port = ((u_int)sport) << 16 | dport;
-                        }
-
-                        for (th = &tcp_seq_hash[tha.port % TSEQ_HASHSIZE];
-                             th->nxt; th = th->nxt)
-                                if (memcmp((char *)&tha, (char *)&th->addr,
-                                           sizeof(th->addr)) == 0)
-                                        break;
-
-                        if (!th->nxt || (flags & TH_SYN)) {
-                                /* didn't find it or new conversation */
-                                /* calloc() return used by the 'tcp_seq_hash4'
-                                   hash table: do not free() */
-                                if (th->nxt == NULL) {
-                                        th->nxt = (struct tcp_seq_hash *)
-                                                calloc(1, sizeof(*th));
-                                        if (th->nxt == NULL)
-                                                (*ndo->ndo_error)(ndo,
-                                                        S_ERR_ND_MEM_ALLOC,
-                                                        "%s: calloc", __func__);
-                                }
-                                th->addr = tha;
-                                if (rev) {
-                                        th->ack = seq;
-                                        th->seq = ack - 1;
-                                } else {
-                                        th->seq = seq;
-                                        th->ack = ack - 1;
-                                }
+                                seq -= th->ack;
+                                ack -= th->seq;
                         } else {
-                                if (rev) {
-                                        seq -= th->ack;
-                                        ack -= th->seq;
-                                } else {
-                                        seq -= th->seq;
-                                        ack -= th->ack;
-                                }
+                                seq -= th->seq;
+                                ack -= th->ack;
                         }
-
-                        thseq = th->seq;
-                        thack = th->ack;
                 }
+                if (flags & TH_FIN)
+                        th->flags |= rev ? TCP_FLOW_FIN_REV : TCP_FLOW_FIN;
+                if (flags & TH_RST)
+                        th->flags |= TCP_FLOW_RST;
+                if ((th->flags & TCP_FLOW_RST) ||
+                    (th->flags & (TCP_FLOW_FIN|TCP_FLOW_FIN_REV)) ==
+                     (TCP_FLOW_FIN|TCP_FLOW_FIN_REV))
+                        nd_flow_set_timeout(ndo, th, TCP_FLOW_CLOSED_LINGER);
+                else
+                        nd_flow_set_timeout(ndo, th, TCP_FLOW_IDLE_TIMEOUT);
+
+                thseq = th->seq;
+                thack = th->ack;
         } else {
                 /*fool gcc*/
                 thseq = thack = rev = 0;
@@ -425,7 +601,7 @@ tcp_print(netdissect_options *ndo,
                 if (IP_V(ip) == 4) {
                         if (ND_TTEST_LEN(tp->th_sport, length)) {
                                 sum = tcp_cksum(ndo, ip, tp, length);
-                                tcp_sum = GET_BE_U_2(tp->th_sum);
+                                tcp_sum = VIEW_BE_U_2(tp_ok, tp->th_sum);
 
                                 ND_PRINT(", cksum 0x%04x", tcp_sum);
                                 if (sum != 0)
@@ -437,7 +613,7 @@ tcp_print(netdissect_options *ndo,
                 } else if (IP_V(ip) == 6) {
                         if (ND_TTEST_LEN(tp->th_sport, length)) {
                                 sum = tcp6_cksum(ndo, ip6, tp, length);
-                                tcp_sum = GET_BE_U_2(tp->th_sum);
+                                tcp_sum = VIEW_BE_U_2(tp_ok, tp->th_sum);
 
                                 ND_PRINT(", cksum 0x%04x", tcp_sum);
                                 if (sum != 0)
@@ -787,89 +963,11 @@ tcp_print(netdissect_options *ndo,
                 return;
         }
 
-        if (IS_SRC_OR_DST_PORT(FTP_PORT)) {
-                ND_PRINT(": ");
-                ftp_print(ndo, bp, length);
-        } else if (IS_SRC_OR_DST_PORT(SSH_PORT)) {
-                ssh_print(ndo, bp, length);
-        } else if (IS_SRC_OR_DST_PORT(TELNET_PORT)) {
-                telnet_print(ndo, bp, length);
-        } else if (IS_SRC_OR_DST_PORT(SMTP_PORT)) {
-                ND_PRINT(": ");
-                smtp_print(ndo, bp, length);
-        } else if (IS_SRC_OR_DST_PORT(WHOIS_PORT)) {
-                ND_PRINT(": ");
-                whois_print(ndo, bp, length);
-        } else if (IS_SRC_OR_DST_PORT(NAMESERVER_PORT)) {
-                /* over_tcp: TRUE, is_mdns: FALSE */
-                domain_print(ndo, bp, length, TRUE, FALSE);
-        } else if (IS_SRC_OR_DST_PORT(HTTP_PORT)) {
-                ND_PRINT(": ");
-                http_print(ndo, bp, length);
-#ifdef ENABLE_SMB
-        } else if (IS_SRC_OR_DST_PORT(NETBIOS_SSN_PORT)) {
-                nbt_tcp_print(ndo, bp, length);
-#endif
-        } else if (IS_SRC_OR_DST_PORT(BGP_PORT)) {
-                bgp_print(ndo, bp, length);
-        } else if (IS_SRC_OR_DST_PORT(RPKI_RTR_PORT)) {
-                rpki_rtr_print(ndo, bp, length);
-#ifdef ENABLE_SMB
-        } else if (IS_SRC_OR_DST_PORT(SMB_PORT)) {
-                smb_tcp_print(ndo, bp, length);
-#endif
-        } else if (IS_SRC_OR_DST_PORT(RTSP_PORT)) {
-                ND_PRINT(": ");
-                rtsp_print(ndo, bp, length);
-        } else if (IS_SRC_OR_DST_PORT(MSDP_PORT)) {
-                msdp_print(ndo, bp, length);
-        } else if (IS_SRC_OR_DST_PORT(LDP_PORT)) {
-                ldp_print(ndo, bp, length);
-        } else if (IS_SRC_OR_DST_PORT(PPTP_PORT))
-                pptp_print(ndo, bp);
-        else if (IS_SRC_OR_DST_PORT(REDIS_PORT))
-                resp_print(ndo, bp, length);
-        else if (IS_SRC_OR_DST_PORT(BEEP_PORT))
-                beep_print(ndo, bp, length);
-        else if (IS_SRC_OR_DST_PORT(OPENFLOW_PORT_OLD) || IS_SRC_OR_DST_PORT(OPENFLOW_PORT_IANA)) {
-                openflow_print(ndo, bp, length);
-        } else if (IS_SRC_OR_DST_PORT(HTTP_PORT_ALT)) {
-                ND_PRINT(": ");
-                http_print(ndo, bp, length);
-        } else if (IS_SRC_OR_DST_PORT(RTSP_PORT_ALT)) {
-                ND_PRINT(": ");
-                rtsp_print(ndo, bp, length);
-        } else if ((IS_SRC_OR_DST_PORT(NFS_PORT)) &&
-                 length >= 4) {
-                /*
-                 * If data present, header length valid, and NFS port used,
-                 * assume NFS.
-                 * Pass offset of data plus 4 bytes for RPC TCP msg length
-                 * to NFS print routines.
-                 */
-                uint32_t fraglen;
-                const struct sunrpc_msg *rp;
-                enum sunrpc_msg_type direction;
-
-                fraglen = GET_BE_U_4(bp) & 0x7FFFFFFF;
-                if (fraglen > (length) - 4)
-                        fraglen = (length) - 4;
-                rp = (const struct sunrpc_msg *)(bp + 4);
-                if (ND_TTEST_4(rp->rm_direction)) {
-                        direction = (enum sunrpc_msg_type) GET_BE_U_4(rp->rm_direction);
-                        if (dport == NFS_PORT && direction == SUNRPC_CALL) {
-                                ND_PRINT(": NFS request xid %u ",
-                                         GET_BE_U_4(rp->rm_xid));
-                                nfsreq_noaddr_print(ndo, (const u_char *)rp, fraglen, (const u_char *)ip);
-                                return;
-                        }
-                        if (sport == NFS_PORT && direction == SUNRPC_REPLY) {
-                                ND_PRINT(": NFS reply xid %u ",
-                                         GET_BE_U_4(rp->rm_xid));
-                                nfsreply_noaddr_print(ndo, (const u_char *)rp, fraglen, (const u_char *)ip);
-                                return;
-                        }
-                }
+        port_map_iter_init(&it, tcp_get_port_map(ndo), sport, dport);
+        while ((dissector = port_map_next(&it, &port)) != -1) {
+                if (tcp_dissect(ndo, dissector, sport, dport, port, bp,
+                                length, (const u_char *)ip))
+                        break;
         }
 
         return;
@@ -368,7 +368,7 @@ static const char *enctype[] = {
 static char *
 numstr(int x)
 {
-	static char buf[20];
+	static ND_THREAD_LOCAL char buf[20];
 
 	snprintf(buf, sizeof(buf), "%#x", x);
 	return buf;
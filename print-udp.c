@@ -35,6 +35,7 @@
 #include "ip.h"
 #include "ip6.h"
 #include "ipproto.h"
+#include "portmap.h"
 #include "rpc_auth.h"
 #include "rpc_msg.h"
 
@@ -303,18 +304,20 @@ udpipaddr_print(netdissect_options *ndo,
                 const struct ip *ip, const uint16_t sport, const uint16_t dport)
 {
 	const struct ip6_hdr *ip6 = (const struct ip6_hdr *)ip;
+	const u_int ipver = IP_V(ip);
+	const int ip_ok = ipver == 6 ? ND_TTEST_SIZE(ip6) : ND_TTEST_SIZE(ip);
 
-	if (IP_V(ip) == 4 && GET_U_1(ip->ip_p) == IPPROTO_UDP) {
+	if (ipver == 4 && VIEW_U_1(ip_ok, ip->ip_p) == IPPROTO_UDP) {
 		ND_PRINT("%s.%s > %s.%s: ",
-			GET_IPADDR_STRING(ip->ip_src),
+			VIEW_IPADDR_STRING(ip_ok, ip->ip_src),
 			udpport_string(ndo, sport),
-			GET_IPADDR_STRING(ip->ip_dst),
+			VIEW_IPADDR_STRING(ip_ok, ip->ip_dst),
 			udpport_string(ndo, dport));
-	} else if (IP_V(ip) == 6 && GET_U_1(ip6->ip6_nxt) == IPPROTO_UDP) {
+	} else if (ipver == 6 && VIEW_U_1(ip_ok, ip6->ip6_nxt) == IPPROTO_UDP) {
 		ND_PRINT("%s.%s > %s.%s: ",
-			GET_IP6ADDR_STRING(ip6->ip6_src),
+			VIEW_IP6ADDR_STRING(ip_ok, ip6->ip6_src),
 			udpport_string(ndo, sport),
-			GET_IP6ADDR_STRING(ip6->ip6_dst),
+			VIEW_IP6ADDR_STRING(ip_ok, ip6->ip6_dst),
 			udpport_string(ndo, dport));
 	} else
 		ND_PRINT("%s > %s: ",
@@ -337,6 +340,421 @@ udpipaddr_noport_print(netdissect_options *ndo, const struct ip *ip)
 	}
 }
 
+/*
+ * The dissectors that udp_print() can hand the payload to, by port.
+ */
+enum udp_dissector {
+	UDP_DOMAIN,
+	UDP_BOOTP,
+	UDP_TFTP,
+	UDP_KRB,
+	UDP_NTP,
+	UDP_NBT_NS,
+	UDP_NBT_DGRAM,
+	UDP_SNMP,
+	UDP_PTP,
+	UDP_CISCO_AUTORP,
+	UDP_ISAKMP,
+	UDP_SYSLOG,
+	UDP_RIP,
+	UDP_RIPNG,
+	UDP_TIMED,
+	UDP_DHCP6,
+	UDP_LDP,
+	UDP_AODV,
+	UDP_OLSR,
+	UDP_LMP,
+	UDP_LWRES,
+	UDP_MDNS,
+	UDP_ISAKMP_NATT,
+	UDP_L2TP,
+	UDP_VAT,
+	UDP_ZEPHYR,
+	UDP_RX,
+	UDP_AHCP,
+	UDP_BABEL,
+	UDP_HNCP,
+	UDP_WB,
+	UDP_RADIUS,
+	UDP_HSRP,
+	UDP_LSPPING,
+	UDP_BFD,
+	UDP_VQP,
+	UDP_SFLOW,
+	UDP_LWAPP_CONTROL,
+	UDP_LWAPP_DATA,
+	UDP_SIP,
+	UDP_VXLAN,
+	UDP_GENEVE,
+	UDP_LISP,
+	UDP_VXLAN_GPE,
+	UDP_ZEP,
+	UDP_MPLS,
+	UDP_KIP,
+	UDP_SOMEIP,
+	UDP_QUIC,
+	UDP_BCM_LI,
+	UDP_RTP,
+	UDP_RTCP,
+	UDP_CNFP
+};
+
+const struct tok udp_port_dissectors[] = {
+	{ UDP_DOMAIN,		"domain" },
+	{ UDP_BOOTP,		"bootp" },
+	{ UDP_TFTP,		"tftp" },
+	{ UDP_KRB,		"krb" },
+	{ UDP_NTP,		"ntp" },
+#ifdef ENABLE_SMB
+	{ UDP_NBT_NS,		"nbt-ns" },
+	{ UDP_NBT_DGRAM,	"nbt-dgram" },
+#endif
+	{ UDP_SNMP,		"snmp" },
+	{ UDP_PTP,		"ptp" },
+	{ UDP_CISCO_AUTORP,	"cisco-autorp" },
+	{ UDP_ISAKMP,		"isakmp" },
+	{ UDP_SYSLOG,		"syslog" },
+	{ UDP_RIP,		"rip" },
+	{ UDP_RIPNG,		"ripng" },
+	{ UDP_TIMED,		"timed" },
+	{ UDP_DHCP6,		"dhcp6" },
+	{ UDP_LDP,		"ldp" },
+	{ UDP_AODV,		"aodv" },
+	{ UDP_OLSR,		"olsr" },
+	{ UDP_LMP,		"lmp" },
+	{ UDP_LWRES,		"lwres" },
+	{ UDP_MDNS,		"mdns" },
+	{ UDP_ISAKMP_NATT,	"isakmp-natt" },
+	{ UDP_L2TP,		"l2tp" },
+	{ UDP_VAT,		"vat" },
+	{ UDP_ZEPHYR,		"zephyr" },
+	{ UDP_RX,		"rx" },
+	{ UDP_AHCP,		"ahcp" },
+	{ UDP_BABEL,		"babel" },
+	{ UDP_HNCP,		"hncp" },
+	{ UDP_WB,		"wb" },
+	{ UDP_RADIUS,		"radius" },
+	{ UDP_HSRP,		"hsrp" },
+	{ UDP_LSPPING,		"lspping" },
+	{ UDP_BFD,		"bfd" },
+	{ UDP_VQP,		"vqp" },
+	{ UDP_SFLOW,		"sflow" },
+	{ UDP_LWAPP_CONTROL,	"lwapp-control" },
+	{ UDP_LWAPP_DATA,	"lwapp-data" },
+	{ UDP_SIP,		"sip" },
+	{ UDP_VXLAN,		"vxlan" },
+	{ UDP_GENEVE,		"geneve" },
+	{ UDP_LISP,		"lisp" },
+	{ UDP_VXLAN_GPE,	"vxlan-gpe" },
+	{ UDP_ZEP,		"zep" },
+	{ UDP_MPLS,		"mpls" },
+	{ UDP_KIP,		"kip" },
+	{ UDP_SOMEIP,		"someip" },
+	{ UDP_QUIC,		"quic" },
+	{ UDP_BCM_LI,		"bcm-li" },
+	{ UDP_RTP,		"rtp" },
+	{ UDP_RTCP,		"rtcp" },
+	{ UDP_CNFP,		"cnfp" },
+	{ 0, NULL }
+};
+
+#define EITHER(port, d)	{ (port), (port), PORT_MATCH_EITHER, (d) }
+#define DST(port, d)	{ (port), (port), PORT_MATCH_DST, (d) }
+#define SRC(port, d)	{ (port), (port), PORT_MATCH_SRC, (d) }
+
+/*
+ * When more than one entry matches, the first one is tried first.
+ */
+static const struct port_map_entry udp_port_map[] = {
+	EITHER(NAMESERVER_PORT, UDP_DOMAIN),
+	EITHER(BOOTPC_PORT, UDP_BOOTP),
+	EITHER(BOOTPS_PORT, UDP_BOOTP),
+	EITHER(TFTP_PORT, UDP_TFTP),
+	EITHER(KERBEROS_PORT, UDP_KRB),
+	EITHER(NTP_PORT, UDP_NTP),
+#ifdef ENABLE_SMB
+	EITHER(NETBIOS_NS_PORT, UDP_NBT_NS),
+	EITHER(NETBIOS_DGRAM_PORT, UDP_NBT_DGRAM),
+#endif
+	EITHER(SNMP_PORT, UDP_SNMP),
+	EITHER(SNMPTRAP_PORT, UDP_SNMP),
+	EITHER(PTP_EVENT_PORT, UDP_PTP),
+	EITHER(PTP_GENERAL_PORT, UDP_PTP),
+	EITHER(CISCO_AUTORP_PORT, UDP_CISCO_AUTORP),
+	EITHER(ISAKMP_PORT, UDP_ISAKMP),
+	EITHER(SYSLOG_PORT, UDP_SYSLOG),
+	EITHER(RIP_PORT, UDP_RIP),
+	EITHER(RIPNG_PORT, UDP_RIPNG),
+	EITHER(TIMED_PORT, UDP_TIMED),
+	EITHER(DHCP6_SERV_PORT, UDP_DHCP6),
+	EITHER(DHCP6_CLI_PORT, UDP_DHCP6),
+	EITHER(LDP_PORT, UDP_LDP),
+	EITHER(AODV_PORT, UDP_AODV),
+	EITHER(OLSR_PORT, UDP_OLSR),
+	EITHER(LMP_PORT, UDP_LMP),
+	EITHER(KERBEROS_SEC_PORT, UDP_KRB),
+	EITHER(LWRES_PORT, UDP_LWRES),
+	EITHER(MULTICASTDNS_PORT, UDP_MDNS),
+	EITHER(ISAKMP_PORT_NATT, UDP_ISAKMP_NATT),
+	EITHER(ISAKMP_PORT_USER1, UDP_ISAKMP),
+	EITHER(ISAKMP_PORT_USER2, UDP_ISAKMP),
+	EITHER(L2TP_PORT, UDP_L2TP),
+	DST(VAT_PORT, UDP_VAT),
+	EITHER(ZEPHYR_SRV_PORT, UDP_ZEPHYR),
+	EITHER(ZEPHYR_CLT_PORT, UDP_ZEPHYR),
+	{ RX_PORT_LOW, RX_PORT_HIGH, PORT_MATCH_EITHER, UDP_RX },
+	EITHER(AHCP_PORT, UDP_AHCP),
+	EITHER(BABEL_PORT, UDP_BABEL),
+	EITHER(BABEL_PORT_OLD, UDP_BABEL),
+	EITHER(HNCP_PORT, UDP_HNCP),
+	/*
+	 * Kludge in test for whiteboard packets.
+	 */
+	DST(WB_PORT, UDP_WB),
+	EITHER(RADIUS_PORT, UDP_RADIUS),
+	EITHER(RADIUS_NEW_PORT, UDP_RADIUS),
+	EITHER(RADIUS_ACCOUNTING_PORT, UDP_RADIUS),
+	EITHER(RADIUS_NEW_ACCOUNTING_PORT, UDP_RADIUS),
+	EITHER(RADIUS_CISCO_COA_PORT, UDP_RADIUS),
+	EITHER(RADIUS_COA_PORT, UDP_RADIUS),
+	DST(HSRP_PORT, UDP_HSRP),
+	EITHER(MPLS_LSP_PING_PORT, UDP_LSPPING),
+	DST(BFD_CONTROL_PORT, UDP_BFD),
+	DST(BFD_MULTIHOP_PORT, UDP_BFD),
+	DST(BFD_LAG_PORT, UDP_BFD),
+	DST(SBFD_PORT, UDP_BFD),
+	DST(BFD_ECHO_PORT, UDP_BFD),
+	SRC(SBFD_PORT, UDP_BFD),
+	EITHER(VQP_PORT, UDP_VQP),
+	EITHER(SFLOW_PORT, UDP_SFLOW),
+	DST(LWAPP_CONTROL_PORT, UDP_LWAPP_CONTROL),
+	SRC(LWAPP_CONTROL_PORT, UDP_LWAPP_CONTROL),
+	EITHER(LWAPP_DATA_PORT, UDP_LWAPP_DATA),
+	EITHER(SIP_PORT, UDP_SIP),
+	EITHER(VXLAN_LINUX_PORT, UDP_VXLAN),
+	EITHER(VXLAN_PORT, UDP_VXLAN),
+	DST(GENEVE_PORT, UDP_GENEVE),
+	EITHER(LISP_CONTROL_PORT, UDP_LISP),
+	EITHER(VXLAN_GPE_PORT, UDP_VXLAN_GPE),
+	EITHER(ZEP_PORT, UDP_ZEP),
+	EITHER(MPLS_PORT, UDP_MPLS),
+	/* AppleTalk sockets; see atalk_port() */
+	{ 200, 327, PORT_MATCH_EITHER, UDP_KIP },
+	{ 768, 895, PORT_MATCH_EITHER, UDP_KIP },
+	{ 16512, 16639, PORT_MATCH_EITHER, UDP_KIP },
+	EITHER(SOMEIP_PORT, UDP_SOMEIP),
+	EITHER(HTTPS_PORT, UDP_QUIC),
+	SRC(BCM_LI_PORT, UDP_BCM_LI)
+};
+
+#undef EITHER
+#undef DST
+#undef SRC
+
+static const struct port_map *
+udp_get_port_map(netdissect_options *ndo)
+{
+	if (ndo->ndo_udp_port_map == NULL)
+		ndo->ndo_udp_port_map = port_map_build(ndo, IPPROTO_UDP,
+		    udp_port_map,
+		    sizeof(udp_port_map) / sizeof(udp_port_map[0]));
+	return ndo->ndo_udp_port_map;
+}
+
+/*
+ * Hand the payload to the dissector, which was chosen because the
+ * port matched; return 0 if the payload doesn't look like something
+ * the dissector handles, so that the next one is tried.
+ */
+static int
+udp_dissect(netdissect_options *ndo, int dissector, uint16_t sport,
+	    uint16_t dport, uint16_t port, const u_char *cp, u_int length,
+	    const u_char *bp2, int fragmented, u_int ttl_hl)
+{
+	const struct ip *ip = (const struct ip *)bp2;
+	const u_char *ep;
+
+	switch (dissector) {
+
+	case UDP_DOMAIN:
+		/* over_tcp: FALSE, is_mdns: FALSE */
+		domain_print(ndo, cp, length, FALSE, FALSE);
+		break;
+	case UDP_BOOTP:
+		bootp_print(ndo, cp, length);
+		break;
+	case UDP_TFTP:
+		tftp_print(ndo, cp, length);
+		break;
+	case UDP_KRB:
+		krb_print(ndo, (const u_char *)cp);
+		break;
+	case UDP_NTP:
+		ntp_print(ndo, cp, length);
+		break;
+#ifdef ENABLE_SMB
+	case UDP_NBT_NS:
+		nbt_udp137_print(ndo, cp, length);
+		break;
+	case UDP_NBT_DGRAM:
+		nbt_udp138_print(ndo, cp, length);
+		break;
+#endif
+	case UDP_SNMP:
+		snmp_print(ndo, cp, length);
+		break;
+	case UDP_PTP:
+		ptp_print(ndo, cp, length);
+		break;
+	case UDP_CISCO_AUTORP:
+		cisco_autorp_print(ndo, cp, length);
+		break;
+	case UDP_ISAKMP:
+		isakmp_print(ndo, cp, length, bp2);
+		break;
+	case UDP_SYSLOG:
+		syslog_print(ndo, cp, length);
+		break;
+	case UDP_RIP:
+		rip_print(ndo, cp, length);
+		break;
+	case UDP_RIPNG:
+		ripng_print(ndo, cp, length);
+		break;
+	case UDP_TIMED:
+		timed_print(ndo, (const u_char *)cp);
+		break;
+	case UDP_DHCP6:
+		dhcp6_print(ndo, cp, length);
+		break;
+	case UDP_LDP:
+		ldp_print(ndo, cp, length);
+		break;
+	case UDP_AODV:
+		aodv_print(ndo, cp, length, IP_V(ip) == 6);
+		break;
+	case UDP_OLSR:
+		olsr_print(ndo, cp, length, IP_V(ip) == 6);
+		break;
+	case UDP_LMP:
+		lmp_print(ndo, cp, length);
+		break;
+	case UDP_LWRES:
+		lwres_print(ndo, cp, length);
+		break;
+	case UDP_MDNS:
+		/* over_tcp: FALSE, is_mdns: TRUE */
+		domain_print(ndo, cp, length, FALSE, TRUE);
+		break;
+	case UDP_ISAKMP_NATT:
+		isakmp_rfc3948_print(ndo, cp, length, bp2, IP_V(ip), fragmented, ttl_hl);
+		break;
+	case UDP_L2TP:
+		l2tp_print(ndo, cp, length);
+		break;
+	case UDP_VAT:
+		vat_print(ndo, cp, length);
+		break;
+	case UDP_ZEPHYR:
+		zephyr_print(ndo, cp, length);
+		break;
+	case UDP_RX:
+		rx_print(ndo, cp, length, sport, dport,
+			 (const u_char *) ip);
+		break;
+	case UDP_AHCP:
+		ahcp_print(ndo, cp, length);
+		break;
+	case UDP_BABEL:
+		babel_print(ndo, cp, length);
+		break;
+	case UDP_HNCP:
+		hncp_print(ndo, cp, length);
+		break;
+	case UDP_WB:
+		wb_print(ndo, cp, length);
+		break;
+	case UDP_RADIUS:
+		radius_print(ndo, cp, length);
+		break;
+	case UDP_HSRP:
+		hsrp_print(ndo, cp, length);
+		break;
+	case UDP_LSPPING:
+		lspping_print(ndo, cp, length);
+		break;
+	case UDP_BFD:
+		bfd_print(ndo, cp, length, port);
+		break;
+	case UDP_VQP:
+		vqp_print(ndo, cp, length);
+		break;
+	case UDP_SFLOW:
+		sflow_print(ndo, cp, length);
+		break;
+	case UDP_LWAPP_CONTROL:
+		/* Is this going to the controller? */
+		lwapp_print(ndo, cp, length, port == dport);
+		break;
+	case UDP_LWAPP_DATA:
+		lwapp_print(ndo, cp, length, 0);
+		break;
+	case UDP_SIP:
+		sip_print(ndo, cp, length);
+		break;
+	case UDP_VXLAN:
+		vxlan_print(ndo, cp, length);
+		break;
+	case UDP_GENEVE:
+		geneve_print(ndo, cp, length);
+		break;
+	case UDP_LISP:
+		lisp_print(ndo, cp, length);
+		break;
+	case UDP_VXLAN_GPE:
+		vxlan_gpe_print(ndo, cp, length);
+		break;
+	case UDP_ZEP:
+		zep_print(ndo, cp, length);
+		break;
+	case UDP_MPLS:
+		mpls_print(ndo, cp, length);
+		break;
+	case UDP_KIP:
+		if (GET_U_1(((const struct LAP *)cp)->type) != lapDDP)
+			return 0;
+		if (ndo->ndo_vflag)
+			ND_PRINT("kip ");
+		llap_print(ndo, cp, length);
+		break;
+	case UDP_SOMEIP:
+		someip_print(ndo, cp, length);
+		break;
+	case UDP_QUIC:
+		if (!quic_detect(ndo, cp, length))
+			return 0;
+		quic_print(ndo, cp);
+		break;
+	case UDP_BCM_LI:
+		bcm_li_print(ndo, cp, length);
+		break;
+	case UDP_RTP:
+		rtp_print(ndo, cp, length);
+		break;
+	case UDP_RTCP:
+		ep = ndo->ndo_snapend;
+		while (cp < ep)
+			cp = rtcp_print(ndo, cp);
+		break;
+	case UDP_CNFP:
+		cnfp_print(ndo, cp);
+		break;
+	default:
+		return 0;
+	}
+	return 1;
+}
+
 void
 udp_print(netdissect_options *ndo, const u_char *bp, u_int length,
 	  const u_char *bp2, int fragmented, u_int ttl_hl)
@@ -349,9 +767,11 @@ udp_print(netdissect_options *ndo, const u_char *bp, u_int length,
 	u_int ulen;
 	uint16_t udp_sum;
 	const struct ip6_hdr *ip6;
+	int up_ok;
 
 	ndo->ndo_protocol = "udp";
 	up = (const struct udphdr *)bp;
+	up_ok = ND_TTEST_SIZE(up);
 	ip = (const struct ip *)bp2;
 	if (IP_V(ip) == 6)
 		ip6 = (const struct ip6_hdr *)bp2;
@@ -362,14 +782,14 @@ udp_print(netdissect_options *ndo, const u_char *bp, u_int length,
 		nd_trunc_longjmp(ndo);
 	}
 
-	sport = GET_BE_U_2(up->uh_sport);
-	dport = GET_BE_U_2(up->uh_dport);
+	sport = VIEW_BE_U_2(up_ok, up->uh_sport);
+	dport = VIEW_BE_U_2(up_ok, up->uh_dport);
 	if (ndo->ndo_packettype != PT_RPC)
 		udpipaddr_print(ndo, ip, sport, dport);
 
 	ND_ICHECKMSG_ZU("undersized-udp", length, <, sizeof(struct udphdr));
-	ulen = GET_BE_U_2(up->uh_ulen);
-	udp_sum = GET_BE_U_2(up->uh_sum);
+	ulen = VIEW_BE_U_2(up_ok, up->uh_ulen);
+	udp_sum = VIEW_BE_U_2(up_ok, up->uh_sum);
 	/*
 	 * IPv6 Jumbo Datagrams; see RFC 2675.
 	 * If the length is zero, and the length provided to us is
@@ -535,153 +955,21 @@ udp_print(netdissect_options *ndo, const u_char *bp, u_int length,
 	}
 
 	if (!ndo->ndo_qflag) {
-		if (IS_SRC_OR_DST_PORT(NAMESERVER_PORT))
-			/* over_tcp: FALSE, is_mdns: FALSE */
-			domain_print(ndo, cp, length, FALSE, FALSE);
-		else if (IS_SRC_OR_DST_PORT(BOOTPC_PORT) ||
-			 IS_SRC_OR_DST_PORT(BOOTPS_PORT))
-			bootp_print(ndo, cp, length);
-		else if (IS_SRC_OR_DST_PORT(TFTP_PORT))
-			tftp_print(ndo, cp, length);
-		else if (IS_SRC_OR_DST_PORT(KERBEROS_PORT))
-			krb_print(ndo, (const u_char *)cp);
-		else if (IS_SRC_OR_DST_PORT(NTP_PORT))
-			ntp_print(ndo, cp, length);
-#ifdef ENABLE_SMB
-		else if (IS_SRC_OR_DST_PORT(NETBIOS_NS_PORT))
-			nbt_udp137_print(ndo, cp, length);
-		else if (IS_SRC_OR_DST_PORT(NETBIOS_DGRAM_PORT))
-			nbt_udp138_print(ndo, cp, length);
-#endif
-		else if (IS_SRC_OR_DST_PORT(SNMP_PORT) ||
-			 IS_SRC_OR_DST_PORT(SNMPTRAP_PORT))
-			snmp_print(ndo, cp, length);
-		else if (IS_SRC_OR_DST_PORT(PTP_EVENT_PORT) ||
-			 IS_SRC_OR_DST_PORT(PTP_GENERAL_PORT))
-			ptp_print(ndo, cp, length);
-		else if (IS_SRC_OR_DST_PORT(CISCO_AUTORP_PORT))
-			cisco_autorp_print(ndo, cp, length);
-		else if (IS_SRC_OR_DST_PORT(ISAKMP_PORT))
-			 isakmp_print(ndo, cp, length, bp2);
-		else if (IS_SRC_OR_DST_PORT(SYSLOG_PORT))
-			syslog_print(ndo, cp, length);
-		else if (IS_SRC_OR_DST_PORT(RIP_PORT))
-			rip_print(ndo, cp, length);
-		else if (IS_SRC_OR_DST_PORT(RIPNG_PORT))
-			ripng_print(ndo, cp, length);
-		else if (IS_SRC_OR_DST_PORT(TIMED_PORT))
-			timed_print(ndo, (const u_char *)cp);
-		else if (IS_SRC_OR_DST_PORT(DHCP6_SERV_PORT) ||
-			 IS_SRC_OR_DST_PORT(DHCP6_CLI_PORT))
-			dhcp6_print(ndo, cp, length);
-		else if (IS_SRC_OR_DST_PORT(LDP_PORT))
-			ldp_print(ndo, cp, length);
-		else if (IS_SRC_OR_DST_PORT(AODV_PORT))
-			aodv_print(ndo, cp, length, IP_V(ip) == 6);
-		else if (IS_SRC_OR_DST_PORT(OLSR_PORT))
-			olsr_print(ndo, cp, length, IP_V(ip) == 6);
-		else if (IS_SRC_OR_DST_PORT(LMP_PORT))
-			lmp_print(ndo, cp, length);
-		else if (IS_SRC_OR_DST_PORT(KERBEROS_SEC_PORT))
-			krb_print(ndo, (const u_char *)cp);
-		else if (IS_SRC_OR_DST_PORT(LWRES_PORT))
-			lwres_print(ndo, cp, length);
-		else if (IS_SRC_OR_DST_PORT(MULTICASTDNS_PORT))
-			/* over_tcp: FALSE, is_mdns: TRUE */
-			domain_print(ndo, cp, length, FALSE, TRUE);
-		else if (IS_SRC_OR_DST_PORT(ISAKMP_PORT_NATT))
-			 isakmp_rfc3948_print(ndo, cp, length, bp2, IP_V(ip), fragmented, ttl_hl);
-		else if (IS_SRC_OR_DST_PORT(ISAKMP_PORT_USER1) || IS_SRC_OR_DST_PORT(ISAKMP_PORT_USER2))
-			isakmp_print(ndo, cp, length, bp2);
-		else if (IS_SRC_OR_DST_PORT(L2TP_PORT))
-			l2tp_print(ndo, cp, length);
-		else if (dport == VAT_PORT)
-			vat_print(ndo, cp, length);
-		else if (IS_SRC_OR_DST_PORT(ZEPHYR_SRV_PORT) || IS_SRC_OR_DST_PORT(ZEPHYR_CLT_PORT))
-			zephyr_print(ndo, cp, length);
-		/*
-		 * Since there are 10 possible ports to check, I think
-		 * a <> test would be more efficient
-		 */
-		else if ((sport >= RX_PORT_LOW && sport <= RX_PORT_HIGH) ||
-			 (dport >= RX_PORT_LOW && dport <= RX_PORT_HIGH))
-			rx_print(ndo, cp, length, sport, dport,
-				 (const u_char *) ip);
-		else if (IS_SRC_OR_DST_PORT(AHCP_PORT))
-			ahcp_print(ndo, cp, length);
-		else if (IS_SRC_OR_DST_PORT(BABEL_PORT) || IS_SRC_OR_DST_PORT(BABEL_PORT_OLD))
-			babel_print(ndo, cp, length);
-		else if (IS_SRC_OR_DST_PORT(HNCP_PORT))
-			hncp_print(ndo, cp, length);
-		/*
-		 * Kludge in test for whiteboard packets.
-		 */
-		else if (dport == WB_PORT)
-			wb_print(ndo, cp, length);
-		else if (IS_SRC_OR_DST_PORT(RADIUS_PORT) ||
-			 IS_SRC_OR_DST_PORT(RADIUS_NEW_PORT) ||
-			 IS_SRC_OR_DST_PORT(RADIUS_ACCOUNTING_PORT) ||
-			 IS_SRC_OR_DST_PORT(RADIUS_NEW_ACCOUNTING_PORT) ||
-			 IS_SRC_OR_DST_PORT(RADIUS_CISCO_COA_PORT) ||
-			 IS_SRC_OR_DST_PORT(RADIUS_COA_PORT) )
-			radius_print(ndo, cp, length);
-		else if (dport == HSRP_PORT)
-			hsrp_print(ndo, cp, length);
-		else if (IS_SRC_OR_DST_PORT(MPLS_LSP_PING_PORT))
-			lspping_print(ndo, cp, length);
-		else if (dport == BFD_CONTROL_PORT ||
-			 dport == BFD_MULTIHOP_PORT ||
-			 dport == BFD_LAG_PORT ||
-			 dport == SBFD_PORT ||
-			 dport == BFD_ECHO_PORT )
-			bfd_print(ndo, cp, length, dport);
-		else if (sport == SBFD_PORT)
-			bfd_print(ndo, cp, length, sport);
-		else if (IS_SRC_OR_DST_PORT(VQP_PORT))
-			vqp_print(ndo, cp, length);
-		else if (IS_SRC_OR_DST_PORT(SFLOW_PORT))
-			sflow_print(ndo, cp, length);
-		else if (dport == LWAPP_CONTROL_PORT)
-			lwapp_print(ndo, cp, length, 1);
-		else if (sport == LWAPP_CONTROL_PORT)
-			lwapp_print(ndo, cp, length, 0);
-		else if (IS_SRC_OR_DST_PORT(LWAPP_DATA_PORT))
-			lwapp_print(ndo, cp, length, 0);
-		else if (IS_SRC_OR_DST_PORT(SIP_PORT))
-			sip_print(ndo, cp, length);
-		else if (IS_SRC_OR_DST_PORT(VXLAN_LINUX_PORT))
-			vxlan_print(ndo, cp, length);
-		else if (IS_SRC_OR_DST_PORT(VXLAN_PORT))
-			vxlan_print(ndo, cp, length);
-		else if (dport == GENEVE_PORT)
-			geneve_print(ndo, cp, length);
-		else if (IS_SRC_OR_DST_PORT(LISP_CONTROL_PORT))
-			lisp_print(ndo, cp, length);
-		else if (IS_SRC_OR_DST_PORT(VXLAN_GPE_PORT))
-			vxlan_gpe_print(ndo, cp, length);
-		else if (IS_SRC_OR_DST_PORT(ZEP_PORT))
-			zep_print(ndo, cp, length);
-		else if (IS_SRC_OR_DST_PORT(MPLS_PORT))
-			mpls_print(ndo, cp, length);
-		else if ((atalk_port(sport) || atalk_port(dport)) &&
-			 GET_U_1(((const struct LAP *)cp)->type) == lapDDP) {
-			if (ndo->ndo_vflag)
-				ND_PRINT("kip ");
-			llap_print(ndo, cp, length);
-		} else if (IS_SRC_OR_DST_PORT(SOMEIP_PORT))
-			someip_print(ndo, cp, length);
-		else if (IS_SRC_OR_DST_PORT(HTTPS_PORT) &&
-			 quic_detect(ndo, cp, length))
-			quic_print(ndo, cp);
-		else if (sport == BCM_LI_PORT)
-			bcm_li_print(ndo, cp, length);
-		else {
-			if (ulen > length && !fragmented)
-				ND_PRINT("UDP, bad length %u > %u",
-				    ulen, length);
-			else
-				ND_PRINT("UDP, length %u", ulen);
+		struct port_map_iter it;
+		uint16_t port;
+		int dissector;
+
+		port_map_iter_init(&it, udp_get_port_map(ndo), sport, dport);
+		while ((dissector = port_map_next(&it, &port)) != -1) {
+			if (udp_dissect(ndo, dissector, sport, dport, port,
+					cp, length, bp2, fragmented, ttl_hl))
+				return;
 		}
+		if (ulen > length && !fragmented)
+			ND_PRINT("UDP, bad length %u > %u",
+			    ulen, length);
+		else
+			ND_PRINT("UDP, length %u", ulen);
 	} else {
 		if (ulen > length && !fragmented)
 			ND_PRINT("UDP, bad length %u > %u",
@@ -81,7 +81,7 @@ static const struct tok z_types[] = {
     { 0,			NULL }
 };
 
-static char z_buf[256];
+static ND_THREAD_LOCAL char z_buf[256];
 
 static const char *
 parse_field(netdissect_options *ndo, const char **pptr, int *len)
@@ -246,8 +246,40 @@ init_print(netdissect_options *ndo, uint32_t localnet, uint32_t mask)
 	init_addrtoname(ndo, localnet, mask);
 }
 
+/*
+ * The printers for the link-layer header types below PRINTER_INDEX_SIZE,
+ * which are almost all of them, indexed by type; filled in on first use.
+ */
+#define PRINTER_INDEX_SIZE	512
+
+static if_printer printer_index[PRINTER_INDEX_SIZE];
+static int printer_index_built;
+
+static if_printer scan_printers(int type);
+
+static void
+build_printer_index(void)
+{
+	int type;
+
+	for (type = 0; type < PRINTER_INDEX_SIZE; type++)
+		printer_index[type] = scan_printers(type);
+	printer_index_built = 1;
+}
+
 if_printer
 lookup_printer(int type)
+{
+	if (type >= 0 && type < PRINTER_INDEX_SIZE) {
+		if (!printer_index_built)
+			build_printer_index();
+		return printer_index[type];
+	}
+	return scan_printers(type);
+}
+
+static if_printer
+scan_printers(int type)
 {
 	const struct printer *p;
 
@@ -300,33 +332,74 @@ get_if_printer(int type)
 	return printer;
 }
 
-#ifdef ENABLE_INSTRUMENT_FUNCTIONS
-extern int profile_func_level;
-static int pretty_print_packet_level = -1;
-#endif
+/*
+ * Work out what to do for each packet from the link-layer printer and
+ * the options.
+ */
+static void
+init_dispatch(netdissect_options *ndo)
+{
+	struct nd_dispatch *d = &ndo->ndo_dispatch;
+
+	d->printer = ndo->ndo_if_printer;
+	d->ts_print = get_ts_printer(ndo);
+	d->flags = 0;
+	if (ndo->ndo_packet_number || ndo->ndo_lengths)
+		d->flags |= ND_DISPATCH_PREFIX;
+	if (ndo->ndo_Xflag || ndo->ndo_xflag || ndo->ndo_Aflag)
+		d->flags |= ND_DISPATCH_RAW;
+}
 
+/*
+ * Set the printer for the link-layer header type, and what to do for
+ * each packet with it; call this once the options are all set, and
+ * again if the type changes.
+ */
 void
-pretty_print_packet(netdissect_options *ndo, const struct pcap_pkthdr *h,
-		    const u_char *sp, u_int packets_captured)
+nd_set_dispatch(netdissect_options *ndo, int type)
 {
-	u_int hdrlen = 0;
-	int invalid_header = 0;
+	ndo->ndo_if_printer = get_if_printer(type);
+	init_dispatch(ndo);
+	ndo->ndo_dispatch.dlt = type;
+}
 
-	if (ndo->ndo_print_sampling && packets_captured % ndo->ndo_print_sampling != 0)
-		return;
+/*
+ * Set up dst to print packets with the same options and printer as
+ * src, but with none of the state src has built up, so that it can be
+ * used on another thread; call init_print() for it on that thread.
+ */
+void
+nd_copy_options(netdissect_options *dst, const netdissect_options *src)
+{
+	*dst = *src;
+	dst->ndo_last_mem_p = NULL;
+	dst->ndo_arena = NULL;
+	dst->ndo_flow_state = NULL;
+	dst->ndo_xid_map = NULL;
+	dst->ndo_esp_state = NULL;
+	dst->ndo_quic_cid_table = NULL;
+	dst->ndo_udp_port_map = NULL;
+	dst->ndo_tcp_port_map = NULL;
+	dst->ndo_packet_info_stack = NULL;
+	memset(&dst->ndo_ts_ref, 0, sizeof(dst->ndo_ts_ref));
+	dst->ndo_outbuf = NULL;
+	dst->ndo_outbuf_len = 0;
+	dst->ndo_outbuf_size = 0;
+}
 
 #ifdef ENABLE_INSTRUMENT_FUNCTIONS
-	if (pretty_print_packet_level == -1)
-		pretty_print_packet_level = profile_func_level;
+extern int profile_func_level;
+static int pretty_print_packet_level = -1;
 #endif
 
-	if (ndo->ndo_packet_number)
-		ND_PRINT("%5u  ", packets_captured);
-
-	if (ndo->ndo_lengths)
-		ND_PRINT("caplen %u len %u ", h->caplen, h->len);
+/*
+ * Report what's wrong with the lengths in a packet header.
+ */
+static void
+invalid_header_print(netdissect_options *ndo, const struct pcap_pkthdr *h)
+{
+	int invalid_header = 0;
 
-	/* Sanity checks on packet length / capture length */
 	if (h->caplen == 0) {
 		invalid_header = 1;
 		ND_PRINT("[Invalid header: caplen==0");
@@ -362,8 +435,117 @@ pretty_print_packet(netdissect_options *ndo, const struct pcap_pkthdr *h,
 			ND_PRINT(",");
 		ND_PRINT(" len(%u) > %u", h->len, MAXIMUM_SNAPLEN);
 	}
-	if (invalid_header) {
-		ND_PRINT("]\n");
+	ND_PRINT("]\n");
+	nd_flush_output(ndo);
+}
+
+/*
+ * Print the raw packet data, after the link-layer header unless
+ * the -x, -X or -A flag was given twice.
+ */
+static void
+raw_data_print(netdissect_options *ndo, const struct pcap_pkthdr *h,
+	       const u_char *sp, u_int hdrlen)
+{
+	if (ndo->ndo_Xflag) {
+		/*
+		 * Print the raw packet data in hex and ASCII.
+		 */
+		if (ndo->ndo_Xflag > 1) {
+			/*
+			 * Include the link-layer header.
+			 */
+			hex_and_ascii_print(ndo, "\n\t", sp, h->caplen);
+		} else {
+			/*
+			 * Don't include the link-layer header - and if
+			 * we have nothing past the link-layer header,
+			 * print nothing.
+			 */
+			if (h->caplen > hdrlen)
+				hex_and_ascii_print(ndo, "\n\t", sp + hdrlen,
+						    h->caplen - hdrlen);
+		}
+	} else if (ndo->ndo_xflag) {
+		/*
+		 * Print the raw packet data in hex.
+		 */
+		if (ndo->ndo_xflag > 1) {
+			/*
+			 * Include the link-layer header.
+			 */
+			hex_print(ndo, "\n\t", sp, h->caplen);
+		} else {
+			/*
+			 * Don't include the link-layer header - and if
+			 * we have nothing past the link-layer header,
+			 * print nothing.
+			 */
+			if (h->caplen > hdrlen)
+				hex_print(ndo, "\n\t", sp + hdrlen,
+					  h->caplen - hdrlen);
+		}
+	} else if (ndo->ndo_Aflag) {
+		/*
+		 * Print the raw packet data in ASCII.
+		 */
+		if (ndo->ndo_Aflag > 1) {
+			/*
+			 * Include the link-layer header.
+			 */
+			ascii_print(ndo, sp, h->caplen);
+		} else {
+			/*
+			 * Don't include the link-layer header - and if
+			 * we have nothing past the link-layer header,
+			 * print nothing.
+			 */
+			if (h->caplen > hdrlen)
+				ascii_print(ndo, sp + hdrlen, h->caplen - hdrlen);
+		}
+	}
+}
+
+void
+pretty_print_packet(netdissect_options *ndo, const struct pcap_pkthdr *h,
+		    const u_char *sp, u_int packets_captured)
+{
+	const struct nd_dispatch *d = &ndo->ndo_dispatch;
+	u_int hdrlen = 0;
+
+	if (ndo->ndo_print_sampling && packets_captured % ndo->ndo_print_sampling != 0)
+		return;
+
+	/*
+	 * If the printer was set without nd_set_dispatch(), work out
+	 * the rest now.
+	 */
+	if (d->printer != ndo->ndo_if_printer)
+		init_dispatch(ndo);
+
+	update_name_tables(ndo);
+
+#ifdef ENABLE_INSTRUMENT_FUNCTIONS
+	if (pretty_print_packet_level == -1)
+		pretty_print_packet_level = profile_func_level;
+#endif
+
+	if (d->flags & ND_DISPATCH_PREFIX) {
+		if (ndo->ndo_packet_number)
+			ND_PRINT("%5u  ", packets_captured);
+
+		if (ndo->ndo_lengths)
+			ND_PRINT("caplen %u len %u ", h->caplen, h->len);
+	}
+
+	/*
+	 * Sanity checks on packet length / capture length; between
+	 * them, these catch a zero packet length and a capture length
+	 * greater than MAXIMUM_SNAPLEN as well.
+	 */
+	if (h->caplen == 0 || h->len < h->caplen ||
+	    h->len > MAXIMUM_SNAPLEN) {
+		invalid_header_print(ndo, h);
 		return;
 	}
 
@@ -388,7 +570,7 @@ pretty_print_packet(netdissect_options *ndo, const struct pcap_pkthdr *h,
 	struct timeval tvbuf;
 	tvbuf.tv_sec = h->ts.tv_sec;
 	tvbuf.tv_usec = h->ts.tv_usec;
-	ts_print(ndo, &tvbuf);
+	(d->ts_print)(ndo, &tvbuf);
 
 	/*
 	 * Printers must check that they're not walking off the end of
@@ -398,13 +580,14 @@ pretty_print_packet(netdissect_options *ndo, const struct pcap_pkthdr *h,
 	 */
 	ndo->ndo_snapend = sp + h->caplen;
 	ndo->ndo_packetp = sp;
+	ndo->ndo_packet_ts = h->ts;
 
 	ndo->ndo_protocol = "";
 	ndo->ndo_ll_hdr_len = 0;
 	switch (setjmp(ndo->ndo_early_end)) {
 	case 0:
 		/* Print the packet. */
-		(ndo->ndo_if_printer)(ndo, h, sp);
+		(d->printer)(ndo, h, sp);
 		break;
 	case ND_TRUNCATED:
 		/* A printer quit because the packet was truncated; report it */
@@ -436,65 +619,11 @@ pretty_print_packet(netdissect_options *ndo, const struct pcap_pkthdr *h,
 	 */
 	ndo->ndo_snapend = sp + h->caplen;
 	ndo->ndo_packetp = sp;
-	if (ndo->ndo_Xflag) {
-		/*
-		 * Print the raw packet data in hex and ASCII.
-		 */
-		if (ndo->ndo_Xflag > 1) {
-			/*
-			 * Include the link-layer header.
-			 */
-			hex_and_ascii_print(ndo, "\n\t", sp, h->caplen);
-		} else {
-			/*
-			 * Don't include the link-layer header - and if
-			 * we have nothing past the link-layer header,
-			 * print nothing.
-			 */
-			if (h->caplen > hdrlen)
-				hex_and_ascii_print(ndo, "\n\t", sp + hdrlen,
-						    h->caplen - hdrlen);
-		}
-	} else if (ndo->ndo_xflag) {
-		/*
-		 * Print the raw packet data in hex.
-		 */
-		if (ndo->ndo_xflag > 1) {
-			/*
-			 * Include the link-layer header.
-			 */
-			hex_print(ndo, "\n\t", sp, h->caplen);
-		} else {
-			/*
-			 * Don't include the link-layer header - and if
-			 * we have nothing past the link-layer header,
-			 * print nothing.
-			 */
-			if (h->caplen > hdrlen)
-				hex_print(ndo, "\n\t", sp + hdrlen,
-					  h->caplen - hdrlen);
-		}
-	} else if (ndo->ndo_Aflag) {
-		/*
-		 * Print the raw packet data in ASCII.
-		 */
-		if (ndo->ndo_Aflag > 1) {
-			/*
-			 * Include the link-layer header.
-			 */
-			ascii_print(ndo, sp, h->caplen);
-		} else {
-			/*
-			 * Don't include the link-layer header - and if
-			 * we have nothing past the link-layer header,
-			 * print nothing.
-			 */
-			if (h->caplen > hdrlen)
-				ascii_print(ndo, sp + hdrlen, h->caplen - hdrlen);
-		}
-	}
+	if (d->flags & ND_DISPATCH_RAW)
+		raw_data_print(ndo, h, sp, hdrlen);
 
 	ND_PRINT("\n");
+	nd_flush_output(ndo);
 	nd_free_all(ndo);
 }
 
@@ -514,6 +643,11 @@ ndo_error(netdissect_options *ndo, status_exit_codes_t status,
 {
 	va_list ap;
 
+	/* Don't lose what was printed for the packet so far. */
+	if (ndo->ndo_outbuf_len != 0) {
+		(void)fwrite(ndo->ndo_outbuf, 1, ndo->ndo_outbuf_len, stdout);
+		ndo->ndo_outbuf_len = 0;
+	}
 	if (ndo->program_name)
 		(void)fprintf(stderr, "%s: ", ndo->program_name);
 	va_start(ap, fmt);
@@ -548,23 +682,202 @@ ndo_warning(netdissect_options *ndo, FORMAT_STRING(const char *fmt), ...)
 	}
 }
 
+/*
+ * The default ndo_printf() doesn't write to the standard output for every
+ * fragment of a line; it appends to a buffer in the netdissect_options
+ * structure, which pretty_print_packet() writes out once per packet with
+ * nd_flush_output().
+ */
+#define ND_OUTBUF_INITIAL_SIZE	8192
+#define ND_OUTBUF_MIN_FREE	128
+#define ND_UINT_BUFSIZE		sizeof("4294967295")
+
+/*
+ * Render an unsigned value in decimal into the bytes just before "end",
+ * and return a pointer to the first digit.
+ */
+static const char *
+nd_format_uint(char *end, u_int val)
+{
+	do {
+		*--end = '0' + (val % 10);
+		val /= 10;
+	} while (val != 0);
+	return end;
+}
+
+/*
+ * Make sure there's room for at least "needed" more bytes in the
+ * output buffer, and return a pointer to the first free byte.
+ */
+static char *
+nd_outbuf_reserve(netdissect_options *ndo, size_t needed)
+{
+	size_t newsize;
+	char *newbuf;
+
+	if (ndo->ndo_outbuf_size - ndo->ndo_outbuf_len < needed) {
+		newsize = ndo->ndo_outbuf_size;
+		if (newsize == 0)
+			newsize = ND_OUTBUF_INITIAL_SIZE;
+		while (newsize - ndo->ndo_outbuf_len < needed)
+			newsize *= 2;
+		newbuf = realloc(ndo->ndo_outbuf, newsize);
+		if (newbuf == NULL)
+			ndo_error(ndo, S_ERR_ND_MEM_ALLOC,
+				  "%s: realloc", __func__);
+		ndo->ndo_outbuf = newbuf;
+		ndo->ndo_outbuf_size = newsize;
+	}
+	return ndo->ndo_outbuf + ndo->ndo_outbuf_len;
+}
+
+static void
+nd_outbuf_append(netdissect_options *ndo, const char *s, size_t len)
+{
+	memcpy(nd_outbuf_reserve(ndo, len), s, len);
+	ndo->ndo_outbuf_len += len;
+#ifdef ENABLE_INSTRUMENT_FUNCTIONS
+	/* The function call traces are written directly to stdout. */
+	nd_flush_output(ndo);
+#endif
+}
+
+/*
+ * Write out, and empty, the output buffer.
+ */
+void
+nd_flush_output(netdissect_options *ndo)
+{
+	size_t len = ndo->ndo_outbuf_len;
+
+	if (len == 0 || ndo->ndo_keep_output)
+		return;
+	ndo->ndo_outbuf_len = 0;
+	if (fwrite(ndo->ndo_outbuf, 1, len, stdout) != len)
+		ndo_error(ndo, S_ERR_ND_WRITE_FILE,
+			  "Unable to write output: %s", pcap_strerror(errno));
+}
+
 /* VARARGS */
 static int PRINTFLIKE(2, 3)
 ndo_printf(netdissect_options *ndo, FORMAT_STRING(const char *fmt), ...)
 {
 	va_list args;
+	size_t len, avail;
+	const char *str;
+	char *p;
 	int ret;
 
+	/*
+	 * Format strings with no conversion at all, and the very common
+	 * "%s" and "%u", don't need to go through vsnprintf().
+	 */
+	len = strcspn(fmt, "%");
+	if (fmt[len] == '\0') {
+		nd_outbuf_append(ndo, fmt, len);
+		return (int)len;
+	}
+	if (len == 0 && fmt[2] == '\0') {
+		if (fmt[1] == 's') {
+			va_start(args, fmt);
+			str = va_arg(args, const char *);
+			va_end(args);
+			if (str != NULL) {
+				len = strlen(str);
+				nd_outbuf_append(ndo, str, len);
+				return (int)len;
+			}
+		}
+		if (fmt[1] == 'u') {
+			char buf[ND_UINT_BUFSIZE];
+
+			va_start(args, fmt);
+			str = nd_format_uint(buf + sizeof(buf), va_arg(args, u_int));
+			va_end(args);
+			len = (size_t)(buf + sizeof(buf) - str);
+			nd_outbuf_append(ndo, str, len);
+			return (int)len;
+		}
+	}
+
+	p = nd_outbuf_reserve(ndo, ND_OUTBUF_MIN_FREE);
+	avail = ndo->ndo_outbuf_size - ndo->ndo_outbuf_len;
 	va_start(args, fmt);
-	ret = vfprintf(stdout, fmt, args);
+	ret = vsnprintf(p, avail, fmt, args);
 	va_end(args);
-
 	if (ret < 0)
 		ndo_error(ndo, S_ERR_ND_WRITE_FILE,
-			  "Unable to write output: %s", pcap_strerror(errno));
+			  "Unable to format output: %s", pcap_strerror(errno));
+	if ((size_t)ret >= avail) {
+		/* Didn't fit; make room, including the terminating NUL. */
+		p = nd_outbuf_reserve(ndo, (size_t)ret + 1);
+		va_start(args, fmt);
+		(void)vsnprintf(p, (size_t)ret + 1, fmt, args);
+		va_end(args);
+	}
+	ndo->ndo_outbuf_len += ret;
+#ifdef ENABLE_INSTRUMENT_FUNCTIONS
+	nd_flush_output(ndo);
+#endif
 	return (ret);
 }
 
+/*
+ * Fast paths for the most common kinds of output.  If the application
+ * supplied its own ndo_printf(), they go through it instead.
+ */
+void
+nd_print_strn(netdissect_options *ndo, const char *s, size_t len)
+{
+	if (ndo->ndo_printf != ndo_printf) {
+		ND_PRINT("%.*s", (int)len, s);
+		return;
+	}
+	nd_outbuf_append(ndo, s, len);
+}
+
+void
+nd_print_str(netdissect_options *ndo, const char *s)
+{
+	nd_print_strn(ndo, s, strlen(s));
+}
+
+/*
+ * Print an unsigned value in decimal, as "%u" would.
+ */
+void
+nd_print_uint(netdissect_options *ndo, u_int val)
+{
+	char buf[ND_UINT_BUFSIZE];
+	const char *p;
+
+	p = nd_format_uint(buf + sizeof(buf), val);
+	nd_print_strn(ndo, p, (size_t)(buf + sizeof(buf) - p));
+}
+
+/*
+ * Print an unsigned value in lower-case hex, zero-padded to at least
+ * "width" digits, as "%0<width>x" would.
+ */
+void
+nd_print_hex(netdissect_options *ndo, u_int val, u_int width)
+{
+	static const char hex[] = "0123456789abcdef";
+	char buf[2 * sizeof(u_int)];
+	char *p = buf + sizeof(buf);
+
+	if (width > sizeof(buf))
+		width = sizeof(buf);
+	do {
+		*--p = hex[val & 0xf];
+		val >>= 4;
+	} while (val != 0);
+	while ((size_t)(buf + sizeof(buf) - p) < width)
+		*--p = '0';
+	nd_print_strn(ndo, p, (size_t)(buf + sizeof(buf) - p));
+}
+
 void
 ndo_set_function_pointers(netdissect_options *ndo)
 {
@@ -34,6 +34,11 @@ int	has_printer(int type);
 
 if_printer get_if_printer(int type);
 
+void	nd_set_dispatch(netdissect_options *ndo, int type);
+
+void	nd_copy_options(netdissect_options *dst,
+	    const netdissect_options *src);
+
 void	pretty_print_packet(netdissect_options *ndo,
 	    const struct pcap_pkthdr *h, const u_char *sp,
 	    u_int packets_captured);
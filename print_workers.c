@@ -0,0 +1,702 @@
+/*
+ * Copyright (c) 2026 The TCPDUMP project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that: (1) source code
+ * distributions retain the above copyright notice and this paragraph
+ * in its entirety, and (2) distributions including binary code include
+ * the above copyright notice and this paragraph in its entirety in
+ * the documentation or other materials provided with the distribution.
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND
+ * WITHOUT ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, WITHOUT
+ * LIMITATION, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE.
+ */
+
+/*
+ * Dissecting packets on worker threads.
+ *
+ * The thread reading the packets copies each one to be printed into a
+ * slot in a ring, with its data in a second ring of bytes, and hands
+ * the slot to one of the workers.  Each worker has its own
+ * netdissect_options, and so its own printer state, and prints the
+ * packet into its output buffer, which it then swaps with the one in
+ * the slot.  A writer thread writes the output of the slots to the
+ * standard output in ring order, i.e. in the order in which the packets
+ * were read, and frees them for the reading thread to reuse.
+ *
+ * The printers keep state across packets - TCP sequence numbers, RPC
+ * calls waiting for replies, and so on - so all the packets between the
+ * same two IP addresses, or for a TCP connection, the same two
+ * addresses and ports, go to the same worker, which sees them in the
+ * order in which they were read.  ICMP and ICMPv6 errors go with the
+ * packet they're about.  Packets that aren't IP, or that have a
+ * link-layer header type that isn't handled below, all go to the first
+ * worker.  Idle conversations are timed out against the time stamps of
+ * the packets a worker is given, not of all those read, so they can be
+ * forgotten later than they would be otherwise.
+ *
+ * Each index into the rings is only ever advanced by one thread, so no
+ * lock is needed to pass packets along; as in dump_writer.c, the mutex
+ * and condition variables are only used to put an idle thread to sleep
+ * and wake it up.
+ */
+
+#include <config.h>
+
+#include "netdissect-stdinc.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <pcap.h>
+
+#include "netdissect.h"
+#include "ethertype.h"
+#include "ipproto.h"
+#include "print.h"
+#include "timeval-operations.h"
+
+#include "print_workers.h"
+
+#ifdef USE_PRINT_WORKERS
+
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <unistd.h>
+
+#define PW_NSLOTS	4096		/* packets in flight; a power of 2 */
+#define PW_DATA_SIZE	(16*1024*1024)	/* room for their data; a power of 2 */
+#define PW_OUTBUF_KEEP	(64*1024)	/* free bigger output buffers */
+
+enum pw_slot_state {
+	PW_FREE,	/* can be filled in by the reading thread */
+	PW_QUEUED,	/* waiting for, or being printed by, a worker */
+	PW_DONE		/* printed, waiting for the writer */
+};
+
+struct pw_slot {
+	atomic_int state;
+	struct pcap_pkthdr hdr;
+	uint64_t data_pos;		/* the data in the data ring */
+	uint64_t data_end;		/* data ring position after it */
+	u_int number;			/* packets_captured, for -# */
+	int dlt;
+	struct timeval ts_ref;		/* for -ttt and -ttttt */
+	char *out;			/* what was printed */
+	size_t out_len;
+	size_t out_size;
+};
+
+struct pw_worker {
+	u_int id;
+	pthread_t thread;
+	netdissect_options ndo;
+	uint32_t *queue;		/* slots for this worker; PW_NSLOTS */
+	atomic_uint_fast64_t head;	/* slots queued, ever */
+	uint64_t tail;			/* slots taken, ever */
+	pthread_cond_t wake;		/* signaled to wake the worker */
+	atomic_int idle;
+};
+
+static struct {
+	int started;
+	u_int nworkers;
+	struct pw_worker *workers;
+	struct pw_slot *slots;
+	u_char *data;
+	netdissect_options *ndo;	/* the reading thread's */
+	uint32_t localnet;
+	uint32_t netmask;
+
+	atomic_uint_fast64_t head;	/* slots filled, ever */
+	atomic_uint_fast64_t tail;	/* slots written out, ever */
+	atomic_uint_fast64_t data_tail;	/* data ring bytes freed, ever */
+
+	pthread_t writer;
+	pthread_mutex_t lock;
+	pthread_cond_t done;		/* signaled to wake the writer */
+	pthread_cond_t room;		/* signaled to wake the reading thread */
+	atomic_int writer_idle;
+	atomic_int reader_waiting;
+	atomic_int stop;
+	int output_failed;		/* used only by the writer */
+
+	/* Used only by the reading thread */
+	uint64_t data_head;		/* data ring bytes used, ever */
+	struct timeval ts_ref;
+
+	/* Reports from the workers when they're stopped, one at a time */
+	void (*report)(netdissect_options *, u_int);
+	u_int report_turn;
+	pthread_cond_t report_cond;
+} pw = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.done = PTHREAD_COND_INITIALIZER,
+	.room = PTHREAD_COND_INITIALIZER,
+	.report_cond = PTHREAD_COND_INITIALIZER,
+};
+
+static void
+pw_deadline(struct timespec *ts, u_int msec)
+{
+	clock_gettime(CLOCK_REALTIME, ts);
+	ts->tv_sec += msec / 1000;
+	ts->tv_nsec += (long)(msec % 1000) * 1000000;
+	if (ts->tv_nsec >= 1000000000) {
+		ts->tv_sec++;
+		ts->tv_nsec -= 1000000000;
+	}
+}
+
+/* Wake a worker, if it's waiting. */
+static void
+pw_wake_worker(struct pw_worker *w)
+{
+	if (atomic_load(&w->idle)) {
+		pthread_mutex_lock(&pw.lock);
+		pthread_cond_signal(&w->wake);
+		pthread_mutex_unlock(&pw.lock);
+	}
+}
+
+/* Wake the writer thread, if it's waiting. */
+static void
+pw_wake_writer(void)
+{
+	if (atomic_load(&pw.writer_idle)) {
+		pthread_mutex_lock(&pw.lock);
+		pthread_cond_signal(&pw.done);
+		pthread_mutex_unlock(&pw.lock);
+	}
+}
+
+/* Wake the reading thread, if it's waiting. */
+static void
+pw_wake_reader(void)
+{
+	if (atomic_load(&pw.reader_waiting)) {
+		pthread_mutex_lock(&pw.lock);
+		pthread_cond_signal(&pw.room);
+		pthread_mutex_unlock(&pw.lock);
+	}
+}
+
+/*
+ * Wait, on the reading thread, for the writer to free a slot; the
+ * timeout only guards against a wakeup that's never sent.
+ */
+static void
+pw_wait_for_writer(void)
+{
+	struct timespec ts;
+
+	pthread_mutex_lock(&pw.lock);
+	atomic_store(&pw.reader_waiting, 1);
+	pw_deadline(&ts, 10);
+	pthread_cond_timedwait(&pw.room, &pw.lock, &ts);
+	atomic_store(&pw.reader_waiting, 0);
+	pthread_mutex_unlock(&pw.lock);
+}
+
+/*
+ * Hash the bytes of an address, and maybe a port, into h (64-bit FNV-1a).
+ */
+static uint64_t
+pw_hash(uint64_t h, const u_char *p, u_int len)
+{
+	while (len-- != 0) {
+		h ^= *p++;
+		h *= 0x100000001b3ULL;
+	}
+	return (h);
+}
+
+#define PW_HASH_INIT	0xcbf29ce484222325ULL
+
+/*
+ * Work out a key for an IPv4 or IPv6 packet that's the same for both
+ * directions of a conversation, as described at the top; returns 0 if
+ * it isn't one.
+ */
+static int
+pw_ip_key(const u_char *p, u_int len, int nested, uint64_t *keyp)
+{
+	uint64_t a, b;
+	u_int hl, proto;
+
+	if (len < 1)
+		return (0);
+	switch (p[0] >> 4) {
+
+	case 4:
+		if (len < 20)
+			return (0);
+		a = pw_hash(PW_HASH_INIT, p + 12, 4);
+		b = pw_hash(PW_HASH_INIT, p + 16, 4);
+		proto = p[9];
+		hl = (p[0] & 0x0f) * 4;
+		/*
+		 * Only the first fragment has the TCP header, so the
+		 * others are keyed on the addresses alone; they aren't
+		 * dissected beyond the IP header, so it doesn't matter
+		 * which worker they go to.
+		 */
+		if (((p[6] & 0x1f) << 8 | p[7]) != 0 || hl < 20 || hl > len)
+			break;
+		if (proto == IPPROTO_TCP && len - hl >= 4) {
+			a = pw_hash(a, p + hl, 2);
+			b = pw_hash(b, p + hl + 2, 2);
+		} else if (proto == IPPROTO_ICMP && !nested && len - hl >= 8) {
+			switch (p[hl]) {
+			case 3:		/* unreachable */
+			case 4:		/* source quench */
+			case 5:		/* redirect */
+			case 11:	/* time exceeded */
+			case 12:	/* parameter problem */
+				if (pw_ip_key(p + hl + 8, len - hl - 8, 1,
+				    keyp))
+					return (1);
+			}
+		}
+		break;
+
+	case 6:
+		if (len < 40)
+			return (0);
+		a = pw_hash(PW_HASH_INIT, p + 8, 16);
+		b = pw_hash(PW_HASH_INIT, p + 24, 16);
+		proto = p[6];
+		hl = 40;
+		while ((proto == IPPROTO_HOPOPTS || proto == IPPROTO_ROUTING ||
+		    proto == IPPROTO_DSTOPTS || proto == IPPROTO_FRAGMENT) &&
+		    len - hl >= 8) {
+			if (proto == IPPROTO_FRAGMENT) {
+				proto = p[hl];
+				/*
+				 * Key a fragment other than the first as
+				 * the protocol it's a fragment of, as for
+				 * IPv4.
+				 */
+				if (((p[hl + 2] << 8 | p[hl + 3]) & 0xfff8) != 0)
+					goto done;
+				hl += 8;
+				continue;
+			}
+			proto = p[hl];
+			hl += (p[hl + 1] + 1) * 8;
+			if (hl > len)
+				break;
+		}
+		if (hl > len)
+			break;
+		if (proto == IPPROTO_TCP && len - hl >= 4) {
+			a = pw_hash(a, p + hl, 2);
+			b = pw_hash(b, p + hl + 2, 2);
+		} else if (proto == IPPROTO_ICMPV6 && !nested && len - hl >= 8 &&
+		    p[hl] >= 1 && p[hl] <= 4) {
+			/* Destination unreachable to parameter problem */
+			if (pw_ip_key(p + hl + 8, len - hl - 8, 1, keyp))
+				return (1);
+		}
+		break;
+
+	default:
+		return (0);
+	}
+done:
+	/* Adding them makes it the same both ways. */
+	*keyp = (a + b) ^ proto;
+	return (1);
+}
+
+/*
+ * Pick the worker to print a packet, which has len bytes of data.
+ */
+static u_int
+pw_pick_worker(int dlt, const u_char *p, u_int len)
+{
+	u_int off, type;
+	uint64_t key;
+
+	if (pw.nworkers == 1)
+		return (0);
+	switch (dlt) {
+
+	case DLT_EN10MB:
+		off = 12;
+		if (len < off + 2)
+			return (0);
+		type = p[off] << 8 | p[off + 1];
+		while ((type == ETHERTYPE_8021Q || type == ETHERTYPE_8021Q9100 ||
+		    type == ETHERTYPE_8021Q9200 || type == ETHERTYPE_8021QinQ) &&
+		    len >= off + 6) {
+			off += 4;
+			type = p[off] << 8 | p[off + 1];
+		}
+		off += 2;
+		if (type != ETHERTYPE_IP && type != ETHERTYPE_IPV6)
+			return (0);
+		break;
+
+#ifdef DLT_LINUX_SLL
+	case DLT_LINUX_SLL:
+		off = 16;
+		if (len < off)
+			return (0);
+		type = p[14] << 8 | p[15];
+		if (type != ETHERTYPE_IP && type != ETHERTYPE_IPV6)
+			return (0);
+		break;
+#endif
+
+#ifdef DLT_LINUX_SLL2
+	case DLT_LINUX_SLL2:
+		off = 20;
+		if (len < off)
+			return (0);
+		type = p[0] << 8 | p[1];
+		if (type != ETHERTYPE_IP && type != ETHERTYPE_IPV6)
+			return (0);
+		break;
+#endif
+
+	case DLT_NULL:
+#ifdef DLT_LOOP
+	case DLT_LOOP:
+#endif
+		/* The address family is checked by looking at the version. */
+		off = 4;
+		break;
+
+	case DLT_RAW:
+#ifdef DLT_IPV4
+	case DLT_IPV4:
+#endif
+#ifdef DLT_IPV6
+	case DLT_IPV6:
+#endif
+		off = 0;
+		break;
+
+	default:
+		return (0);
+	}
+	if (len < off || !pw_ip_key(p + off, len - off, 0, &key))
+		return (0);
+	key *= 0x9e3779b97f4a7c15ULL;
+	return ((u_int)((key >> 32) % pw.nworkers));
+}
+
+/* Print the packet in a slot, leaving the output in the slot. */
+static void
+pw_print(struct pw_worker *w, struct pw_slot *slot)
+{
+	netdissect_options *ndo = &w->ndo;
+	char *out;
+	size_t size;
+
+	if (ndo->ndo_dispatch.dlt != slot->dlt)
+		nd_set_dispatch(ndo, slot->dlt);
+	ndo->ndo_ts_ref = slot->ts_ref;
+	pretty_print_packet(ndo, &slot->hdr,
+	    pw.data + (slot->data_pos & (PW_DATA_SIZE - 1)), slot->number);
+
+	/* Swap buffers, so that nothing is copied. */
+	out = slot->out;
+	size = slot->out_size;
+	slot->out = ndo->ndo_outbuf;
+	slot->out_len = ndo->ndo_outbuf_len;
+	slot->out_size = ndo->ndo_outbuf_size;
+	ndo->ndo_outbuf = out;
+	ndo->ndo_outbuf_len = 0;
+	ndo->ndo_outbuf_size = size;
+}
+
+static void *
+pw_worker_thread(void *arg)
+{
+	struct pw_worker *w = (struct pw_worker *)arg;
+	struct pw_slot *slot;
+
+	/* Set up this thread's copy of the name tables. */
+	init_print(&w->ndo, pw.localnet, pw.netmask);
+	for (;;) {
+		if (w->tail == atomic_load_explicit(&w->head,
+		    memory_order_acquire)) {
+			if (atomic_load(&pw.stop))
+				break;
+			pthread_mutex_lock(&pw.lock);
+			atomic_store(&w->idle, 1);
+			if (w->tail == atomic_load(&w->head) &&
+			    !atomic_load(&pw.stop))
+				pthread_cond_wait(&w->wake, &pw.lock);
+			atomic_store(&w->idle, 0);
+			pthread_mutex_unlock(&pw.lock);
+			continue;
+		}
+		slot = &pw.slots[w->queue[w->tail & (PW_NSLOTS - 1)]];
+		w->tail++;
+		pw_print(w, slot);
+		atomic_store(&slot->state, PW_DONE);
+		pw_wake_writer();
+	}
+
+	/*
+	 * The tables that are reported on may be this thread's own, so
+	 * it does the reporting, after the workers before it.  A worker
+	 * that was given no packets has nothing to report.
+	 */
+	if (pw.report != NULL) {
+		pthread_mutex_lock(&pw.lock);
+		while (pw.report_turn != w->id)
+			pthread_cond_wait(&pw.report_cond, &pw.lock);
+		pthread_mutex_unlock(&pw.lock);
+		if (w->tail != 0)
+			(*pw.report)(&w->ndo, w->id);
+		pthread_mutex_lock(&pw.lock);
+		pw.report_turn++;
+		pthread_cond_broadcast(&pw.report_cond);
+		pthread_mutex_unlock(&pw.lock);
+	}
+	return (NULL);
+}
+
+static void
+pw_write(struct pw_slot *slot)
+{
+	if (slot->out_len == 0 || pw.output_failed)
+		return;
+	if (fwrite(slot->out, 1, slot->out_len, stdout) == slot->out_len)
+		return;
+	if (errno == EPIPE) {
+		/*
+		 * SIGPIPE was blocked on this thread; send it to the
+		 * process, so that it's handled as it would have been
+		 * without --threads, and drop the rest of the output.
+		 */
+		pw.output_failed = 1;
+		kill(getpid(), SIGPIPE);
+		return;
+	}
+	(*pw.ndo->ndo_error)(pw.ndo, S_ERR_ND_WRITE_FILE,
+	    "Unable to write output: %s", pcap_strerror(errno));
+}
+
+static void *
+pw_writer_thread(void *arg _U_)
+{
+	uint64_t tail = 0;
+	struct pw_slot *slot;
+
+	for (;;) {
+		slot = &pw.slots[tail & (PW_NSLOTS - 1)];
+		if (atomic_load_explicit(&slot->state, memory_order_acquire) !=
+		    PW_DONE) {
+			if (atomic_load(&pw.stop))
+				break;
+			pthread_mutex_lock(&pw.lock);
+			atomic_store(&pw.writer_idle, 1);
+			if (atomic_load(&slot->state) != PW_DONE &&
+			    !atomic_load(&pw.stop))
+				pthread_cond_wait(&pw.done, &pw.lock);
+			atomic_store(&pw.writer_idle, 0);
+			pthread_mutex_unlock(&pw.lock);
+			continue;
+		}
+		pw_write(slot);
+		slot->out_len = 0;
+		if (slot->out_size > PW_OUTBUF_KEEP) {
+			free(slot->out);
+			slot->out = NULL;
+			slot->out_size = 0;
+		}
+		atomic_store_explicit(&pw.data_tail, slot->data_end,
+		    memory_order_release);
+		atomic_store(&slot->state, PW_FREE);
+		atomic_store(&pw.tail, ++tail);
+		pw_wake_reader();
+	}
+	return (NULL);
+}
+
+/*
+ * Start nworkers worker threads, each printing packets with a copy of
+ * the options and printer set up in ndo, and the writer thread.  Call
+ * this once the options are all set and nd_set_dispatch() has been
+ * called; localnet and netmask are as for init_print().
+ * Returns -1, with a message in errbuf, on failure.
+ */
+int
+print_workers_start(netdissect_options *ndo, u_int nworkers,
+    uint32_t localnet, uint32_t netmask, char *errbuf, size_t errbuf_size)
+{
+	struct pw_worker *w;
+	sigset_t all, old;
+	u_int i;
+	int err = 0;
+
+	pw.slots = (struct pw_slot *)calloc(PW_NSLOTS, sizeof(*pw.slots));
+	pw.data = (u_char *)malloc(PW_DATA_SIZE);
+	pw.workers = (struct pw_worker *)calloc(nworkers,
+	    sizeof(*pw.workers));
+	if (pw.slots == NULL || pw.data == NULL || pw.workers == NULL) {
+		snprintf(errbuf, errbuf_size,
+		    "can't allocate buffers for the worker threads");
+		return (-1);
+	}
+	pw.ndo = ndo;
+	pw.localnet = localnet;
+	pw.netmask = netmask;
+
+	/* Leave the signals to the reading thread. */
+	sigfillset(&all);
+	pthread_sigmask(SIG_SETMASK, &all, &old);
+	for (i = 0; i < nworkers; i++) {
+		w = &pw.workers[i];
+		w->id = i;
+		w->queue = (uint32_t *)malloc(PW_NSLOTS * sizeof(*w->queue));
+		if (w->queue == NULL) {
+			snprintf(errbuf, errbuf_size,
+			    "can't allocate buffers for the worker threads");
+			err = -1;
+			break;
+		}
+		nd_copy_options(&w->ndo, ndo);
+		w->ndo.ndo_keep_output = 1;
+		pthread_cond_init(&w->wake, NULL);
+		err = pthread_create(&w->thread, NULL, pw_worker_thread, w);
+		if (err != 0) {
+			snprintf(errbuf, errbuf_size,
+			    "can't create worker thread: %s", strerror(err));
+			break;
+		}
+		pw.nworkers++;
+	}
+	if (i == nworkers) {
+		err = pthread_create(&pw.writer, NULL, pw_writer_thread, NULL);
+		if (err != 0)
+			snprintf(errbuf, errbuf_size,
+			    "can't create output thread: %s", strerror(err));
+	}
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+	if (err != 0)
+		return (-1);
+	pw.started = 1;
+	return (0);
+}
+
+/*
+ * Have a packet printed by a worker, waiting for room if need be;
+ * ndo is the one passed to print_workers_start(), with the printer for
+ * the current link-layer header type.
+ */
+void
+print_workers_print(netdissect_options *ndo, const struct pcap_pkthdr *h,
+    const u_char *sp, u_int packets_captured)
+{
+	uint64_t head = atomic_load_explicit(&pw.head, memory_order_relaxed);
+	struct pw_slot *slot = &pw.slots[head & (PW_NSLOTS - 1)];
+	struct pw_worker *w;
+	uint64_t whead;
+	u_int len, pad;
+	int valid;
+
+	/* pretty_print_packet() would print nothing */
+	if (ndo->ndo_print_sampling &&
+	    packets_captured % ndo->ndo_print_sampling != 0)
+		return;
+
+	/*
+	 * pretty_print_packet() doesn't look at the data, or print a time
+	 * stamp, for a packet with a bad header.
+	 */
+	valid = h->caplen != 0 && h->len >= h->caplen &&
+	    h->len <= MAXIMUM_SNAPLEN;
+	len = valid ? h->caplen : 0;
+
+	/* Don't wrap the data around the end of the ring. */
+	pad = PW_DATA_SIZE - (u_int)(pw.data_head & (PW_DATA_SIZE - 1));
+	if (pad >= len)
+		pad = 0;
+	while (atomic_load_explicit(&slot->state, memory_order_acquire) !=
+	    PW_FREE || pw.data_head + pad + len -
+	    atomic_load_explicit(&pw.data_tail, memory_order_acquire) >
+	    PW_DATA_SIZE)
+		pw_wait_for_writer();
+	pw.data_head += pad;
+	slot->data_pos = pw.data_head;
+	memcpy(pw.data + (pw.data_head & (PW_DATA_SIZE - 1)), sp, len);
+	pw.data_head += len;
+	slot->data_end = pw.data_head;
+	slot->hdr = *h;
+	slot->number = packets_captured;
+	slot->dlt = ndo->ndo_dispatch.dlt;
+
+	/*
+	 * The time stamps that -ttt and -ttttt print relative to depend
+	 * on the packets before, so they're worked out here, as
+	 * ts_delta_print() would have.
+	 */
+	if (valid && (ndo->ndo_tflag == 3 || ndo->ndo_tflag == 5)) {
+		struct timeval tv;
+
+		tv.tv_sec = h->ts.tv_sec;
+		tv.tv_usec = h->ts.tv_usec;
+		if (!netdissect_timevalisset(&pw.ts_ref))
+			pw.ts_ref = tv;
+		slot->ts_ref = pw.ts_ref;
+		if (ndo->ndo_tflag == 3)
+			pw.ts_ref = tv;
+	}
+
+	atomic_store_explicit(&slot->state, PW_QUEUED, memory_order_relaxed);
+	w = &pw.workers[pw_pick_worker(slot->dlt, sp, len)];
+	whead = atomic_load_explicit(&w->head, memory_order_relaxed);
+	w->queue[whead & (PW_NSLOTS - 1)] = (uint32_t)(head & (PW_NSLOTS - 1));
+	atomic_store_explicit(&pw.head, head + 1, memory_order_relaxed);
+	atomic_store(&w->head, whead + 1);
+	pw_wake_worker(w);
+}
+
+/* Wait for everything handed to the workers to be written out. */
+void
+print_workers_drain(void)
+{
+	if (!pw.started)
+		return;
+	while (atomic_load(&pw.tail) != atomic_load(&pw.head))
+		pw_wait_for_writer();
+}
+
+/*
+ * Write out everything handed to the workers and stop them; if report
+ * isn't null, each worker then calls it, on its own thread, with its
+ * netdissect_options and its number, one after another.
+ */
+void
+print_workers_stop(void (*report)(netdissect_options *, u_int))
+{
+	u_int i;
+
+	if (!pw.started)
+		return;
+	print_workers_drain();
+	pw.started = 0;
+	pw.report = report;
+	atomic_store(&pw.stop, 1);
+	pthread_mutex_lock(&pw.lock);
+	for (i = 0; i < pw.nworkers; i++)
+		pthread_cond_signal(&pw.workers[i].wake);
+	pthread_cond_signal(&pw.done);
+	pthread_mutex_unlock(&pw.lock);
+	pthread_join(pw.writer, NULL);
+	for (i = 0; i < pw.nworkers; i++)
+		pthread_join(pw.workers[i].thread, NULL);
+}
+#endif /* USE_PRINT_WORKERS */
@@ -0,0 +1,37 @@
+/*
+ * Copyright (c) 2026 The TCPDUMP project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that: (1) source code
+ * distributions retain the above copyright notice and this paragraph
+ * in its entirety, and (2) distributions including binary code include
+ * the above copyright notice and this paragraph in its entirety in
+ * the documentation or other materials provided with the distribution.
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND
+ * WITHOUT ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, WITHOUT
+ * LIMITATION, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE.
+ */
+
+#ifndef print_workers_h
+#define print_workers_h
+
+/*
+ * Dissecting and printing packets on worker threads (--threads), with
+ * the output written in the order in which the packets were read.
+ * The printers' static variables have to be thread-local for that.
+ */
+#if defined(HAVE_PTHREADS) && defined(HAVE_STDATOMIC_H) && \
+    defined(ND_HAVE_THREAD_LOCAL)
+#define USE_PRINT_WORKERS
+
+extern int print_workers_start(netdissect_options *, u_int, uint32_t,
+    uint32_t, char *, size_t);
+extern void print_workers_print(netdissect_options *,
+    const struct pcap_pkthdr *, const u_char *, u_int);
+extern void print_workers_drain(void);
+extern void print_workers_stop(void (*)(netdissect_options *, u_int));
+#endif /* HAVE_PTHREADS && HAVE_STDATOMIC_H && ND_HAVE_THREAD_LOCAL */
+
+#endif /* print_workers_h */
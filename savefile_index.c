@@ -0,0 +1,538 @@
+/*
+ * Copyright (c) 2026 The TCPDUMP project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that: (1) source code
+ * distributions retain the above copyright notice and this paragraph
+ * in its entirety, and (2) distributions including binary code include
+ * the above copyright notice and this paragraph in its entirety in
+ * the documentation or other materials provided with the distribution.
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND
+ * WITHOUT ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, WITHOUT
+ * LIMITATION, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE.
+ */
+
+/*
+ * Sidecar savefile indexes.
+ *
+ * The index of a savefile is kept in a file with the same name and
+ * ".idx" appended.  It has an entry for every Nth packet, giving the
+ * packet number, the offset of its record in the savefile and its time
+ * stamp, so that reading can start at the entry before the packet
+ * wanted instead of at the beginning of the file.  Each entry also has
+ * the latest time stamp of all the packets before it: the time stamps
+ * in a savefile aren't always in order, and with that the first packet
+ * at or after a given time can still be found exactly.  An index of a
+ * savefile that was written or read to the end finishes with an entry
+ * for the end of the file.
+ *
+ * The index is written as the savefile is written with -w, or as it's
+ * read from the beginning with -r.  Entries are added as packets go
+ * by, so the index of a savefile that's still being written, or whose
+ * reading stopped early, covers the part written or read so far.
+ *
+ * All fields are little-endian:
+ *
+ *	header:	"TCPDIDX1" (8 bytes)
+ *		packets between entries (4 bytes)
+ *		flags (4 bytes); SFI_FLAG_NSEC means that time stamps
+ *		    are in nanoseconds rather than microseconds
+ *
+ *	entry:	packet number, counting from 0 (8 bytes)
+ *		offset of the packet's record in the savefile (8 bytes)
+ *		time stamp of the packet (8 bytes)
+ *		latest time stamp of the packets before it (8 bytes)
+ *		original length of the packet (4 bytes)
+ *
+ * The end-of-file entry has a time stamp of all ones.
+ *
+ * Nothing in the index says which savefile it was made from, and the
+ * savefile isn't read through to check it.  Instead, before an entry
+ * is used, the record at its offset is checked against it, as is the
+ * last entry, which catches a savefile that's been replaced or added
+ * to since it was indexed.
+ *
+ * Only pcap savefiles are indexed: a packet in a pcapng file can't be
+ * read without the interface description blocks before it.
+ */
+
+#include <config.h>
+
+#include "netdissect-stdinc.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <pcap.h>
+
+#include "savefile_index.h"
+
+#ifdef _WIN32
+#define sfi_fseek	_fseeki64
+#define sfi_ftell	_ftelli64
+#else
+#include <unistd.h>
+#define sfi_fseek	fseeko
+#define sfi_ftell	ftello
+#endif
+
+#define SFI_MAGIC	"TCPDIDX1"
+#define SFI_HDRLEN	16
+#define SFI_ENTRYLEN	36
+#define SFI_FLAG_NSEC	0x00000001
+#define SFI_END_TS	UINT64_MAX	/* time stamp of the end entry */
+
+/* The parts of the pcap savefile format needed here */
+#define PCAP_MAGIC		0xa1b2c3d4
+#define PCAP_NSEC_MAGIC		0xa1b23c4d
+#define PCAP_FILE_HDRLEN	24
+#define PCAP_REC_HDRLEN		16
+
+struct sf_index_entry {
+	uint64_t packet;	/* packet number, counting from 0 */
+	uint64_t offset;	/* offset of its record in the savefile */
+	uint64_t ts;		/* its time stamp */
+	uint64_t maxts;		/* latest time stamp before it */
+	uint32_t len;		/* its original length */
+};
+
+struct sf_index_writer {
+	FILE *fp;		/* the index */
+	char *name;		/* ... and its name */
+	FILE *sfp;		/* the savefile, if it's being read */
+	u_int interval;		/* packets between entries */
+	u_int left;		/* packets until the next entry */
+	int nsec;		/* time stamps are in nanoseconds */
+	uint64_t count;		/* packets so far */
+	uint64_t offset;	/* offset of the next packet's record */
+	uint64_t maxts;		/* latest time stamp so far */
+	int error;		/* an error happened writing the index */
+};
+
+static void
+put_le32(u_char *p, uint32_t v)
+{
+	p[0] = (u_char)v;
+	p[1] = (u_char)(v >> 8);
+	p[2] = (u_char)(v >> 16);
+	p[3] = (u_char)(v >> 24);
+}
+
+static void
+put_le64(u_char *p, uint64_t v)
+{
+	put_le32(p, (uint32_t)v);
+	put_le32(p + 4, (uint32_t)(v >> 32));
+}
+
+static uint32_t
+get_le32(const u_char *p)
+{
+	return ((uint32_t)p[3] << 24 | (uint32_t)p[2] << 16 |
+	    (uint32_t)p[1] << 8 | (uint32_t)p[0]);
+}
+
+static uint32_t
+get_be32(const u_char *p)
+{
+	return ((uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 |
+	    (uint32_t)p[2] << 8 | (uint32_t)p[3]);
+}
+
+static uint64_t
+get_le64(const u_char *p)
+{
+	return ((uint64_t)get_le32(p + 4) << 32 | get_le32(p));
+}
+
+static char *
+index_name(const char *savefile)
+{
+	size_t len = strlen(savefile);
+	char *name;
+
+	name = malloc(len + sizeof(".idx"));
+	if (name != NULL) {
+		memcpy(name, savefile, len);
+		memcpy(name + len, ".idx", sizeof(".idx"));
+	}
+	return (name);
+}
+
+/*
+ * Check that sfp is a pcap savefile, rather than a pcapng file or
+ * something that can't be seeked in, and get the byte order and
+ * time stamp precision of its records.  The file position is left
+ * where it was.
+ */
+static int
+check_savefile(FILE *sfp, int *bigendian, int *nsec)
+{
+	u_char magic[4];
+	int64_t pos;
+	size_t n;
+
+	pos = sfi_ftell(sfp);
+	if (pos == -1 || sfi_fseek(sfp, 0, SEEK_SET) == -1)
+		return (-1);
+	n = fread(magic, 1, sizeof(magic), sfp);
+	if (sfi_fseek(sfp, pos, SEEK_SET) == -1 || n != sizeof(magic))
+		return (-1);
+
+	*bigendian = 0;
+	*nsec = 0;
+	switch (get_le32(magic)) {
+
+	case PCAP_NSEC_MAGIC:
+		*nsec = 1;
+		break;
+
+	case PCAP_MAGIC:
+		break;
+
+	default:
+		*bigendian = 1;
+		switch (get_be32(magic)) {
+
+		case PCAP_NSEC_MAGIC:
+			*nsec = 1;
+			break;
+
+		case PCAP_MAGIC:
+			break;
+
+		default:
+			return (-1);
+		}
+	}
+	return (0);
+}
+
+/*
+ * Start an index, relative to the directory dirfd (-1 for the current
+ * directory), for the pcap savefile savefile with time stamps in
+ * nanoseconds if nsec is set, with an entry every interval packets.
+ * If sfp is NULL, the savefile is being written, and each packet's
+ * record is where the one before it ends; otherwise, it's the savefile
+ * being read, positioned at its first packet, and the records are
+ * where sfp says they are.
+ */
+struct sf_index_writer *
+sf_index_writer_open(int dirfd _U_, const char *savefile, u_int interval,
+    int nsec, FILE *sfp, char *ebuf, size_t ebufsize)
+{
+	struct sf_index_writer *w;
+	u_char hdr[SFI_HDRLEN];
+	int64_t offset = PCAP_FILE_HDRLEN;
+	int bigendian, fnsec;
+#ifndef _WIN32
+	int fd;
+#endif
+
+	if (sfp != NULL) {
+		if (check_savefile(sfp, &bigendian, &fnsec) == -1 ||
+		    (offset = sfi_ftell(sfp)) == -1) {
+			snprintf(ebuf, ebufsize,
+			    "%s can't be indexed; it's not a pcap savefile that can be seeked in",
+			    savefile);
+			return (NULL);
+		}
+	}
+
+	w = calloc(1, sizeof(*w));
+	if (w == NULL || (w->name = index_name(savefile)) == NULL) {
+		snprintf(ebuf, ebufsize, "can't allocate index for %s",
+		    savefile);
+		free(w);
+		return (NULL);
+	}
+#ifdef _WIN32
+	w->fp = fopen(w->name, "wb");
+#else
+	fd = openat(dirfd == -1 ? AT_FDCWD : dirfd, w->name,
+	    O_CREAT | O_WRONLY | O_TRUNC, 0666);
+	if (fd != -1) {
+		w->fp = fdopen(fd, "w");
+		if (w->fp == NULL)
+			close(fd);
+	}
+#endif
+	if (w->fp == NULL) {
+		snprintf(ebuf, ebufsize, "can't create index %s: %s", w->name,
+		    pcap_strerror(errno));
+		free(w->name);
+		free(w);
+		return (NULL);
+	}
+	w->sfp = sfp;
+	w->interval = interval;
+	w->nsec = nsec;
+	w->offset = (uint64_t)offset;
+
+	memcpy(hdr, SFI_MAGIC, 8);
+	put_le32(hdr + 8, interval);
+	put_le32(hdr + 12, nsec ? SFI_FLAG_NSEC : 0);
+	if (fwrite(hdr, sizeof(hdr), 1, w->fp) != 1)
+		w->error = 1;
+	return (w);
+}
+
+static void
+put_entry(struct sf_index_writer *w, uint64_t packet, uint64_t offset,
+    uint64_t ts, uint32_t len)
+{
+	u_char buf[SFI_ENTRYLEN];
+
+	put_le64(buf, packet);
+	put_le64(buf + 8, offset);
+	put_le64(buf + 16, ts);
+	put_le64(buf + 24, w->maxts);
+	put_le32(buf + 32, len);
+	if (fwrite(buf, sizeof(buf), 1, w->fp) != 1)
+		w->error = 1;
+}
+
+/*
+ * Add the next packet of the savefile to the index.
+ */
+void
+sf_index_add(struct sf_index_writer *w, const struct pcap_pkthdr *h)
+{
+	uint64_t ts;
+	int64_t offset;
+
+	ts = (uint64_t)h->ts.tv_sec * (w->nsec ? 1000000000 : 1000000) +
+	    (uint64_t)h->ts.tv_usec;
+	if (w->left == 0) {
+		put_entry(w, w->count, w->offset, ts, h->len);
+		w->left = w->interval;
+	}
+	if (ts > w->maxts)
+		w->maxts = ts;
+	w->count++;
+	w->left--;
+
+	/*
+	 * A savefile being read is only asked where the next record is
+	 * when that record will get an entry.
+	 */
+	if (w->sfp == NULL)
+		w->offset += PCAP_REC_HDRLEN + h->caplen;
+	else if (w->left == 0) {
+		if ((offset = sfi_ftell(w->sfp)) == -1)
+			w->error = 1;
+		w->offset = (uint64_t)offset;
+	}
+}
+
+/*
+ * Finish an index, with an end-of-file entry if all of the savefile
+ * was written or read.
+ */
+int
+sf_index_writer_close(struct sf_index_writer *w, int complete, char *ebuf,
+    size_t ebufsize)
+{
+	int64_t offset;
+	int ret = 0;
+
+	if (complete) {
+		if (w->sfp != NULL) {
+			if ((offset = sfi_ftell(w->sfp)) == -1)
+				w->error = 1;
+			w->offset = (uint64_t)offset;
+		}
+		put_entry(w, w->count, w->offset, SFI_END_TS, 0);
+	}
+	if (fclose(w->fp) == EOF || w->error) {
+		snprintf(ebuf, ebufsize, "error writing index %s", w->name);
+		ret = -1;
+	}
+	free(w->name);
+	free(w);
+	return (ret);
+}
+
+static int64_t
+file_size(FILE *fp)
+{
+	int64_t pos, size;
+
+	if ((pos = sfi_ftell(fp)) == -1 || sfi_fseek(fp, 0, SEEK_END) == -1)
+		return (-1);
+	size = sfi_ftell(fp);
+	if (sfi_fseek(fp, pos, SEEK_SET) == -1)
+		return (-1);
+	return (size);
+}
+
+/*
+ * Check an entry against the savefile: its record must have the time
+ * stamp and length the entry says, compared to the microsecond in case
+ * the savefile was indexed as it was read with less precision than it
+ * has, and an end entry must be at the end of the file.  This moves
+ * the file position.
+ */
+static int
+check_entry(FILE *sfp, int bigendian, int fnsec, int nsec,
+    const struct sf_index_entry *e)
+{
+	u_char rec[PCAP_REC_HDRLEN];
+	uint32_t (*get32)(const u_char *);
+	uint64_t usec;
+
+	if (e->ts == SFI_END_TS)
+		return (file_size(sfp) == (int64_t)e->offset);
+	if (sfi_fseek(sfp, (int64_t)e->offset, SEEK_SET) == -1 ||
+	    fread(rec, sizeof(rec), 1, sfp) != 1)
+		return (0);
+	get32 = bigendian ? get_be32 : get_le32;
+	usec = (uint64_t)get32(rec) * 1000000 +
+	    (fnsec ? get32(rec + 4) / 1000 : get32(rec + 4));
+	return (usec == (nsec ? e->ts / 1000 : e->ts) &&
+	    get32(rec + 12) == e->len);
+}
+
+/*
+ * Move the savefile that pd has just opened, if it has an index, to
+ * the last indexed packet that's at most max_packets packets into the
+ * file and, if start isn't 0, before which all the packets have time
+ * stamps before start (in nanoseconds since the epoch).  Returns 1,
+ * with the number of packets passed over in *packets, if the savefile
+ * has an index, whether or not that moved anywhere; 0 if it doesn't,
+ * or, if complete is set, if its index doesn't go to the end of the
+ * savefile; and -1, with a message in ebuf, if its index can't be
+ * used.  The savefile is left at its first packet unless 1 is
+ * returned.
+ */
+int
+sf_index_seek(pcap_t *pd, const char *savefile, uint64_t max_packets,
+    uint64_t start, int complete, uint64_t *packets, char *ebuf,
+    size_t ebufsize)
+{
+	FILE *sfp, *fp;
+	char *name;
+	u_char *buf = NULL;
+	struct sf_index_entry *entries = NULL, *e;
+	int64_t pos, size;
+	size_t n, i, lo, hi;
+	int bigendian, fnsec, nsec;
+	int ret = -1;
+
+	*packets = 0;
+	sfp = pcap_file(pd);
+	if (sfp == NULL || check_savefile(sfp, &bigendian, &fnsec) == -1 ||
+	    (pos = sfi_ftell(sfp)) == -1)
+		return (0);
+	if ((name = index_name(savefile)) == NULL) {
+		snprintf(ebuf, ebufsize, "can't allocate index name for %s",
+		    savefile);
+		return (-1);
+	}
+	fp = fopen(name, "rb");
+	if (fp == NULL) {
+		if (errno == ENOENT)
+			ret = 0;
+		else
+			snprintf(ebuf, ebufsize, "can't open index %s: %s",
+			    name, pcap_strerror(errno));
+		free(name);
+		return (ret);
+	}
+
+	/*
+	 * Read all of the index.  There's one entry per interval packets
+	 * of the savefile, so it's small next to the savefile; a trailing
+	 * partial entry, from an index that's still being written, is
+	 * left out.
+	 */
+	size = file_size(fp);
+	if (size < SFI_HDRLEN || (buf = malloc((size_t)size)) == NULL ||
+	    fread(buf, (size_t)size, 1, fp) != 1 ||
+	    memcmp(buf, SFI_MAGIC, 8) != 0) {
+		snprintf(ebuf, ebufsize, "%s isn't a savefile index", name);
+		goto done;
+	}
+	nsec = (get_le32(buf + 12) & SFI_FLAG_NSEC) != 0;
+	n = (size_t)(size - SFI_HDRLEN) / SFI_ENTRYLEN;
+	if (complete && (n == 0 || get_le64(buf + SFI_HDRLEN +
+	    (n - 1) * SFI_ENTRYLEN + 16) != SFI_END_TS)) {
+		/* Left by a write or read that stopped early. */
+		ret = 0;
+		goto done;
+	}
+	if (n == 0) {
+		ret = 1;
+		goto done;
+	}
+	entries = calloc(n, sizeof(*entries));
+	if (entries == NULL) {
+		snprintf(ebuf, ebufsize, "can't allocate index %s", name);
+		goto done;
+	}
+	for (i = 0; i < n; i++) {
+		const u_char *p = buf + SFI_HDRLEN + i * SFI_ENTRYLEN;
+
+		e = &entries[i];
+		e->packet = get_le64(p);
+		e->offset = get_le64(p + 8);
+		e->ts = get_le64(p + 16);
+		e->maxts = get_le64(p + 24);
+		e->len = get_le32(p + 32);
+		if (e->offset < (uint64_t)pos || (i != 0 &&
+		    (e->packet <= e[-1].packet || e->offset <= e[-1].offset ||
+		    e->maxts < e[-1].maxts || e[-1].ts == SFI_END_TS))) {
+			snprintf(ebuf, ebufsize, "index %s is corrupt", name);
+			goto done;
+		}
+	}
+	if (!check_entry(sfp, bigendian, fnsec, nsec, &entries[n - 1])) {
+		snprintf(ebuf, ebufsize, "index %s is out of date", name);
+		goto done;
+	}
+
+	/*
+	 * Both conditions hold for a run of entries at the start of the
+	 * index, if any, and the last of those is the one wanted.
+	 */
+	if (start != 0 && !nsec)
+		start /= 1000;
+	lo = 0;
+	hi = n;
+	while (lo < hi) {
+		i = lo + (hi - lo) / 2;
+		if (entries[i].packet <= max_packets &&
+		    (start == 0 || entries[i].maxts < start))
+			lo = i + 1;
+		else
+			hi = i;
+	}
+	ret = 1;
+	if (lo == 0 || entries[lo - 1].offset == (uint64_t)pos)
+		goto done;
+	e = &entries[lo - 1];
+	if (lo != n && !check_entry(sfp, bigendian, fnsec, nsec, e)) {
+		snprintf(ebuf, ebufsize, "index %s is out of date", name);
+		ret = -1;
+		goto done;
+	}
+	pos = (int64_t)e->offset;
+	*packets = e->packet;
+done:
+	if (sfi_fseek(sfp, pos, SEEK_SET) == -1) {
+		snprintf(ebuf, ebufsize, "can't seek in %s: %s", savefile,
+		    pcap_strerror(errno));
+		*packets = 0;
+		ret = -1;
+	}
+	free(entries);
+	free(buf);
+	fclose(fp);
+	free(name);
+	return (ret);
+}
@@ -0,0 +1,34 @@
+/*
+ * Copyright (c) 2026 The TCPDUMP project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that: (1) source code
+ * distributions retain the above copyright notice and this paragraph
+ * in its entirety, and (2) distributions including binary code include
+ * the above copyright notice and this paragraph in its entirety in
+ * the documentation or other materials provided with the distribution.
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND
+ * WITHOUT ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, WITHOUT
+ * LIMITATION, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE.
+ */
+
+#ifndef savefile_index_h
+#define savefile_index_h
+
+/*
+ * Sidecar indexes for pcap savefiles (--write-index), used to start
+ * reading a savefile near the packet wanted with --skip or --start-time.
+ */
+struct sf_index_writer;
+
+extern struct sf_index_writer *sf_index_writer_open(int, const char *,
+    u_int, int, FILE *, char *, size_t);
+extern void sf_index_add(struct sf_index_writer *, const struct pcap_pkthdr *);
+extern int sf_index_writer_close(struct sf_index_writer *, int, char *,
+    size_t);
+extern int sf_index_seek(pcap_t *, const char *, uint64_t, uint64_t, int,
+    uint64_t *, char *, size_t);
+
+#endif /* savefile_index_h */
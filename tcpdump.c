@@ -148,13 +148,20 @@ The Regents of the University of California.  All rights reserved.\n";
 #include "interface.h"
 #include "addrtoname.h"
 #include "ascii_strcasecmp.h"
+#include "netdissect-ctype.h"
 
+#include "portmap.h"
 #include "print.h"
 
 #include "diag-control.h"
 
 #include "fptype.h"
 
+#include "dump_rotate.h"
+#include "dump_writer.h"
+#include "print_workers.h"
+#include "savefile_index.h"
+
 #ifndef PATH_MAX
 #define PATH_MAX 1024
 #endif
@@ -214,11 +221,50 @@ static int timeout = 1000;		/* default timeout = 1000 ms = 1 s */
 static int immediate_mode;
 #endif
 static int count_mode;
+static int rpc_latency;			/* report RPC latency per procedure */
+static int table_stats;			/* report on the caches and tables */
 static u_int packets_to_skip;
+static uint64_t start_time;		/* first time to read, in ns since the epoch */
+static uint64_t end_time = UINT64_MAX;	/* time to stop reading at */
+static u_int write_index;		/* index savefiles every this many packets */
+static struct sf_index_writer *dump_index;	/* index of the savefile written */
+
+/*
+ * Reading savefiles with --start-time, --end-time or --write-index
+ * (see read_packet()).
+ */
+static int read_all_packets;		/* the filter is run by read_packet() */
+static pcap_handler read_callback;	/* callback for packets that pass */
+static const struct bpf_program *read_fcode;
+static struct sf_index_writer *read_index;	/* index being built */
+static int read_nsec;			/* time stamps are in nanoseconds */
+static int read_started;		/* --start-time has been reached */
+static int read_ended;			/* --end-time has been reached */
+static int read_eof;			/* the savefile has been read to the end */
+static int read_passed;			/* packets that passed, this batch */
+static u_int read_skipped;		/* --skip packets passed over with the index */
+#ifdef USE_DUMP_WRITER
+static size_t write_buffer_size;	/* write savefiles from a separate thread */
+static int direct_io;			/* ... with O_DIRECT */
+
+/* Default size of the buffer for the savefile writer thread */
+#define DEFAULT_WRITE_BUFFER_SIZE	(16*1024*1024)
+
+#ifdef USE_DUMP_WRITER_COMPRESSION
+static enum dump_compression compress_method;	/* compress savefiles ... */
+static int compress_level;			/* ... at this level ... */
+static int compress_threads;			/* ... with this many threads */
+#endif
+#endif
+
+static u_int print_threads;		/* print packets on worker threads */
 
 static int infodelay;
 static int infoprint;
 
+/* Maximum number of packets to get with one pcap_dispatch() call */
+#define DISPATCH_BATCH	256
+
 /*
  * Last component of the path to the executable.
  */
@@ -237,6 +283,7 @@ static u_int parse_u_int(const char *argname, const char *string, char **endp,
     u_int minval, u_int maxval, int base);
 static int64_t parse_int64(const char *argname, const char *string,
     char **endp, int64_t minval, int64_t maxval, int base);
+static uint64_t parse_time(const char *argname, const char *string);
 static void (*setsignal (int sig, void (*func)(int)))(int);
 static void cleanup(int);
 #if defined(HAVE_FORK) || defined(HAVE_VFORK)
@@ -245,9 +292,19 @@ static void child_cleanup(int);
 static void print_version(FILE *);
 static void print_usage(FILE *);
 
+static void print_table_stats(netdissect_options *);
+#ifdef USE_PRINT_WORKERS
+static void report_worker_stats(netdissect_options *, u_int);
+#endif
+static void print_one_packet(netdissect_options *, const struct pcap_pkthdr *, const u_char *);
 static void print_packet(u_char *, const struct pcap_pkthdr *, const u_char *);
 static void dump_packet_and_trunc(u_char *, const struct pcap_pkthdr *, const u_char *);
 static void dump_packet(u_char *, const struct pcap_pkthdr *, const u_char *);
+static void skip_packet(u_char *, const struct pcap_pkthdr *, const u_char *);
+static void read_packet(u_char *, const struct pcap_pkthdr *, const u_char *);
+static int dispatch_loop(int, pcap_handler, u_char *, pcap_dumper_t **);
+static void seek_savefile(const char *, const struct bpf_program *, int);
+static void open_dump_index(int, const char *);
 
 #ifdef SIGNAL_REQ_INFO
 static void requestinfo(int);
@@ -301,6 +358,9 @@ struct dump_info {
 #endif
 };
 
+static void rotate_dump_file_by_time(struct dump_info *, time_t);
+static void close_dump_index(void);
+
 #if defined(HAVE_PCAP_SET_PARSER_DEBUG)
 /*
  * We have pcap_set_parser_debug() in libpcap; declare it (it's not declared
@@ -355,6 +415,14 @@ void pcap_set_optimizer_debug(int);
 static void NORETURN
 exit_tcpdump(const int status)
 {
+#ifdef USE_DUMP_WRITER
+	dump_writer_stop();
+#endif
+#ifdef USE_DUMP_ROTATE
+	dump_rotate_stop();
+#endif
+	if (dump_index != NULL)
+		close_dump_index();
 	nd_cleanup();
 	exit(status);
 }
@@ -684,6 +752,24 @@ show_remote_devices_and_exit(void)
 #define OPTION_LENGTHS			138
 #define OPTION_TIME_T_SIZE		139
 #define OPTION_SKIP			140
+#define OPTION_RESOLVE_ASYNC		141
+#define OPTION_RESOLVE_WAIT		142
+#define OPTION_NAME_CACHE_SIZE		143
+#define OPTION_WRITE_BUFFER		144
+#define OPTION_DIRECT_IO		145
+#define OPTION_COMPRESS			146
+#define OPTION_COMPRESS_THREADS		147
+#define OPTION_TCP_FLOW_TABLE_SIZE	148
+#define OPTION_RPC_XID_TABLE_SIZE	149
+#define OPTION_RPC_LATENCY		150
+#define OPTION_QUIC_CID_TABLE_SIZE	151
+#define OPTION_PORT_MAP			152
+#define OPTION_FLOW_STATE_MEMORY	153
+#define OPTION_START_TIME		154
+#define OPTION_END_TIME			155
+#define OPTION_WRITE_INDEX		156
+#define OPTION_THREADS			157
+#define OPTION_TABLE_STATS		158
 
 static const struct option longopts[] = {
 	{ "buffer-size", required_argument, NULL, 'B' },
@@ -728,6 +814,34 @@ static const struct option longopts[] = {
 	{ "time-t-size", no_argument, NULL, OPTION_TIME_T_SIZE },
 	{ "ip-oneline", no_argument, NULL, 'g' },
 	{ "skip", required_argument, NULL, OPTION_SKIP },
+	{ "start-time", required_argument, NULL, OPTION_START_TIME },
+	{ "end-time", required_argument, NULL, OPTION_END_TIME },
+	{ "write-index", required_argument, NULL, OPTION_WRITE_INDEX },
+#ifdef HAVE_PTHREADS
+	{ "resolve-async", no_argument, NULL, OPTION_RESOLVE_ASYNC },
+	{ "resolve-wait", required_argument, NULL, OPTION_RESOLVE_WAIT },
+#endif
+	{ "name-cache-size", required_argument, NULL, OPTION_NAME_CACHE_SIZE },
+	{ "tcp-flow-table-size", required_argument, NULL, OPTION_TCP_FLOW_TABLE_SIZE },
+	{ "rpc-xid-table-size", required_argument, NULL, OPTION_RPC_XID_TABLE_SIZE },
+	{ "rpc-latency", no_argument, NULL, OPTION_RPC_LATENCY },
+	{ "quic-cid-table-size", required_argument, NULL, OPTION_QUIC_CID_TABLE_SIZE },
+	{ "port-map", required_argument, NULL, OPTION_PORT_MAP },
+	{ "flow-state-memory", required_argument, NULL, OPTION_FLOW_STATE_MEMORY },
+	{ "table-stats", no_argument, NULL, OPTION_TABLE_STATS },
+#ifdef USE_PRINT_WORKERS
+	{ "threads", required_argument, NULL, OPTION_THREADS },
+#endif
+#ifdef USE_DUMP_WRITER
+	{ "write-buffer", required_argument, NULL, OPTION_WRITE_BUFFER },
+	{ "direct-io", no_argument, NULL, OPTION_DIRECT_IO },
+#ifdef USE_DUMP_WRITER_COMPRESSION
+	{ "compress", required_argument, NULL, OPTION_COMPRESS },
+#endif
+#ifdef USE_DUMP_WRITER_ZSTD
+	{ "compress-threads", required_argument, NULL, OPTION_COMPRESS_THREADS },
+#endif
+#endif
 	{ "version", no_argument, NULL, OPTION_VERSION },
 	{ NULL, 0, NULL, 0 }
 };
@@ -818,9 +932,8 @@ getWflagChars(int x)
 static void
 MakeFilename(char *buffer, char *orig_name, int cnt, int max_chars)
 {
-        char *filename = malloc(PATH_MAX + 1);
-        if (filename == NULL)
-            error("%s: malloc", __func__);
+        char filename[PATH_MAX + 1];
+
         if (strlen(orig_name) == 0)
             error("an empty string is not a valid file name");
 
@@ -863,7 +976,18 @@ MakeFilename(char *buffer, char *orig_name, int cnt, int max_chars)
 		if (snprintf(buffer, PATH_MAX + 1, "%s%0*d", filename, max_chars, cnt) > PATH_MAX)
                   /* Report an error if the filename is too large */
                   error("too many output files or filename is too long (> %d)", PATH_MAX);
-        free(filename);
+
+#ifdef USE_DUMP_WRITER_COMPRESSION
+	/* Name compressed savefiles the way gzip and zstd would. */
+	if (compress_method != DUMP_COMPRESS_NONE) {
+		size_t len = strlen(buffer);
+
+		if (snprintf(buffer + len, PATH_MAX + 1 - len, "%s",
+		    compress_method == DUMP_COMPRESS_GZIP ? ".gz" : ".zst") >
+		    (int)(PATH_MAX - len))
+			error("filename is too long (> %d)", PATH_MAX);
+	}
+#endif
 }
 
 static char *
@@ -1003,11 +1127,23 @@ set_dumper_capsicum_rights(pcap_dumper_t *p)
 	int fd = fileno(pcap_dump_file(p));
 	cap_rights_t rights;
 
+	uint32_t fcntls = CAP_FCNTL_GETFL;
+
+#ifdef USE_DUMP_WRITER
+	/* The writer thread turns O_DIRECT on and off. */
+	if (direct_io)
+		fcntls |= CAP_FCNTL_SETFL;
+#endif
 	cap_rights_init(&rights, CAP_SEEK, CAP_WRITE, CAP_FCNTL);
+#ifdef USE_DUMP_WRITER_COMPRESSION
+	/* The writer thread replaces the uncompressed header. */
+	if (compress_method != DUMP_COMPRESS_NONE)
+		cap_rights_set(&rights, CAP_FTRUNCATE);
+#endif
 	if (cap_rights_limit(fd, &rights) < 0 && errno != ENOSYS) {
 		error("unable to limit dump descriptor");
 	}
-	if (cap_fcntls_limit(fd, CAP_FCNTL_GETFL) < 0 && errno != ENOSYS) {
+	if (cap_fcntls_limit(fd, fcntls) < 0 && errno != ENOSYS) {
 		error("unable to limit dump descriptor fcntls");
 	}
 }
@@ -1101,6 +1237,38 @@ read_infile(char *fname)
 	return (cp);
 }
 
+#ifdef USE_DUMP_WRITER_COMPRESSION
+/*
+ * Parse the argument to --compress, "method[:level]".
+ */
+static void
+parse_compression(const char *arg)
+{
+	const char *colon = strchr(arg, ':');
+	size_t len = colon != NULL ? (size_t)(colon - arg) : strlen(arg);
+
+#ifdef USE_DUMP_WRITER_GZIP
+	if (len == 4 && strncmp(arg, "gzip", 4) == 0) {
+		compress_method = DUMP_COMPRESS_GZIP;
+		compress_level = colon != NULL ?
+		    parse_int("gzip compression level", colon + 1, NULL,
+			1, 9, 10) : 6;
+		return;
+	}
+#endif
+#ifdef USE_DUMP_WRITER_ZSTD
+	if (len == 4 && strncmp(arg, "zstd", 4) == 0) {
+		compress_method = DUMP_COMPRESS_ZSTD;
+		compress_level = colon != NULL ?
+		    parse_int("zstd compression level", colon + 1, NULL,
+			1, 22, 10) : 3;
+		return;
+	}
+#endif
+	error("unsupported compression method \"%.*s\"", (int)len, arg);
+}
+#endif
+
 static long
 parse_interface_number(const char *device)
 {
@@ -2117,6 +2285,108 @@ main(int argc, char **argv)
 			    optarg, NULL, 0, INT_MAX, 0);
 			break;
 
+		case OPTION_START_TIME:
+			start_time = parse_time("start time", optarg);
+			break;
+
+		case OPTION_END_TIME:
+			end_time = parse_time("end time", optarg);
+			break;
+
+		case OPTION_WRITE_INDEX:
+			write_index = parse_u_int("index interval", optarg,
+			    NULL, 1, INT_MAX, 10);
+			break;
+
+#ifdef HAVE_PTHREADS
+		case OPTION_RESOLVE_ASYNC:
+			ndo->ndo_resolve_async = 1;
+			break;
+
+		case OPTION_RESOLVE_WAIT:
+			ndo->ndo_resolve_async = 1;
+			ndo->ndo_resolve_wait = parse_int("resolve wait",
+			    optarg, NULL, 0, INT_MAX, 10);
+			break;
+#endif
+
+		case OPTION_NAME_CACHE_SIZE:
+			ndo->ndo_name_cache_size = parse_u_int("name cache size",
+			    optarg, NULL, 1, INT_MAX, 10);
+			break;
+
+		case OPTION_TCP_FLOW_TABLE_SIZE:
+			ndo->ndo_tcp_flow_table_size = parse_u_int(
+			    "TCP flow table size", optarg, NULL, 1, INT_MAX, 10);
+			break;
+
+		case OPTION_RPC_XID_TABLE_SIZE:
+			ndo->ndo_rpc_xid_table_size = parse_u_int(
+			    "RPC call table size", optarg, NULL, 1, INT_MAX, 10);
+			break;
+
+		case OPTION_RPC_LATENCY:
+			rpc_latency = 1;
+			break;
+
+		case OPTION_TABLE_STATS:
+			table_stats = 1;
+			break;
+
+		case OPTION_QUIC_CID_TABLE_SIZE:
+			ndo->ndo_quic_cid_table_size = parse_u_int(
+			    "QUIC connection ID table size", optarg, NULL, 1,
+			    INT_MAX, 10);
+			break;
+
+		case OPTION_PORT_MAP:
+			if (port_map_read(ndo, optarg, ebuf, sizeof(ebuf)) == -1)
+				error("%s", ebuf);
+			break;
+
+		case OPTION_FLOW_STATE_MEMORY:
+			/* Size in KiB */
+			ndo->ndo_flow_state_memory = parse_u_int(
+			    "flow state memory size", optarg, NULL, 1,
+			    INT_MAX, 10);
+			break;
+
+#ifdef USE_PRINT_WORKERS
+		case OPTION_THREADS:
+			print_threads = parse_u_int("number of threads", optarg,
+			    NULL, 1, 256, 10);
+			break;
+#endif
+
+#ifdef USE_DUMP_WRITER
+		case OPTION_WRITE_BUFFER:
+			/* Size in KiB */
+			write_buffer_size = (size_t)parse_u_int("write buffer size",
+			    optarg, NULL, 1, INT_MAX / 1024, 10) * 1024;
+			break;
+
+		case OPTION_DIRECT_IO:
+			direct_io = 1;
+			if (write_buffer_size == 0)
+				write_buffer_size = DEFAULT_WRITE_BUFFER_SIZE;
+			break;
+
+#ifdef USE_DUMP_WRITER_COMPRESSION
+		case OPTION_COMPRESS:
+			parse_compression(optarg);
+			if (write_buffer_size == 0)
+				write_buffer_size = DEFAULT_WRITE_BUFFER_SIZE;
+			break;
+#endif
+
+#ifdef USE_DUMP_WRITER_ZSTD
+		case OPTION_COMPRESS_THREADS:
+			compress_threads = parse_int("number of compression threads",
+			    optarg, NULL, 1, 256, 10);
+			break;
+#endif
+#endif
+
 #ifdef HAVE_PCAP_SET_TSTAMP_PRECISION
 		case OPTION_TSTAMP_MICRO:
 			ndo->ndo_tstamp_precision = PCAP_TSTAMP_PRECISION_MICRO;
@@ -2160,14 +2430,54 @@ main(int argc, char **argv)
 		error("-G cannot be used without -w.");
 	if (count_mode && RFileName == NULL && VFileName == NULL)
 		error("--count cannot be used without -r or -V.");
+	if ((start_time != 0 || end_time != UINT64_MAX) &&
+	    RFileName == NULL && VFileName == NULL)
+		error("--start-time and --end-time cannot be used without -r or -V.");
+	if (end_time <= start_time)
+		error("--end-time must be later than --start-time.");
+	if (write_index != 0) {
+		if (WFileName == NULL && RFileName == NULL && VFileName == NULL)
+			error("--write-index cannot be used without -r, -V or -w.");
+		if (WFileName != NULL && strcmp(WFileName, "-") == 0)
+			error("--write-index cannot be used with -w to the standard output.");
+	}
 #if defined(HAVE_FORK) || defined(HAVE_VFORK)
 	if (zflag != NULL && (WFileName == NULL || (Cflag == 0 && Gflag == 0)))
 		error("-z cannot be used without -w and (-C or -G).");
+	if (zflag != NULL && write_index != 0)
+		error("-z and --write-index are mutually exclusive.");
 #endif
+#ifdef USE_DUMP_WRITER_COMPRESSION
+	if (compress_method != DUMP_COMPRESS_NONE) {
+		if (WFileName == NULL || strcmp(WFileName, "-") == 0)
+			error("--compress cannot be used without -w to a file.");
+		if (zflag != NULL)
+			error("-z and --compress are mutually exclusive.");
+		if (write_index != 0)
+			error("--compress and --write-index are mutually exclusive.");
+	}
+	if (compress_threads != 0 && compress_method != DUMP_COMPRESS_ZSTD)
+		error("--compress-threads can only be used with --compress=zstd.");
+#endif
+	if (print_threads != 0) {
+		/*
+		 * Looking up names, decrypting ESP and translating OIDs
+		 * with libsmi use state that the worker threads can't
+		 * share.
+		 */
+		if (!ndo->ndo_nflag)
+			error("--threads cannot be used without -n.");
+		if (ndo->ndo_espsecret != NULL)
+			error("-E and --threads are mutually exclusive.");
+		if (nd_smi_module_loaded)
+			error("-m and --threads are mutually exclusive.");
+		if (WFileName != NULL && !print)
+			error("--threads cannot be used with -w without --print.");
+	}
 
 	if (cnt != -1)
 		if ((int)packets_to_skip > (INT_MAX - cnt))
-			// cnt + (int)packets_to_skip used in pcap_loop() call
+			// cnt + (int)packets_to_skip used in dispatch_loop() call
 			error("Overflow (-c count) %d + (--skip count) %d", cnt,
 			      (int)packets_to_skip);
 
@@ -2199,6 +2509,16 @@ main(int argc, char **argv)
 	if (VFileName != NULL && RFileName != NULL)
 		error("-V and -r are mutually exclusive.");
 
+	/*
+	 * Starting or stopping at a time, or indexing the savefiles read,
+	 * needs every packet in them, so the filter is run by read_packet()
+	 * rather than by libpcap.  With -w, --write-index indexes the
+	 * savefiles written instead.
+	 */
+	read_all_packets = (RFileName != NULL || VFileName != NULL) &&
+	    (start_time != 0 || end_time != UINT64_MAX ||
+	    (write_index != 0 && WFileName == NULL));
+
 	/*
 	 * If we're printing dissected packets to the standard output,
 	 * and either the standard output is a terminal or we're doing
@@ -2280,7 +2600,7 @@ main(int argc, char **argv)
 		if (pd == NULL)
 			error("%s", ebuf);
 #ifdef HAVE_CAPSICUM
-		cap_rights_init(&rights, CAP_READ);
+		cap_rights_init(&rights, CAP_READ, CAP_SEEK);
 		if (cap_rights_limit(fileno(pcap_file(pd)), &rights) < 0 &&
 		    errno != ENOSYS) {
 			error("unable to limit pcap descriptor");
@@ -2545,14 +2865,21 @@ DIAG_ON_ASSIGN_ENUM
 		}
 		capng_apply(CAPNG_SELECT_BOTH);
 #endif /* HAVE_LIBCAP_NG */
-		if (username || chroot_dir)
+		if (username || chroot_dir) {
+			load_name_tables(ndo);
 			droproot(username, chroot_dir);
+		}
 
 	}
 #endif /* _WIN32 */
 
-	if (pcap_setfilter(pd, &fcode) < 0)
+	if (read_all_packets)
+		read_fcode = &fcode;
+	else if (pcap_setfilter(pd, &fcode) < 0)
 		error("%s", pcap_geterr(pd));
+	if (RFileName != NULL)
+		seek_savefile(RFileName, &fcode,
+		    write_index != 0 && WFileName == NULL);
 #ifdef HAVE_CAPSICUM
 	if (RFileName == NULL && VFileName == NULL && pcap_fileno(pd) != -1) {
 		static const unsigned long cmds[] = { BIOCGSTATS, BIOCROTZBUF };
@@ -2605,6 +2932,8 @@ DIAG_ON_ASSIGN_ENUM
 #ifdef HAVE_CAPSICUM
 		set_dumper_capsicum_rights(pdd);
 #endif
+		if (write_index != 0)
+			open_dump_index(-1, dumpinfo.CurrentFileName);
 		if (Cflag != 0 || Gflag != 0) {
 #ifdef HAVE_CAPSICUM
 			/*
@@ -2646,7 +2975,9 @@ DIAG_ON_ASSIGN_ENUM
 			free(WFileName_copy);
 
 			cap_rights_init(&rights, CAP_CREATE, CAP_FCNTL,
-			    CAP_FTRUNCATE, CAP_LOOKUP, CAP_SEEK, CAP_WRITE);
+			    CAP_FTRUNCATE, CAP_LOOKUP, CAP_RENAMEAT_SOURCE,
+			    CAP_RENAMEAT_TARGET, CAP_SEEK, CAP_UNLINKAT,
+			    CAP_WRITE);
 			if (cap_rights_limit(dumpinfo.dirfd, &rights) < 0 &&
 			    errno != ENOSYS) {
 				error("unable to limit directory rights");
@@ -2671,19 +3002,55 @@ DIAG_ON_ASSIGN_ENUM
 		}
 		if (print) {
 			dlt = pcap_datalink(pd);
-			ndo->ndo_if_printer = get_if_printer(dlt);
+			nd_set_dispatch(ndo, dlt);
 			dumpinfo.ndo = ndo;
 		} else
 			dumpinfo.ndo = NULL;
 
 		if (Uflag)
 			pcap_dump_flush(pdd);
+#ifdef USE_DUMP_WRITER
+#ifdef USE_DUMP_WRITER_COMPRESSION
+		if (compress_method != DUMP_COMPRESS_NONE &&
+		    dump_writer_set_compression(compress_method, compress_level,
+		    compress_threads, pd, ebuf, sizeof(ebuf)) == -1)
+			error("%s", ebuf);
+#endif
+		if (write_buffer_size != 0) {
+			if (dump_writer_start(write_buffer_size, direct_io,
+			    ebuf, sizeof(ebuf)) == -1 ||
+			    dump_writer_open(pdd, ebuf, sizeof(ebuf)) == -1)
+				error("%s", ebuf);
+		}
+#endif
+#ifdef USE_DUMP_ROTATE
+		if (Cflag != 0 || Gflag != 0) {
+#ifdef HAVE_CAPSICUM
+			if (dump_rotate_start(dumpinfo.dirfd, 0644, Gflag_time,
+			    Gflag, ebuf, sizeof(ebuf)) == -1)
+				error("%s", ebuf);
+			/* Later files are opened relative to dirfd. */
+			dump_rotate_prepare(dumpinfo.WFileName);
+#else
+			if (dump_rotate_start(AT_FDCWD, 0666, Gflag_time,
+			    Gflag, ebuf, sizeof(ebuf)) == -1)
+				error("%s", ebuf);
+			dump_rotate_prepare(dumpinfo.CurrentFileName);
+#endif
+		}
+#endif
 	} else {
 		dlt = pcap_datalink(pd);
-		ndo->ndo_if_printer = get_if_printer(dlt);
+		nd_set_dispatch(ndo, dlt);
 		callback = print_packet;
 		pcap_userdata = (u_char *)ndo;
 	}
+#ifdef USE_PRINT_WORKERS
+	if (print_threads != 0 &&
+	    print_workers_start(ndo, print_threads, localnet, netmask,
+	    ebuf, sizeof(ebuf)) == -1)
+		error("%s", ebuf);
+#endif
 
 #ifdef SIGNAL_REQ_INFO
 	/*
@@ -2769,14 +3136,27 @@ DIAG_ON_ASSIGN_ENUM
 	cansandbox = (cansandbox && (pcap_fileno(pd) != -1 ||
 	    RFileName != NULL));
 
+	if (cansandbox)
+		load_name_tables(ndo);
 	if (cansandbox && cap_enter() < 0 && errno != ENOSYS)
 		error("unable to enter the capability mode");
 #endif	/* HAVE_CAPSICUM */
 
 	do {
-		status = pcap_loop(pd,
-				   (cnt == -1 ? -1 : cnt + (int)packets_to_skip),
-				   callback, pcap_userdata);
+		status = dispatch_loop(
+				   (cnt == -1 ? -1 :
+				    cnt + (int)(packets_to_skip - read_skipped)),
+				   callback, pcap_userdata,
+				   WFileName != NULL ? &dumpinfo.pdd : NULL);
+#ifdef USE_PRINT_WORKERS
+		/*
+		 * Wait for the worker threads to print everything we've
+		 * read, so that the output comes before anything we
+		 * report below.
+		 */
+		if (print_threads != 0)
+			print_workers_drain();
+#endif
 		if (WFileName == NULL) {
 			/*
 			 * We're printing packets.  Flush the printed output,
@@ -2804,7 +3184,7 @@ DIAG_ON_ASSIGN_ENUM
 			/*
 			 * Error.  Report it.
 			 */
-			(void)fprintf(stderr, "%s: pcap_loop: %s\n",
+			(void)fprintf(stderr, "%s: pcap_dispatch: %s\n",
 			    program_name, pcap_geterr(pd));
 		}
 		if (RFileName == NULL) {
@@ -2814,6 +3194,21 @@ DIAG_ON_ASSIGN_ENUM
 			 */
 			info(1);
 		}
+		if (read_index != NULL) {
+			if (sf_index_writer_close(read_index, read_eof, ebuf,
+			    sizeof(ebuf)) == -1)
+				warning("%s", ebuf);
+			read_index = NULL;
+		}
+		read_eof = 0;
+		if (read_ended) {
+			/*
+			 * We're past --end-time; don't read any more
+			 * files.
+			 */
+			VFileName = NULL;
+			ret = NULL;
+		}
 		pcap_close(pd);
 		pd = NULL;
 		if (VFileName != NULL) {
@@ -2826,7 +3221,7 @@ DIAG_ON_ASSIGN_ENUM
 				if (pd == NULL)
 					error("%s", ebuf);
 #ifdef HAVE_CAPSICUM
-				cap_rights_init(&rights, CAP_READ);
+				cap_rights_init(&rights, CAP_READ, CAP_SEEK);
 				if (cap_rights_limit(fileno(pcap_file(pd)),
 				    &rights) < 0 && errno != ENOSYS) {
 					error("unable to limit pcap descriptor");
@@ -2862,7 +3257,7 @@ DIAG_ON_ASSIGN_ENUM
 					 * the new DLT.
 					 */
 					dlt = new_dlt;
-					ndo->ndo_if_printer = get_if_printer(dlt);
+					nd_set_dispatch(ndo, dlt);
 					/* Free the old filter */
 					pcap_freecode(&fcode);
 					/*
@@ -2876,7 +3271,8 @@ DIAG_ON_ASSIGN_ENUM
 				/*
 				 * Set the filter on the new file.
 				 */
-				if (pcap_setfilter(pd, &fcode) < 0)
+				if (!read_all_packets &&
+				    pcap_setfilter(pd, &fcode) < 0)
 					error("%s", pcap_geterr(pd));
 
 				/*
@@ -2892,20 +3288,75 @@ DIAG_ON_ASSIGN_ENUM
 						pcap_datalink_val_to_description(dlt));
 				}
 				fprintf(stderr, ", snapshot length %d\n", pcap_snapshot(pd));
+				seek_savefile(RFileName, &fcode,
+				    write_index != 0 && WFileName == NULL);
 			}
 		}
 	}
 	while (ret != NULL);
 
+#ifdef USE_PRINT_WORKERS
+	if (print_threads != 0) {
+		/*
+		 * Each worker thread has its own name caches and tables;
+		 * have them report on those, and on RPC latency.
+		 */
+		print_workers_stop(table_stats || rpc_latency ?
+		    report_worker_stats : NULL);
+	} else
+#endif
+	if (table_stats) {
+		/*
+		 * Report the statistics for the name caches and the
+		 * printers' tables, for all the files read, if any.
+		 */
+		print_table_stats(ndo);
+	}
 	if (count_mode && RFileName != NULL)
 		fprintf(stdout, "%u packet%s\n", packets_captured,
 			PLURAL_SUFFIX(packets_captured));
+	if (rpc_latency && print_threads == 0)
+		xid_map_print_latency(ndo, stdout);
 
 	free(cmdbuf);
 	pcap_freecode(&fcode);
 	exit_tcpdump(status == -1 ? S_ERR_HOST_PROGRAM : S_SUCCESS);
 }
 
+/*
+ * Report the statistics for the name caches and the printers' tables.
+ */
+static void
+print_table_stats(netdissect_options *ndo)
+{
+	print_name_cache_stats(stderr);
+	nd_flow_print_stats(ndo, stderr);
+	xid_map_print_stats(ndo, stderr);
+	quic_print_cid_stats(ndo, stderr);
+	nd_alloc_print_stats(ndo, stderr);
+}
+
+#ifdef USE_PRINT_WORKERS
+/*
+ * Called by each worker thread, in turn, when it's finished, to
+ * report on its own tables.
+ */
+static void
+report_worker_stats(netdissect_options *ndo, u_int id)
+{
+	if (table_stats) {
+		if (print_threads > 1)
+			fprintf(stderr, "Thread %u:\n", id + 1);
+		print_table_stats(ndo);
+	}
+	if (rpc_latency) {
+		if (print_threads > 1)
+			fprintf(stdout, "Thread %u:\n", id + 1);
+		xid_map_print_latency(ndo, stdout);
+	}
+}
+#endif
+
 /*
  * Routines to parse numerical command-line arguments and check for
  * errors, including "too large for that type".
@@ -3034,6 +3485,63 @@ parse_int64(const char *argname, const char *string, char **endpp,
 	return ((int64_t)val);
 }
 
+/*
+ * Parse a --start-time or --end-time argument, which is either seconds
+ * since the epoch or a local date and time in the form printed by
+ * -tttt, in each case optionally with a fraction of a second, and
+ * return it in nanoseconds since the epoch.
+ */
+static uint64_t
+parse_time(const char *argname, const char *string)
+{
+	struct tm tm;
+	time_t t;
+	const char *cp;
+	char *endp;
+	uint64_t frac = 0, unit = 1000000000;
+	int n;
+
+	memset(&tm, 0, sizeof(tm));
+	if (sscanf(string, "%4d-%2d-%2d%*1[ T]%2d:%2d:%2d%n", &tm.tm_year,
+	    &tm.tm_mon, &tm.tm_mday, &tm.tm_hour, &tm.tm_min, &tm.tm_sec,
+	    &n) == 6) {
+		if (tm.tm_mon < 1 || tm.tm_mon > 12 || tm.tm_mday < 1 ||
+		    tm.tm_mday > 31 || tm.tm_hour > 23 || tm.tm_min > 59 ||
+		    tm.tm_sec > 60)
+			error("invalid %s \"%s\" (not a valid time)", argname,
+			    string);
+		tm.tm_year -= 1900;
+		tm.tm_mon -= 1;
+		tm.tm_isdst = -1;
+		t = mktime(&tm);
+		if (t == (time_t)-1 || t < 0)
+			error("invalid %s \"%s\" (not a valid time)", argname,
+			    string);
+		cp = string + n;
+	} else {
+		t = (time_t)parse_int64(argname, string, &endp, 0,
+		    UINT32_MAX, 10);
+		cp = endp;
+	}
+
+	if (*cp == '.') {
+		cp++;
+		if (!ND_ASCII_ISDIGIT(*cp))
+			error("invalid %s \"%s\" (not a valid time)", argname,
+			    string);
+		while (ND_ASCII_ISDIGIT(*cp)) {
+			if (unit > 1) {
+				unit /= 10;
+				frac += (uint64_t)(*cp - '0') * unit;
+			}
+			cp++;
+		}
+	}
+	if (*cp != '\0')
+		error("invalid %s \"%s\" (not a valid time)", argname, string);
+	return ((uint64_t)t * 1000000000 + frac);
+}
+
 /*
  * Catch a signal.
  */
@@ -3151,10 +3659,32 @@ info(int verbose)
 			fputs(", ", stderr);
 		else
 			putc('\n', stderr);
-		(void)fprintf(stderr, "%u packet%s dropped by interface\n",
+		(void)fprintf(stderr, "%u packet%s dropped by interface",
 		    stats.ps_ifdrop, PLURAL_SUFFIX(stats.ps_ifdrop));
-	} else
-		putc('\n', stderr);
+	}
+#ifdef USE_DUMP_WRITER
+	if (write_buffer_size != 0) {
+		struct dump_writer_stats dwstats;
+
+		dump_writer_get_stats(&dwstats);
+		if (!verbose)
+			fputs(", ", stderr);
+		else
+			putc('\n', stderr);
+		(void)fprintf(stderr,
+		    "%" PRIu64 " bytes waiting to be written (at most %" PRIu64 ")",
+		    dwstats.queued, dwstats.max_queued);
+		if (!verbose)
+			fputs(", ", stderr);
+		else
+			putc('\n', stderr);
+		(void)fprintf(stderr,
+		    "%" PRIu64 " write stall%s (%" PRIu64 " ms)",
+		    dwstats.stalls, PLURAL_SUFFIX(dwstats.stalls),
+		    dwstats.stall_usec / 1000);
+	}
+#endif
+	putc('\n', stderr);
 	infoprint = 0;
 }
 
@@ -3202,12 +3732,60 @@ compress_savefile(const char *filename)
 }
 #endif /* HAVE_FORK || HAVE_VFORK */
 
+/*
+ * Start the index of the savefile just opened, relative to the
+ * directory dirfd (-1 for the current directory).
+ */
+static void
+open_dump_index(int dirfd, const char *name)
+{
+	char ebuf[PCAP_ERRBUF_SIZE];
+	int nsec = 0;
+
+#ifdef HAVE_PCAP_SET_TSTAMP_PRECISION
+	nsec = (pcap_get_tstamp_precision(pd) == PCAP_TSTAMP_PRECISION_NANO);
+#endif
+	dump_index = sf_index_writer_open(dirfd, name, write_index, nsec,
+	    NULL, ebuf, sizeof(ebuf));
+	if (dump_index == NULL)
+		error("%s", ebuf);
+}
+
+static void
+close_dump_index(void)
+{
+	char ebuf[PCAP_ERRBUF_SIZE];
+
+	if (sf_index_writer_close(dump_index, 1, ebuf, sizeof(ebuf)) == -1)
+		warning("%s", ebuf);
+	dump_index = NULL;
+}
+
 static void
 close_old_dump_file(struct dump_info *dump_info)
 {
 	/*
 	 * Close the current file and open a new one.
 	 */
+	if (dump_index != NULL)
+		close_dump_index();
+#ifdef USE_DUMP_WRITER
+	if (write_buffer_size != 0) {
+		dump_writer_close(dump_info->pdd);
+#if defined(HAVE_FORK) || defined(HAVE_VFORK)
+		/* The file must be complete before it's compressed. */
+		if (zflag != NULL)
+			dump_writer_wait(0);
+#endif
+	} else
+#endif
+#ifdef USE_DUMP_ROTATE
+	/*
+	 * Have the rotation thread close the file, unless it must be
+	 * complete before it's compressed.
+	 */
+	if (zflag != NULL || dump_rotate_close(dump_info->pdd) == -1)
+#endif
 	pcap_dump_close(dump_info->pdd);
 
 #if defined(HAVE_FORK) || defined(HAVE_VFORK)
@@ -3222,38 +3800,146 @@ close_old_dump_file(struct dump_info *dump_info)
 static void
 open_new_dump_file(struct dump_info *dump_info)
 {
-#ifdef HAVE_CAPSICUM
-	FILE *fp;
+#if defined(HAVE_CAPSICUM) || defined(USE_DUMP_ROTATE)
+	FILE *fp = NULL;
 	int fd;
 #endif
 
+#ifdef USE_DUMP_ROTATE
+	/* Use the file the rotation thread has prepared, if there is one. */
+	fd = dump_rotate_take(dump_info->CurrentFileName);
+	if (fd != -1) {
+		fp = fdopen(fd, "w");
+		if (fp == NULL) {
+			error("unable to fdopen file %s",
+			    dump_info->CurrentFileName);
+		}
+	} else
+#endif
+	{
+#ifdef USE_DUMP_WRITER
+		/*
+		 * With -W, file names are reused; don't truncate a file
+		 * the writer thread is still writing to.
+		 */
+		if (write_buffer_size != 0 && Wflag > 0)
+			dump_writer_wait(Wflag - 1);
+#endif
 #ifdef HAVE_LIBCAP_NG
-	capng_update(CAPNG_ADD, CAPNG_EFFECTIVE, CAP_DAC_OVERRIDE);
-	capng_apply(CAPNG_SELECT_BOTH);
+		capng_update(CAPNG_ADD, CAPNG_EFFECTIVE, CAP_DAC_OVERRIDE);
+		capng_apply(CAPNG_SELECT_BOTH);
 #endif /* HAVE_LIBCAP_NG */
 #ifdef HAVE_CAPSICUM
-	fd = openat(dump_info->dirfd, dump_info->CurrentFileName,
-	    O_CREAT | O_WRONLY | O_TRUNC, 0644);
-	if (fd < 0) {
-		error("unable to open file %s", dump_info->CurrentFileName);
-	}
-	fp = fdopen(fd, "w");
-	if (fp == NULL) {
-		error("unable to fdopen file %s", dump_info->CurrentFileName);
-	}
-	dump_info->pdd = pcap_dump_fopen(dump_info->pd, fp);
+		fd = openat(dump_info->dirfd, dump_info->CurrentFileName,
+		    O_CREAT | O_WRONLY | O_TRUNC, 0644);
+		if (fd < 0) {
+			error("unable to open file %s",
+			    dump_info->CurrentFileName);
+		}
+		fp = fdopen(fd, "w");
+		if (fp == NULL) {
+			error("unable to fdopen file %s",
+			    dump_info->CurrentFileName);
+		}
 #else	/* !HAVE_CAPSICUM */
-	dump_info->pdd = pcap_dump_open(dump_info->pd, dump_info->CurrentFileName);
+		dump_info->pdd = pcap_dump_open(dump_info->pd,
+		    dump_info->CurrentFileName);
 #endif
 #ifdef HAVE_LIBCAP_NG
-	capng_update(CAPNG_DROP, CAPNG_EFFECTIVE, CAP_DAC_OVERRIDE);
-	capng_apply(CAPNG_SELECT_BOTH);
+		capng_update(CAPNG_DROP, CAPNG_EFFECTIVE, CAP_DAC_OVERRIDE);
+		capng_apply(CAPNG_SELECT_BOTH);
 #endif /* HAVE_LIBCAP_NG */
+	}
+#if defined(HAVE_CAPSICUM) || defined(USE_DUMP_ROTATE)
+	if (fp != NULL)
+		dump_info->pdd = pcap_dump_fopen(dump_info->pd, fp);
+#endif
 	if (dump_info->pdd == NULL)
 		error("%s", pcap_geterr(pd));
 #ifdef HAVE_CAPSICUM
 	set_dumper_capsicum_rights(dump_info->pdd);
 #endif
+#ifdef USE_DUMP_WRITER
+	if (write_buffer_size != 0) {
+		char ebuf[PCAP_ERRBUF_SIZE];
+
+		if (dump_writer_open(dump_info->pdd, ebuf, sizeof(ebuf)) == -1)
+			error("%s", ebuf);
+	}
+#endif
+#ifdef USE_DUMP_ROTATE
+	/* Get the next one ready. */
+	dump_rotate_prepare(dump_info->CurrentFileName);
+#endif
+	if (write_index != 0) {
+#ifdef HAVE_CAPSICUM
+		open_dump_index(dump_info->dirfd, dump_info->CurrentFileName);
+#else
+		open_dump_index(-1, dump_info->CurrentFileName);
+#endif
+	}
+}
+
+/* Write a packet to the current savefile. */
+static void
+write_packet(struct dump_info *dump_info, const struct pcap_pkthdr *h,
+    const u_char *sp)
+{
+	if (dump_index != NULL)
+		sf_index_add(dump_index, h);
+#ifdef USE_DUMP_WRITER
+	if (write_buffer_size != 0) {
+		if (dump_writer_dump(h, sp) == -1)
+			error("%s", dump_writer_geterr());
+		return;
+	}
+#endif
+	pcap_dump((u_char *)dump_info->pdd, h, sp);
+}
+
+/*
+ * Start a new savefile for the -G period beginning at time t.
+ */
+static void
+rotate_dump_file_by_time(struct dump_info *dump_info, time_t t)
+{
+	/* Update the Gflag_time */
+	Gflag_time = t;
+	/* Update Gflag_count */
+	Gflag_count++;
+
+	close_old_dump_file(dump_info);
+
+	/*
+	 * Check to see if we've exceeded the Wflag (when
+	 * not using Cflag).
+	 */
+	if (Cflag == 0 && Wflag > 0 && Gflag_count >= Wflag) {
+		(void)fprintf(stderr, "Maximum file limit reached: %d\n",
+		    Wflag);
+		info(1);
+		exit_tcpdump(S_SUCCESS);
+		/* NOTREACHED */
+	}
+	/*
+	 * Gflag was set otherwise we wouldn't be here. Reset the count
+	 * so multiple files would end with 1,2,3 in the filename.
+	 * The counting is handled with the -C flow after this.
+	 */
+	Cflag_count = 0;
+
+	/*
+	 * This is always the first file in the Cflag
+	 * rotation: e.g. 0
+	 * We also don't need numbering if Cflag is not set.
+	 */
+	if (Cflag != 0)
+		MakeFilename(dump_info->CurrentFileName, dump_info->WFileName, 0,
+		    WflagChars);
+	else
+		MakeFilename(dump_info->CurrentFileName, dump_info->WFileName, 0, 0);
+
+	open_new_dump_file(dump_info);
 }
 
 static void
@@ -3267,74 +3953,35 @@ dump_packet_and_trunc(u_char *user, const struct pcap_pkthdr *h, const u_char *s
 
 	dump_info = (struct dump_info *)user;
 
-	if (packets_captured <= packets_to_skip)
-		return;
-
 	/*
-	 * XXX - this won't force the file to rotate on the specified time
-	 * boundary, but it will rotate on the first packet received after the
-	 * specified Gflag number of seconds. Note: if a Gflag time boundary
-	 * and a Cflag size boundary coincide, the time rotation will occur
-	 * first thereby cancelling the Cflag boundary (since the file should
-	 * be 0).
+	 * Note: if a Gflag time boundary and a Cflag size boundary
+	 * coincide, the time rotation will occur first thereby cancelling
+	 * the Cflag boundary (since the file should be 0).
 	 */
 	if (Gflag != 0) {
 		/* Check if it is time to rotate */
 		time_t t;
 
-		/* Get the current time */
+#ifdef USE_DUMP_ROTATE
+		/* The rotation thread keeps the time. */
+		if ((t = dump_rotate_due()) != 0)
+			rotate_dump_file_by_time(dump_info, t);
+#else
+		/*
+		 * XXX - this won't force the file to rotate on the
+		 * specified time boundary, but it will rotate on the
+		 * first packet received after the specified Gflag
+		 * number of seconds.
+		 */
 		if ((t = time(NULL)) == (time_t)-1) {
 			error("%s: can't get current_time: %s",
 			    __func__, pcap_strerror(errno));
 		}
 
-
 		/* If the time is greater than the specified window, rotate */
-		if (t - Gflag_time >= Gflag) {
-			/* Update the Gflag_time */
-			Gflag_time = t;
-			/* Update Gflag_count */
-			Gflag_count++;
-
-			close_old_dump_file(dump_info);
-
-			/*
-			 * Check to see if we've exceeded the Wflag (when
-			 * not using Cflag).
-			 */
-			if (Cflag == 0 && Wflag > 0 && Gflag_count >= Wflag) {
-				(void)fprintf(stderr, "Maximum file limit reached: %d\n",
-				    Wflag);
-				info(1);
-				exit_tcpdump(S_SUCCESS);
-				/* NOTREACHED */
-			}
-			if (dump_info->CurrentFileName != NULL)
-				free(dump_info->CurrentFileName);
-			/* Allocate space for max filename + \0. */
-			dump_info->CurrentFileName = (char *)malloc(PATH_MAX + 1);
-			if (dump_info->CurrentFileName == NULL)
-				error("%s: malloc", __func__);
-			/*
-			 * Gflag was set otherwise we wouldn't be here. Reset the count
-			 * so multiple files would end with 1,2,3 in the filename.
-			 * The counting is handled with the -C flow after this.
-			 */
-			Cflag_count = 0;
-
-			/*
-			 * This is always the first file in the Cflag
-			 * rotation: e.g. 0
-			 * We also don't need numbering if Cflag is not set.
-			 */
-			if (Cflag != 0)
-				MakeFilename(dump_info->CurrentFileName, dump_info->WFileName, 0,
-				    WflagChars);
-			else
-				MakeFilename(dump_info->CurrentFileName, dump_info->WFileName, 0, 0);
-
-			open_new_dump_file(dump_info);
-		}
+		if (t - Gflag_time >= Gflag)
+			rotate_dump_file_by_time(dump_info, t);
+#endif
 	}
 
 	/*
@@ -3343,7 +3990,14 @@ dump_packet_and_trunc(u_char *user, const struct pcap_pkthdr *h, const u_char *s
 	 * file could put it over Cflag.
 	 */
 	if (Cflag != 0) {
+#ifdef USE_DUMP_WRITER
+		int64_t size = write_buffer_size != 0 ? dump_writer_ftell(Cflag) :
 #ifdef HAVE_PCAP_DUMP_FTELL64
+		    pcap_dump_ftell64(dump_info->pdd);
+#else
+		    pcap_dump_ftell(dump_info->pdd);
+#endif
+#elif defined(HAVE_PCAP_DUMP_FTELL64)
 		int64_t size = pcap_dump_ftell64(dump_info->pdd);
 #else
 		/*
@@ -3365,23 +4019,16 @@ dump_packet_and_trunc(u_char *user, const struct pcap_pkthdr *h, const u_char *s
 				if (Cflag_count >= Wflag)
 					Cflag_count = 0;
 			}
-			if (dump_info->CurrentFileName != NULL)
-				free(dump_info->CurrentFileName);
-			dump_info->CurrentFileName = (char *)malloc(PATH_MAX + 1);
-			if (dump_info->CurrentFileName == NULL)
-				error("%s: malloc", __func__);
 			MakeFilename(dump_info->CurrentFileName, dump_info->WFileName, Cflag_count, WflagChars);
 
 			open_new_dump_file(dump_info);
 		}
 	}
 
-	pcap_dump((u_char *)dump_info->pdd, h, sp);
-	if (Uflag)
-		pcap_dump_flush(dump_info->pdd);
+	write_packet(dump_info, h, sp);
 
 	if (dump_info->ndo != NULL)
-		pretty_print_packet(dump_info->ndo, h, sp, packets_captured);
+		print_one_packet(dump_info->ndo, h, sp);
 
 	--infodelay;
 	if (infoprint)
@@ -3399,21 +4046,212 @@ dump_packet(u_char *user, const struct pcap_pkthdr *h, const u_char *sp)
 
 	dump_info = (struct dump_info *)user;
 
-	if (packets_captured <= packets_to_skip)
-		return;
-
-	pcap_dump((u_char *)dump_info->pdd, h, sp);
-	if (Uflag)
-		pcap_dump_flush(dump_info->pdd);
+	write_packet(dump_info, h, sp);
 
 	if (dump_info->ndo != NULL)
-		pretty_print_packet(dump_info->ndo, h, sp, packets_captured);
+		print_one_packet(dump_info->ndo, h, sp);
 
 	--infodelay;
 	if (infoprint)
 		info(0);
 }
 
+static void
+skip_packet(u_char *user _U_, const struct pcap_pkthdr *h _U_,
+    const u_char *sp _U_)
+{
+	++packets_captured;
+}
+
+/*
+ * Callback for savefiles of which every packet has to be seen: add the
+ * packet to the index being built, apply --start-time and --end-time,
+ * run the filter and skip the packets to be skipped with --skip, and
+ * hand the rest to the real callback.  --start-time is reached at the
+ * first packet at or after it, and --end-time at the first packet at
+ * or after it, whether or not they pass the filter.
+ */
+static void
+read_packet(u_char *user, const struct pcap_pkthdr *h, const u_char *sp)
+{
+	uint64_t ts;
+
+	if (read_index != NULL)
+		sf_index_add(read_index, h);
+	if (read_ended)
+		return;
+	ts = (uint64_t)h->ts.tv_sec * 1000000000 +
+	    (uint64_t)h->ts.tv_usec * (read_nsec ? 1 : 1000);
+	if (!read_started) {
+		if (ts < start_time)
+			return;
+		read_started = 1;
+	}
+	if (ts >= end_time) {
+		read_ended = 1;
+		return;
+	}
+	if (pcap_offline_filter(read_fcode, h, sp) == 0)
+		return;
+	++read_passed;
+	if (packets_captured < packets_to_skip)
+		++packets_captured;
+	else
+		(*read_callback)(user, h, sp);
+}
+
+/*
+ * Does the filter program let every packet through?
+ */
+static int
+filter_passes_all(const struct bpf_program *fcode)
+{
+	return (fcode->bf_len == 1 &&
+	    fcode->bf_insns[0].code == (BPF_RET|BPF_K) &&
+	    fcode->bf_insns[0].k != 0);
+}
+
+/*
+ * The savefile in pd has just been opened: if it has an index, use it
+ * to start at or near the first packet wanted with --start-time or,
+ * if every packet passes the filter fcode (as --skip counts the ones
+ * that do), with --skip.  If build is set and it has no usable index
+ * that goes to the end of the file (one written, or read, by a run that
+ * stopped early doesn't), index it as it's read.
+ */
+static void
+seek_savefile(const char *name, const struct bpf_program *fcode, int build)
+{
+	char ebuf[PCAP_ERRBUF_SIZE];
+	uint64_t max_packets = 0, start = 0, skipped;
+	int ret;
+
+#ifdef HAVE_PCAP_SET_TSTAMP_PRECISION
+	read_nsec = (pcap_get_tstamp_precision(pd) ==
+	    PCAP_TSTAMP_PRECISION_NANO);
+#endif
+	read_skipped = 0;
+	if (start_time != 0 && !read_started) {
+		max_packets = UINT64_MAX;
+		start = start_time;
+	} else if (packets_captured < packets_to_skip &&
+	    filter_passes_all(fcode))
+		max_packets = packets_to_skip - packets_captured;
+	if (max_packets == 0 && !build)
+		return;
+
+	ret = sf_index_seek(pd, name, max_packets, start, build, &skipped,
+	    ebuf, sizeof(ebuf));
+	if (ret == -1)
+		warning("%s", ebuf);
+	if (start == 0) {
+		read_skipped = (u_int)skipped;
+		packets_captured += read_skipped;
+	}
+	if (build && ret != 1) {
+		read_index = sf_index_writer_open(-1, name, write_index,
+		    read_nsec, pcap_file(pd), ebuf, sizeof(ebuf));
+		if (read_index == NULL)
+			warning("%s", ebuf);
+	}
+}
+
+/*
+ * Like pcap_loop(), but get the packets with pcap_dispatch(), at most
+ * DISPATCH_BATCH at a time, and do the work that needn't be done per
+ * packet once per batch instead: packets skipped with --skip are only
+ * counted, without going through the printing or dumping callback, and,
+ * with -U, the savefile is flushed after each batch rather than after
+ * each packet.  A batch from a live capture holds the packets that were
+ * available in the capture buffer, so they're still written out as soon
+ * as they arrive.
+ */
+static int
+dispatch_loop(int cnt, pcap_handler callback, u_char *user,
+    pcap_dumper_t **pddp)
+{
+	pcap_handler handler;
+	int n, want;
+#ifdef USE_DUMP_ROTATE
+	time_t t;
+#endif
+
+	for (;;) {
+		want = DISPATCH_BATCH;
+		if (read_all_packets) {
+			/* read_packet() does the skipping. */
+			handler = read_packet;
+			read_callback = callback;
+		} else if (packets_captured < packets_to_skip) {
+			handler = skip_packet;
+			if (packets_to_skip - packets_captured < (u_int)want)
+				want = (int)(packets_to_skip - packets_captured);
+		} else
+			handler = callback;
+		if (cnt != -1 && cnt < want)
+			want = cnt;
+
+		read_passed = 0;
+		n = pcap_dispatch(pd, want, handler, user);
+		if (n < 0)
+			return (n);
+		if (handler == read_packet) {
+			/*
+			 * n is the number of packets read, not the number
+			 * that got past read_packet(); reading none means
+			 * the end of the savefile.
+			 */
+			if (n == 0)
+				read_eof = 1;
+			if (n == 0 || read_ended)
+				return (0);
+			n = read_passed;
+		}
+		if (n > 0 && Uflag && pddp != NULL && handler != skip_packet) {
+#ifdef USE_DUMP_WRITER
+			if (write_buffer_size != 0)
+				dump_writer_flush();
+			else
+#endif
+			pcap_dump_flush(*pddp);
+		}
+#ifdef USE_DUMP_ROTATE
+		/* Rotate on a -G boundary even if no packets arrive. */
+		if (Gflag != 0 && callback == dump_packet_and_trunc &&
+		    (t = dump_rotate_due()) != 0)
+			rotate_dump_file_by_time((struct dump_info *)user, t);
+#endif
+		if (cnt != -1) {
+			cnt -= n;
+			if (cnt == 0)
+				return (0);
+		}
+		/*
+		 * Getting no packets from a live capture just means that
+		 * the timeout expired; from a savefile, it means EOF.
+		 */
+		if (n == 0 && handler != read_packet && pcap_file(pd) != NULL)
+			return (0);
+	}
+}
+
+/*
+ * Print a packet, or hand it to the worker threads to print if we
+ * have them.
+ */
+static void
+print_one_packet(netdissect_options *ndo, const struct pcap_pkthdr *h,
+    const u_char *sp)
+{
+#ifdef USE_PRINT_WORKERS
+	if (print_threads != 0) {
+		print_workers_print(ndo, h, sp, packets_captured);
+		return;
+	}
+#endif
+	pretty_print_packet(ndo, h, sp, packets_captured);
+}
+
 static void
 print_packet(u_char *user, const struct pcap_pkthdr *h, const u_char *sp)
 {
@@ -3421,8 +4259,8 @@ print_packet(u_char *user, const struct pcap_pkthdr *h, const u_char *sp)
 
 	++infodelay;
 
-	if (!count_mode && packets_captured > packets_to_skip)
-		pretty_print_packet((netdissect_options *)user, h, sp, packets_captured);
+	if (!count_mode)
+		print_one_packet((netdissect_options *)user, h, sp);
 
 	--infodelay;
 	if (infoprint)
@@ -3444,6 +4282,11 @@ requestinfo(int signo _U_)
 static void
 flushpcap(int signo _U_)
 {
+#ifdef USE_DUMP_WRITER
+	/* The writer thread owns the file, and writes it out soon anyway. */
+	if (write_buffer_size != 0)
+		return;
+#endif
 	if (pdd != NULL)
 		pcap_dump_flush(pdd);
 }
@@ -3514,7 +4357,11 @@ print_usage(FILE *f)
 "Usage: %s [-AbdDefghHI" J_FLAG "KlLnNOpqStuUvxX#] [ -B size ] [ -c count ] [--count]\n",
 	    executable_name);
 	(void)fprintf(f,
-"\t\t[ -C file_size ] " E_FLAG_USAGE "[ -F file ] [ -G seconds ]\n");
+"\t\t[ -C file_size ] " E_FLAG_USAGE "[ -F file ]\n");
+	(void)fprintf(f,
+"\t\t[ --end-time time ]\n");
+	(void)fprintf(f,
+"\t\t[ --flow-state-memory kilobytes ] [ -G seconds ]\n");
 	(void)fprintf(f,
 "\t\t[ -i interface ]" IMMEDIATE_MODE_USAGE j_FLAG_USAGE "\n");
 	(void)fprintf(f,
@@ -3524,13 +4371,40 @@ print_usage(FILE *f)
 "\t\t" m_FLAG_USAGE "\n");
 #endif
 	(void)fprintf(f,
-"\t\t" M_FLAG_USAGE "[ --number ] [ --print ]\n");
+"\t\t" M_FLAG_USAGE "[ --name-cache-size entries ] [ --number ]\n");
+	(void)fprintf(f,
+"\t\t[ --port-map file ] [ --print ] [ --print-sampling nth ]\n");
+	(void)fprintf(f,
+"\t\t[ -Q in|out|inout ] [ --quic-cid-table-size entries ] [ -r file ]\n");
+	(void)fprintf(f,
+"\t\t[ --rpc-latency ] [ --rpc-xid-table-size entries ]\n");
+#ifdef HAVE_PTHREADS
+	(void)fprintf(f,
+"\t\t[ --resolve-async ] [ --resolve-wait msec ]\n");
+#endif
+	(void)fprintf(f,
+"\t\t[ -s snaplen ] [ --skip count ] [ --start-time time ] [ -T type ]\n");
+	(void)fprintf(f,
+"\t\t[ --table-stats ] [ --tcp-flow-table-size entries ]\n");
 	(void)fprintf(f,
-"\t\t[ --print-sampling nth ] [ -Q in|out|inout ] [ -r file ]\n");
+"\t\t[ --version ] [ -V file ] [ -w file ] [ -W filecount ]\n");
 	(void)fprintf(f,
-"\t\t[ -s snaplen ] [ --skip count ] [ -T type ] [ --version ]\n");
+"\t\t[ --write-index packets ] [ -y datalinktype ]\n");
+#ifdef USE_PRINT_WORKERS
 	(void)fprintf(f,
-"\t\t[ -V file ] [ -w file ] [ -W filecount ] [ -y datalinktype ]\n");
+"\t\t[ --threads count ]\n");
+#endif
+#ifdef USE_DUMP_WRITER
+	(void)fprintf(f,
+"\t\t[ --write-buffer size ] [ --direct-io ]\n");
+#endif
+#ifdef USE_DUMP_WRITER_ZSTD
+	(void)fprintf(f,
+"\t\t[ --compress method[:level] ] [ --compress-threads count ]\n");
+#elif defined(USE_DUMP_WRITER_COMPRESSION)
+	(void)fprintf(f,
+"\t\t[ --compress method[:level] ]\n");
+#endif
 #ifdef HAVE_PCAP_SET_TSTAMP_PRECISION
 	(void)fprintf(f,
 "\t\t[ --time-stamp-precision precision ] [ --micro ] [ --nano ]\n");
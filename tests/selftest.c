@@ -0,0 +1,539 @@
+/*
+ * Copyright (c) 2026 The TCPDUMP project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that: (1) source code
+ * distributions retain the above copyright notice and this paragraph
+ * in its entirety, and (2) distributions including binary code include
+ * the above copyright notice and this paragraph in its entirety in
+ * the documentation or other materials provided with the distribution.
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND
+ * WITHOUT ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, WITHOUT
+ * LIMITATION, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE.
+ */
+
+/*
+ * Tests and benchmarks for the parts of libnetdissect that have a fast
+ * path and a simple one that must give the same answers, such as the
+ * checksum kernels, which are checked against the checksum as RFC 1071
+ * defines it, and the token table indexes.  tests/TESTrun runs each
+ * test; "selftest --bench" times the checksum kernels against each
+ * other, the token table indexes against a scan of the table, and the
+ * per-packet dispatch, whose output is checked by the print-dispatch
+ * tests in TESTLIST.
+ *
+ *	selftest --list		list the tests
+ *	selftest <test>		run a test; exit with 0 if it passes
+ *	selftest --bench	run the benchmarks
+ */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "netdissect-stdinc.h"
+
+#include "netdissect.h"
+#include "addrtoname.h"
+#include "ethertype.h"
+#include "ipproto.h"
+#include "nlpid.h"
+#include "oui.h"
+#include "print.h"
+
+static uint64_t rand_state = UINT64_C(0x9e3779b97f4a7c15);
+
+/* A fixed sequence of pseudo-random numbers (xorshift64*). */
+static uint64_t
+rand64(void)
+{
+	rand_state ^= rand_state >> 12;
+	rand_state ^= rand_state << 25;
+	rand_state ^= rand_state >> 27;
+	return (rand_state * UINT64_C(0x2545f4914f6cdd1d));
+}
+
+static u_int
+rand_below(u_int n)
+{
+	return ((u_int)(rand64() % n));
+}
+
+/* Seconds of processor time used so far. */
+static double
+cpu_seconds(void)
+{
+	return ((double)clock() / CLOCKS_PER_SEC);
+}
+
+/*
+ * The checksum of the pieces, one byte at a time, as RFC 1071 defines
+ * it; this works for any length.
+ */
+static uint16_t
+ref_in_cksum(const struct cksum_vec *vec, int veclen)
+{
+	uint64_t sum = 0;
+	uint16_t w;
+	u_int n = 0;
+	int i;
+
+	for (; veclen != 0; vec++, veclen--) {
+		for (i = 0; i < vec->len; i++, n++)
+			sum += (n & 1) ? vec->ptr[i] : (uint64_t)vec->ptr[i] << 8;
+	}
+	while (sum > 0xffff)
+		sum = (sum & 0xffff) + (sum >> 16);
+	/* That's a big-endian sum; in_cksum() returns it in host order. */
+	w = htons((uint16_t)sum);
+	return (~w & 0xffff);
+}
+
+#define CKSUM_BUFSIZE	(1024 * 1024)
+#define CKSUM_MAXVEC	6
+
+/*
+ * Compare in_cksum(), with each kernel this CPU can run, against the
+ * bytewise sum on random pieces of random, all-zero and all-ones data,
+ * at every alignment.
+ */
+static int
+test_in_cksum(void)
+{
+	uint8_t *bufs[3];
+	struct cksum_vec vec[CKSUM_MAXVEC];
+	const char *name;
+	u_int k, i, j, nvec, maxlen;
+	uint16_t got, want;
+	int r, failed = 0;
+
+	for (i = 0; i < 3; i++) {
+		bufs[i] = (uint8_t *)malloc(CKSUM_BUFSIZE);
+		if (bufs[i] == NULL) {
+			fprintf(stderr, "out of memory\n");
+			return (1);
+		}
+	}
+	for (j = 0; j < CKSUM_BUFSIZE; j++)
+		bufs[0][j] = (uint8_t)rand64();
+	memset(bufs[1], 0, CKSUM_BUFSIZE);
+	memset(bufs[2], 0xff, CKSUM_BUFSIZE);
+
+	for (k = 0; (r = in_cksum_set_kernel(k, &name)) != -1; k++) {
+		if (r == 0) {
+			printf("%s: not supported by this CPU\n", name);
+			continue;
+		}
+		for (i = 0; i < 200000 && !failed; i++) {
+			const uint8_t *buf = bufs[i % 7 == 0 ? 1 + i / 7 % 2 : 0];
+
+			/*
+			 * Mostly packet-sized pieces; every so often, pieces
+			 * long enough to carry out of 32 bits.
+			 */
+			if (i % 1000 == 0)
+				maxlen = CKSUM_BUFSIZE / CKSUM_MAXVEC;
+			else if (i % 10 == 0)
+				maxlen = 9000 / CKSUM_MAXVEC;
+			else
+				maxlen = 200;
+			nvec = 1 + rand_below(CKSUM_MAXVEC);
+			for (j = 0; j < nvec; j++) {
+				vec[j].len = rand_below(maxlen + 1);
+				vec[j].ptr = buf + rand_below(CKSUM_BUFSIZE -
+				    vec[j].len + 1);
+			}
+			got = in_cksum(vec, nvec);
+			want = ref_in_cksum(vec, nvec);
+			if (got != want) {
+				fprintf(stderr, "%s: case %u: got 0x%04x, want 0x%04x; pieces:",
+				    name, i, got, want);
+				for (j = 0; j < nvec; j++)
+					fprintf(stderr, " %u+%d",
+					    (u_int)(vec[j].ptr - buf), vec[j].len);
+				fprintf(stderr, "\n");
+				failed = 1;
+			}
+		}
+		if (!failed)
+			printf("%s: %u cases passed\n", name, i);
+	}
+	in_cksum_init();
+	for (i = 0; i < 3; i++)
+		free(bufs[i]);
+	return (failed);
+}
+
+/*
+ * Checksum single pieces of common sizes with each kernel, and print
+ * the speed in MB/s.
+ */
+static void
+bench_in_cksum(void)
+{
+	static const u_int sizes[] = { 20, 40, 64, 128, 256, 576, 1500, 9000 };
+	uint8_t *buf;
+	struct cksum_vec vec[1];
+	const char *name;
+	u_int i, j, k, n, iters;
+	volatile uint16_t sink = 0;
+	double t;
+	int r;
+
+	buf = (uint8_t *)malloc(32768 + 1);
+	if (buf == NULL) {
+		fprintf(stderr, "out of memory\n");
+		return;
+	}
+	for (i = 0; i < 32768 + 1; i++)
+		buf[i] = (uint8_t)rand64();
+	printf("in_cksum, MB/s, even and odd addresses:\n%-10s", "bytes");
+	for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+		printf(" %14u", sizes[i]);
+	printf("\n");
+	for (k = 0; (r = in_cksum_set_kernel(k, &name)) != -1; k++) {
+		if (r == 0)
+			continue;
+		printf("%-10s", name);
+		for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+			iters = (256 * 1024 * 1024) / sizes[i];
+			vec[0].len = sizes[i];
+			for (n = 0; n < 2; n++) {
+				vec[0].ptr = buf + n;
+				t = cpu_seconds();
+				for (j = 0; j < iters; j++)
+					sink += in_cksum(vec, 1);
+				t = cpu_seconds() - t;
+				printf(n == 0 ? " %7.0f" : "/%-6.0f",
+				    t > 0 ? (double)iters * sizes[i] / t / 1e6 : 0);
+			}
+		}
+		printf("\n");
+	}
+	in_cksum_init();
+	free(buf);
+}
+
+/* Look a value up by scanning the table, as tok2str() used to. */
+static const char *
+scan_tok(const struct tok *lp, u_int v)
+{
+	for (; lp->s != NULL; lp++) {
+		if (lp->v == v)
+			return (lp->s);
+	}
+	return (NULL);
+}
+
+/*
+ * Tables of the kinds tok2str() handles differently: empty, short
+ * enough to be scanned, just long enough to be indexed, with values
+ * just dense enough for a direct-mapped index and just too sparse for
+ * one, at both ends of the range, and with values that appear again
+ * after the first TOK_INDEX_MIN_ENTRIES entries, for which the first
+ * string must be found.
+ */
+static const struct tok tok_empty[] = {
+	{ 0, NULL }
+};
+static const struct tok tok_short[] = {
+	{ 0, "s0" }, { 1, "s1" }, { 2, "s2" }, { 3, "s3" }, { 4, "s4" },
+	{ 0, NULL }
+};
+static const struct tok tok_8[] = {
+	{ 100, "e0" }, { 101, "e1" }, { 102, "e2" }, { 103, "e3" },
+	{ 104, "e4" }, { 105, "e5" }, { 106, "e6" }, { 107, "e7" },
+	{ 0, NULL }
+};
+static const struct tok tok_9[] = {
+	{ 100, "n0" }, { 101, "n1" }, { 102, "n2" }, { 103, "n3" },
+	{ 104, "n4" }, { 105, "n5" }, { 106, "n6" }, { 107, "n7" },
+	{ 108, "n8" },
+	{ 0, NULL }
+};
+/* 10 entries spanning 39 values: direct-mapped. */
+static const struct tok tok_dense_edge[] = {
+	{ 7, "d0" }, { 45, "d1" }, { 12, "d2" }, { 30, "d3" }, { 8, "d4" },
+	{ 19, "d5" }, { 33, "d6" }, { 41, "d7" }, { 12, "d8" }, { 26, "d9" },
+	{ 0, NULL }
+};
+/* 10 entries spanning 41 values: hashed. */
+static const struct tok tok_sparse_edge[] = {
+	{ 7, "p0" }, { 47, "p1" }, { 12, "p2" }, { 30, "p3" }, { 8, "p4" },
+	{ 19, "p5" }, { 33, "p6" }, { 41, "p7" }, { 12, "p8" }, { 26, "p9" },
+	{ 0, NULL }
+};
+static const struct tok tok_sparse_ends[] = {
+	{ 0xffffffff, "x0" }, { 0, "x1" }, { 0x80000000, "x2" },
+	{ 0x12345678, "x3" }, { 1, "x4" }, { 0xfffffffe, "x5" },
+	{ 0x7fffffff, "x6" }, { 65536, "x7" }, { 0xffffffff, "x8" },
+	{ 256, "x9" }, { 0, "x10" }, { 0x80000001, "x11" },
+	{ 0, NULL }
+};
+static const struct tok tok_top[] = {
+	{ 0xfffffff6, "t0" }, { 0xfffffff7, "t1" }, { 0xfffffff8, "t2" },
+	{ 0xfffffff9, "t3" }, { 0xfffffffa, "t4" }, { 0xfffffffb, "t5" },
+	{ 0xfffffffc, "t6" }, { 0xfffffffd, "t7" }, { 0xfffffffe, "t8" },
+	{ 0xffffffff, "t9" }, { 0xfffffff6, "t10" },
+	{ 0, NULL }
+};
+
+/* Those tables, and some of the printers' tables. */
+static const struct {
+	const char *name;
+	const struct tok *table;
+} tok_tables[] = {
+	{ "empty", tok_empty },
+	{ "short", tok_short },
+	{ "8", tok_8 },
+	{ "9", tok_9 },
+	{ "dense-edge", tok_dense_edge },
+	{ "sparse-edge", tok_sparse_edge },
+	{ "sparse-ends", tok_sparse_ends },
+	{ "top", tok_top },
+	{ "ethertype", ethertype_values },
+	{ "ipproto", ipproto_values },
+	{ "nlpid", nlpid_values },
+	{ "oui", oui_values },
+	{ "smi", smi_values },
+};
+
+#define NTOKTABLES	(sizeof(tok_tables) / sizeof(tok_tables[0]))
+
+/*
+ * Compare tok2str() with a scan of the table, for each value in each
+ * table, the values next to them, and random values.
+ */
+static int
+test_tok2str(void)
+{
+	const struct tok *table, *lp;
+	const char *got, *want;
+	char buf[32];
+	u_int t, i, v, n, cases = 0;
+	int failed = 0;
+
+	for (t = 0; t < NTOKTABLES && !failed; t++) {
+		table = tok_tables[t].table;
+		for (n = 0; table[n].s != NULL; n++)
+			continue;
+		for (i = 0; i < 3 * n + 1000 && !failed; i++, cases++) {
+			if (i < 3 * n) {
+				lp = &table[i / 3];
+				v = lp->v + (i % 3) - 1;
+			} else if (i % 2)
+				v = (u_int)rand64();
+			else
+				v = rand_below(2048);
+			got = tok2str(table, "#%u", v);
+			want = scan_tok(table, v);
+			if (want == NULL) {
+				snprintf(buf, sizeof(buf), "#%u", v);
+				want = buf;
+				if (strcmp(got, want) == 0)
+					continue;
+			} else if (got == want)
+				continue;
+			fprintf(stderr, "table %s: value %u: got \"%s\", want \"%s\"\n",
+			    tok_tables[t].name, v, got, want);
+			failed = 1;
+		}
+	}
+	if (!failed)
+		printf("%u cases passed\n", cases);
+	return (failed);
+}
+
+/*
+ * Look up values that are in each table, in a random order, by scanning
+ * the table and with tok2str(), and print the time per lookup.
+ */
+static void
+bench_tok2str(void)
+{
+	/* Called through pointers, so neither is inlined here. */
+	const char *(*volatile scan)(const struct tok *, u_int) = scan_tok;
+	const char *(*volatile lookup)(const struct tok *, const char *,
+	    u_int) = tok2str;
+	const struct tok *table;
+	u_int *values;
+	u_int t, i, j, k, n;
+	volatile uintptr_t sink = 0;
+	double secs[2];
+
+	values = (u_int *)malloc(4096 * sizeof(*values));
+	if (values == NULL) {
+		fprintf(stderr, "out of memory\n");
+		return;
+	}
+	printf("tok2str, ns per lookup of a value in the table:\n");
+	printf("%-12s %8s %8s %8s\n", "table", "entries", "scan", "tok2str");
+	for (t = 0; t < NTOKTABLES; t++) {
+		table = tok_tables[t].table;
+		for (n = 0; table[n].s != NULL; n++)
+			continue;
+		if (n <= 8)
+			continue;	/* not indexed */
+		for (i = 0; i < 4096; i++)
+			values[i] = table[rand_below(n)].v;
+		for (k = 0; k < 2; k++) {
+			secs[k] = cpu_seconds();
+			for (j = 0; j < 1000; j++) {
+				for (i = 0; i < 4096; i++) {
+					if (k == 0)
+						sink += (uintptr_t)(*scan)(table,
+						    values[i]);
+					else
+						sink += (uintptr_t)(*lookup)(table,
+						    NULL, values[i]);
+				}
+			}
+			secs[k] = cpu_seconds() - secs[k];
+		}
+		printf("%-12s %8u %8.1f %8.1f\n", tok_tables[t].name, n,
+		    secs[0] * 1e9 / 4096000, secs[1] * 1e9 / 4096000);
+	}
+	free(values);
+}
+
+/*
+ * A 14-byte Ethernet frame of a type that isn't dissected, and a TCP
+ * SYN from 192.0.2.1 port 40000 to 198.51.100.2 port 80, in Ethernet.
+ */
+static const u_char pp_frame[14] = {
+	0x02, 0x00, 0x00, 0x00, 0x00, 0x01,
+	0x02, 0x00, 0x00, 0x00, 0x00, 0x02, 0x88, 0xb5
+};
+static const u_char pp_syn[54] = {
+	0x02, 0x00, 0x00, 0x00, 0x00, 0x01,
+	0x02, 0x00, 0x00, 0x00, 0x00, 0x02, 0x08, 0x00,
+	0x45, 0x00, 0x00, 0x28, 0x12, 0x34, 0x40, 0x00,
+	0x40, 0x06, 0x00, 0x00, 192, 0, 2, 1, 198, 51, 100, 2,
+	0x9c, 0x40, 0x00, 0x50, 0x01, 0x02, 0x03, 0x04,
+	0x00, 0x00, 0x00, 0x00, 0x50, 0x02, 0xff, 0xff,
+	0x00, 0x00, 0x00, 0x00
+};
+
+/*
+ * Print a packet over and over to the null device, with the printer
+ * set by nd_set_dispatch() and, as programs other than tcpdump might
+ * set it, through ndo_if_printer, and print the time per packet.
+ */
+static void
+bench_pretty_print_packet(void)
+{
+	static const struct {
+		const char *name;
+		const u_char *data;
+		u_int len;
+		int tflag;
+	} runs[] = {
+		{ "14-byte frame, -t", pp_frame, sizeof(pp_frame), 1 },
+		{ "14-byte frame", pp_frame, sizeof(pp_frame), 0 },
+		{ "14-byte frame, -tttt", pp_frame, sizeof(pp_frame), 4 },
+		{ "TCP SYN, -t", pp_syn, sizeof(pp_syn), 1 },
+		{ "TCP SYN", pp_syn, sizeof(pp_syn), 0 },
+	};
+	netdissect_options ndo;
+	struct pcap_pkthdr h;
+	FILE *devnull;
+	int saved_stdout, how;
+	u_int i, j;
+	double secs[2];
+
+#ifdef _WIN32
+	devnull = fopen("NUL", "w");
+#else
+	devnull = fopen("/dev/null", "w");
+#endif
+	if (devnull == NULL || (saved_stdout = dup(1)) == -1) {
+		perror("selftest: can't open the null device");
+		return;
+	}
+	printf("pretty_print_packet, ns per packet:\n");
+	printf("%-24s %16s %16s\n", "packet", "nd_set_dispatch", "ndo_if_printer");
+	for (i = 0; i < sizeof(runs) / sizeof(runs[0]); i++) {
+		h.ts.tv_sec = 1700000000;
+		h.ts.tv_usec = 0;
+		h.caplen = h.len = runs[i].len;
+		for (how = 0; how < 2; how++) {
+			memset(&ndo, 0, sizeof(ndo));
+			ndo_set_function_pointers(&ndo);
+			ndo.program_name = "selftest";
+			ndo.ndo_nflag = 1;
+			ndo.ndo_Sflag = 1;
+			ndo.ndo_tflag = runs[i].tflag;
+			if (how == 0)
+				nd_set_dispatch(&ndo, DLT_EN10MB);
+			else
+				ndo.ndo_if_printer = get_if_printer(DLT_EN10MB);
+			fflush(stdout);
+			dup2(fileno(devnull), 1);
+			secs[how] = cpu_seconds();
+			for (j = 0; j < 1000000; j++) {
+				h.ts.tv_usec = j % 1000000;
+				pretty_print_packet(&ndo, &h, runs[i].data,
+				    j + 1);
+			}
+			fflush(stdout);
+			secs[how] = cpu_seconds() - secs[how];
+			dup2(saved_stdout, 1);
+		}
+		printf("%-24s %16.1f %16.1f\n", runs[i].name,
+		    secs[0] * 1e3, secs[1] * 1e3);
+	}
+	close(saved_stdout);
+	fclose(devnull);
+}
+
+static const struct {
+	const char *name;
+	int (*test)(void);
+	void (*bench)(void);
+} tests[] = {
+	{ "in_cksum", test_in_cksum, bench_in_cksum },
+	{ "tok2str", test_tok2str, bench_tok2str },
+	{ "pretty_print_packet", NULL, bench_pretty_print_packet },
+};
+
+#define NTESTS	(sizeof(tests) / sizeof(tests[0]))
+
+int
+main(int argc, char **argv)
+{
+	char ebuf[128];
+	size_t i;
+
+	if (nd_init(ebuf, sizeof(ebuf)) == -1) {
+		fprintf(stderr, "selftest: %s\n", ebuf);
+		return (2);
+	}
+	if (argc == 2 && strcmp(argv[1], "--list") == 0) {
+		for (i = 0; i < NTESTS; i++) {
+			if (tests[i].test != NULL)
+				printf("%s\n", tests[i].name);
+		}
+		return (0);
+	}
+	if (argc == 2 && strcmp(argv[1], "--bench") == 0) {
+		for (i = 0; i < NTESTS; i++) {
+			if (tests[i].bench != NULL)
+				(*tests[i].bench)();
+		}
+		return (0);
+	}
+	if (argc == 2) {
+		for (i = 0; i < NTESTS; i++) {
+			if (tests[i].test != NULL &&
+			    strcmp(argv[1], tests[i].name) == 0)
+				return ((*tests[i].test)());
+		}
+	}
+	fprintf(stderr, "Usage: selftest --list | --bench | <test>\n");
+	return (2);
+}
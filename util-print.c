@@ -41,6 +41,7 @@
 
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "netdissect-ctype.h"
@@ -56,20 +57,102 @@ enum date_flag { WITHOUT_DATE = 0, WITH_DATE = 1 };
 enum time_flag { UTC_TIME = 0, LOCAL_TIME = 1 };
 
 /*
- * Print out a character, filtering out the non-printable ones
+ * Put a character, with the non-printable ones filtered out as
+ * "M-" and/or "^" followed by a printable one, at buf, and return
+ * its length, at most 4.
  */
-void
-fn_print_char(netdissect_options *ndo, u_char c)
+static size_t
+fn_format_char(char *buf, u_char c)
 {
+	size_t len = 0;
+
 	if (!ND_ISASCII(c)) {
 		c = ND_TOASCII(c);
-		ND_PRINT("M-");
+		buf[len++] = 'M';
+		buf[len++] = '-';
 	}
 	if (!ND_ASCII_ISPRINT(c)) {
 		c ^= 0x40;	/* DEL to ?, others to alpha */
-		ND_PRINT("^");
+		buf[len++] = '^';
+	}
+	buf[len++] = (char)c;
+	return len;
+}
+
+/*
+ * Print out a character, filtering out the non-printable ones
+ */
+void
+fn_print_char(netdissect_options *ndo, u_char c)
+{
+	char buf[4];
+
+	nd_print_strn(ndo, buf, fn_format_char(buf, c));
+}
+
+/*
+ * Return the number of characters at the start of s, looking at no
+ * more than n, that are printable ASCII no lower than lo (0x20 for all
+ * of them, 0x21 to stop at a space), or, if tab_ok is true, tabs.
+ *
+ * Eight bytes are looked at a time: in each, the top bit is set if the
+ * byte is 0x80 or above, the top bit of the low 7 bits plus (0x80 - lo)
+ * is clear if it's below lo, and the top bit of the low 7 bits plus 1
+ * is set if it's 0x7f; the top bit of the low 7 bits of the byte XOR
+ * 0x09, plus 0x7f, ORed with the byte XOR 0x09, is clear if it's a tab.
+ * No sum carries into the next byte.
+ */
+static size_t
+ascii_span(const u_char *s, size_t n, u_char lo, int tab_ok)
+{
+	const uint64_t ones = UINT64_C(0x0101010101010101);
+	const uint64_t highs = UINT64_C(0x8080808080808080);
+	uint64_t w, x, low7, bad;
+	size_t i = 0;
+
+	while (n - i >= 8) {
+		memcpy(&w, s + i, 8);
+		low7 = w & ~highs;
+		bad = (w | ~(low7 + (0x80 - lo) * ones) | (low7 + ones)) &
+		    highs;
+		if (bad != 0 && tab_ok) {
+			x = w ^ (0x09 * ones);
+			bad &= ((x & ~highs) + ~highs) | x;
+		}
+		if (bad != 0)
+			break;
+		i += 8;
+	}
+	while (i < n && ((s[i] >= lo && s[i] < 0x7f) ||
+			 (tab_ok && s[i] == '\t')))
+		i++;
+	return i;
+}
+
+/*
+ * Print n characters, filtering out non-printable ones; runs of
+ * printable characters are printed in one go.  There is no truncation
+ * check.
+ */
+void
+fn_print_strn(netdissect_options *ndo, const u_char *s, size_t n)
+{
+	char buf[4];
+	size_t run;
+
+	while (n != 0) {
+		run = ascii_span(s, n, 0x20, 0);
+		if (run != 0) {
+			nd_print_strn(ndo, (const char *)s, run);
+			s += run;
+			n -= run;
+			if (n == 0)
+				break;
+		}
+		nd_print_strn(ndo, buf, fn_format_char(buf, *s));
+		s++;
+		n--;
 	}
-	ND_PRINT("%c", c);
 }
 
 /*
@@ -80,10 +163,7 @@ fn_print_char(netdissect_options *ndo, u_char c)
 void
 fn_print_str(netdissect_options *ndo, const u_char *s)
 {
-	while (*s != '\0') {
-		fn_print_char(ndo, *s);
-		s++;
-       }
+	fn_print_strn(ndo, s, strlen((const char *)s));
 }
 
 /*
@@ -108,37 +188,31 @@ u_int
 nd_printztn(netdissect_options *ndo,
          const u_char *s, u_int n, const u_char *ep)
 {
-	u_int bytes;
-	u_char c;
-
-	bytes = 0;
-	for (;;) {
-		if (n == 0 || (ep != NULL && s >= ep)) {
-			/*
-			 * Truncated.  This includes "no null before we
-			 * got to the end of the fixed-length buffer or
-			 * the end of the packet".
-			 *
-			 * XXX - BOOTP says "null-terminated", which
-			 * means the maximum length of the string, in
-			 * bytes, is 1 less than the size of the buffer,
-			 * as there must always be a terminating null.
-			 */
-			bytes = 0;
-			break;
-		}
-
-		c = GET_U_1(s);
-		s++;
-		bytes++;
-		n--;
-		if (c == '\0') {
-			/* End of string */
-			break;
-		}
-		fn_print_char(ndo, c);
+	u_int limit, avail;
+	const u_char *nul;
+
+	limit = n;
+	if (ep != NULL && ND_BYTES_BETWEEN(s, ep) < limit)
+		limit = ND_BYTES_BETWEEN(s, ep);
+	avail = ND_BYTES_AVAILABLE_AFTER(s);
+	nul = memchr(s, '\0', ND_MIN(limit, avail));
+	if (nul != NULL) {
+		/* End of string */
+		fn_print_strn(ndo, s, (size_t)(nul - s));
+		return (u_int)(nul - s) + 1;
 	}
-	return(bytes);
+	fn_print_strn(ndo, s, ND_MIN(limit, avail));
+	if (avail < limit)
+		nd_trunc_longjmp(ndo);
+	/*
+	 * Truncated.  This includes "no null before we got to the end
+	 * of the fixed-length buffer or the end of the packet".
+	 *
+	 * XXX - BOOTP says "null-terminated", which means the maximum
+	 * length of the string, in bytes, is 1 less than the size of
+	 * the buffer, as there must always be a terminating null.
+	 */
+	return 0;
 }
 
 /*
@@ -152,15 +226,16 @@ int
 nd_printn(netdissect_options *ndo,
           const u_char *s, u_int n, const u_char *ep)
 {
-	u_char c;
-
-	while (n > 0 && (ep == NULL || s < ep)) {
-		n--;
-		c = GET_U_1(s);
-		s++;
-		fn_print_char(ndo, c);
-	}
-	return (n == 0) ? 0 : 1;
+	u_int limit, avail;
+
+	limit = n;
+	if (ep != NULL && ND_BYTES_BETWEEN(s, ep) < limit)
+		limit = ND_BYTES_BETWEEN(s, ep);
+	avail = ND_BYTES_AVAILABLE_AFTER(s);
+	fn_print_strn(ndo, s, ND_MIN(limit, avail));
+	if (avail < limit)
+		nd_trunc_longjmp(ndo);
+	return (limit == n) ? 0 : 1;
 }
 
 /*
@@ -173,11 +248,11 @@ nd_printn(netdissect_options *ndo,
 void
 nd_printjn(netdissect_options *ndo, const u_char *s, u_int n)
 {
-	while (n != 0) {
-		fn_print_char(ndo, GET_U_1(s));
-		n--;
-		s++;
-	}
+	u_int avail = ND_BYTES_AVAILABLE_AFTER(s);
+
+	fn_print_strn(ndo, s, ND_MIN(n, avail));
+	if (avail < n)
+		nd_trunc_longjmp(ndo);
 }
 
 /*
@@ -190,16 +265,34 @@ nd_printjn(netdissect_options *ndo, const u_char *s, u_int n)
 void
 nd_printjnp(netdissect_options *ndo, const u_char *s, u_int n)
 {
-	u_char c;
+	u_int avail = ND_BYTES_AVAILABLE_AFTER(s);
+	const u_char *nul;
 
-	while (n != 0) {
-		c = GET_U_1(s);
-		if (c == '\0')
-			break;
-		fn_print_char(ndo, c);
-		n--;
-		s++;
+	nul = memchr(s, '\0', ND_MIN(n, avail));
+	if (nul != NULL) {
+		fn_print_strn(ndo, s, (size_t)(nul - s));
+		return;
+	}
+	fn_print_strn(ndo, s, ND_MIN(n, avail));
+	if (avail < n)
+		nd_trunc_longjmp(ndo);
+}
+
+/*
+ * Put ".FRAC", "width" digits wide with leading zeros, at buf, and
+ * return its length.
+ */
+static size_t
+ts_frac_format(char *buf, u_int frac, u_int width)
+{
+	u_int i;
+
+	buf[0] = '.';
+	for (i = width; i != 0; i--) {
+		buf[i] = (char)('0' + frac % 10);
+		frac /= 10;
 	}
+	return width + 1;
 }
 
 /*
@@ -208,19 +301,26 @@ nd_printjnp(netdissect_options *ndo, const u_char *s, u_int n)
 static void
 ts_frac_print(netdissect_options *ndo, const struct timeval *tv)
 {
+	char buf[1 + 9];
+	u_int frac = (unsigned)tv->tv_usec;
+
 #ifdef HAVE_PCAP_SET_TSTAMP_PRECISION
 	switch (ndo->ndo_tstamp_precision) {
 
 	case PCAP_TSTAMP_PRECISION_MICRO:
-		ND_PRINT(".%06u", (unsigned)tv->tv_usec);
-		if ((unsigned)tv->tv_usec > ND_MICRO_PER_SEC - 1)
+		if (frac > ND_MICRO_PER_SEC - 1) {
+			ND_PRINT(".%06u", frac);
 			ND_PRINT(" " ND_INVALID_MICRO_SEC_STR);
+		} else
+			nd_print_strn(ndo, buf, ts_frac_format(buf, frac, 6));
 		break;
 
 	case PCAP_TSTAMP_PRECISION_NANO:
-		ND_PRINT(".%09u", (unsigned)tv->tv_usec);
-		if ((unsigned)tv->tv_usec > ND_NANO_PER_SEC - 1)
+		if (frac > ND_NANO_PER_SEC - 1) {
+			ND_PRINT(".%09u", frac);
 			ND_PRINT(" " ND_INVALID_NANO_SEC_STR);
+		} else
+			nd_print_strn(ndo, buf, ts_frac_format(buf, frac, 9));
 		break;
 
 	default:
@@ -228,12 +328,25 @@ ts_frac_print(netdissect_options *ndo, const struct timeval *tv)
 		break;
 	}
 #else
-	ND_PRINT(".%06u", (unsigned)tv->tv_usec);
-	if ((unsigned)tv->tv_usec > ND_MICRO_PER_SEC - 1)
+	if (frac > ND_MICRO_PER_SEC - 1) {
+		ND_PRINT(".%06u", frac);
 		ND_PRINT(" " ND_INVALID_MICRO_SEC_STR);
+	} else
+		nd_print_strn(ndo, buf, ts_frac_format(buf, frac, 6));
 #endif
 }
 
+/*
+ * The [YY:MM:DD] HH:MM:SS part of the last timestamp printed, for each
+ * combination of date_flag and time_flag, so that localtime(), gmtime()
+ * and strftime() are called only once per second of capture time.
+ */
+static ND_THREAD_LOCAL struct {
+	time_t sec;
+	size_t len;			/* 0 = nothing cached yet */
+	char str[64];
+} ts_sec_cache[2][2];
+
 /*
  * Print the timestamp as [YY:MM:DD] HH:MM:SS.FRAC.
  *   if time_flag == LOCAL_TIME print local time else UTC/GMT time
@@ -243,44 +356,61 @@ static void
 ts_date_hmsfrac_print(netdissect_options *ndo, const struct timeval *tv,
 		      enum date_flag date_flag, enum time_flag time_flag)
 {
-	struct tm *tm;
+	struct tm tmbuf, *tm;
 	char timebuf[32];
 	const char *timestr;
-#ifdef _WIN32
 	time_t sec;
-#endif
+	u_int hms;
 
 	if (tv->tv_sec < 0) {
 		ND_PRINT("[timestamp overflow]");
 		return;
 	}
 
-#ifdef _WIN32
 	/* on Windows tv->tv_sec is a long not a 64-bit time_t. */
 	sec = tv->tv_sec;
-#endif
 
-	if (time_flag == LOCAL_TIME)
-#ifdef _WIN32
-		tm = localtime(&sec);
-#else
-		tm = localtime(&tv->tv_sec);
-#endif
-	else
-#ifdef _WIN32
-		tm = gmtime(&sec);
-#else
-		tm = gmtime(&tv->tv_sec);
-#endif
+	if (date_flag == WITHOUT_DATE && time_flag == UTC_TIME) {
+		/*
+		 * UTC days are all 86400 seconds long in time_t terms, so
+		 * HH:MM:SS doesn't need gmtime(); this is also what -ttt
+		 * and -ttttt print, with times that aren't in order.
+		 */
+		hms = (u_int)(sec % 86400);
+		timebuf[0] = (char)('0' + hms / 36000);
+		timebuf[1] = (char)('0' + hms / 3600 % 10);
+		timebuf[2] = ':';
+		timebuf[3] = (char)('0' + hms % 3600 / 600);
+		timebuf[4] = (char)('0' + hms % 600 / 60);
+		timebuf[5] = ':';
+		timebuf[6] = (char)('0' + hms % 60 / 10);
+		timebuf[7] = (char)('0' + hms % 10);
+		nd_print_strn(ndo, timebuf, 8);
+		ts_frac_print(ndo, tv);
+		return;
+	}
 
-	if (date_flag == WITH_DATE) {
-		timestr = nd_format_time(timebuf, sizeof(timebuf),
-		    "%Y-%m-%d %H:%M:%S", tm);
-	} else {
-		timestr = nd_format_time(timebuf, sizeof(timebuf),
-		    "%H:%M:%S", tm);
+	if (ts_sec_cache[date_flag][time_flag].len == 0 ||
+	    ts_sec_cache[date_flag][time_flag].sec != sec) {
+		if (time_flag == LOCAL_TIME)
+			tm = nd_localtime(&sec, &tmbuf);
+		else
+			tm = nd_gmtime(&sec, &tmbuf);
+
+		if (date_flag == WITH_DATE) {
+			timestr = nd_format_time(timebuf, sizeof(timebuf),
+			    "%Y-%m-%d %H:%M:%S", tm);
+		} else {
+			timestr = nd_format_time(timebuf, sizeof(timebuf),
+			    "%H:%M:%S", tm);
+		}
+		ts_sec_cache[date_flag][time_flag].sec = sec;
+		ts_sec_cache[date_flag][time_flag].len =
+		    strlcpy(ts_sec_cache[date_flag][time_flag].str, timestr,
+			    sizeof(ts_sec_cache[date_flag][time_flag].str));
 	}
-	ND_PRINT("%s", timestr);
+	nd_print_strn(ndo, ts_sec_cache[date_flag][time_flag].str,
+		      ts_sec_cache[date_flag][time_flag].len);
 
 	ts_frac_print(ndo, tv);
 }
@@ -301,73 +431,117 @@ ts_unix_print(netdissect_options *ndo, const struct timeval *tv)
 }
 
 /*
- * Print the timestamp
+ * The timestamp printers for each -t option; get_ts_printer() picks one.
  */
-void
-ts_print(netdissect_options *ndo,
-         const struct timeval *tvp)
+
+/* Default */
+static void
+ts_default_print(netdissect_options *ndo, const struct timeval *tvp)
+{
+	ts_date_hmsfrac_print(ndo, tvp, WITHOUT_DATE, LOCAL_TIME);
+	ND_PRINT(" ");
+}
+
+/* No time stamp (-t) */
+static void
+ts_none_print(netdissect_options *ndo _U_, const struct timeval *tvp _U_)
+{
+}
+
+/* Unix timeval style (-tt) */
+static void
+ts_unix_sep_print(netdissect_options *ndo, const struct timeval *tvp)
+{
+	ts_unix_print(ndo, tvp);
+	ND_PRINT(" ");
+}
+
+/*
+ * Microseconds/nanoseconds since previous packet (-ttt) or since first
+ * packet (-ttttt)
+ */
+static void
+ts_delta_print(netdissect_options *ndo, const struct timeval *tvp)
 {
-	static struct timeval tv_ref;
 	struct timeval tv_result;
 	int negative_offset;
 	int nano_prec;
 
-	switch (ndo->ndo_tflag) {
-
-	case 0: /* Default */
-		ts_date_hmsfrac_print(ndo, tvp, WITHOUT_DATE, LOCAL_TIME);
-		ND_PRINT(" ");
+#ifdef HAVE_PCAP_SET_TSTAMP_PRECISION
+	switch (ndo->ndo_tstamp_precision) {
+	case PCAP_TSTAMP_PRECISION_MICRO:
+		nano_prec = 0;
 		break;
-
-	case 1: /* No time stamp */
+	case PCAP_TSTAMP_PRECISION_NANO:
+		nano_prec = 1;
 		break;
-
-	case 2: /* Unix timeval style */
-		ts_unix_print(ndo, tvp);
-		ND_PRINT(" ");
+	default:
+		nano_prec = 0;
 		break;
-
-	case 3: /* Microseconds/nanoseconds since previous packet */
-        case 5: /* Microseconds/nanoseconds since first packet */
-#ifdef HAVE_PCAP_SET_TSTAMP_PRECISION
-		switch (ndo->ndo_tstamp_precision) {
-		case PCAP_TSTAMP_PRECISION_MICRO:
-			nano_prec = 0;
-			break;
-		case PCAP_TSTAMP_PRECISION_NANO:
-			nano_prec = 1;
-			break;
-		default:
-			nano_prec = 0;
-			break;
-		}
+	}
 #else
-		nano_prec = 0;
+	nano_prec = 0;
 #endif
-		if (!(netdissect_timevalisset(&tv_ref)))
-			tv_ref = *tvp; /* set timestamp for first packet */
+	if (!(netdissect_timevalisset(&ndo->ndo_ts_ref)))
+		ndo->ndo_ts_ref = *tvp; /* set timestamp for first packet */
 
-		negative_offset = netdissect_timevalcmp(tvp, &tv_ref, <);
-		if (negative_offset)
-			netdissect_timevalsub(&tv_ref, tvp, &tv_result, nano_prec);
-		else
-			netdissect_timevalsub(tvp, &tv_ref, &tv_result, nano_prec);
+	negative_offset = netdissect_timevalcmp(tvp, &ndo->ndo_ts_ref, <);
+	if (negative_offset)
+		netdissect_timevalsub(&ndo->ndo_ts_ref, tvp, &tv_result,
+		    nano_prec);
+	else
+		netdissect_timevalsub(tvp, &ndo->ndo_ts_ref, &tv_result,
+		    nano_prec);
 
-		ND_PRINT((negative_offset ? "-" : " "));
-		ts_date_hmsfrac_print(ndo, &tv_result, WITHOUT_DATE, UTC_TIME);
-		ND_PRINT(" ");
+	ND_PRINT((negative_offset ? "-" : " "));
+	ts_date_hmsfrac_print(ndo, &tv_result, WITHOUT_DATE, UTC_TIME);
+	ND_PRINT(" ");
 
-                if (ndo->ndo_tflag == 3)
-			tv_ref = *tvp; /* set timestamp for previous packet */
-		break;
+	if (ndo->ndo_tflag == 3)
+		ndo->ndo_ts_ref = *tvp; /* set timestamp for previous packet */
+}
 
-	case 4: /* Date + Default */
-		ts_date_hmsfrac_print(ndo, tvp, WITH_DATE, LOCAL_TIME);
-		ND_PRINT(" ");
-		break;
+/* Date + Default (-tttt) */
+static void
+ts_date_print(netdissect_options *ndo, const struct timeval *tvp)
+{
+	ts_date_hmsfrac_print(ndo, tvp, WITH_DATE, LOCAL_TIME);
+	ND_PRINT(" ");
+}
+
+ts_printer
+get_ts_printer(const netdissect_options *ndo)
+{
+	switch (ndo->ndo_tflag) {
+
+	case 0:
+		return ts_default_print;
+
+	case 2:
+		return ts_unix_sep_print;
+
+	case 3:
+	case 5:
+		return ts_delta_print;
+
+	case 4:
+		return ts_date_print;
+
+	default:
+		return ts_none_print;
 	}
 }
 
+/*
+ * Print the timestamp
+ */
+void
+ts_print(netdissect_options *ndo,
+         const struct timeval *tvp)
+{
+	(get_ts_printer(ndo))(ndo, tvp);
+}
+
 /*
  * Print an unsigned relative number of seconds (e.g. hold time, prune timer)
  * in the form 5m1s.  This does no truncation, so 32230861 seconds
@@ -452,6 +626,34 @@ nd_format_time(char *buf, size_t bufsize, const char *format,
 		return ("[localtime() or gmtime() couldn't convert the date and time]");
 }
 
+/*
+ * localtime() and gmtime() return a pointer to a static struct tm that
+ * other threads may be using; these fill in the caller's instead.
+ */
+struct tm *
+nd_localtime(const time_t *timep, struct tm *result)
+{
+#ifdef _WIN32
+	if (localtime_s(result, timep) != 0)
+		return (NULL);
+	return (result);
+#else
+	return (localtime_r(timep, result));
+#endif
+}
+
+struct tm *
+nd_gmtime(const time_t *timep, struct tm *result)
+{
+#ifdef _WIN32
+	if (gmtime_s(result, timep) != 0)
+		return (NULL);
+	return (result);
+#else
+	return (gmtime_r(timep, result));
+#endif
+}
+
 /* Print the truncated string */
 void nd_print_trunc(netdissect_options *ndo)
 {
@@ -515,19 +717,202 @@ print_unknown_data(netdissect_options *ndo, const u_char *cp,
 }
 
 /*
- * Convert a token value to a string; use "fmt" if not found.
+ * Looking a value up in a token table is a linear scan, which is fine
+ * for most of the tables but not for the ones with dozens or hundreds
+ * of entries.  So, the first time a value isn't found within the first
+ * TOK_INDEX_MIN_ENTRIES entries of a table, an index is built for that
+ * table: a direct-mapped array of the strings if the values are dense
+ * enough, and an open-addressing hash table of the entries otherwise.
+ * The index gives the same string as the scan for values that appear
+ * more than once in a table, i.e. the first one.
+ *
+ * The indexes are found by the address of the table, so this relies on
+ * token tables not changing once they've been used, which holds for the
+ * "static const" tables in the printers.  If memory for an index can't
+ * be allocated, the table is just scanned.  Each thread that dissects
+ * packets builds its own indexes.
+ */
+#define TOK_INDEX_MIN_ENTRIES	8
+#define TOK_INDEX_DENSITY	4	/* at most 4 slots per entry */
+
+struct tok_index {
+	const struct tok *table;
+	u_int base;		/* lowest value, for a direct-mapped index */
+	u_int nslots;
+	const char **strings;	/* direct-mapped: string for base + i */
+	const struct tok **entries; /* hashed: a power of 2 of slots */
+};
+
+static ND_THREAD_LOCAL struct tok_index **tok_indexes;	/* hashed on the table address */
+static ND_THREAD_LOCAL size_t tok_indexes_size;		/* a power of 2 */
+static ND_THREAD_LOCAL size_t tok_indexes_count;
+
+static inline size_t
+tok_hash(uint64_t k)
+{
+	k ^= k >> 33;
+	k *= UINT64_C(0xff51afd7ed558ccd);
+	k ^= k >> 33;
+	return ((size_t)k);
+}
+
+static struct tok_index *
+tok_index_build(const struct tok *table)
+{
+	struct tok_index *ti;
+	const struct tok *lp;
+	u_int n = 0, lo = table->v, hi = table->v;
+	size_t i, mask;
+
+	for (lp = table; lp->s != NULL; lp++) {
+		n++;
+		if (lp->v < lo)
+			lo = lp->v;
+		if (lp->v > hi)
+			hi = lp->v;
+	}
+	ti = (struct tok_index *)calloc(1, sizeof(*ti));
+	if (ti == NULL)
+		return (NULL);
+	ti->table = table;
+	if (hi - lo < (uint64_t)n * TOK_INDEX_DENSITY) {
+		ti->base = lo;
+		ti->nslots = hi - lo + 1;
+		ti->strings = (const char **)calloc(ti->nslots,
+		    sizeof(*ti->strings));
+		if (ti->strings == NULL) {
+			free(ti);
+			return (NULL);
+		}
+		for (lp = table; lp->s != NULL; lp++) {
+			if (ti->strings[lp->v - lo] == NULL)
+				ti->strings[lp->v - lo] = lp->s;
+		}
+	} else {
+		ti->nslots = 2 * TOK_INDEX_MIN_ENTRIES;
+		while (ti->nslots < 2 * n)
+			ti->nslots *= 2;
+		ti->entries = (const struct tok **)calloc(ti->nslots,
+		    sizeof(*ti->entries));
+		if (ti->entries == NULL) {
+			free(ti);
+			return (NULL);
+		}
+		mask = ti->nslots - 1;
+		for (lp = table; lp->s != NULL; lp++) {
+			for (i = tok_hash(lp->v) & mask; ti->entries[i] != NULL;
+			    i = (i + 1) & mask) {
+				if (ti->entries[i]->v == lp->v)
+					break;
+			}
+			if (ti->entries[i] == NULL)
+				ti->entries[i] = lp;
+		}
+	}
+	return (ti);
+}
+
+/*
+ * Find the index for a table, building it if need be; return NULL if
+ * it can't be built.
+ */
+static const struct tok_index *
+tok_index_get(const struct tok *table)
+{
+	struct tok_index **newindexes, *ti;
+	size_t newsize, i, j, mask;
+
+	if (tok_indexes_size != 0) {
+		mask = tok_indexes_size - 1;
+		for (i = tok_hash((uintptr_t)table) & mask;
+		    tok_indexes[i] != NULL; i = (i + 1) & mask) {
+			if (tok_indexes[i]->table == table)
+				return (tok_indexes[i]);
+		}
+	}
+	if ((tok_indexes_count + 1) * 2 > tok_indexes_size) {
+		newsize = tok_indexes_size != 0 ? tok_indexes_size * 2 : 64;
+		newindexes = (struct tok_index **)calloc(newsize,
+		    sizeof(*newindexes));
+		if (newindexes == NULL)
+			return (NULL);
+		for (j = 0; j < tok_indexes_size; j++) {
+			if (tok_indexes[j] == NULL)
+				continue;
+			for (i = tok_hash((uintptr_t)tok_indexes[j]->table) &
+			    (newsize - 1); newindexes[i] != NULL;
+			    i = (i + 1) & (newsize - 1))
+				continue;
+			newindexes[i] = tok_indexes[j];
+		}
+		free(tok_indexes);
+		tok_indexes = newindexes;
+		tok_indexes_size = newsize;
+	}
+	ti = tok_index_build(table);
+	if (ti == NULL)
+		return (NULL);
+	mask = tok_indexes_size - 1;
+	for (i = tok_hash((uintptr_t)table) & mask; tok_indexes[i] != NULL;
+	    i = (i + 1) & mask)
+		continue;
+	tok_indexes[i] = ti;
+	tok_indexes_count++;
+	return (ti);
+}
+
+/*
+ * Look a value up in a token table; return NULL if it's not there.
  */
 static const char *
-tok2strbuf(const struct tok *lp, const char *fmt,
-	   const u_int v, char *buf, const size_t bufsize)
+tok_lookup(const struct tok *table, const u_int v)
 {
-	if (lp != NULL) {
-		while (lp->s != NULL) {
+	const struct tok *lp;
+	const struct tok_index *ti;
+	const struct tok *e;
+	size_t i, mask;
+
+	if (table == NULL)
+		return (NULL);
+	for (lp = table; lp < table + TOK_INDEX_MIN_ENTRIES; lp++) {
+		if (lp->s == NULL)
+			return (NULL);
+		if (lp->v == v)
+			return (lp->s);
+	}
+	ti = tok_index_get(table);
+	if (ti == NULL) {
+		/* Fall back on scanning the rest of the table. */
+		for (; lp->s != NULL; lp++) {
 			if (lp->v == v)
 				return (lp->s);
-			++lp;
 		}
+		return (NULL);
+	}
+	if (ti->strings != NULL)
+		return (v - ti->base < ti->nslots ? ti->strings[v - ti->base] :
+		    NULL);
+	mask = ti->nslots - 1;
+	for (i = tok_hash(v) & mask; (e = ti->entries[i]) != NULL;
+	    i = (i + 1) & mask) {
+		if (e->v == v)
+			return (e->s);
 	}
+	return (NULL);
+}
+
+/*
+ * Convert a token value to a string; use "fmt" if not found.
+ */
+static const char *
+tok2strbuf(const struct tok *lp, const char *fmt,
+	   const u_int v, char *buf, const size_t bufsize)
+{
+	const char *s;
+
+	s = tok_lookup(lp, v);
+	if (s != NULL)
+		return (s);
 	if (fmt == NULL)
 		fmt = "#%d";
 
@@ -538,13 +923,13 @@ tok2strbuf(const struct tok *lp, const char *fmt,
 /*
  * Convert a token value to a string; use "fmt" if not found.
  * Uses tok2strbuf() on one of four local static buffers of size TOKBUFSIZE
- * in round-robin fashion.
+ * in round-robin fashion; each thread has its own four.
  */
 const char *
 tok2str(const struct tok *lp, const char *fmt, const u_int v)
 {
-	static char buf[4][TOKBUFSIZE];
-	static int idx = 0;
+	static ND_THREAD_LOCAL char buf[4][TOKBUFSIZE];
+	static ND_THREAD_LOCAL int idx = 0;
 	char *ret;
 
 	ret = buf[idx];
@@ -564,7 +949,7 @@ static char *
 bittok2str_internal(const struct tok *lp, const char *fmt,
 		    const u_int v, const char *sep)
 {
-        static char buf[1024+1]; /* our string buffer */
+        static ND_THREAD_LOCAL char buf[1024+1]; /* our string buffer */
         char *bufp = buf;
         size_t space_left = sizeof(buf), string_size;
         const char * sepstr = "";
@@ -626,7 +1011,7 @@ bittok2str(const struct tok *lp, const char *fmt, const u_int v)
 const char *
 tok2strary_internal(const char **lp, int n, const char *fmt, const int v)
 {
-	static char buf[TOKBUFSIZE];
+	static ND_THREAD_LOCAL char buf[TOKBUFSIZE];
 
 	if (v >= 0 && v < n && lp[v] != NULL)
 		return lp[v];
@@ -727,39 +1112,40 @@ static u_int
 fetch_token(netdissect_options *ndo, const u_char *pptr, u_int idx, u_int len,
 	    u_char *tbuf, size_t tbuflen)
 {
-	size_t toklen = 0;
+	size_t toklen;
+	u_int avail;
 	u_char c;
 
-	for (; idx < len; idx++) {
-		if (!ND_TTEST_1(pptr + idx)) {
-			/* ran past end of captured data */
-			return (0);
-		}
-		c = GET_U_1(pptr + idx);
-		if (!ND_ISASCII(c)) {
-			/* not an ASCII character */
-			return (0);
-		}
-		if (c == ' ' || c == '\t' || c == '\r' || c == '\n') {
-			/* end of token */
-			break;
-		}
-		if (!ND_ASCII_ISPRINT(c)) {
-			/* not part of a command token or response code */
-			return (0);
-		}
-		if (toklen + 2 > tbuflen) {
-			/* no room for this character and terminating '\0' */
+	if (idx >= len)
+		return (0);	/* no token */
+	avail = ND_BYTES_AVAILABLE_AFTER(pptr + idx);
+	toklen = ascii_span(pptr + idx, ND_MIN(len - idx, avail), 0x21, 0);
+	if (toklen >= tbuflen) {
+		/* no room for the token and terminating '\0' */
+		return (0);
+	}
+	if (toklen == len - idx) {
+		/* the token runs to the end of the data */
+	} else if (toklen == avail) {
+		/* ran past end of captured data */
+		return (0);
+	} else {
+		c = EXTRACT_U_1(pptr + idx + toklen);
+		if (c != ' ' && c != '\t' && c != '\r' && c != '\n') {
+			/*
+			 * Not an ASCII character, or not part of a command
+			 * token or response code.
+			 */
 			return (0);
 		}
-		tbuf[toklen] = c;
-		toklen++;
 	}
 	if (toklen == 0) {
 		/* no token */
 		return (0);
 	}
+	memcpy(tbuf, pptr + idx, toklen);
 	tbuf[toklen] = '\0';
+	idx += (u_int)toklen;
 
 	/*
 	 * Skip past any white space after the token, until we see
@@ -799,10 +1185,17 @@ print_txt_line(netdissect_options *ndo, const char *prefix,
 {
 	u_int startidx;
 	u_int linelen;
+	u_int avail;
 	u_char c;
 
 	startidx = idx;
-	while (idx < len) {
+	if (idx < len) {
+		avail = ND_BYTES_AVAILABLE_AFTER(pptr + idx);
+		/* Skip the printable ASCII characters and tabs. */
+		idx += (u_int)ascii_span(pptr + idx,
+		    ND_MIN(len - idx, avail), 0x20, 1);
+	}
+	if (idx < len) {
 		c = GET_U_1(pptr + idx);
 		if (c == '\n') {
 			/*
@@ -836,15 +1229,13 @@ print_txt_line(netdissect_options *ndo, const char *prefix,
 			 * it.
 			 */
 			return (0);
-		} else if (!ND_ASCII_ISPRINT(c) && c != '\t') {
-			/*
-			 * Not a printable ASCII character and not a tab;
-			 * treat this as if it were binary data, and
-			 * don't print it.
-			 */
-			return (0);
 		}
-		idx++;
+		/*
+		 * Not a printable ASCII character and not a tab;
+		 * treat this as if it were binary data, and
+		 * don't print it.
+		 */
+		return (0);
 	}
 
 	/*
@@ -852,11 +1243,13 @@ print_txt_line(netdissect_options *ndo, const char *prefix,
 	 * in the buffer.
 	 */
 	linelen = idx - startidx;
-	ND_PRINT("%s%.*s", prefix, (int)linelen, pptr + startidx);
+	nd_print_str(ndo, prefix);
+	nd_print_strn(ndo, (const char *)pptr + startidx, linelen);
 	return (0);
 
 print:
-	ND_PRINT("%s%.*s", prefix, (int)linelen, pptr + startidx);
+	nd_print_str(ndo, prefix);
+	nd_print_strn(ndo, (const char *)pptr + startidx, linelen);
 	return (idx);
 }
 
@@ -56,4 +56,35 @@
   #define _U_
 #endif
 
+/*
+ * Storage class for static variables of which each thread should have
+ * its own copy, such as the buffers that some printers return strings
+ * in, so that packets can be dissected on more than one thread at once.
+ * ND_HAVE_THREAD_LOCAL is defined if the compiler supports that.
+ */
+#if defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L && \
+    !defined(__STDC_NO_THREADS__)
+  /*
+   * C11 or later.
+   */
+  #define ND_THREAD_LOCAL _Thread_local
+  #define ND_HAVE_THREAD_LOCAL
+#elif ND_IS_AT_LEAST_GNUC_VERSION(3,3) \
+    || ND_IS_AT_LEAST_SUNC_VERSION(5,9)
+  /*
+   * GCC 3.3 and later, compilers that claim to be like it, such as
+   * Clang, and Sun C 5.9 and later, support __thread.
+   */
+  #define ND_THREAD_LOCAL __thread
+  #define ND_HAVE_THREAD_LOCAL
+#elif defined(_MSC_VER)
+  #define ND_THREAD_LOCAL __declspec(thread)
+  #define ND_HAVE_THREAD_LOCAL
+#else
+  /*
+   * We don't know how to do it; there's only one copy.
+   */
+  #define ND_THREAD_LOCAL
+#endif
+
 #endif
@@ -0,0 +1,379 @@
+/*
+ * Copyright (c) 2026 The TCPDUMP project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that: (1) source code
+ * distributions retain the above copyright notice and this paragraph
+ * in its entirety, and (2) distributions including binary code include
+ * the above copyright notice and this paragraph in its entirety in
+ * the documentation or other materials provided with the distribution.
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND
+ * WITHOUT ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, WITHOUT
+ * LIMITATION, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE.
+ */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "netdissect-stdinc.h"
+
+#include "netdissect.h"
+#include "netdissect-hash.h"
+#include "extract.h"
+#include "ip.h"
+#include "ip6.h"
+#include "flowstate.h"
+#include "xidmap.h"
+
+/*
+ * Outstanding calls are kept in the flow state (see flowstate.h).  A
+ * call that has been answered is kept as long as one that hasn't, so
+ * that a reply that is seen again, because the call was retransmitted,
+ * can still be decoded; calls are dropped when they haven't been seen
+ * for long enough (of packet time stamps) and, with a size limit
+ * (--rpc-xid-table-size), in least recently used order to stay within
+ * the limit.
+ */
+#define XID_MAP_IDLE_TIMEOUT	(5 * 60)	/* seconds */
+
+#define XID_MAP_REPLIED		0x01	/* a reply has been seen */
+
+struct xid_map_entry {
+	uint32_t	prog;		/* program number or server port */
+	uint32_t	vers;		/* program version */
+	uint32_t	proc;		/* procedure number or opcode */
+	uint32_t	kind;		/* enum xid_map_kind */
+	const struct tok *procs;	/* procedure names, or NULL */
+	uint64_t	call_ns;	/* time stamp of the call */
+	u_int		flags;
+};
+
+/*
+ * Time from call to first reply, for each procedure; kept in an
+ * open-addressing hash table, which never has entries removed.
+ */
+#define XID_MAP_PROCS_INITIAL_SIZE	64
+
+struct xid_map_proc_stats {
+	uint32_t	prog;
+	uint32_t	vers;
+	uint32_t	proc;
+	uint32_t	kind;		/* enum xid_map_kind; 0 = empty */
+	const struct tok *procs;
+	uint64_t	replies;
+	uint64_t	total_ns;
+	uint64_t	min_ns;
+	uint64_t	max_ns;
+};
+
+struct xid_map {
+	uint64_t	calls;
+	uint64_t	matched;
+	struct xid_map_proc_stats *stats;
+	size_t		stats_size;
+	size_t		stats_count;
+};
+
+static const struct tok xid_map_kind_str[] = {
+	{ XID_MAP_NFS,		"NFS" },
+	{ XID_MAP_SUNRPC,	"Sun RPC" },
+	{ XID_MAP_RX,		"AFS Rx" },
+	{ 0, NULL }
+};
+
+static struct xid_map *
+xid_map_get(netdissect_options *ndo)
+{
+	if (ndo->ndo_xid_map == NULL) {
+		ndo->ndo_xid_map = (struct xid_map *)
+			calloc(1, sizeof(*ndo->ndo_xid_map));
+		if (ndo->ndo_xid_map == NULL)
+			(*ndo->ndo_error)(ndo, S_ERR_ND_MEM_ALLOC,
+					  "%s: calloc", __func__);
+	}
+	return ndo->ndo_xid_map;
+}
+
+static size_t
+xid_map_hash(const void *key)
+{
+	uint64_t w[2];
+
+	memcpy(w, key, sizeof(w));
+	return ((size_t)nd_hash64(0, w, 2));
+}
+
+/* The time stamp of the packet being printed, in nanoseconds. */
+static uint64_t
+xid_map_now_ns(const netdissect_options *ndo)
+{
+	uint64_t frac = (uint64_t)ndo->ndo_packet_ts.tv_usec;
+
+#ifdef HAVE_PCAP_SET_TSTAMP_PRECISION
+	if (ndo->ndo_tstamp_precision != PCAP_TSTAMP_PRECISION_NANO)
+#endif
+		frac *= 1000;
+	return (uint64_t)ndo->ndo_packet_ts.tv_sec * 1000000000 + frac;
+}
+
+/*
+ * Set up the key for a call or, if reply is non-zero, for the reply
+ * to one, from the IPv4 or IPv6 header at iph.  Returns 0 if iph
+ * isn't either.
+ */
+int
+xid_map_key_init(netdissect_options *ndo, struct xid_map_key *key,
+		 enum xid_map_kind kind, uint32_t xid, const u_char *iph,
+		 int reply)
+{
+	const struct ip *ip;
+	const struct ip6_hdr *ip6;
+
+	memset(key, 0, sizeof(*key));
+	switch (IP_V((const struct ip *)iph)) {
+	case 4:
+		ip = (const struct ip *)iph;
+		GET_CPY_BYTES(reply ? &key->server : &key->client, ip->ip_src,
+			      sizeof(ip->ip_src));
+		GET_CPY_BYTES(reply ? &key->client : &key->server, ip->ip_dst,
+			      sizeof(ip->ip_dst));
+		key->ipver = 4;
+		break;
+	case 6:
+		ip6 = (const struct ip6_hdr *)iph;
+		GET_CPY_BYTES(reply ? &key->server : &key->client,
+			      ip6->ip6_src, sizeof(ip6->ip6_src));
+		GET_CPY_BYTES(reply ? &key->client : &key->server,
+			      ip6->ip6_dst, sizeof(ip6->ip6_dst));
+		key->ipver = 6;
+		break;
+	default:
+		return (0);
+	}
+	key->kind = (uint8_t)kind;
+	key->xid = xid;
+	return (1);
+}
+
+static void
+xid_map_flow_key(const struct xid_map_key *key, struct nd_flow_key *fkey)
+{
+	memset(fkey, 0, sizeof(*fkey));
+	memcpy(&fkey->src, &key->client, sizeof(fkey->src));
+	memcpy(&fkey->dst, &key->server, sizeof(fkey->dst));
+	fkey->dport = key->port;
+	fkey->ipver = key->ipver;
+	fkey->id[0] = key->xid;
+	fkey->id[1] = key->conn;
+	fkey->id[2] = key->service;
+	fkey->id[3] = key->kind;
+}
+
+/*
+ * Remember a call to procedure proc of version vers of program prog
+ * (for Rx, the server port and the opcode); procs, if not NULL, has
+ * the names of the procedures, for the latency report.
+ */
+void
+xid_map_enter(netdissect_options *ndo, const struct xid_map_key *key,
+	      uint32_t prog, uint32_t vers, uint32_t proc,
+	      const struct tok *procs)
+{
+	struct xid_map *xm = xid_map_get(ndo);
+	struct xid_map_entry *xmep;
+	struct nd_flow_key fkey;
+
+	xid_map_flow_key(key, &fkey);
+	xmep = nd_flow_find(ndo, ND_FLOW_RPC_CALL, &fkey);
+	if (xmep == NULL) {
+		xmep = nd_flow_create(ndo, ND_FLOW_RPC_CALL, &fkey,
+				      sizeof(*xmep), XID_MAP_IDLE_TIMEOUT);
+		xmep->kind = key->kind;
+		/* Nothing to wait for yet; the call time is set below. */
+		xmep->flags = XID_MAP_REPLIED;
+	}
+	/*
+	 * A call for which no reply has been seen yet is probably being
+	 * retransmitted; the latency is from the first transmission.
+	 */
+	if (xmep->flags & XID_MAP_REPLIED) {
+		xmep->call_ns = xid_map_now_ns(ndo);
+		xmep->flags &= ~XID_MAP_REPLIED;
+	}
+	xmep->prog = prog;
+	xmep->vers = vers;
+	xmep->proc = proc;
+	xmep->procs = procs;
+	nd_flow_set_timeout(ndo, xmep, XID_MAP_IDLE_TIMEOUT);
+	xm->calls++;
+}
+
+static void
+xid_map_add_latency(netdissect_options *ndo, struct xid_map *xm,
+		    const struct xid_map_entry *xmep, uint64_t ns)
+{
+	struct xid_map_proc_stats key, *old, *ps;
+	size_t oldsize, i, mask;
+
+	if ((xm->stats_count + 1) * 2 > xm->stats_size) {
+		old = xm->stats;
+		oldsize = xm->stats_size;
+		xm->stats_size = oldsize != 0 ? oldsize * 2 :
+		    XID_MAP_PROCS_INITIAL_SIZE;
+		xm->stats = (struct xid_map_proc_stats *)
+			calloc(xm->stats_size, sizeof(*xm->stats));
+		if (xm->stats == NULL)
+			(*ndo->ndo_error)(ndo, S_ERR_ND_MEM_ALLOC,
+					  "%s: calloc", __func__);
+		mask = xm->stats_size - 1;
+		for (i = 0; i < oldsize; i++) {
+			if (old[i].kind == 0)
+				continue;
+			ps = &xm->stats[xid_map_hash(&old[i]) & mask];
+			while (ps->kind != 0) {
+				if (++ps == xm->stats + xm->stats_size)
+					ps = xm->stats;
+			}
+			*ps = old[i];
+		}
+		free(old);
+	}
+
+	/* The first 16 bytes of the statistics are the key. */
+	memset(&key, 0, sizeof(key));
+	key.prog = xmep->prog;
+	key.vers = xmep->vers;
+	key.proc = xmep->proc;
+	key.kind = xmep->kind;
+	mask = xm->stats_size - 1;
+	ps = &xm->stats[xid_map_hash(&key) & mask];
+	while (ps->kind != 0 && memcmp(ps, &key, 16) != 0) {
+		if (++ps == xm->stats + xm->stats_size)
+			ps = xm->stats;
+	}
+	if (ps->kind == 0) {
+		*ps = key;
+		ps->procs = xmep->procs;
+		ps->min_ns = ns;
+		xm->stats_count++;
+	}
+	ps->replies++;
+	ps->total_ns += ns;
+	if (ns < ps->min_ns)
+		ps->min_ns = ns;
+	if (ns > ps->max_ns)
+		ps->max_ns = ns;
+}
+
+/*
+ * Find the call that a reply answers.  Returns 1, and puts the
+ * program version and procedure number in *vers and *proc, if it's
+ * found; returns 0 otherwise.
+ */
+int
+xid_map_find(netdissect_options *ndo, const struct xid_map_key *key,
+	     uint32_t *vers, uint32_t *proc)
+{
+	struct xid_map *xm = xid_map_get(ndo);
+	struct xid_map_entry *xmep;
+	struct nd_flow_key fkey;
+	uint64_t now_ns;
+
+	xid_map_flow_key(key, &fkey);
+	xmep = nd_flow_find(ndo, ND_FLOW_RPC_CALL, &fkey);
+	if (xmep == NULL)
+		return (0);
+	if (!(xmep->flags & XID_MAP_REPLIED)) {
+		now_ns = xid_map_now_ns(ndo);
+		/* Time stamps can go backwards. */
+		if (now_ns >= xmep->call_ns)
+			xid_map_add_latency(ndo, xm, xmep,
+					    now_ns - xmep->call_ns);
+		xmep->flags |= XID_MAP_REPLIED;
+		xm->matched++;
+	}
+	nd_flow_set_timeout(ndo, xmep, XID_MAP_IDLE_TIMEOUT);
+	*vers = xmep->vers;
+	*proc = xmep->proc;
+	return (1);
+}
+
+/*
+ * Report the number of calls and replies, if any calls have been seen.
+ */
+void
+xid_map_print_stats(netdissect_options *ndo, FILE *f)
+{
+	const struct xid_map *xm = ndo->ndo_xid_map;
+
+	if (xm == NULL || xm->calls == 0)
+		return;
+	fprintf(f, "RPC calls: %" PRIu64 " seen, %" PRIu64 " answered\n",
+		xm->calls, xm->matched);
+}
+
+static int
+xid_map_stats_cmp(const void *a, const void *b)
+{
+	const struct xid_map_proc_stats *psa = a, *psb = b;
+
+	if (psa->kind != psb->kind)
+		return (psa->kind < psb->kind ? -1 : 1);
+	if (psa->prog != psb->prog)
+		return (psa->prog < psb->prog ? -1 : 1);
+	if (psa->vers != psb->vers)
+		return (psa->vers < psb->vers ? -1 : 1);
+	if (psa->proc != psb->proc)
+		return (psa->proc < psb->proc ? -1 : 1);
+	return (0);
+}
+
+/*
+ * Report the time from call to first reply for each procedure for
+ * which a reply has been seen, in milliseconds.
+ */
+void
+xid_map_print_latency(netdissect_options *ndo, FILE *f)
+{
+	const struct xid_map *xm = ndo->ndo_xid_map;
+	struct xid_map_proc_stats *sorted;
+	const struct xid_map_proc_stats *ps;
+	size_t i, n;
+
+	if (xm == NULL || xm->stats_count == 0)
+		return;
+	sorted = (struct xid_map_proc_stats *)
+		malloc(xm->stats_count * sizeof(*sorted));
+	if (sorted == NULL)
+		(*ndo->ndo_error)(ndo, S_ERR_ND_MEM_ALLOC,
+				  "%s: malloc", __func__);
+	for (i = 0, n = 0; i < xm->stats_size; i++) {
+		if (xm->stats[i].kind != 0)
+			sorted[n++] = xm->stats[i];
+	}
+	qsort(sorted, n, sizeof(*sorted), xid_map_stats_cmp);
+	for (i = 0; i < n; i++) {
+		ps = &sorted[i];
+		if (ps->kind == XID_MAP_RX)
+			fprintf(f, "%s port %u ",
+				tok2str(xid_map_kind_str, NULL, ps->kind),
+				ps->prog);
+		else
+			fprintf(f, "%s program %u version %u ",
+				tok2str(xid_map_kind_str, NULL, ps->kind),
+				ps->prog, ps->vers);
+		fprintf(f, "%s: %" PRIu64 " repl%s, latency min %.3f ms,"
+			" avg %.3f ms, max %.3f ms\n",
+			tok2str(ps->procs, "proc %u", ps->proc),
+			ps->replies, ps->replies == 1 ? "y" : "ies",
+			(double)ps->min_ns / 1e6,
+			(double)ps->total_ns / (double)ps->replies / 1e6,
+			(double)ps->max_ns / 1e6);
+	}
+	free(sorted);
+}
@@ -0,0 +1,60 @@
+/*
+ * Copyright (c) 2026 The TCPDUMP project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that: (1) source code
+ * distributions retain the above copyright notice and this paragraph
+ * in its entirety, and (2) distributions including binary code include
+ * the above copyright notice and this paragraph in its entirety in
+ * the documentation or other materials provided with the distribution.
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND
+ * WITHOUT ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, WITHOUT
+ * LIMITATION, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE.
+ */
+
+#ifndef netdissect_xidmap_h
+#define netdissect_xidmap_h
+
+/*
+ * A table of outstanding RPC calls, so that the printers for replies,
+ * which don't say what they're replies to, can find out from the call.
+ * It's shared by the Sun RPC (NFS) and AFS Rx printers, and also keeps
+ * track of the time from call to reply for each procedure.
+ */
+
+#include "netdissect.h"
+
+enum xid_map_kind {
+	XID_MAP_NFS = 1,	/* NFS call, which the NFS printer can decode */
+	XID_MAP_SUNRPC,		/* other Sun RPC call */
+	XID_MAP_RX		/* AFS Rx call */
+};
+
+/*
+ * A call is identified by its transaction ID (call number, for Rx),
+ * client and server addresses and, for Rx, connection ID, server port
+ * and service ID.
+ * Set up with xid_map_key_init(), which zeroes the fields not used.
+ */
+struct xid_map_key {
+	nd_ipv6		client;		/* client IP address (net order) */
+	nd_ipv6		server;		/* server IP address (net order) */
+	uint32_t	xid;		/* transaction ID (host order) */
+	uint32_t	conn;		/* Rx connection ID (host order) */
+	uint16_t	port;		/* server port (host order) */
+	uint16_t	service;	/* Rx service ID (host order) */
+	uint8_t		ipver;		/* IP version (4 or 6); 0 = empty */
+	uint8_t		kind;		/* enum xid_map_kind */
+	uint8_t		pad[2];
+};
+
+extern int xid_map_key_init(netdissect_options *, struct xid_map_key *,
+			    enum xid_map_kind, uint32_t, const u_char *, int);
+extern void xid_map_enter(netdissect_options *, const struct xid_map_key *,
+			  uint32_t, uint32_t, uint32_t, const struct tok *);
+extern int xid_map_find(netdissect_options *, const struct xid_map_key *,
+			uint32_t *, uint32_t *);
+
+#endif /* netdissect_xidmap_h */